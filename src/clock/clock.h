@@ -0,0 +1,18 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define CLOCK_NS_PER_US 1000ULL
+#define CLOCK_NS_PER_MS (1000ULL * 1000ULL)
+#define CLOCK_NS_PER_S  (1000ULL * 1000ULL * 1000ULL)
+
+// Monotonic time in nanoseconds. Only meaningful relative to other calls.
+static inline uint64_t clock_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * CLOCK_NS_PER_S + (uint64_t)ts.tv_nsec;
+}
+
+#endif
@@ -4,6 +4,10 @@
 #include <assert.h>
 #include <string.h>
 
+#include "log/log.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+
 #if defined(LINUX)
 #include <netdb.h>
 #include <arpa/inet.h>
@@ -15,9 +19,10 @@
 #endif
 
 DNS_Resolve_Result dns_resolve_hostname(const char *hostname, IP_Address *out_ip_addresses, uint32_t ip_addresses_size, uint32_t *out_ip_address_count) {
-    // printf("Resolving hostname '%s' ... \n", hostname);
+    // LOG_TRACE("Resolving hostname '%s' ... ", hostname);
 
     *out_ip_address_count = 0;
+    metrics_count(Metric_Counter_DNS_Lookups, 1);
 
 #if defined(LINUX)
     struct addrinfo hints;
@@ -27,9 +32,12 @@ DNS_Resolve_Result dns_resolve_hostname(const char *hostname, IP_Address *out_ip
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
 
+    TRACE_BEGIN(Trace_Category_Syscall, "getaddrinfo", 0);
     int status = getaddrinfo(hostname, NULL, &hints, &result);
+    TRACE_END(Trace_Category_Syscall, "getaddrinfo", status);
     if (status != 0) {
-        printf("Failed to get addrinfo: %s.\n", gai_strerror(status));
+        LOG_ERROR("Failed to get addrinfo: %s.", gai_strerror(status));
+        metrics_count(Metric_Counter_DNS_Lookup_Failures, 1);
         return DNS_Resolve_Result_Failed_To_Get_Address_Info;
     }
 
@@ -59,11 +67,13 @@ DNS_Resolve_Result dns_resolve_hostname(const char *hostname, IP_Address *out_ip
         memcpy(&out_ip_addresses[*out_ip_address_count], &ip, sizeof(IP_Address));
         *out_ip_address_count += 1;
 
-        if(*out_ip_address_count > ip_addresses_size) {
+        if(*out_ip_address_count >= ip_addresses_size) {
             break;
         }
     }
 
+    freeaddrinfo(result);
+
 #elif defined(WINDOWS)
 
 #elif defined(MACOS)
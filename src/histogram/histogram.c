@@ -0,0 +1,140 @@
+#include "histogram.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+static inline uint32_t histogram_bucket_index(uint64_t value) {
+    if(value < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return (uint32_t)value;
+    }
+
+    uint32_t highest_bit = 63 - (uint32_t)__builtin_clzll(value);
+    uint32_t shift = highest_bit - HISTOGRAM_SUB_BUCKET_BITS;
+    uint32_t sub_bucket = (uint32_t)(value >> shift) - HISTOGRAM_SUB_BUCKET_COUNT;
+
+    return (shift + 1) * HISTOGRAM_SUB_BUCKET_COUNT + sub_bucket;
+}
+
+// The largest value that lands in the bucket.
+static inline uint64_t histogram_bucket_highest_value(uint32_t index) {
+    if(index < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return index;
+    }
+
+    uint32_t shift = index / HISTOGRAM_SUB_BUCKET_COUNT - 1;
+    uint64_t sub_bucket = (index % HISTOGRAM_SUB_BUCKET_COUNT) + HISTOGRAM_SUB_BUCKET_COUNT;
+
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+// NOTE: Only the recording thread ever writes, so these don't need to be read-modify-write atomics. They're atomic
+// stores so a thread that merges meanwhile reads whole values.
+static inline uint64_t histogram_load(const uint64_t *value) {
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+static inline void histogram_store(uint64_t *value, uint64_t new_value) {
+    __atomic_store_n(value, new_value, __ATOMIC_RELAXED);
+}
+
+void histogram_record(Histogram *histogram, uint64_t value) {
+    assert(histogram != NULL);
+
+    if(value > HISTOGRAM_MAX_VALUE) {
+        value = HISTOGRAM_MAX_VALUE;
+    }
+
+    uint32_t index = histogram_bucket_index(value);
+    assert(index < HISTOGRAM_BUCKET_COUNT);
+
+    histogram_store(&histogram->counts[index], histogram->counts[index] + 1);
+    if(histogram->total_count == 0 || value < histogram->min) {
+        histogram_store(&histogram->min, value);
+    }
+    if(value > histogram->max) {
+        histogram_store(&histogram->max, value);
+    }
+    histogram_store(&histogram->sum, histogram->sum + value);
+    histogram_store(&histogram->total_count, histogram->total_count + 1);
+}
+
+void histogram_merge(Histogram *into, const Histogram *from) {
+    assert(into != NULL);
+    assert(from != NULL);
+
+    uint64_t from_total_count = 0;
+    for(uint32_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        uint64_t count = histogram_load(&from->counts[i]);
+        into->counts[i] += count;
+        from_total_count += count;
+    }
+    if(from_total_count == 0) {
+        return;
+    }
+
+    // Taken from the buckets rather than 'from->total_count', so it agrees with what we actually added.
+    uint64_t from_min = histogram_load(&from->min);
+    uint64_t from_max = histogram_load(&from->max);
+    if(into->total_count == 0 || from_min < into->min) {
+        into->min = from_min;
+    }
+    if(from_max > into->max) {
+        into->max = from_max;
+    }
+    into->sum += histogram_load(&from->sum);
+    into->total_count += from_total_count;
+}
+
+uint64_t histogram_value_at_percentile(const Histogram *histogram, double percentile) {
+    assert(histogram != NULL);
+
+    uint64_t total_count = histogram_load(&histogram->total_count);
+    if(total_count == 0) {
+        return 0;
+    }
+
+    if(percentile > 100.0) {
+        percentile = 100.0;
+    }
+    uint64_t wanted_count = (uint64_t)((percentile / 100.0) * (double)total_count + 0.5);
+    if(wanted_count == 0) {
+        wanted_count = 1;
+    }
+
+    uint64_t max = histogram_load(&histogram->max);
+    uint64_t count_so_far = 0;
+    for(uint32_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        count_so_far += histogram_load(&histogram->counts[i]);
+        if(count_so_far >= wanted_count) {
+            uint64_t value = histogram_bucket_highest_value(i);
+            return value < max ? value : max;
+        }
+    }
+
+    return max;
+}
+
+uint64_t histogram_mean(const Histogram *histogram) {
+    assert(histogram != NULL);
+
+    uint64_t total_count = histogram_load(&histogram->total_count);
+    if(total_count == 0) {
+        return 0;
+    }
+
+    return histogram_load(&histogram->sum) / total_count;
+}
+
+uint64_t histogram_count_at_or_below(const Histogram *histogram, uint64_t value) {
+    assert(histogram != NULL);
+
+    uint64_t count = 0;
+    for(uint32_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        if(histogram_bucket_highest_value(i) > value) {
+            break;
+        }
+        count += histogram_load(&histogram->counts[i]);
+    }
+
+    return count;
+}
@@ -0,0 +1,51 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Log-linear histogram, HDR style. Values below HISTOGRAM_SUB_BUCKET_COUNT get a bucket each. Above that every power
+// of two is split into HISTOGRAM_SUB_BUCKET_COUNT linear buckets, so every value is known to within
+// 1/HISTOGRAM_SUB_BUCKET_COUNT of itself (~3% with the defaults) no matter how big it is. The buckets are the same for
+// every histogram, which means merging two (e.g. one per worker) is just adding up the counts.
+//
+// One thread records into a histogram. Any other thread may merge or read it at the same time; it sees counts that may
+// be a few records behind, but never torn ones.
+
+#ifndef HISTOGRAM_SUB_BUCKET_BITS
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#endif
+
+#ifndef HISTOGRAM_MAX_VALUE_BITS
+#define HISTOGRAM_MAX_VALUE_BITS 32 // Bigger values are counted as HISTOGRAM_MAX_VALUE.
+#endif
+
+#define HISTOGRAM_SUB_BUCKET_COUNT (1u << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKET_COUNT ((HISTOGRAM_MAX_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT)
+#define HISTOGRAM_MAX_VALUE ((1ull << HISTOGRAM_MAX_VALUE_BITS) - 1)
+
+// A zeroed Histogram is empty.
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKET_COUNT];
+    uint64_t total_count;
+    uint64_t sum;
+    uint64_t min; // Only valid if 'total_count' > 0.
+    uint64_t max;
+} Histogram;
+
+void histogram_record(Histogram *histogram, uint64_t value);
+
+// Adds everything in 'from' to 'into'. 'into' must not be recorded into by anyone else meanwhile.
+void histogram_merge(Histogram *into, const Histogram *from);
+
+// The value that 'percentile' (0 to 100) percent of the recorded values are at or below, rounded up to the end of its
+// bucket. 0 for an empty histogram.
+uint64_t histogram_value_at_percentile(const Histogram *histogram, double percentile);
+
+uint64_t histogram_mean(const Histogram *histogram);
+
+// How many recorded values are at or below 'value'. Values that share a bucket with 'value' but may be above it aren't
+// counted, so this can come out a little low; by at most one bucket's worth.
+uint64_t histogram_count_at_or_below(const Histogram *histogram, uint64_t value);
+
+#endif
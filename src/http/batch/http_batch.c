@@ -0,0 +1,467 @@
+#include "http_batch.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "http/http.h"
+#include "http/client/http_client.h"
+#include "json/json.h"
+#include "log/log.h"
+
+// One line's request. Owns everything the HTTP client borrows from it until the request completes.
+typedef struct {
+    uint64_t line_number;
+
+    HTTP_Method method;
+    char *hostname;
+    char *path;    // Starts with '/'. The HTTP client wants it without, so it gets 'path + 1'.
+    char *headers; // NULL if there are none.
+    char *body;    // NULL if there is none.
+    uint16_t port;
+
+    char *id_json; // Raw JSON, echoed back. NULL if the line had none.
+} HTTP_Batch_Request;
+
+// Keys of HTTP_Client_Timings' phases in the result.
+static const char *http_batch_timing_keys[HTTP_Client_Phase_Count] = {
+    [HTTP_Client_Phase_DNS]                = "dns",
+    [HTTP_Client_Phase_Connect]            = "connect",
+    [HTTP_Client_Phase_Request_Write]      = "request_write",
+    [HTTP_Client_Phase_Time_To_First_Byte] = "time_to_first_byte",
+    [HTTP_Client_Phase_Body_Transfer]      = "body_transfer",
+    [HTTP_Client_Phase_Total]              = "total",
+};
+
+static void http_batch_request_free(HTTP_Batch_Request *request) {
+    if(request == NULL) {
+        return;
+    }
+
+    free(request->hostname);
+    free(request->path);
+    free(request->headers);
+    free(request->body);
+    free(request->id_json);
+    free(request);
+}
+
+static char *http_batch_copy(const char *text, const size_t length) {
+    char *copy = malloc(length + 1);
+    if(copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// A header name is a token (RFC 9110, section 5.6.2). Values may be anything but line breaks and other control
+// characters, so nothing can be smuggled into the request as an extra header.
+static bool http_batch_is_valid_header_name(const String_Buffer *name) {
+    if(name->length == 0) {
+        return false;
+    }
+    for(size_t i = 0; i < name->length; i++) {
+        char c = name->data[i];
+        bool is_alphanumeric = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        if(!is_alphanumeric && strchr("!#$%&'*+-.^_`|~", c) == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool http_batch_is_valid_header_value(const String_Buffer *value) {
+    for(size_t i = 0; i < value->length; i++) {
+        unsigned char c = (unsigned char)value->data[i];
+        if((c < 0x20 && c != '\t') || c == 0x7F) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The host and path go into the request line and the Host header as they are, so neither may have spaces or control
+// characters in them (they'd end the line early, or start another). A host can't have a '/' either, except in the
+// path of a 'unix:' one, which is never sent.
+static bool http_batch_is_valid_request_target(const String_Buffer *value, const bool is_host) {
+    size_t start = 0;
+    bool allow_slash = !is_host;
+    if(is_host && strncmp(value->data, TCP_ENDPOINT_UNIX_PREFIX, strlen(TCP_ENDPOINT_UNIX_PREFIX)) == 0) {
+        start = strlen(TCP_ENDPOINT_UNIX_PREFIX);
+        allow_slash = true;
+    }
+
+    for(size_t i = start; i < value->length; i++) {
+        unsigned char c = (unsigned char)value->data[i];
+        if(c <= 0x20 || c == 0x7F || (c == '/' && !allow_slash)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads the "headers" object into "Name: Value\r\n" lines.
+static bool http_batch_parse_headers(JSON_Reader *reader, String_Buffer *out, const char **out_error) {
+    String_Buffer name;
+    String_Buffer value;
+    string_buffer_init(&name, 64);
+    string_buffer_init(&value, 256);
+
+    bool ok = json_read_object_begin(reader);
+    if(!ok) {
+        *out_error = "\"headers\" has to be an object";
+    }
+
+    bool has_member = true;
+    while(ok && (ok = json_read_object_next(reader, &name, &has_member)) && has_member) {
+        if(!json_read_string(reader, &value)) {
+            *out_error = "Header values have to be strings";
+            ok = false;
+        }
+        else if(!http_batch_is_valid_header_name(&name)) {
+            *out_error = "Invalid header name";
+            ok = false;
+        }
+        else if(!http_batch_is_valid_header_value(&value)) {
+            *out_error = "Header values can't have line breaks or other control characters";
+            ok = false;
+        }
+        else {
+            string_buffer_appendf(out, "%s: %s\r\n", name.data, value.data);
+        }
+    }
+    if(!ok && *out_error == NULL) {
+        *out_error = "\"headers\" is malformed";
+    }
+
+    string_buffer_free(&name);
+    string_buffer_free(&value);
+    return ok;
+}
+
+// Turns one line into a request. Returns NULL with 'out_error' set if it isn't one.
+static HTTP_Batch_Request *http_batch_parse_line(const char *line, const size_t length, const uint64_t line_number, const char **out_error) {
+    HTTP_Batch_Request *request = calloc(1, sizeof(HTTP_Batch_Request));
+    if(request == NULL) {
+        *out_error = "Out of memory";
+        return NULL;
+    }
+    request->line_number = line_number;
+    request->method = HTTP_Method_GET;
+    request->port = TCP_ENDPOINT_DEFAULT_PORT;
+
+    String_Buffer key;
+    String_Buffer value;
+    String_Buffer headers;
+    string_buffer_init(&key, 64);
+    string_buffer_init(&value, 256);
+    string_buffer_init(&headers, 256);
+
+    JSON_Reader reader;
+    json_reader_init(&reader, line, length);
+
+    *out_error = NULL;
+    if(!json_read_object_begin(&reader)) {
+        *out_error = "Not a JSON object";
+    }
+
+    bool has_member = true;
+    bool well_formed = true;
+    while(*out_error == NULL && (well_formed = json_read_object_next(&reader, &key, &has_member)) && has_member) {
+        if(strcmp(key.data, "method") == 0) {
+            if(!json_read_string(&reader, &value) || !http_string_to_method_type(value.data, &request->method)) {
+                *out_error = "\"method\" has to be \"GET\", \"POST\" or \"PUT\"";
+            }
+        }
+        else if(strcmp(key.data, "host") == 0) {
+            if(!json_read_string(&reader, &value) || value.length == 0 || strlen(value.data) != value.length) {
+                *out_error = "\"host\" has to be a non-empty string";
+            }
+            else if(!http_batch_is_valid_request_target(&value, true)) {
+                *out_error = "\"host\" can't have spaces, '/' or control characters";
+            }
+            else {
+                free(request->hostname);
+                request->hostname = http_batch_copy(value.data, value.length);
+            }
+        }
+        else if(strcmp(key.data, "port") == 0) {
+            double port = 0;
+            if(!json_read_number(&reader, &port) || port < 1 || port > 65535 || port != (double)(uint16_t)port) {
+                *out_error = "\"port\" has to be a whole number from 1 to 65535";
+            }
+            else {
+                request->port = (uint16_t)port;
+            }
+        }
+        else if(strcmp(key.data, "path") == 0) {
+            if(!json_read_string(&reader, &value) || strlen(value.data) != value.length) {
+                *out_error = "\"path\" has to be a string";
+            }
+            else if(!http_batch_is_valid_request_target(&value, false)) {
+                *out_error = "\"path\" can't have spaces or control characters";
+            }
+            else {
+                // With a '/' in front, whether it had one or not.
+                const char *path = value.data[0] == '/' ? &value.data[1] : value.data;
+                size_t path_length = strlen(path);
+                free(request->path);
+                request->path = malloc(path_length + 2);
+                if(request->path != NULL) {
+                    request->path[0] = '/';
+                    memcpy(&request->path[1], path, path_length + 1);
+                }
+            }
+        }
+        else if(strcmp(key.data, "headers") == 0) {
+            headers.length = 0;
+            headers.data[0] = '\0';
+            http_batch_parse_headers(&reader, &headers, out_error);
+        }
+        else if(strcmp(key.data, "body") == 0) {
+            if(!json_read_string(&reader, &value) || strlen(value.data) != value.length) {
+                *out_error = "\"body\" has to be a string without null characters";
+            }
+            else {
+                free(request->body);
+                request->body = http_batch_copy(value.data, value.length);
+            }
+        }
+        else if(strcmp(key.data, "id") == 0) {
+            json_peek(&reader); // Skips the whitespace, so the copy starts at the value.
+            size_t start = reader.position;
+            if(!json_skip_value(&reader)) {
+                *out_error = "\"id\" is malformed";
+            }
+            else {
+                free(request->id_json);
+                request->id_json = http_batch_copy(&line[start], reader.position - start);
+            }
+        }
+        else if(!json_skip_value(&reader)) {
+            *out_error = "Malformed JSON";
+        }
+    }
+
+    if(*out_error == NULL && (!well_formed || !json_at_end(&reader))) {
+        *out_error = "Malformed JSON";
+    }
+    if(*out_error == NULL && request->hostname == NULL) {
+        *out_error = "\"host\" is missing";
+    }
+    if(*out_error == NULL && request->method == HTTP_Method_GET && request->body != NULL) {
+        *out_error = "GET requests can't have a body";
+    }
+    if(*out_error == NULL && request->method != HTTP_Method_GET && (request->body == NULL || request->body[0] == '\0')) {
+        *out_error = "POST and PUT requests need a non-empty \"body\"";
+    }
+    if(*out_error == NULL && request->path == NULL) {
+        request->path = http_batch_copy("/", 1);
+    }
+    if(*out_error == NULL && headers.length > 0) {
+        request->headers = http_batch_copy(headers.data, headers.length);
+    }
+    if(*out_error == NULL && (request->path == NULL || (headers.length > 0 && request->headers == NULL))) {
+        *out_error = "Out of memory";
+    }
+
+    string_buffer_free(&key);
+    string_buffer_free(&value);
+    string_buffer_free(&headers);
+
+    if(*out_error != NULL) {
+        http_batch_request_free(request);
+        return NULL;
+    }
+    return request;
+}
+
+static void http_batch_append_invalid_line(String_Buffer *out, const uint64_t line_number, const char *error) {
+    string_buffer_appendf(out, "{\"line\":%llu,\"error\":", (unsigned long long)line_number);
+    json_append_string(out, error, strlen(error));
+    string_buffer_appendf(out, "}\n");
+}
+
+static void http_batch_append_result(String_Buffer *out, const HTTP_Batch_Request *request, const HTTP_Client_Completion *completion, const bool include_body) {
+    const HTTP_Client_Timings *timings = &completion->timings;
+    const bool got_whole_response = timings->phases_completed == HTTP_Client_Phase_Total;
+    const HTTP_Body *body = &completion->http->body;
+
+    string_buffer_appendf(out, "{\"line\":%llu,", (unsigned long long)request->line_number);
+    if(request->id_json != NULL) {
+        string_buffer_appendf(out, "\"id\":%s,", request->id_json);
+    }
+    string_buffer_appendf(out, "\"method\":\"%s\",\"host\":", http_method_to_string(request->method));
+    json_append_string(out, request->hostname, strlen(request->hostname));
+    string_buffer_appendf(out, ",\"port\":%u,\"path\":", (unsigned int)request->port);
+    json_append_string(out, request->path, strlen(request->path));
+
+    string_buffer_appendf(out, ",\"status\":%i,\"body_length\":%llu,\"timings_us\":{",
+        got_whole_response ? completion->http->status.status_code : 0,
+        got_whole_response ? (unsigned long long)body->string_buffer.length : 0ULL
+    );
+    for(uint32_t phase = 0; phase < HTTP_Client_Phase_Count; phase++) {
+        string_buffer_appendf(out, "%s\"%s\":%llu", phase == 0 ? "" : ",", http_batch_timing_keys[phase], (unsigned long long)timings->duration_us[phase]);
+    }
+    string_buffer_appendf(out, "}");
+
+    if(!got_whole_response) {
+        string_buffer_appendf(out, ",\"error\":\"Failed during %s\"", http_client_phase_name(timings->phases_completed));
+    }
+    else if(include_body) {
+        string_buffer_appendf(out, ",\"body\":");
+        json_append_string(out, body->string_buffer.data, body->string_buffer.length);
+    }
+
+    string_buffer_appendf(out, "}\n");
+}
+
+// Writes out what's been gathered in 'out' and empties it. Returns false if the output has failed.
+static bool http_batch_flush(FILE *output, String_Buffer *out) {
+    bool written = true;
+    if(out->length > 0) {
+        written = fwrite(out->data, 1, out->length, output) == out->length;
+        out->length = 0;
+        out->data[0] = '\0';
+    }
+    return fflush(output) == 0 && written;
+}
+
+bool http_batch_run(FILE *input, FILE *output, const HTTP_Batch_Options *options, HTTP_Batch_Summary *out_summary) {
+    assert(input != NULL);
+    assert(output != NULL);
+
+    HTTP_Batch_Options default_options = {0};
+    if(options == NULL) {
+        options = &default_options;
+    }
+    const uint32_t max_in_flight = options->max_in_flight > 0 ? options->max_in_flight : HTTP_BATCH_DEFAULT_MAX_IN_FLIGHT;
+
+    HTTP_Batch_Summary summary = {0};
+
+    Worker worker;
+    memset(&worker, 0, sizeof(Worker));
+    worker.name = "Batch";
+
+    // NOTE: Room for every request that can be in flight, so a completion is never dropped for lack of space.
+    Worker_Queue completions;
+    if(!worker_queue_init(&completions, max_in_flight)) {
+        LOG_ERROR("Failed to create a completion queue for %u requests.", max_in_flight);
+        return false;
+    }
+
+    HTTP_Client_Request_Options request_options = {
+        .socket_options = options->socket_options,
+        .completion_queue = &completions,
+        .cache = options->cache,
+        .coalesce = options->coalesce,
+    };
+
+    String_Buffer out;
+    string_buffer_init(&out, 4096);
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    uint64_t line_number = 0;
+
+    uint32_t in_flight = 0;
+    bool input_done = false;
+    bool output_ok = true;
+
+    while(!input_done || in_flight > 0) {
+        // Top up with new requests. Lines that aren't requests are answered right away and don't take up room.
+        while(!input_done && in_flight < max_in_flight) {
+            ssize_t length = getline(&line, &line_capacity, input);
+            if(length < 0) {
+                input_done = true;
+                break;
+            }
+            line_number += 1;
+
+            while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+                length -= 1;
+            }
+            JSON_Reader blank_check;
+            json_reader_init(&blank_check, line, (size_t)length);
+            if(json_at_end(&blank_check)) {
+                continue;
+            }
+            summary.lines_read += 1;
+
+            const char *error = NULL;
+            HTTP_Batch_Request *request = http_batch_parse_line(line, (size_t)length, line_number, &error);
+            if(request == NULL) {
+                summary.invalid_lines += 1;
+                http_batch_append_invalid_line(&out, line_number, error);
+                continue;
+            }
+
+            request_options.port = request->port;
+            request_options.headers = request->headers;
+            request_options.user_data = request;
+            if(!http_client_request(&worker, request->method, request->hostname, &request->path[1], request->body, &request_options, NULL, NULL)) {
+                summary.failed += 1;
+                http_batch_append_invalid_line(&out, line_number, "Couldn't start the request");
+                http_batch_request_free(request);
+                continue;
+            }
+            in_flight += 1;
+        }
+
+        worker_work(&worker);
+
+        bool got_any = false;
+        HTTP_Client_Completion *completion;
+        while((completion = worker_queue_pop(&completions)) != NULL) {
+            HTTP_Batch_Request *request = completion->user_data;
+            assert(in_flight > 0);
+            in_flight -= 1;
+            got_any = true;
+
+            if(completion->timings.phases_completed == HTTP_Client_Phase_Total) {
+                summary.succeeded += 1;
+            }
+            else {
+                summary.failed += 1;
+            }
+            http_batch_append_result(&out, request, completion, options->include_body);
+
+            http_client_completion_free(completion);
+            http_batch_request_free(request);
+        }
+
+        if(output_ok && (got_any || out.length > 0)) {
+            output_ok = http_batch_flush(output, &out);
+            if(!output_ok) {
+                // NOTE: Nobody's listening anymore. Let what's in flight finish so everything is freed properly, but
+                // don't start anything new.
+                LOG_ERROR("Failed to write batch results. Stopping after the %u requests in flight.", in_flight);
+                input_done = true;
+            }
+        }
+        out.length = 0;
+        out.data[0] = '\0';
+
+        if(in_flight > 0 && !got_any) {
+            worker_wait(&worker, -1);
+        }
+    }
+
+    free(line);
+    string_buffer_free(&out);
+    worker_dispose(&worker);
+    worker_queue_dispose(&completions);
+
+    if(ferror(input)) {
+        LOG_ERROR("Failed to read batch input after line %llu.", (unsigned long long)line_number);
+        output_ok = false;
+    }
+
+    if(out_summary != NULL) {
+        *out_summary = summary;
+    }
+    return output_ok;
+}
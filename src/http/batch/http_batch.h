@@ -0,0 +1,53 @@
+#ifndef HTTP_BATCH_H
+#define HTTP_BATCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tcp/tcp_socket.h"
+#include "http/client/http_client_cache.h"
+
+// Runs requests read as JSON Lines, one object per line, and writes one result line per request as it finishes, so
+// results come back in completion order rather than input order. Input lines look like
+//     {"id":7,"method":"POST","host":"example.com","port":8080,"path":"/items","headers":{"X-Key":"1"},"body":"{}"}
+// where only "host" is required. "method" is GET, POST or PUT (GET if left out), "port" 80 and "path" "/". "id" can
+// be any JSON value and is echoed back as it was, to match results with requests. Unknown keys are ignored. Hosts,
+// paths and headers that would break up the request (spaces, line breaks, ..) make the line invalid.
+//
+// Result lines look like
+//     {"line":1,"id":7,"method":"POST","host":"example.com","port":8080,"path":"/items","status":201,
+//      "body_length":2,"timings_us":{"dns":..,"connect":..,"request_write":..,"time_to_first_byte":..,
+//      "body_transfer":..,"total":..}}
+// with a "body" too if asked for. A request that didn't get a complete response has status 0 and an "error" saying
+// which phase it failed in; its timings cover the phases it got through. A line that isn't a valid request gets
+// {"line":n,"error":".."} and the rest of the file carries on.
+//
+// Everything runs on one Worker on the calling thread. Lines are only read when there's room for another request in
+// flight, so the input can be as long as it likes. Reading blocks though: if it's a pipe that's slow to fill, the
+// requests in flight wait along with it (and their timings show it).
+
+#ifndef HTTP_BATCH_DEFAULT_MAX_IN_FLIGHT
+#define HTTP_BATCH_DEFAULT_MAX_IN_FLIGHT 16
+#endif
+
+typedef struct {
+    uint32_t max_in_flight;  // 0 for HTTP_BATCH_DEFAULT_MAX_IN_FLIGHT.
+    bool include_body;       // Add the response body to each result, as a JSON string.
+
+    const TCP_Socket_Options *socket_options; // NULL for TCP_Socket_Profile_Default.
+    HTTP_Client_Cache *cache; // Answer repeated GETs from here when it can. NULL for none.
+    bool coalesce;            // Identical GETs in flight at the same time share one request.
+} HTTP_Batch_Options;
+
+typedef struct {
+    uint64_t lines_read;    // Not counting empty lines.
+    uint64_t invalid_lines;
+    uint64_t succeeded;     // Got a complete response, whatever its status code.
+    uint64_t failed;
+} HTTP_Batch_Summary;
+
+// Returns false if it couldn't get going or couldn't write results. 'options' and 'out_summary' may be NULL.
+bool http_batch_run(FILE *input, FILE *output, const HTTP_Batch_Options *options, HTTP_Batch_Summary *out_summary);
+
+#endif
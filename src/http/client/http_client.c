@@ -1,381 +1,977 @@
+#define _GNU_SOURCE // memmem(..).
 #include "http_client.h"
 #include <string.h>
 #include <assert.h>
 
-static inline bool http_tcp_send_request_work(Worker_Context *context, const uint32_t lifetime) {
-    (void)lifetime;
-    HTTP_Client_Send_Request_Context *ctx = (HTTP_Client_Send_Request_Context *)context;
-
-    // printf("Text:\n%s\n", ctx->text);
-
-    printf("Worker: Sending bytes. Progress: %i/%i bytes.\n", ctx->amount_of_bytes_sent, ctx->amount_of_bytes_to_send);
-
-    assert(ctx->amount_of_bytes_sent <= ctx->amount_of_bytes_to_send);
-    uint32_t bytes_left_to_send = ctx->amount_of_bytes_to_send - ctx->amount_of_bytes_sent;
-
-    if(bytes_left_to_send == 0) {
-        printf("All bytes sent. :)\n");
-        return true; // Task is done. All bytes have been sent. :)
+#include "clock/clock.h"
+#include "log/log.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+
+_Static_assert(sizeof(HTTP_Client_Request_Context) <= HTTP_CLIENT_REQUEST_CONTEXT_BUDGET, "HTTP_Client_Request_Context is over its budget. See http_client.h.");
+
+// The headers every request sends. Shared by all requests instead of being formatted into each one.
+#define HTTP_CLIENT_COMMON_HEADERS \
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/140.0.0.0 Safari/537.36\r\n" \
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+
+static const char http_client_get_headers[] =
+    HTTP_CLIENT_COMMON_HEADERS
+    "\r\n"; // Very important to signal that we're done with the headers.
+
+static const char http_client_post_headers[] =
+    HTTP_CLIENT_COMMON_HEADERS
+    "Content-Type: application/json\r\n" // TODO: SS - Make this customizable.
+    "\r\n"; // Very important to signal that we're done with the headers.
+
+// The shared template that goes out after 'request_head'. The caller's headers replace the default Content-Type, so
+// there's no way to end up with two.
+static inline const char *http_client_request_headers(const HTTP_Client_Request_Context *ctx, uint32_t *out_length) {
+    if(ctx->headers != NULL || ctx->transfer.body_length == 0) {
+        *out_length = sizeof(http_client_get_headers) - 1;
+        return &http_client_get_headers[0];
     }
 
-    uint32_t bytes_sent_this_time = 0;
-    TCP_Socket_Result send_result = tcp_socket_send(
-        &ctx->tcp_client->socket,
-        &ctx->text[ctx->amount_of_bytes_sent],
-        bytes_left_to_send,
-        &bytes_sent_this_time
-    );
+    *out_length = sizeof(http_client_post_headers) - 1;
+    return &http_client_post_headers[0];
+}
+
+// Puts together the parts of the request that are specific to it: the request line, Host, Content-Length, the
+// caller's own headers and, to revalidate a stale response from the cache, If-None-Match and If-Modified-Since. The
+// rest is a shared template and the caller's body. Returns false if there's nothing sensible to send.
+static bool http_client_build_request(HTTP_Client_Request_Context *ctx) {
+    // There's no real host behind a Unix socket, but HTTP/1.1 requires the header.
+    const char *host_header = ctx->is_unix_endpoint ? "localhost" : ctx->hostname;
 
-    switch(send_result) {
-        case TCP_Socket_Result_Not_Connected: {
-            assert(false); // TEMP: SS - Handle this more gracefully.
+    uint32_t body_length = 0;
+    switch(ctx->method) {
+        case HTTP_Method_GET: {
             break;
         }
-        case TCP_Socket_Result_OK: {
+        case HTTP_Method_POST:
+        case HTTP_Method_PUT: {
+            if(ctx->body == NULL) {
+                LOG_ERROR("Failed to %s. Body is NULL.", http_method_to_string(ctx->method));
+                return false;
+            }
+
+            body_length = strlen(ctx->body);
+            if(body_length == 0) {
+                LOG_ERROR("Failed to %s. Body's length is 0.", http_method_to_string(ctx->method));
+                return false;
+            }
             break;
         }
-        case TCP_Socket_Result_Not_Ready_To_Be_Written_To: {
-            printf("Error: Socket %i is not ready.\n", ctx->tcp_client->socket.fd);
-            break;
+        default: {
+            LOG_ERROR("Unhandled request method %i.", ctx->method);
+            assert(false);
+            return false;
         }
-        case TCP_Socket_Result_Failed_To_Send: {
-            printf("Error: Failed to send.\n");
-            break;
+    }
+
+    // Host has to name the port too, unless it's the default one.
+    char port_text[8] = "";
+    if(!ctx->is_unix_endpoint && ctx->port != 0 && ctx->port != TCP_ENDPOINT_DEFAULT_PORT) {
+        snprintf(port_text, sizeof(port_text), ":%u", (unsigned)ctx->port);
+    }
+
+    char content_length_text[32] = "";
+    if(body_length > 0) {
+        snprintf(content_length_text, sizeof(content_length_text), "Content-Length: %u\r\n", body_length);
+    }
+
+    char request_head[512];
+    int request_head_length = snprintf(
+        &request_head[0],
+        sizeof(request_head),
+
+        "%s /%s HTTP/1.1\r\n"
+        "Host: %s%s\r\n"
+        "%s"
+        ,
+
+        http_method_to_string(ctx->method),
+        ctx->path,
+        host_header,
+        port_text,
+        content_length_text
+    );
+
+    if(request_head_length <= 0 || request_head_length >= (int)sizeof(request_head)) {
+        LOG_ERROR("Failed to build the request. Is the path or hostname too long?");
+        return false;
+    }
+
+    ctx->transfer.body_length = body_length;
+
+    char validators[2 * HTTP_MAX_HEADER_VALUE_LENGTH + 64] = "";
+    uint32_t validators_length = 0;
+    if(ctx->cache_lookup == HTTP_Client_Cache_Lookup_Stale) {
+        validators_length = http_client_cache_get_validators(ctx->cache, ctx->method, ctx->hostname, ctx->port, ctx->path, &validators[0], sizeof(validators));
+        if(validators_length == 0) {
+            ctx->cache_lookup = HTTP_Client_Cache_Lookup_Miss; // Gone since. Nothing to revalidate anymore.
         }
-        default: {
-            printf("Unhandled case (%i) when sending data over the socket.\n", send_result);
-            break;
+    }
+
+    // Has to outlive this stack frame; sending can take several ticks.
+    const uint32_t headers_length = ctx->headers != NULL ? strlen(ctx->headers) : 0;
+    ctx->transfer.request_head = malloc((size_t)request_head_length + headers_length + validators_length + 1);
+    if(ctx->transfer.request_head == NULL) {
+        return false;
+    }
+    memcpy(&ctx->transfer.request_head[0], &request_head[0], request_head_length);
+    if(headers_length > 0) {
+        memcpy(&ctx->transfer.request_head[request_head_length], ctx->headers, headers_length);
+    }
+    if(validators_length > 0) {
+        memcpy(&ctx->transfer.request_head[request_head_length + headers_length], &validators[0], validators_length);
+    }
+    ctx->transfer.request_head_length = (uint32_t)request_head_length + headers_length + validators_length;
+    ctx->transfer.request_head[ctx->transfer.request_head_length] = '\0';
+
+#ifdef HTTP_CLIENT_DEBUG_PRINT_REQUEST_STRING
+    uint32_t request_headers_length;
+    LOG_INFO("Request string:\n%s%s%s", ctx->transfer.request_head, http_client_request_headers(ctx, &request_headers_length), ctx->transfer.body_length > 0 ? ctx->body : "");
+#endif
+
+    return true;
+}
+
+// Sends as much of the request as the socket takes right now.
+static TCP_Socket_Result http_client_send_request(HTTP_Client_Request_Context *ctx) {
+    uint32_t request_headers_length;
+    const char *request_headers = http_client_request_headers(ctx, &request_headers_length);
+
+    struct iovec parts[3];
+    const char *part_data[3] = { ctx->transfer.request_head, request_headers, ctx->body };
+    const uint32_t part_length[3] = { ctx->transfer.request_head_length, request_headers_length, ctx->transfer.body_length };
+
+    // Skip whatever has already gone out.
+    uint32_t skip = ctx->transfer.amount_of_bytes_sent;
+    uint32_t part_count = 0;
+    for(uint32_t i = 0; i < 3; i++) {
+        if(skip >= part_length[i]) {
+            skip -= part_length[i];
+            continue;
         }
+
+        parts[part_count].iov_base = (void *)&part_data[i][skip];
+        parts[part_count].iov_len = part_length[i] - skip;
+        part_count += 1;
+        skip = 0;
     }
+    assert(part_count > 0);
 
-    ctx->amount_of_bytes_sent += bytes_sent_this_time;
+    uint32_t bytes_sent_this_time = 0;
+    TCP_Socket_Result send_result = tcp_socket_send_vectored(&ctx->tcp_client.socket, &parts[0], part_count, &bytes_sent_this_time);
+    ctx->transfer.amount_of_bytes_sent += bytes_sent_this_time;
 
-    return false; // Not done. There are still some bytes left to send.
+    return send_result;
 }
 
-static inline bool http_tcp_receive_response_work(Worker_Context *context, const uint32_t lifetime) {
-    (void)lifetime;
-    HTTP_Client_Receive_Response_Context *ctx = (HTTP_Client_Receive_Response_Context *)context;
+// Marks the end of 'phase' at 'end_ns', which has to be the one after the last one that ended. Ends from before the
+// request started count as right when it did.
+static inline void http_client_phase_done_at(HTTP_Client_Request_Context *ctx, HTTP_Client_Phase phase, uint64_t end_ns) {
+    assert(phase == (HTTP_Client_Phase)ctx->phases_completed);
+    assert(phase < HTTP_Client_Phase_Total);
 
-    // printf("Worker: Reading bytes. Progress: %i/?? bytes.\n", ctx->amount_of_bytes_read);
+    ctx->phase_end_us[phase] = end_ns > ctx->started_ns ? (uint32_t)((end_ns - ctx->started_ns) / CLOCK_NS_PER_US) : 0;
+    if(phase > 0 && ctx->phase_end_us[phase] < ctx->phase_end_us[phase - 1]) {
+        ctx->phase_end_us[phase] = ctx->phase_end_us[phase - 1];
+    }
+    ctx->phases_completed = (uint8_t)(phase + 1);
+
+    TRACE_ASYNC_END(Trace_Category_HTTP_Client, http_client_phase_name(phase), (uintptr_t)ctx);
+    if(phase + 1 < HTTP_Client_Phase_Total) {
+        TRACE_ASYNC_BEGIN(Trace_Category_HTTP_Client, http_client_phase_name(phase + 1), (uintptr_t)ctx);
+    }
+}
+
+static inline void http_client_phase_done(HTTP_Client_Request_Context *ctx, HTTP_Client_Phase phase) {
+    http_client_phase_done_at(ctx, phase, clock_now_ns());
+}
+
+// Closes the request's trace span, and the span of the phase it's in if it didn't get to the end.
+static void http_client_trace_end(const HTTP_Client_Request_Context *ctx) {
+    if(ctx->phases_completed < HTTP_Client_Phase_Total) {
+        TRACE_ASYNC_END(Trace_Category_HTTP_Client, http_client_phase_name((HTTP_Client_Phase)ctx->phases_completed), (uintptr_t)ctx);
+    }
+    TRACE_ASYNC_END(Trace_Category_HTTP_Client, "request", (uintptr_t)ctx);
+}
+
+static void http_client_get_timings(const HTTP_Client_Request_Context *ctx, HTTP_Client_Timings *out_timings) {
+    memset(out_timings, 0, sizeof(HTTP_Client_Timings));
+
+    uint32_t previous_end_us = 0;
+    for(uint32_t phase = 0; phase < ctx->phases_completed; phase++) {
+        out_timings->duration_us[phase] = ctx->phase_end_us[phase] - previous_end_us;
+        previous_end_us = ctx->phase_end_us[phase];
+    }
+
+    out_timings->duration_us[HTTP_Client_Phase_Total] = (clock_now_ns() - ctx->started_ns) / CLOCK_NS_PER_US;
+    out_timings->phases_completed = (HTTP_Client_Phase)ctx->phases_completed;
+}
+
+static inline uint32_t http_client_request_length(const HTTP_Client_Request_Context *ctx) {
+    uint32_t request_headers_length;
+    http_client_request_headers(ctx, &request_headers_length);
+    return ctx->transfer.request_head_length + request_headers_length + ctx->transfer.body_length;
+}
 
-    uint32_t bytes_read_this_time = 0;
-    TCP_Socket_Result receive_result = tcp_socket_receive(
-        &ctx->tcp_client->socket,
-        ctx->buffer,
-        HTTP_CLIENT_RESPONSE_BUFFER_INITIAL_SIZE,
-        &bytes_read_this_time
+// Resolves the hostname, unless it's 'unix:/path'. Returns false if there's nowhere to connect to.
+static bool http_client_resolve(HTTP_Client_Request_Context *ctx) {
+    TCP_Endpoint unix_endpoint;
+    if(tcp_endpoint_try_parse_unix(ctx->hostname, &unix_endpoint)) {
+        // 'unix:/path'. Nothing to resolve, it's a local socket.
+        ctx->is_unix_endpoint = true;
+        return true;
+    }
+
+    // Resolve hostname to an IP address.
+    LOG_DEBUG("'%s/%s': Resolving hostname ...", ctx->hostname, ctx->path);
+
+    ctx->connecting.ip_address_candidates = calloc(MAX_IP_ADDRESS_CANDIDATES, sizeof(IP_Address));
+    if(ctx->connecting.ip_address_candidates == NULL) {
+        return false;
+    }
+    ctx->connecting.ip_address_candidates_found = 0;
+
+    DNS_Resolve_Result resolve_result = dns_resolve_hostname(
+        ctx->hostname,
+        &ctx->connecting.ip_address_candidates[0],
+        MAX_IP_ADDRESS_CANDIDATES,
+        &ctx->connecting.ip_address_candidates_found
     );
 
-    // printf("Receive result: %i\n", receive_result);
+    if(resolve_result != DNS_Resolve_Result_OK) {
+        return false;
+    }
 
-    switch(receive_result) {
-        case TCP_Socket_Result_Not_Connected: {
-            assert(false); // TEMP: SS - Handle this more gracefully.
-            break;
+    assert(ctx->connecting.ip_address_candidates_found > 0);
+    LOG_DEBUG("Found %i addresses for hostname '%s':", ctx->connecting.ip_address_candidates_found, ctx->hostname);
+    for(uint32_t i = 0; i < ctx->connecting.ip_address_candidates_found; i++) {
+        char ip_text[IP_ADDRESS_STRING_SIZE];
+        LOG_DEBUG("- %s", ip_to_string(ctx->connecting.ip_address_candidates[i], ip_text));
+    }
+
+    return true;
+}
+
+// Starts connecting to the next endpoint we haven't tried yet. Returns false once we've run out.
+static bool http_client_start_connecting_to_next(HTTP_Client_Request_Context *ctx) {
+    if(ctx->is_unix_endpoint) {
+        if(ctx->connecting.ip_address_candidates_tried > 0) {
+            return false; // There's only the one.
+        }
+        ctx->connecting.ip_address_candidates_tried = 1;
+
+        TCP_Endpoint unix_endpoint;
+        bool parsed = tcp_endpoint_try_parse_unix(ctx->hostname, &unix_endpoint);
+        assert(parsed);
+        (void)parsed;
+
+        TCP_Client_Start_Connecting_Result start_connecting_result = tcp_client_connect(&ctx->tcp_client, unix_endpoint, &ctx->connecting.socket_options);
+        if(start_connecting_result != TCP_Client_Start_Connecting_Result_Connecting) {
+            ctx->socket_result = TCP_Socket_Result_Failed_To_Create;
+            LOG_ERROR("Failed to connect to '%s'. Got start-connecting-result: %i.", ctx->hostname, start_connecting_result);
+            return false;
         }
-        case TCP_Socket_Result_OK: {
-            if(bytes_read_this_time == 0) { // Timeout or socket closed, probably.
-                printf("Read 0 bytes. Work done.\n");
-            }
 
-            break;
+        return true;
+    }
+
+    while(ctx->connecting.ip_address_candidates_tried < ctx->connecting.ip_address_candidates_found) {
+        IP_Address *ip_to_connect_to = &ctx->connecting.ip_address_candidates[ctx->connecting.ip_address_candidates_tried];
+        ctx->connecting.ip_address_candidates_tried += 1;
+
+        char ip_text[IP_ADDRESS_STRING_SIZE];
+        LOG_TRACE("'%s/%s': Start connecting to ip-adress: %s", ctx->hostname, ctx->path, ip_to_string(*ip_to_connect_to, ip_text));
+
+        TCP_Client_Start_Connecting_Result start_connecting_result = tcp_client_connect(&ctx->tcp_client, tcp_endpoint_from_ip(*ip_to_connect_to, ctx->port), &ctx->connecting.socket_options);
+        if(start_connecting_result != TCP_Client_Start_Connecting_Result_Connecting) {
+            ctx->socket_result = TCP_Socket_Result_Failed_To_Create;
+            LOG_WARNING("'%s/%s': Failed to start connecting. Got start-connecting-result: %i.", ctx->hostname, ctx->path, start_connecting_result);
+            continue;
         }
-        case TCP_Socket_Result_Not_Ready_To_Be_Read: {
-            // printf("Error: Socket %i is not ready to be read.\n", ctx->tcp_client->socket.fd);
-            break;
+
+        return true;
+    }
+
+    LOG_ERROR("Failed to connect to any of the %i ip address candidates.", ctx->connecting.ip_address_candidates_found);
+    return false;
+}
+
+// Connected. Let go of what was only needed for connecting and get ready to transfer.
+static void http_client_begin_transfer(HTTP_Client_Request_Context *ctx) {
+    assert(!ctx->is_transferring);
+
+    free(ctx->connecting.ip_address_candidates);
+
+    memset(&ctx->transfer, 0, sizeof(ctx->transfer));
+    ctx->is_transferring = true;
+}
+
+static inline uint32_t http_client_pick_read_size(HTTP_Client_Request_Context *ctx, bool first_read) {
+    // Prefer what the parser says is missing (the rest of 'Content-Length' or of the current chunk). If it doesn't know,
+    // ask the kernel how much is queued on the socket. Never go below the size we've grown to, and never above the cap.
+    uint64_t read_size = ctx->transfer.http_parser->http.body.bytes_missing;
+    if(read_size == 0 && first_read) {
+        read_size = tcp_socket_bytes_available(&ctx->tcp_client.socket);
+    }
+
+    if(read_size < ctx->transfer.next_read_size) {
+        read_size = ctx->transfer.next_read_size;
+    }
+    if(read_size > HTTP_CLIENT_RECEIVE_MAX_READ_SIZE) {
+        read_size = HTTP_CLIENT_RECEIVE_MAX_READ_SIZE;
+    }
+
+    return (uint32_t)read_size;
+}
+
+typedef enum {
+    HTTP_Client_Receive_Status_Would_Block,
+    HTTP_Client_Receive_Status_Done,   // Got the whole response, or as much as we're ever going to get.
+} HTTP_Client_Receive_Status;
+
+// Where the body stands once the sink has had its go at it.
+static HTTP_Parse_Result http_client_sink_parse_result(HTTP_Client_Request_Context *ctx, HTTP_Client_Sink_Result result) {
+    switch(result) {
+        case HTTP_Client_Sink_Result_Done: {
+            ctx->transfer.http_parser->state = HTTP_Parse_Status_Parsing_Done; // With an empty body. It's in the file.
+            return HTTP_Parse_Result_Done;
         }
-        case TCP_Socket_Result_Failed_To_Read: {
-            printf("Error: Failed to read.\n");
-            break;
+        case HTTP_Client_Sink_Result_Invalid_Data: {
+            return HTTP_Parse_Result_Invalid_Data;
         }
-        default: {
-            printf("Unhandled case (%i) when reading data from the socket.\n", receive_result);
-            break;
+        case HTTP_Client_Sink_Result_Needs_More_Data:
+        case HTTP_Client_Sink_Result_Failed_To_Write: { // The body never got all the way. See 'sink->error'.
+            return HTTP_Parse_Result_Needs_More_Data;
         }
     }
+    return HTTP_Parse_Result_Invalid_Data;
+}
 
-    ctx->amount_of_bytes_read += bytes_read_this_time;
+// Parses what's arrived so far. With a sink, only up to the end of the head at first: once the status is in, the body
+// either goes to the sink (starting with whatever of it came along with the head) or is parsed like always.
+static HTTP_Parse_Result http_client_parse_response(HTTP_Client_Request_Context *ctx) {
+    HTTP_Parser *http_parser = ctx->transfer.http_parser;
+    const String_Buffer *response = &ctx->transfer.response;
+    HTTP http;
 
-    if(bytes_read_this_time > 0) {
-        string_buffer_append_buf(&ctx->sb, &ctx->buffer[0], bytes_read_this_time);
+    if(!ctx->has_sink || http_parser->state == HTTP_Parse_Status_Parsing_Body) {
+        return http_try_parse(http_parser, &response->data[0], response->length, &http);
+    }
 
-        memset(&ctx->buffer, 0, HTTP_CLIENT_RESPONSE_BUFFER_INITIAL_SIZE);
+    const char *head_end = memmem(&response->data[0], response->length, "\r\n\r\n", 4);
+    const uint64_t head_length = head_end != NULL ? (uint64_t)(head_end + 4 - &response->data[0]) : response->length;
+    HTTP_Parse_Result result = http_try_parse(http_parser, &response->data[0], head_length, &http);
+    if(http_parser->state != HTTP_Parse_Status_Parsing_Body) {
+        return result; // Not all of the head yet, or no body to speak of.
+    }
+    if(!http_client_sink_wants(&http_parser->http.status)) {
+        return http_try_parse(http_parser, &response->data[0], response->length, &http);
+    }
 
-        // printf("Read %u bytes.\n", bytes_read_this_time);
-        // printf("%s\n", ctx->sb.data);
+    HTTP_Client_Sink_Result sink_result = http_client_sink_begin(ctx->sink, &http_parser->http.headers);
+    if(sink_result == HTTP_Client_Sink_Result_Needs_More_Data && response->length > head_length) {
+        sink_result = http_client_sink_take(ctx->sink, &response->data[head_length], response->length - head_length);
+    }
 
-        HTTP http;
+    // The head is parsed into the parser's own copy, and the sink has the rest. From here on this only holds reads of
+    // chunked bodies, one at a time.
+    ctx->transfer.response.length = 0;
+    return http_client_sink_parse_result(ctx, sink_result);
+}
+
+// Reads until the socket has nothing more for us (EAGAIN), so a large response doesn't need one tick per read.
+static HTTP_Client_Receive_Status http_client_receive_available(HTTP_Client_Request_Context *ctx) {
+    // LOG_TRACE("Reading bytes. Progress: %i/?? bytes.", ctx->transfer.amount_of_bytes_read);
 
-        HTTP_Parse_Result result = http_try_parse(ctx->http_parser, &ctx->sb.data[0], ctx->sb.length, &http);
+    if(ctx->transfer.http_parser == NULL) {
+        // First time there's something to read. Until now the request didn't need any of this.
+        ctx->transfer.http_parser = calloc(1, sizeof(HTTP_Parser));
+        if(ctx->transfer.http_parser == NULL) {
+            return HTTP_Client_Receive_Status_Done;
+        }
+        http_parser_init(ctx->transfer.http_parser, HTTP_CLIENT_RESPONSE_BUFFER_INITIAL_SIZE);
+
+        ctx->transfer.next_read_size = HTTP_CLIENT_RESPONSE_BUFFER_INITIAL_SIZE;
+        string_buffer_init(&ctx->transfer.response, HTTP_CLIENT_RESPONSE_BUFFER_INITIAL_SIZE);
+    }
+
+    for(bool first_read = true; ; first_read = false) {
+        // Identity-encoded bodies headed for a sink are read straight into its staging buffer.
+        uint32_t read_size = 0;
+        char *read_into = ctx->has_sink ? http_client_sink_reserve(ctx->sink, &read_size) : NULL;
+        const bool into_sink = read_into != NULL;
+        if(!into_sink) {
+            read_size = http_client_pick_read_size(ctx, first_read);
+            read_into = string_buffer_reserve(&ctx->transfer.response, read_size);
+        }
+
+        uint32_t bytes_read_this_time = 0;
+        TCP_Socket_Result receive_result = tcp_socket_receive(
+            &ctx->tcp_client.socket,
+            read_into,
+            read_size,
+            &bytes_read_this_time
+        );
+
+        // LOG_TRACE("Receive result: %i", receive_result);
+
+        switch(receive_result) {
+            case TCP_Socket_Result_OK: {
+                break;
+            }
+            case TCP_Socket_Result_Not_Ready_To_Be_Read: {
+                // Drained. Wait for more.
+                return HTTP_Client_Receive_Status_Would_Block;
+            }
+            case TCP_Socket_Result_Not_Connected:
+            case TCP_Socket_Result_Failed_To_Read: {
+                LOG_ERROR("Failed to read from socket %i (%i).", ctx->tcp_client.socket.fd, receive_result);
+                ctx->socket_result = (uint8_t)receive_result;
+                return HTTP_Client_Receive_Status_Done;
+            }
+            default: {
+                LOG_WARNING("Unhandled case (%i) when reading data from the socket.", receive_result);
+                return HTTP_Client_Receive_Status_Would_Block;
+            }
+        }
+
+        if(bytes_read_this_time == 0) { // The server closed the connection.
+            LOG_TRACE("Read 0 bytes. Work done.");
+            return HTTP_Client_Receive_Status_Done;
+        }
+
+        if(ctx->transfer.amount_of_bytes_read == 0) {
+            http_client_phase_done(ctx, HTTP_Client_Phase_Time_To_First_Byte);
+        }
+
+        ctx->transfer.amount_of_bytes_read += bytes_read_this_time;
+
+        if(bytes_read_this_time == read_size && ctx->transfer.next_read_size < HTTP_CLIENT_RECEIVE_MAX_READ_SIZE) {
+            ctx->transfer.next_read_size *= 2; // We filled the whole read. Ask for more next time.
+        }
+
+        // LOG_TRACE("Read %u bytes.", bytes_read_this_time);
+
+        HTTP_Parse_Result result;
+        if(into_sink) {
+            result = http_client_sink_parse_result(ctx, http_client_sink_commit(ctx->sink, bytes_read_this_time));
+        }
+        else if(ctx->has_sink && http_client_sink_streaming(ctx->sink)) {
+            result = http_client_sink_parse_result(ctx, http_client_sink_take(ctx->sink, read_into, bytes_read_this_time));
+        }
+        else {
+            string_buffer_commit(&ctx->transfer.response, bytes_read_this_time);
+            result = http_client_parse_response(ctx);
+        }
+        ctx->parse_result = (uint8_t)result;
+
+        if(ctx->has_sink && ctx->sink->error != 0) {
+            LOG_ERROR("'%s%s': Failed to write the body: %s.", ctx->hostname, ctx->path, strerror(ctx->sink->error));
+            return HTTP_Client_Receive_Status_Done;
+        }
         switch(result) {
             case HTTP_Parse_Result_Done: {
-                return true;
+                return HTTP_Client_Receive_Status_Done;
             }
             case HTTP_Parse_Result_Needs_More_Data: {
-                return false;
+                break;
             }
             case HTTP_Parse_Result_Invalid_Data:
+            case HTTP_Parse_Result_Count:
             case HTTP_Parse_Result_TODO: {
-                return true;
+                return HTTP_Client_Receive_Status_Done;
             }
         }
     }
+}
 
-    return false;
+// Frees everything the request holds and closes its socket. The request's own task is left alone.
+static void http_client_request_release(HTTP_Client_Request_Context *ctx) {
+    if(!ctx->is_transferring && ctx->coalescing == HTTP_Client_Coalescing_Waiting) {
+        if(ctx->connecting.shared_response != NULL) {
+            http_client_shared_response_release(ctx->connecting.shared_response);
+            ctx->connecting.shared_response = NULL;
+        }
+    }
+    else if(!ctx->is_transferring) {
+        free(ctx->connecting.ip_address_candidates);
+        ctx->connecting.ip_address_candidates = NULL;
+    }
+    else {
+        free(ctx->transfer.request_head);
+        ctx->transfer.request_head = NULL;
+
+        string_buffer_free(&ctx->transfer.response);
+        memset(&ctx->transfer.response, 0, sizeof(String_Buffer));
+
+        if(ctx->transfer.http_parser != NULL) {
+            http_dispose(&ctx->transfer.http_parser->http);
+            http_parser_dispose(ctx->transfer.http_parser);
+            free(ctx->transfer.http_parser);
+            ctx->transfer.http_parser = NULL;
+        }
+    }
+
+    if(ctx->has_sink) {
+        http_client_sink_release(ctx->sink);
+    }
+    tcp_client_close(&ctx->tcp_client);
 }
 
+// Looks the request up in its cache. Answers it with a copy of the stored response if that's still fresh, and returns
+// true. Otherwise notes whether there's a stale one to revalidate, and the request goes ahead as usual.
+static bool http_client_answer_from_cache(HTTP_Client_Request_Context *ctx) {
+    HTTP http;
+    memset(&http, 0, sizeof(HTTP));
 
-bool http_client_request_work(Worker_Context *context, const uint32_t lifetime) {
-    (void)lifetime;
-    HTTP_Client_Request_Context *ctx = (HTTP_Client_Request_Context *)context;
+    ctx->cache_lookup = (uint8_t)http_client_cache_lookup(ctx->cache, ctx->method, ctx->hostname, ctx->port, ctx->path, &http);
+    if(ctx->cache_lookup != HTTP_Client_Cache_Lookup_Fresh) {
+        return false;
+    }
 
-    tcp_client_work(&ctx->tcp_client);
+    HTTP_Parser *http_parser = calloc(1, sizeof(HTTP_Parser));
+    if(http_parser == NULL) {
+        string_buffer_free(&http.body.string_buffer);
+        ctx->cache_lookup = HTTP_Client_Cache_Lookup_Miss;
+        return false;
+    }
+    http_parser->http = http;
+    http_parser->state = HTTP_Parse_Status_Parsing_Done;
 
-    switch(ctx->state) {
-        case HTTP_Client_Request_State_Resolving: {
-            // Resolve hostname to an IP address.
-            printf("'%s/%s': Resolving hostname ...\n", ctx->hostname, ctx->path);
+    http_client_begin_transfer(ctx);
+    ctx->transfer.http_parser = http_parser;
+    ctx->parse_result = HTTP_Parse_Result_Done;
 
-            memset(&ctx->ip_address_candidates[0], 0, MAX_IP_ADDRESS_CANDIDATES);
-            ctx->ip_address_candidates_found = 0;
+    // Every phase but the last ends right away. The last one ends like it would for any other response.
+    for(uint32_t phase = HTTP_Client_Phase_DNS; phase < HTTP_Client_Phase_Body_Transfer; phase++) {
+        http_client_phase_done(ctx, (HTTP_Client_Phase)phase);
+    }
+    return true;
+}
 
-            DNS_Resolve_Result resolve_result = dns_resolve_hostname(
-                ctx->hostname,
-                &ctx->ip_address_candidates[0],
-                MAX_IP_ADDRESS_CANDIDATES,
-                &ctx->ip_address_candidates_found
-            );
+// Looks for a flight to wait for, and waits for it if there is one (returns true). Otherwise the request becomes the
+// flight, unless we're out of memory, in which case it just goes ahead on its own.
+static bool http_client_join_flight(Worker *worker, HTTP_Client_Request_Context *ctx) {
+    HTTP_Client_Flight *flight = http_client_flight_find(worker, ctx->hostname, ctx->port, ctx->path);
+    if(flight == NULL) {
+        flight = http_client_flight_begin(worker, ctx->hostname, ctx->port, ctx->path);
+        ctx->coalescing = flight != NULL ? HTTP_Client_Coalescing_Leading : HTTP_Client_Coalescing_Off;
+        return false;
+    }
 
-            if(resolve_result != DNS_Resolve_Result_OK) {
-                ctx->state = HTTP_Client_Request_State_Done;
-            }
-            else {
-                assert(ctx->ip_address_candidates_found > 0);
-                printf("Found %i addresses for hostname '%s':\n", ctx->ip_address_candidates_found, ctx->hostname);
-                for(uint32_t i = 0; i < ctx->ip_address_candidates_found; i++) {
-                    printf("- ");
-                    ip_print(ctx->ip_address_candidates[i]);
-                }
-
-                printf("\n");
-
-                // Okay. We now have atleast one ip-address candidate. Proceed to the 'Connect' state.
-                ctx->state = HTTP_Client_Request_State_Connect;
-            }
+    if(!http_client_flight_add_waiter(flight, worker_current_task_handle(worker))) {
+        ctx->coalescing = HTTP_Client_Coalescing_Off;
+        return false;
+    }
 
-            break;
-        }
-        case HTTP_Client_Request_State_Connect: {
-            // Now that we have some IP addresses, start the tcp-client and connect to one of them.
+    // Nothing was allocated for connecting yet, so the candidates can make room for these.
+    assert(ctx->connecting.ip_address_candidates == NULL);
+    ctx->coalescing = HTTP_Client_Coalescing_Waiting;
+    ctx->connecting.flight = flight;
+    ctx->connecting.shared_response = NULL;
+    return true;
+}
 
-            bool connected_to_an_ip_address_successfully = false;
-            for(uint32_t i = 0; i < ctx->ip_address_candidates_found; i++) {
-                IP_Address *ip_to_connect_to = &ctx->ip_address_candidates[i];
+// Sends everyone waiting for the leader's flight back to look for another one. The first of them to run makes the
+// request.
+static void http_client_abandon_flight(Worker *worker, HTTP_Client_Flight *flight) {
+    for(uint32_t i = 0; i < flight->waiter_count; i++) {
+        HTTP_Client_Request_Context *waiter = (HTTP_Client_Request_Context *)worker_get_task_context(worker, flight->waiters[i]);
+        assert(waiter != NULL); // Waiters leave the flight when they're cancelled.
+
+        waiter->coalescing = HTTP_Client_Coalescing_Requested;
+        waiter->connecting.flight = NULL;
+        waiter->connecting.shared_response = NULL;
+        worker_wake_task(worker, flight->waiters[i]);
+    }
+    http_client_flight_end(flight);
+}
 
-                printf("'%s/%s': Start connecting to ip-adress: ", ctx->hostname, ctx->path);
-                ip_print(*ip_to_connect_to);
+// Ends the leader's flight, handing its response (or failure) to everyone waiting for it. Returns the shared response
+// the leader delivers as well, or NULL if nobody was waiting (or we're out of memory, in which case they go ahead on
+// their own).
+static HTTP_Client_Shared_Response *http_client_land_flight(Worker *worker, HTTP_Client_Request_Context *ctx) {
+    HTTP_Client_Flight *flight = http_client_flight_find(worker, ctx->hostname, ctx->port, ctx->path);
+    assert(flight != NULL);
+    ctx->coalescing = HTTP_Client_Coalescing_Off;
+
+    if(flight->waiter_count == 0) {
+        http_client_flight_end(flight);
+        return NULL;
+    }
 
-                TCP_Client_Start_Connecting_Result start_connecting_result = tcp_client_connect(&ctx->tcp_client, *ip_to_connect_to);
-                if(start_connecting_result != TCP_Client_Start_Connecting_Result_Connecting) {
-                    printf("Failed. Got start-connecting-result: %i.\n", start_connecting_result);
-                    continue;
-                }
+    HTTP_Parser *http_parser = ctx->is_transferring ? ctx->transfer.http_parser : NULL;
+    HTTP_Client_Shared_Response *shared = http_client_shared_response_create(http_parser, 1);
+    if(shared == NULL) {
+        http_client_abandon_flight(worker, flight);
+        return NULL;
+    }
+    if(ctx->is_transferring) {
+        ctx->transfer.http_parser = NULL; // It's theirs now.
+    }
+    shared->phases_completed = (HTTP_Client_Phase)ctx->phases_completed;
+    for(uint32_t phase = 0; phase < ctx->phases_completed; phase++) {
+        shared->phase_end_ns[phase] = ctx->started_ns + (uint64_t)ctx->phase_end_us[phase] * CLOCK_NS_PER_US;
+    }
+    shared->socket_result = ctx->socket_result;
+    shared->parse_result = ctx->parse_result;
 
-                connected_to_an_ip_address_successfully = true;
-                break;
-            }
+    for(uint32_t i = 0; i < flight->waiter_count; i++) {
+        HTTP_Client_Request_Context *waiter = (HTTP_Client_Request_Context *)worker_get_task_context(worker, flight->waiters[i]);
+        assert(waiter != NULL);
 
-            if(!connected_to_an_ip_address_successfully) {
-                printf("Error: Failed to connect to any of the %i ip address candidates.\n", ctx->ip_address_candidates_found);
-                ctx->state = HTTP_Client_Request_State_Done;
-                break;
-            }
+        waiter->connecting.flight = NULL;
+        waiter->connecting.shared_response = shared;
+        __atomic_add_fetch(&shared->references, 1, __ATOMIC_RELAXED);
+        worker_wake_task(worker, flight->waiters[i]);
+    }
+    http_client_flight_end(flight);
+    return shared;
+}
 
-            // Check the state of the TCP Client.
-            ctx->state = HTTP_Client_Request_State_Connecting;
-            break;
+// What a waiter does with the response it landed with: it ends up exactly where the leader did.
+static void http_client_take_shared_response(HTTP_Client_Request_Context *ctx) {
+    const HTTP_Client_Shared_Response *shared = ctx->connecting.shared_response;
+    assert(shared != NULL);
+
+    ctx->socket_result = shared->socket_result;
+    ctx->parse_result = shared->parse_result;
+
+    // Its phases end when the leader's did, so the time it waited shows up where the leader spent it. Like for cached
+    // responses, the last one ends when the request finishes.
+    const uint32_t phases = shared->phases_completed < HTTP_Client_Phase_Body_Transfer ? shared->phases_completed : HTTP_Client_Phase_Body_Transfer;
+    for(uint32_t phase = HTTP_Client_Phase_DNS; phase < phases; phase++) {
+        http_client_phase_done_at(ctx, (HTTP_Client_Phase)phase, shared->phase_end_ns[phase]);
+    }
+    metrics_count(Metric_Counter_HTTP_Client_Requests_Coalesced, 1);
+}
+
+// Where the request's response is, if it has one.
+static HTTP_Parser *http_client_request_parser(const HTTP_Client_Request_Context *ctx) {
+    if(ctx->is_transferring) {
+        return ctx->transfer.http_parser;
+    }
+    if(ctx->coalescing == HTTP_Client_Coalescing_Waiting && ctx->connecting.shared_response != NULL) {
+        return ctx->connecting.shared_response->http_parser;
+    }
+    return NULL;
+}
+
+static HTTP http_client_no_response; // What completions of requests that never got a response point at.
+
+void http_client_completion_free(HTTP_Client_Completion *completion) {
+    assert(completion != NULL);
+
+    if(completion->shared_response != NULL) {
+        http_client_shared_response_release(completion->shared_response);
+    }
+    else if(completion->http_parser != NULL) {
+        http_dispose(&completion->http_parser->http);
+        http_parser_dispose(completion->http_parser);
+        free(completion->http_parser);
+    }
+    free(completion);
+}
+
+// Pushes the result to the request's completion queue, handing over the parser (or a reference to the shared
+// response, if there is one). Returns false if that didn't work out, in which case the request still has everything.
+static bool http_client_request_complete_to_queue(HTTP_Client_Request_Context *ctx, const HTTP_Client_Timings *timings, HTTP_Client_Shared_Response *shared) {
+    HTTP_Client_Completion *completion = malloc(sizeof(HTTP_Client_Completion));
+    if(completion == NULL) {
+        return false;
+    }
+
+    completion->hostname = ctx->hostname;
+    completion->path = ctx->path;
+    completion->user_data = ctx->user_data;
+    completion->shared_response = shared;
+    completion->http_parser = shared != NULL ? shared->http_parser : (ctx->is_transferring ? ctx->transfer.http_parser : NULL);
+    completion->http = completion->http_parser != NULL ? &completion->http_parser->http : &http_client_no_response;
+    completion->timings = *timings;
+    completion->socket_result = (TCP_Socket_Result)ctx->socket_result;
+    completion->parse_result = (HTTP_Parse_Result)ctx->parse_result;
+
+    if(!worker_queue_push(ctx->completion_queue, completion)) {
+        LOG_WARNING("'%s%s': Completion queue is full.", ctx->hostname, ctx->path);
+        free(completion);
+        return false;
+    }
+
+    if(shared == NULL && ctx->is_transferring) {
+        ctx->transfer.http_parser = NULL; // It's theirs now.
+    }
+    return true;
+}
+
+// Hands whatever we got to the callback (or the completion queue) and lets go of everything. A request leading a
+// flight hands it to everyone waiting for it too.
+static void http_client_request_finish(Worker *worker, HTTP_Client_Request_Context *ctx) {
+    // The raw response has been parsed by now. No need to hold on to it during the callback.
+    if(ctx->is_transferring) {
+        string_buffer_free(&ctx->transfer.response);
+        memset(&ctx->transfer.response, 0, sizeof(String_Buffer));
+    }
+
+    const bool waited = ctx->coalescing == HTTP_Client_Coalescing_Waiting;
+    HTTP_Parser *http_parser = http_client_request_parser(ctx);
+    bool got_whole_response = http_parser != NULL && http_parser->state == HTTP_Parse_Status_Parsing_Done;
+    if(got_whole_response && !ctx->has_sink && ctx->cache != NULL && ctx->cache_lookup != HTTP_Client_Cache_Lookup_Fresh && !waited) {
+        const bool revalidating = ctx->cache_lookup == HTTP_Client_Cache_Lookup_Stale;
+        if(!http_client_cache_update(ctx->cache, ctx->method, ctx->hostname, ctx->port, ctx->path, revalidating, &http_parser->http)) {
+            // NOTE: A 304 to a GET the caller never made conditional means nothing to them. Failing it is no worse than
+            // any other request that got cut off, and (unlike retrying) doesn't need a second trip through every phase.
+            LOG_WARNING("'%s%s': Failed. Got a 304, but couldn't answer it with the stored response.", ctx->hostname, ctx->path);
+            assert(ctx->is_transferring && ctx->transfer.http_parser == http_parser);
+            http_dispose(&http_parser->http);
+            http_parser_dispose(http_parser);
+            free(http_parser);
+            ctx->transfer.http_parser = NULL;
+            http_parser = NULL;
+            got_whole_response = false;
         }
-        case HTTP_Client_Request_State_Connecting: {
-            assert(
-                ctx->tcp_client.connection_state == TCP_Client_Connection_State_Connecting ||
-                ctx->tcp_client.connection_state == TCP_Client_Connection_State_Connected
-            );
+    }
+    if(got_whole_response) {
+        http_client_phase_done(ctx, HTTP_Client_Phase_Body_Transfer);
+    }
 
-            // printf("'%s%s': TCP Client connecting ... \n", ctx->hostname, ctx->path);
+    // From here on the request holds its part of the shared response (if any) in this, rather than in its context.
+    HTTP_Client_Shared_Response *shared = NULL;
+    if(ctx->coalescing == HTTP_Client_Coalescing_Leading) {
+        shared = http_client_land_flight(worker, ctx);
+    }
+    else if(waited) {
+        shared = ctx->connecting.shared_response;
+        ctx->connecting.shared_response = NULL;
+    }
 
-            if(ctx->tcp_client.connection_state == TCP_Client_Connection_State_Connected) {
-                printf("Connected to '%s'!\n", ctx->hostname);
-                ctx->state = HTTP_Client_Request_State_Start_Sending_Request;
-                break;
-            }
+    HTTP_Client_Timings timings;
+    http_client_get_timings(ctx, &timings);
+    if(ctx->cache_lookup != HTTP_Client_Cache_Lookup_Fresh && !waited) { // Only what went over the network.
+        http_client_stats_record(ctx->hostname, &timings);
+    }
+    http_client_trace_end(ctx);
 
-            break;
+    metrics_gauge_add(Metric_Gauge_HTTP_Client_Requests_In_Flight, -1);
+    metrics_count(got_whole_response ? Metric_Counter_HTTP_Client_Requests_Succeeded : Metric_Counter_HTTP_Client_Requests_Failed, 1);
+    metrics_observe(Metric_Histogram_HTTP_Client_Request_Duration, timings.duration_us[HTTP_Client_Phase_Total]);
+
+    if(ctx->completion_queue != NULL && http_client_request_complete_to_queue(ctx, &timings, shared)) {
+        http_client_request_release(ctx);
+        return;
+    }
+    if(ctx->done_callback == NULL) {
+        LOG_WARNING("'%s%s': Nowhere to deliver the response. Dropped.", ctx->hostname, ctx->path);
+        if(shared != NULL) {
+            http_client_shared_response_release(shared);
         }
-        case HTTP_Client_Request_State_Start_Sending_Request: {
-            char request_string[512];
-            memset(&request_string[0], 0, sizeof(request_string));
-
-            switch(ctx->method) {
-                case HTTP_Method_GET: {
-                    snprintf(
-                        &request_string[0],
-                        sizeof(request_string),
-
-                        "GET /%s HTTP/1.1\r\n"
-                        "Host: %s\r\n"
-                        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/140.0.0.0 Safari/537.36\r\n"
-                        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
-                        "\r\n" // Very important to signal that we're done with the headers.
-                        ,
-
-                        ctx->path,
-                        ctx->hostname
-                    );
-                    break;
-                }
-                case HTTP_Method_POST: {
-                    if(ctx->body == NULL) {
-                        printf("Failed to POST. Body is NULL.\n");
-                        ctx->state = HTTP_Client_Request_State_Done; // TEMP: SS - Go to disconnect or something instead.
-                        break;
-                    }
-
-                    uint32_t body_text_length = strlen(ctx->body);
-                    if(body_text_length == 0) {
-                        printf("Failed to POST. Body's length is 0.\n");
-                        ctx->state = HTTP_Client_Request_State_Done; // TEMP: SS - Go to disconnect or something instead.
-                        break;
-                    }
-
-                    snprintf(
-                        &request_string[0],
-                        sizeof(request_string),
-
-                        "POST /%s HTTP/1.1\r\n"
-                        "Host: %s\r\n"
-                        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/140.0.0.0 Safari/537.36\r\n"
-                        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
-                        "Content-Type: application/json\r\n" // TODO: SS - Make this customizable.
-                        "Content-Length: %u\r\n"
-                        "\r\n" // Very important to signal that we're done with the headers.
-                        "%s"
-                        ,
-
-                        ctx->path,
-                        ctx->hostname,
-                        body_text_length,
-                        ctx->body
-                    );
-                    break;
-                }
-                default: {
-                    printf("Unhandled request method %i.\n", ctx->method);
-                    assert(false);
-                    break;
-                }
-            }
+        http_client_request_release(ctx);
+        return;
+    }
 
-            assert(strlen(request_string) > 0);
+    HTTP empty_http; // For requests that never got a response.
+    HTTP *http = &empty_http;
+    http_parser = shared != NULL ? shared->http_parser : http_client_request_parser(ctx);
+    if(http_parser != NULL) {
+        http = &http_parser->http;
+    }
+    else {
+        memset(&empty_http, 0, sizeof(HTTP));
+    }
 
-#ifdef HTTP_CLIENT_DEBUG_PRINT_REQUEST_STRING
-            printf("Request string:\n%s\n", request_string);
-#endif
+    ctx->in_done_callback = true;
+    ctx->done_callback(
+        ctx->hostname,
+        ctx->path,
+        http,
+        &timings
+    );
+    ctx->in_done_callback = false;
 
-            HTTP_Client_Send_Request_Context message;
-            memset(&message, 0, sizeof(HTTP_Client_Send_Request_Context));
-            message.tcp_client = &ctx->tcp_client;
-            message.text = request_string;
-            message.amount_of_bytes_to_send = strlen(request_string);
-            message.amount_of_bytes_sent = 0;
-
-            bool ok = worker_add_task(
-                &ctx->tcp_worker,
-                &message,
-                sizeof(HTTP_Client_Send_Request_Context),
-                http_tcp_send_request_work
-            );
-
-            if(!ok) {
-                ctx->state = HTTP_Client_Request_State_Done; // TEMP: SS - Go to disconnect or something instead.
-                break;
-            }
+    if(shared != NULL) {
+        http_client_shared_response_release(shared);
+    }
+    http_client_request_release(ctx);
+}
 
-            ctx->state = HTTP_Client_Request_State_Sending_Request;
+bool http_client_request_work(Worker *worker, Worker_Context *context, const uint32_t lifetime) {
+    (void)lifetime;
+    HTTP_Client_Request_Context *ctx = (HTTP_Client_Request_Context *)context;
 
-            break;
-        }
-        case HTTP_Client_Request_State_Sending_Request: {
-            // printf("'%s%s': Sending request ...\n", ctx->hostname, ctx->path);
+    // NOTE: Everything below reads like blocking code, but every WORKER_AWAIT_.. returns and we pick up right after
+    // it on a later tick. Nothing that lives on the stack survives an await; it all goes in 'ctx'.
+    WORKER_COROUTINE_BEGIN(&ctx->coroutine);
 
-            uint32_t tasks_left = worker_work(&ctx->tcp_worker);
-            if(tasks_left == 0) {
-                // We've sent the entire request.
-                printf("Let's wait for a response ...\n");
+    // Timed from here rather than from when the request was made, so time spent queued for a worker isn't counted.
+    ctx->started_ns = clock_now_ns();
+    TRACE_ASYNC_BEGIN(Trace_Category_HTTP_Client, "request", (uintptr_t)ctx);
+    TRACE_ASYNC_BEGIN(Trace_Category_HTTP_Client, http_client_phase_name(HTTP_Client_Phase_DNS), (uintptr_t)ctx);
+    metrics_count(Metric_Counter_HTTP_Client_Requests, 1);
+    metrics_gauge_add(Metric_Gauge_HTTP_Client_Requests_In_Flight, 1);
 
-                ctx->state = HTTP_Client_Request_State_Waiting_For_Response;
-                break;
-            }
+    if(ctx->priority != Worker_Priority_Normal || ctx->connecting.deadline_ns != 0) {
+        // Done from in here so it works the same no matter which worker (or pool thread) ends up running us.
+        worker_task_set_priority(worker, (Worker_Priority)ctx->priority, ctx->connecting.deadline_ns);
+    }
+
+    if(!ctx->has_sink && ctx->cache != NULL && http_client_answer_from_cache(ctx)) {
+        http_client_request_finish(worker, ctx);
+        WORKER_COROUTINE_EXIT(&ctx->coroutine);
+    }
 
+    // Wait for an identical request in flight, if there is one. If that's cancelled, look again.
+    while(ctx->coalescing == HTTP_Client_Coalescing_Requested) {
+        if(!http_client_join_flight(worker, ctx)) {
             break;
         }
-        case HTTP_Client_Request_State_Waiting_For_Response: {
-            HTTP_Client_Receive_Response_Context response;
-            memset(&response, 0, sizeof(HTTP_Client_Receive_Response_Context));
-            response.tcp_client = &ctx->tcp_client;
-            memset(&response.buffer, 0, sizeof(response.buffer));
 
-            string_buffer_init(&response.sb, HTTP_CLIENT_RESPONSE_BUFFER_INITIAL_SIZE);
+        WORKER_AWAIT_WOKEN(worker, &ctx->coroutine);
+
+        if(ctx->coalescing == HTTP_Client_Coalescing_Waiting) {
+            http_client_take_shared_response(ctx);
+            http_client_request_finish(worker, ctx);
+            WORKER_COROUTINE_EXIT(&ctx->coroutine);
+        }
+    }
+
+    if(!http_client_resolve(ctx)) {
+        http_client_request_finish(worker, ctx);
+        WORKER_COROUTINE_EXIT(&ctx->coroutine);
+    }
+    http_client_phase_done(ctx, HTTP_Client_Phase_DNS);
+
+    // Connect. If an address doesn't work out, move on to the next one.
+    while(ctx->tcp_client.connection_state != TCP_Client_Connection_State_Connected) {
+        if(ctx->tcp_client.connection_state != TCP_Client_Connection_State_Disconnected) {
+            // The previous attempt failed. Its socket was waited on, and the next one is likely to get the same fd.
+            worker_task_forget_fd(worker, ctx->tcp_client.socket.fd);
+            tcp_client_close(&ctx->tcp_client);
+            ctx->socket_result = TCP_Socket_Result_Failed_To_Connect;
+        }
 
-            http_parser_init(&ctx->http_parser, HTTP_CLIENT_RESPONSE_BUFFER_INITIAL_SIZE);
-            response.http_parser = &ctx->http_parser;
+        if(ctx->connecting.socket_options.busy_poll_us == 0 && worker->spin_budget_ns > 0) {
+            // A busy-polling worker wants its sockets busy-polled as well, or the spinning only sees what the softirq
+            // got around to delivering.
+            ctx->connecting.socket_options.busy_poll_us = (int)(worker->spin_budget_ns / CLOCK_NS_PER_US);
+        }
 
-            bool ok = worker_add_task(
-                &ctx->tcp_worker,
-                &response,
-                sizeof(HTTP_Client_Receive_Response_Context),
-                http_tcp_receive_response_work
-            );
+        if(!http_client_start_connecting_to_next(ctx)) {
+            http_client_request_finish(worker, ctx);
+            WORKER_COROUTINE_EXIT(&ctx->coroutine);
+        }
 
-            if(!ok) {
-                string_buffer_free(&response.sb);
-                ctx->state = HTTP_Client_Request_State_Done; // TEMP: SS - Go to disconnect or something instead.
+        while(true) {
+            tcp_client_work(&ctx->tcp_client);
+            if(ctx->tcp_client.connection_state != TCP_Client_Connection_State_Connecting) {
                 break;
             }
 
-            ctx->state = HTTP_Client_Request_State_Receiving_Response;
+            // LOG_TRACE("'%s%s': TCP Client connecting ... ", ctx->hostname, ctx->path);
 
-            break;
+            // The socket becomes writable once the handshake is done (or has failed).
+            WORKER_AWAIT_WRITABLE(worker, &ctx->coroutine, ctx->tcp_client.socket.fd);
         }
-        case HTTP_Client_Request_State_Receiving_Response: {
-            uint32_t tasks_left = worker_work(&ctx->tcp_worker);
-            if(tasks_left == 0) {
-                ctx->state = HTTP_Client_Request_State_Done;
-                break;
-            }
+    }
 
-            break;
+    http_client_phase_done(ctx, HTTP_Client_Phase_Connect);
+    LOG_DEBUG("Connected to '%s'!", ctx->hostname);
+    http_client_begin_transfer(ctx);
+
+    // Send the request.
+    if(!http_client_build_request(ctx)) {
+        http_client_request_finish(worker, ctx);
+        WORKER_COROUTINE_EXIT(&ctx->coroutine);
+    }
+
+    while(ctx->transfer.amount_of_bytes_sent < http_client_request_length(ctx)) {
+        LOG_TRACE("Sending bytes. Progress: %i/%i bytes.", ctx->transfer.amount_of_bytes_sent, http_client_request_length(ctx));
+
+        TCP_Socket_Result send_result = http_client_send_request(ctx);
+        if(send_result == TCP_Socket_Result_Not_Ready_To_Be_Written_To) {
+            WORKER_AWAIT_WRITABLE(worker, &ctx->coroutine, ctx->tcp_client.socket.fd);
+        }
+        else if(send_result != TCP_Socket_Result_OK) {
+            LOG_ERROR("Failed to send (%i).", send_result);
+            ctx->socket_result = (uint8_t)send_result;
+            http_client_request_finish(worker, ctx);
+            WORKER_COROUTINE_EXIT(&ctx->coroutine);
         }
-        case HTTP_Client_Request_State_Done: {
-            ctx->done_callback(
-                ctx->hostname,
-                ctx->path,
-                &ctx->http_parser.http
-            );
+    }
+
+    http_client_phase_done(ctx, HTTP_Client_Phase_Request_Write);
+    LOG_TRACE("All bytes sent. :)");
+    free(ctx->transfer.request_head);
+    ctx->transfer.request_head = NULL;
+    tcp_socket_set_cork(&ctx->tcp_client.socket, false); // Flush whatever TCP_CORK held back.
 
-            http_dispose(&ctx->http_parser.http);
-            tcp_client_disconnect(&ctx->tcp_client);
+    // Receive the response. Nothing is allocated for it until it starts arriving, so a request that waits a long time
+    // for its response (like a long-poll) only costs its context.
+    LOG_TRACE("Let's wait for a response ...");
+
+    while(true) {
+        WORKER_AWAIT_READABLE(worker, &ctx->coroutine, ctx->tcp_client.socket.fd);
+
+        if(http_client_receive_available(ctx) == HTTP_Client_Receive_Status_Done) {
+            break;
         }
     }
 
-    switch(ctx->tcp_client.connection_state) {
-        case TCP_Client_Connection_State_Disconnected:  return false;
-        case TCP_Client_Connection_State_Connecting:    return false;
-        case TCP_Client_Connection_State_Connected:     return false;
-        case TCP_Client_Connection_State_Disconnecting: return true;
+    http_client_request_finish(worker, ctx);
+
+    WORKER_COROUTINE_END(&ctx->coroutine);
+}
+
+static void http_client_request_init_context(
+    HTTP_Client_Request_Context *ctx,
+    HTTP_Method method,
+    const char *hostname,
+    const char *path,
+    const char *body,
+    const HTTP_Client_Request_Options *options,
+    HTTP_Client_Callback done_callback
+) {
+    memset(ctx, 0, sizeof(HTTP_Client_Request_Context));
+
+    ctx->method = method;
+    ctx->hostname = hostname;
+    ctx->path = path;
+    ctx->body = body;
+    ctx->port = TCP_ENDPOINT_DEFAULT_PORT;
+    ctx->socket_result = TCP_Socket_Result_OK;
+    ctx->parse_result = HTTP_Parse_Result_Needs_More_Data;
+    if(options != NULL && options->socket_options != NULL) {
+        ctx->connecting.socket_options = *options->socket_options;
+    }
+    else {
+        ctx->connecting.socket_options = tcp_socket_options_for_profile(TCP_Socket_Profile_Default);
+    }
+    if(options != NULL) {
+        ctx->priority = (uint8_t)options->priority;
+        ctx->connecting.deadline_ns = options->deadline_ns;
+        if(options->port != 0) {
+            ctx->port = options->port;
+        }
+        ctx->headers = options->headers;
+        ctx->completion_queue = options->completion_queue;
+        ctx->user_data = options->user_data;
+        if(options->sink != NULL) {
+            ctx->sink = options->sink;
+            ctx->has_sink = true;
+        }
+        else {
+            ctx->cache = options->cache;
+            if(options->coalesce && method == HTTP_Method_GET) {
+                ctx->coalescing = HTTP_Client_Coalescing_Requested;
+            }
+        }
     }
 
-    return false;
+    assert(done_callback != NULL || ctx->completion_queue != NULL);
+    ctx->done_callback = done_callback;
 }
 
 bool http_client_request(
@@ -384,29 +980,109 @@ bool http_client_request(
     const char *hostname,
     const char *path,
     const char *body,
-    HTTP_Client_Callback done_callback
+    const HTTP_Client_Request_Options *options,
+    HTTP_Client_Callback done_callback,
+    HTTP_Client_Request_Handle *out_handle
 ) {
     HTTP_Client_Request_Context ctx;
-    memset(&ctx, 0, sizeof(HTTP_Client_Request_Context));
-
-    ctx.method = method;
-    ctx.hostname = hostname;
-    ctx.path = path;
-    ctx.body = body;
-
-    ctx.done_callback = done_callback;
-    ctx.state = HTTP_Client_Request_State_Resolving;
+    http_client_request_init_context(&ctx, method, hostname, path, body, options, done_callback);
 
+    Worker_Task_Handle task;
     bool success_adding_task = worker_add_task(
         worker,
         &ctx,
         sizeof(HTTP_Client_Request_Context),
-        http_client_request_work
+        http_client_request_work,
+        &task
     );
 
     if(!success_adding_task) {
         return false;
     }
 
+    if(out_handle != NULL) {
+        out_handle->worker = worker;
+        out_handle->task = task;
+    }
+
+    return true;
+}
+
+bool http_client_request_cancel(const HTTP_Client_Request_Handle handle) {
+    assert(handle.worker != NULL);
+
+    HTTP_Client_Request_Context *ctx = (HTTP_Client_Request_Context *)worker_get_task_context(handle.worker, handle.task);
+    if(ctx == NULL) {
+        return false; // Already finished or cancelled.
+    }
+    if(ctx->in_done_callback) {
+        return false; // Finishing as we speak.
+    }
+
+    LOG_DEBUG("'%s/%s': Cancelled.", ctx->hostname, ctx->path);
+
+    if(ctx->started_ns != 0) { // Only counted as in flight once it ran.
+        metrics_gauge_add(Metric_Gauge_HTTP_Client_Requests_In_Flight, -1);
+        metrics_count(Metric_Counter_HTTP_Client_Requests_Cancelled, 1);
+        http_client_trace_end(ctx);
+    }
+
+    // Nobody waits for a cancelled request.
+    if(ctx->coalescing == HTTP_Client_Coalescing_Waiting && ctx->connecting.flight != NULL) {
+        http_client_flight_remove_waiter(ctx->connecting.flight, handle.task);
+        ctx->connecting.flight = NULL;
+    }
+    else if(ctx->coalescing == HTTP_Client_Coalescing_Leading) {
+        http_client_abandon_flight(handle.worker, http_client_flight_find(handle.worker, ctx->hostname, ctx->port, ctx->path));
+        ctx->coalescing = HTTP_Client_Coalescing_Off;
+    }
+
+    // Release before cancelling; cancelling may free the context.
+    http_client_request_release(ctx);
+
+    bool cancelled = worker_cancel_task(handle.worker, handle.task);
+    assert(cancelled);
+    (void)cancelled;
+
     return true;
-}
\ No newline at end of file
+}
+
+bool http_client_request_on_pool(
+    Worker_Pool *pool,
+    HTTP_Method method,
+    const char *hostname,
+    const char *path,
+    const char *body,
+    const HTTP_Client_Request_Options *options,
+    HTTP_Client_Callback done_callback
+) {
+    HTTP_Client_Request_Context ctx;
+    http_client_request_init_context(&ctx, method, hostname, path, body, options, done_callback);
+
+    return worker_pool_submit(
+        pool,
+        &ctx,
+        sizeof(HTTP_Client_Request_Context),
+        http_client_request_work
+    );
+}
+
+bool http_client_request_submit(
+    Worker *worker,
+    HTTP_Method method,
+    const char *hostname,
+    const char *path,
+    const char *body,
+    const HTTP_Client_Request_Options *options,
+    HTTP_Client_Callback done_callback
+) {
+    HTTP_Client_Request_Context ctx;
+    http_client_request_init_context(&ctx, method, hostname, path, body, options, done_callback);
+
+    return worker_submit_task(
+        worker,
+        &ctx,
+        sizeof(HTTP_Client_Request_Context),
+        http_client_request_work
+    );
+}
@@ -2,26 +2,21 @@
 #define HTTP_CLIENT_H
 
 #include "worker/worker.h"
+#include "worker/pool/worker_pool.h"
+#include "worker/coroutine/worker_coroutine.h"
 #include "dns/dns.h"
 #include "ip/ip.h"
 #include "tcp/client/tcp_client.h"
 #include "string/buffer/string_buffer.h"
 #include "http/http.h"
+#include "http/client/http_client_stats.h"
+#include "http/client/http_client_cache.h"
+#include "http/client/http_client_coalesce.h"
+#include "http/client/http_client_sink.h"
 
 typedef uint16_t HTTP_Client_Status_Code;
 
-typedef void (*HTTP_Client_Callback)(const char *hostname, const char *path, HTTP *http); // TODO: SS - Add 'tcp error'?
-
-typedef enum {
-    HTTP_Client_Request_State_Resolving,
-    HTTP_Client_Request_State_Connect,
-    HTTP_Client_Request_State_Connecting,
-    HTTP_Client_Request_State_Start_Sending_Request,
-    HTTP_Client_Request_State_Sending_Request,
-    HTTP_Client_Request_State_Waiting_For_Response,
-    HTTP_Client_Request_State_Receiving_Response,
-    HTTP_Client_Request_State_Done
-} HTTP_Client_Request_State;
+typedef void (*HTTP_Client_Callback)(const char *hostname, const char *path, HTTP *http, const HTTP_Client_Timings *timings); // TODO: SS - Add 'tcp error'?
 
 #ifndef MAX_IP_ADDRESS_CANDIDATES
 #define MAX_IP_ADDRESS_CANDIDATES 16
@@ -31,46 +26,171 @@ typedef enum {
 #define HTTP_CLIENT_RESPONSE_BUFFER_INITIAL_SIZE 1024
 #endif
 
+#ifndef HTTP_CLIENT_RECEIVE_MAX_READ_SIZE
+#define HTTP_CLIENT_RECEIVE_MAX_READ_SIZE (256 * 1024)
+#endif
+
 typedef struct {
-    TCP_Client *tcp_client;
+    const TCP_Socket_Options *socket_options; // NULL for TCP_Socket_Profile_Default. Copied when the request is made.
+
+    uint16_t port; // 0 for TCP_ENDPOINT_DEFAULT_PORT. Not used for 'unix:' hostnames.
 
-    char buffer[HTTP_CLIENT_RESPONSE_BUFFER_INITIAL_SIZE];
-    String_Buffer sb;
+    // Extra header lines, each ending in "\r\n", e.g. "Authorization: Bearer x\r\nX-Trace: 1\r\n". Borrowed like
+    // 'body'. They replace the default 'Content-Type: application/json' of requests with a body.
+    const char *headers;
 
-    uint32_t amount_of_bytes_read;
+    // How the request's task is scheduled on its worker. See Worker_Priority.
+    Worker_Priority priority;
+    uint64_t deadline_ns; // Absolute, on clock_now_ns()'s clock. 0 for none.
 
-    HTTP_Parser *http_parser;
-} HTTP_Client_Receive_Response_Context;
+    // Where to deliver the result instead of calling 'done_callback' on the worker's thread. The finished request is
+    // pushed as an HTTP_Client_Completion, which whoever owns the queue pops on their own thread whenever it suits
+    // them. The queue has to have room for every request that may be in flight towards it; if it's full the result
+    // goes to 'done_callback' after all, or is dropped if there is none.
+    Worker_Queue *completion_queue;
+    void *user_data; // Handed back in the HTTP_Client_Completion.
 
+    // Answer GETs from this cache when it can, and keep what comes back in it. See http_client_cache.h. NULL for
+    // none. Has to outlive the request.
+    HTTP_Client_Cache *cache;
+
+    // Share the response with identical GETs in flight on the same worker instead of making a request of its own, if
+    // they were made with this too. See http_client_coalesce.h. The response is read-only then.
+    bool coalesce;
+
+    // Write the body of a 2xx response to a file as it arrives, instead of keeping it in memory. See
+    // http_client_sink.h. NULL for none. Requests with one don't use 'cache' or 'coalesce'. Has to outlive the request.
+    HTTP_Client_Sink *sink;
+} HTTP_Client_Request_Options;
+
+// A finished request, delivered through HTTP_Client_Request_Options.completion_queue. Owned by whoever popped it;
+// free it with http_client_completion_free(..).
 typedef struct {
+    const char *hostname;
+    const char *path;
+    void *user_data;
+
+    HTTP *http; // Never NULL. Status code 0 if there was no response. Treat it as read-only in that case.
+    HTTP_Parser *http_parser; // Holds 'http'. NULL if there was no response.
+    HTTP_Client_Shared_Response *shared_response; // Holds 'http_parser' if the request was coalesced. Read-only then.
+
+    HTTP_Client_Timings timings;
+
+    // Why it didn't get a complete response, as far as we know. 'timings.phases_completed' says where.
+    TCP_Socket_Result socket_result; // The socket operation that failed. TCP_Socket_Result_OK if none did.
+    HTTP_Parse_Result parse_result;  // How parsing ended. HTTP_Parse_Result_Needs_More_Data if the connection closed
+                                     // before the response was complete, or it never started.
+} HTTP_Client_Completion;
+
+void http_client_completion_free(HTTP_Client_Completion *completion);
+
+// The whole request is one coroutine (see worker/coroutine/worker_coroutine.h), and this is its frame.
+//
+// It's kept small so a process can hold a lot of requests that are just sitting there, e.g. 100k long-polls that are
+// connected and waiting for a response. Per request that costs:
+// - This context, at most HTTP_CLIENT_REQUEST_CONTEXT_BUDGET bytes (checked at compile time), plus malloc's overhead.
+// - One Worker_Task slot in the worker's slab.
+// - The kernel's socket, which we don't control here.
+// Every request also records its HTTP_Client_Timings into the running thread's HTTP_Client_Stats when it's done.
+// Everything else is allocated when it's needed and freed as soon as it isn't:
+// - The resolved addresses, from resolving until connected.
+// - The request line, Host header and the caller's headers, until sent. Other headers are shared templates and the
+//   body isn't copied, so the caller has to keep 'hostname', 'path', 'body' and 'headers' alive until the callback.
+// - The HTTP_Parser (sizeof(HTTP_Parser), ~5 KB) and the raw response buffer, from the first byte of the response
+//   until the callback.
+// A request answered from its cache never connects; it only costs the context and the HTTP_Parser holding the copy,
+// and isn't recorded into the HTTP_Client_Stats.
+#ifndef HTTP_CLIENT_REQUEST_CONTEXT_BUDGET
+#define HTTP_CLIENT_REQUEST_CONTEXT_BUDGET 192
+#endif
+
+typedef enum {
+    HTTP_Client_Coalescing_Off = 0,
+    HTTP_Client_Coalescing_Requested, // Hasn't looked for a flight to join yet.
+    HTTP_Client_Coalescing_Leading,   // Is the flight others wait for.
+    HTTP_Client_Coalescing_Waiting,   // For someone else's flight. See 'connecting.flight'.
+} HTTP_Client_Coalescing;
+
+typedef struct {
+    Worker_Coroutine coroutine;
+
     HTTP_Method method;
     const char *hostname;
     const char *path;
     const char *body;
-
-    HTTP_Client_Request_State state;
+    const char *headers;
 
     HTTP_Client_Callback done_callback;
-
-    IP_Address ip_address_candidates[MAX_IP_ADDRESS_CANDIDATES];
-    uint32_t ip_address_candidates_found;
+    Worker_Queue *completion_queue;
+    void *user_data;
+    union {
+        HTTP_Client_Cache *cache; // Unless 'has_sink'.
+        HTTP_Client_Sink *sink;
+    };
+
+    uint8_t priority; // Worker_Priority.
+
+    // When each phase ended, in microseconds since 'started_ns'. See HTTP_Client_Timings.
+    uint8_t phases_completed; // HTTP_Client_Phase.
+    uint16_t port;
+    uint8_t socket_result; // TCP_Socket_Result. See HTTP_Client_Completion.
+    uint8_t parse_result;  // HTTP_Parse_Result.
+    uint8_t coalescing;    // HTTP_Client_Coalescing.
+    uint64_t started_ns;
+    uint32_t phase_end_us[HTTP_Client_Phase_Total];
+
+    bool is_unix_endpoint; // The hostname was 'unix:/path'. No DNS, connects straight to it.
+    bool is_transferring;  // Which half of the union below is in use.
+    bool in_done_callback;
+    uint8_t cache_lookup; // HTTP_Client_Cache_Lookup. What the request found in 'cache' when it started.
+    bool has_sink;
 
     TCP_Client tcp_client;
-    Worker tcp_worker;
-
-    HTTP_Client_Status_Code current_status_code;
 
-    HTTP_Parser http_parser;
+    union {
+        // Until we're connected.
+        struct {
+            TCP_Socket_Options socket_options;
+            uint64_t deadline_ns; // Only needed to schedule the task when it first runs.
+
+            union {
+                struct {
+                    IP_Address *ip_address_candidates; // MAX_IP_ADDRESS_CANDIDATES of them.
+                    uint32_t ip_address_candidates_found;
+                    uint32_t ip_address_candidates_tried;
+                };
+
+                // Instead, while waiting for someone else's flight. Never connects unless the flight is cancelled.
+                struct {
+                    HTTP_Client_Flight *flight; // NULL once it's landed.
+                    HTTP_Client_Shared_Response *shared_response; // What it landed with.
+                };
+            };
+        } connecting;
+
+        // Once we're connected.
+        struct {
+            // The request goes out as 'request_head' (request line, Host, Content-Length, the caller's headers and the
+            // cache's validators), a shared template of headers and 'body', in that order.
+            char *request_head; // NULL once sent.
+            uint32_t request_head_length;
+            uint32_t body_length;
+            uint32_t amount_of_bytes_sent;
+
+            String_Buffer response; // recv(..) writes straight into this. Not allocated until there's something to read.
+            uint32_t amount_of_bytes_read;
+            uint32_t next_read_size; // Grows while reads fill up the space we give them, up to HTTP_CLIENT_RECEIVE_MAX_READ_SIZE.
+
+            HTTP_Parser *http_parser; // NULL until the response starts arriving.
+        } transfer;
+    };
 } HTTP_Client_Request_Context;
 
+// Refers to a request made with http_client_request(..) for as long as it's in flight.
 typedef struct {
-    TCP_Client *tcp_client;
-    const char *text;
-    uint32_t amount_of_bytes_to_send; // TODO: SS - Change to uint64_t? Nah, probably alright.
-    uint32_t amount_of_bytes_sent;
-} HTTP_Client_Send_Request_Context;
-
-
+    Worker *worker;
+    Worker_Task_Handle task;
+} HTTP_Client_Request_Handle;
 
 bool http_client_request(
     Worker *worker,
@@ -79,9 +199,45 @@ bool http_client_request(
     const char *hostname,
     const char *path,
     const char *body,
+    const HTTP_Client_Request_Options *options, // NULL for defaults.
+
+    HTTP_Client_Callback done_callback, // May be NULL if 'options' has a completion queue.
+    HTTP_Client_Request_Handle *out_handle // May be NULL.
+);
+
+// Stops the request wherever it is (resolving, connecting, sending or receiving). The socket is closed and its buffers
+// are freed before this returns, and 'done_callback' is never called. Has to be called on the thread running the
+// request's worker, but may be called from inside another task's callback, e.g. another request's 'done_callback'.
+// Returns false if the request already finished, was already cancelled, or is inside its own 'done_callback'.
+bool http_client_request_cancel(const HTTP_Client_Request_Handle handle);
+
+// Same as http_client_request(..), but callable from any thread. The request runs on whichever pool thread adopts it,
+// and 'done_callback' is called on that thread.
+bool http_client_request_on_pool(
+    Worker_Pool *pool,
+
+    HTTP_Method method,
+    const char *hostname,
+    const char *path,
+    const char *body,
+    const HTTP_Client_Request_Options *options, // NULL for defaults.
 
     HTTP_Client_Callback done_callback
 );
 
+// Same as http_client_request(..), but callable from any thread. The request runs on 'worker', which has to have a
+// submit queue (see worker_submit_queue_init(..)). Fails if that queue is full. Pair it with a completion queue in
+// 'options' to get the result back on the calling thread without any locks.
+bool http_client_request_submit(
+    Worker *worker,
+
+    HTTP_Method method,
+    const char *hostname,
+    const char *path,
+    const char *body,
+    const HTTP_Client_Request_Options *options, // NULL for defaults.
+
+    HTTP_Client_Callback done_callback // May be NULL if 'options' has a completion queue.
+);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,579 @@
+#include "http_client_cache.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "clock/clock.h"
+#include "log/log.h"
+#include "metrics/metrics.h"
+
+typedef struct HTTP_Client_Cache_Shard HTTP_Client_Cache_Shard;
+typedef struct HTTP_Client_Cache_Entry HTTP_Client_Cache_Entry;
+
+struct HTTP_Client_Cache_Entry {
+    // The key.
+    HTTP_Method method;
+    uint16_t port;
+    char *hostname; // Followed by the path, in the same allocation.
+    const char *path;
+    uint64_t hash;
+
+    uint64_t bytes; // Everything this entry holds, as counted against 'max_bytes'.
+
+    uint64_t expires_ns; // Fresh until then. When it was stored, for responses that always have to be revalidated.
+
+    char etag[HTTP_MAX_HEADER_VALUE_LENGTH];          // "" for none.
+    char last_modified[HTTP_MAX_HEADER_VALUE_LENGTH]; // "" for none.
+
+    HTTP_Status status;
+    HTTP_Transfer_Encoding encoding;
+    bool has_encoding_set;
+
+    // The headers as "key\0value\0" pairs, rather than a whole HTTP_Headers (~5 KB) for each response.
+    char *headers;
+    uint32_t header_count;
+
+    char *body;
+    uint64_t body_length;
+
+    HTTP_Client_Cache_Entry *bucket_next;
+    HTTP_Client_Cache_Entry *lru_previous; // Towards more recently used.
+    HTTP_Client_Cache_Entry *lru_next;
+};
+
+// One per thread (per HTTP_Client_Cache), so nothing in here is ever shared.
+struct HTTP_Client_Cache_Shard {
+    HTTP_Client_Cache *cache;
+
+    HTTP_Client_Cache_Entry **buckets;
+    uint32_t bucket_mask;
+    uint32_t entry_count;
+    uint64_t bytes;
+
+    HTTP_Client_Cache_Entry *most_recent;
+    HTTP_Client_Cache_Entry *least_recent;
+
+    HTTP_Client_Cache_Shard *next_of_thread; // The calling thread's shards, one per HTTP_Client_Cache.
+    HTTP_Client_Cache_Shard *next_of_cache;  // Every thread's shard of the same HTTP_Client_Cache.
+};
+
+struct HTTP_Client_Cache {
+    uint64_t max_bytes;
+    uint64_t max_entry_bytes;
+
+    HTTP_Client_Cache_Shard *shards; // Pushed to by every thread that uses it. Walked by destroy.
+};
+
+#define HTTP_CLIENT_CACHE_INITIAL_BUCKETS 64
+
+static __thread HTTP_Client_Cache_Shard *http_client_cache_thread_shards;
+
+HTTP_Client_Cache *http_client_cache_create(const HTTP_Client_Cache_Options *options) {
+    HTTP_Client_Cache *cache = calloc(1, sizeof(HTTP_Client_Cache));
+    if(cache == NULL) {
+        return NULL;
+    }
+
+    cache->max_bytes = options != NULL && options->max_bytes > 0 ? options->max_bytes : HTTP_CLIENT_CACHE_DEFAULT_MAX_BYTES;
+    cache->max_entry_bytes = cache->max_bytes / 8;
+    return cache;
+}
+
+static void http_client_cache_entry_free(HTTP_Client_Cache_Entry *entry) {
+    free(entry->hostname);
+    free(entry->headers);
+    free(entry->body);
+    free(entry);
+}
+
+void http_client_cache_destroy(HTTP_Client_Cache *cache) {
+    if(cache == NULL) {
+        return;
+    }
+
+    HTTP_Client_Cache_Shard *shard = __atomic_load_n(&cache->shards, __ATOMIC_ACQUIRE);
+    while(shard != NULL) {
+        HTTP_Client_Cache_Entry *entry = shard->most_recent;
+        while(entry != NULL) {
+            HTTP_Client_Cache_Entry *next = entry->lru_next;
+            http_client_cache_entry_free(entry);
+            entry = next;
+        }
+        metrics_gauge_add(Metric_Gauge_HTTP_Client_Cache_Bytes, -(int64_t)shard->bytes);
+
+        HTTP_Client_Cache_Shard *next = shard->next_of_cache;
+        free(shard->buckets);
+        free(shard);
+        shard = next;
+    }
+
+    free(cache);
+}
+
+static HTTP_Client_Cache_Shard *http_client_cache_shard_for_thread(HTTP_Client_Cache *cache) {
+    for(HTTP_Client_Cache_Shard *shard = http_client_cache_thread_shards; shard != NULL; shard = shard->next_of_thread) {
+        if(shard->cache == cache) {
+            return shard;
+        }
+    }
+
+    HTTP_Client_Cache_Shard *shard = calloc(1, sizeof(HTTP_Client_Cache_Shard));
+    if(shard == NULL) {
+        return NULL;
+    }
+
+    shard->buckets = calloc(HTTP_CLIENT_CACHE_INITIAL_BUCKETS, sizeof(HTTP_Client_Cache_Entry *));
+    if(shard->buckets == NULL) {
+        free(shard);
+        return NULL;
+    }
+    shard->bucket_mask = HTTP_CLIENT_CACHE_INITIAL_BUCKETS - 1;
+    shard->cache = cache;
+
+    shard->next_of_thread = http_client_cache_thread_shards;
+    http_client_cache_thread_shards = shard;
+
+    shard->next_of_cache = __atomic_load_n(&cache->shards, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&cache->shards, &shard->next_of_cache, shard, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // 'next_of_cache' was updated to the current head. Try again.
+    }
+
+    return shard;
+}
+
+static inline uint64_t http_client_cache_hash_bytes(uint64_t hash, const void *data, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+        hash ^= ((const uint8_t *)data)[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t http_client_cache_hash(HTTP_Method method, const char *hostname, uint16_t port, const char *path) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a.
+    uint8_t method_byte = (uint8_t)method;
+    hash = http_client_cache_hash_bytes(hash, &method_byte, 1);
+    hash = http_client_cache_hash_bytes(hash, &port, sizeof(port));
+    hash = http_client_cache_hash_bytes(hash, hostname, strlen(hostname) + 1); // With the '\0', so "ab"+"c" isn't "a"+"bc".
+    hash = http_client_cache_hash_bytes(hash, path, strlen(path));
+    return hash;
+}
+
+static void http_client_cache_lru_unlink(HTTP_Client_Cache_Shard *shard, HTTP_Client_Cache_Entry *entry) {
+    if(entry->lru_previous != NULL) {
+        entry->lru_previous->lru_next = entry->lru_next;
+    } else {
+        shard->most_recent = entry->lru_next;
+    }
+    if(entry->lru_next != NULL) {
+        entry->lru_next->lru_previous = entry->lru_previous;
+    } else {
+        shard->least_recent = entry->lru_previous;
+    }
+    entry->lru_previous = NULL;
+    entry->lru_next = NULL;
+}
+
+static void http_client_cache_lru_push(HTTP_Client_Cache_Shard *shard, HTTP_Client_Cache_Entry *entry) {
+    entry->lru_previous = NULL;
+    entry->lru_next = shard->most_recent;
+    if(shard->most_recent != NULL) {
+        shard->most_recent->lru_previous = entry;
+    } else {
+        shard->least_recent = entry;
+    }
+    shard->most_recent = entry;
+}
+
+static void http_client_cache_remove(HTTP_Client_Cache_Shard *shard, HTTP_Client_Cache_Entry *entry) {
+    HTTP_Client_Cache_Entry **link = &shard->buckets[entry->hash & shard->bucket_mask];
+    while(*link != entry) {
+        assert(*link != NULL);
+        link = &(*link)->bucket_next;
+    }
+    *link = entry->bucket_next;
+
+    http_client_cache_lru_unlink(shard, entry);
+    shard->entry_count -= 1;
+    shard->bytes -= entry->bytes;
+    metrics_gauge_add(Metric_Gauge_HTTP_Client_Cache_Bytes, -(int64_t)entry->bytes);
+
+    http_client_cache_entry_free(entry);
+}
+
+// Doubles the buckets once there are more entries than buckets. Keeps the old ones if that doesn't work out.
+static void http_client_cache_maybe_grow(HTTP_Client_Cache_Shard *shard) {
+    if(shard->entry_count <= shard->bucket_mask) {
+        return;
+    }
+
+    uint32_t bucket_count = (shard->bucket_mask + 1) * 2;
+    HTTP_Client_Cache_Entry **buckets = calloc(bucket_count, sizeof(HTTP_Client_Cache_Entry *));
+    if(buckets == NULL) {
+        return;
+    }
+
+    for(HTTP_Client_Cache_Entry *entry = shard->most_recent; entry != NULL; entry = entry->lru_next) {
+        HTTP_Client_Cache_Entry **bucket = &buckets[entry->hash & (bucket_count - 1)];
+        entry->bucket_next = *bucket;
+        *bucket = entry;
+    }
+
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_mask = bucket_count - 1;
+}
+
+static HTTP_Client_Cache_Entry *http_client_cache_find(HTTP_Client_Cache_Shard *shard, HTTP_Method method, const char *hostname, uint16_t port, const char *path, const uint64_t hash) {
+    for(HTTP_Client_Cache_Entry *entry = shard->buckets[hash & shard->bucket_mask]; entry != NULL; entry = entry->bucket_next) {
+        if(entry->hash == hash && entry->method == method && entry->port == port && strcmp(entry->hostname, hostname) == 0 && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Copies the stored response into 'out_http', over whatever was there. Returns false if we're out of memory, in which
+// case 'out_http' is left alone.
+static bool http_client_cache_entry_copy_to(const HTTP_Client_Cache_Entry *entry, HTTP *out_http) {
+    char *body = malloc(entry->body_length + 1);
+    if(body == NULL) {
+        return false;
+    }
+    memcpy(body, entry->body, entry->body_length);
+    body[entry->body_length] = '\0';
+
+    string_buffer_free(&out_http->body.string_buffer);
+    memset(out_http, 0, sizeof(HTTP));
+
+    out_http->status = entry->status;
+
+    const char *pair = entry->headers;
+    for(uint32_t i = 0; i < entry->header_count; i++) {
+        HTTP_Header *header = &out_http->headers.headers[i];
+        size_t key_length = strlen(pair);
+        memcpy(header->key, pair, key_length + 1);
+        pair += key_length + 1;
+
+        size_t value_length = strlen(pair);
+        memcpy(header->value, pair, value_length + 1);
+        pair += value_length + 1;
+    }
+    out_http->headers.header_count = entry->header_count;
+
+    out_http->body.has_encoding_set = entry->has_encoding_set;
+    out_http->body.encoding = entry->encoding;
+    out_http->body.string_buffer.data = body;
+    out_http->body.string_buffer.length = entry->body_length;
+    out_http->body.string_buffer.capacity = entry->body_length + 1;
+    return true;
+}
+
+HTTP_Client_Cache_Lookup http_client_cache_lookup(HTTP_Client_Cache *cache, HTTP_Method method, const char *hostname, uint16_t port, const char *path, HTTP *out_http) {
+    assert(cache != NULL);
+    assert(out_http != NULL);
+
+    HTTP_Client_Cache_Shard *shard = method == HTTP_Method_GET ? http_client_cache_shard_for_thread(cache) : NULL;
+    if(shard == NULL) {
+        return HTTP_Client_Cache_Lookup_Miss;
+    }
+
+    HTTP_Client_Cache_Entry *entry = http_client_cache_find(shard, method, hostname, port, path, http_client_cache_hash(method, hostname, port, path));
+    if(entry == NULL) {
+        metrics_count(Metric_Counter_HTTP_Client_Cache_Misses, 1);
+        return HTTP_Client_Cache_Lookup_Miss;
+    }
+
+    http_client_cache_lru_unlink(shard, entry);
+    http_client_cache_lru_push(shard, entry);
+
+    if(clock_now_ns() >= entry->expires_ns) {
+        metrics_count(Metric_Counter_HTTP_Client_Cache_Stale, 1);
+        return HTTP_Client_Cache_Lookup_Stale;
+    }
+    if(!http_client_cache_entry_copy_to(entry, out_http)) {
+        metrics_count(Metric_Counter_HTTP_Client_Cache_Misses, 1);
+        return HTTP_Client_Cache_Lookup_Miss;
+    }
+
+    metrics_count(Metric_Counter_HTTP_Client_Cache_Hits, 1);
+    return HTTP_Client_Cache_Lookup_Fresh;
+}
+
+uint32_t http_client_cache_get_validators(HTTP_Client_Cache *cache, HTTP_Method method, const char *hostname, uint16_t port, const char *path, char *out, uint32_t out_size) {
+    assert(cache != NULL);
+    assert(out != NULL && out_size > 0);
+
+    HTTP_Client_Cache_Shard *shard = http_client_cache_shard_for_thread(cache);
+    if(shard == NULL) {
+        return 0;
+    }
+
+    const HTTP_Client_Cache_Entry *entry = http_client_cache_find(shard, method, hostname, port, path, http_client_cache_hash(method, hostname, port, path));
+    if(entry == NULL) {
+        return 0; // Evicted while the request was connecting.
+    }
+
+    int length = snprintf(out, out_size, "%s%s%s%s%s%s",
+        entry->etag[0] != '\0' ? "If-None-Match: " : "", entry->etag, entry->etag[0] != '\0' ? "\r\n" : "",
+        entry->last_modified[0] != '\0' ? "If-Modified-Since: " : "", entry->last_modified, entry->last_modified[0] != '\0' ? "\r\n" : ""
+    );
+    if(length <= 0 || (uint32_t)length >= out_size) {
+        out[0] = '\0';
+        return 0;
+    }
+    return (uint32_t)length;
+}
+
+typedef struct {
+    bool no_store;
+    bool no_cache;
+    bool has_max_age;
+    uint64_t max_age_s;
+} HTTP_Client_Cache_Control;
+
+// Picks out the directives of a Cache-Control value (NULL for none) we care about. The rest (private, public,
+// must-revalidate, ..) don't change anything for a cache that only ever serves fresh responses to one client.
+static void http_client_cache_parse_cache_control(const char *value, HTTP_Client_Cache_Control *out_control) {
+    memset(out_control, 0, sizeof(HTTP_Client_Cache_Control));
+
+    if(value == NULL) {
+        return;
+    }
+
+    const char *directive = value;
+    while(*directive != '\0') {
+        while(*directive == ' ' || *directive == '\t' || *directive == ',') {
+            directive++;
+        }
+        size_t length = strcspn(directive, ",");
+
+        if(length >= 8 && strncasecmp(directive, "no-store", 8) == 0) {
+            out_control->no_store = true;
+        }
+        else if(length >= 8 && strncasecmp(directive, "no-cache", 8) == 0) {
+            out_control->no_cache = true; // NOTE: 'no-cache="field"' too. We don't strip fields, we revalidate.
+        }
+        else if(length > 8 && strncasecmp(directive, "max-age=", 8) == 0) {
+            char *end = NULL;
+            unsigned long long max_age_s = strtoull(&directive[8], &end, 10);
+            if(end != &directive[8]) {
+                out_control->has_max_age = true;
+                out_control->max_age_s = max_age_s;
+            }
+        }
+
+        directive += length;
+    }
+}
+
+// When a response the server sent just now stops being fresh, given its Cache-Control and Age (NULL for none).
+static uint64_t http_client_cache_expires_ns(const HTTP_Client_Cache_Control *control, const char *age_text, const uint64_t now_ns) {
+    if(control->no_cache || !control->has_max_age) {
+        return now_ns;
+    }
+
+    uint64_t age_s = 0;
+    if(age_text != NULL) {
+        age_s = strtoull(age_text, NULL, 10);
+    }
+    if(age_s >= control->max_age_s) {
+        return now_ns;
+    }
+
+    uint64_t fresh_for_s = control->max_age_s - age_s;
+    if(fresh_for_s > (UINT64_MAX - now_ns) / CLOCK_NS_PER_S) {
+        return UINT64_MAX;
+    }
+    return now_ns + fresh_for_s * CLOCK_NS_PER_S;
+}
+
+// The value of one of the stored response's headers. NULL if it doesn't have it.
+static const char *http_client_cache_entry_header(const HTTP_Client_Cache_Entry *entry, const char *key) {
+    const char *pair = entry->headers;
+    for(uint32_t i = 0; i < entry->header_count; i++) {
+        const char *value = pair + strlen(pair) + 1;
+        if(strcasecmp(pair, key) == 0) { // Header names are case-insensitive.
+            return value;
+        }
+        pair = value + strlen(value) + 1;
+    }
+    return NULL;
+}
+
+static void http_client_cache_copy_validators(HTTP_Client_Cache_Entry *entry, const HTTP_Headers *headers) {
+    const char *value = NULL;
+    if(http_try_get_key_from_header(headers, "ETag", &value)) {
+        snprintf(entry->etag, sizeof(entry->etag), "%s", value);
+    }
+    if(http_try_get_key_from_header(headers, "Last-Modified", &value)) {
+        snprintf(entry->last_modified, sizeof(entry->last_modified), "%s", value);
+    }
+}
+
+static void http_client_cache_store(HTTP_Client_Cache_Shard *shard, HTTP_Method method, const char *hostname, uint16_t port, const char *path, const uint64_t hash, const HTTP *http, const HTTP_Client_Cache_Control *control) {
+    HTTP_Client_Cache_Entry *existing = http_client_cache_find(shard, method, hostname, port, path, hash);
+    if(existing != NULL) {
+        http_client_cache_remove(shard, existing);
+    }
+
+    const char *vary = NULL;
+    if(control->no_store || (http_try_get_key_from_header(&http->headers, "Vary", &vary) && strchr(vary, '*') != NULL)) {
+        return;
+    }
+
+    const char *validator = NULL;
+    const bool has_validator = http_try_get_key_from_header(&http->headers, "ETag", &validator)
+        || http_try_get_key_from_header(&http->headers, "Last-Modified", &validator);
+    if(!has_validator && (!control->has_max_age || control->max_age_s == 0 || control->no_cache)) {
+        return; // It could never be used.
+    }
+
+    size_t hostname_size = strlen(hostname) + 1;
+    size_t path_size = strlen(path) + 1;
+
+    uint32_t headers_size = 0;
+    for(uint32_t i = 0; i < http->headers.header_count; i++) {
+        headers_size += strlen(http->headers.headers[i].key) + 1 + strlen(http->headers.headers[i].value) + 1;
+    }
+
+    const uint64_t body_length = http->body.string_buffer.length;
+    const uint64_t bytes = sizeof(HTTP_Client_Cache_Entry) + hostname_size + path_size + headers_size + body_length;
+    if(bytes > shard->cache->max_entry_bytes) {
+        return;
+    }
+
+    HTTP_Client_Cache_Entry *entry = calloc(1, sizeof(HTTP_Client_Cache_Entry));
+    char *key = malloc(hostname_size + path_size);
+    char *headers = malloc(headers_size > 0 ? headers_size : 1);
+    char *body = malloc(body_length > 0 ? body_length : 1);
+    if(entry == NULL || key == NULL || headers == NULL || body == NULL) {
+        free(entry);
+        free(key);
+        free(headers);
+        free(body);
+        return;
+    }
+
+    memcpy(&key[0], hostname, hostname_size);
+    memcpy(&key[hostname_size], path, path_size);
+
+    char *pair = headers;
+    for(uint32_t i = 0; i < http->headers.header_count; i++) {
+        size_t key_size = strlen(http->headers.headers[i].key) + 1;
+        memcpy(pair, http->headers.headers[i].key, key_size);
+        pair += key_size;
+
+        size_t value_size = strlen(http->headers.headers[i].value) + 1;
+        memcpy(pair, http->headers.headers[i].value, value_size);
+        pair += value_size;
+    }
+
+    if(body_length > 0) {
+        memcpy(body, http->body.string_buffer.data, body_length);
+    }
+
+    const uint64_t now_ns = clock_now_ns();
+
+    entry->method = method;
+    entry->port = port;
+    entry->hostname = key;
+    entry->path = &key[hostname_size];
+    entry->hash = hash;
+    entry->bytes = bytes;
+    const char *age = NULL;
+    http_try_get_key_from_header(&http->headers, "Age", &age);
+    entry->expires_ns = http_client_cache_expires_ns(control, age, now_ns);
+    http_client_cache_copy_validators(entry, &http->headers);
+    entry->status = http->status;
+    entry->encoding = http->body.encoding;
+    entry->has_encoding_set = http->body.has_encoding_set;
+    entry->headers = headers;
+    entry->header_count = http->headers.header_count;
+    entry->body = body;
+    entry->body_length = body_length;
+
+    while(shard->bytes + bytes > shard->cache->max_bytes && shard->least_recent != NULL) {
+        http_client_cache_remove(shard, shard->least_recent);
+    }
+
+    HTTP_Client_Cache_Entry **bucket = &shard->buckets[hash & shard->bucket_mask];
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+    http_client_cache_lru_push(shard, entry);
+    shard->entry_count += 1;
+    shard->bytes += bytes;
+    metrics_gauge_add(Metric_Gauge_HTTP_Client_Cache_Bytes, (int64_t)bytes);
+
+    http_client_cache_maybe_grow(shard);
+}
+
+bool http_client_cache_update(HTTP_Client_Cache *cache, HTTP_Method method, const char *hostname, uint16_t port, const char *path, bool revalidating, HTTP *http) {
+    assert(cache != NULL);
+    assert(http != NULL);
+
+    const int status_code = http->status.status_code;
+
+    HTTP_Client_Cache_Shard *shard = http_client_cache_shard_for_thread(cache);
+    if(shard == NULL) {
+        return !(status_code == 304 && revalidating); // Out of memory. Nothing stored can be reached either.
+    }
+
+    if(method != HTTP_Method_GET) {
+        // Whatever was stored for the path is out of date now.
+        if(status_code >= 200 && status_code < 300) {
+            const uint64_t hash = http_client_cache_hash(HTTP_Method_GET, hostname, port, path);
+            HTTP_Client_Cache_Entry *entry = http_client_cache_find(shard, HTTP_Method_GET, hostname, port, path, hash);
+            if(entry != NULL) {
+                http_client_cache_remove(shard, entry);
+            }
+        }
+        return true;
+    }
+
+    const uint64_t hash = http_client_cache_hash(method, hostname, port, path);
+
+    const char *cache_control = NULL;
+    http_try_get_key_from_header(&http->headers, "Cache-Control", &cache_control);
+    HTTP_Client_Cache_Control control;
+
+    if(status_code == 304 && revalidating) {
+        HTTP_Client_Cache_Entry *entry = http_client_cache_find(shard, method, hostname, port, path, hash);
+        if(entry == NULL) {
+            LOG_DEBUG("'%s%s': Got a 304, but the response it's about was evicted meanwhile.", hostname, path);
+            return false;
+        }
+
+        // NOTE: What the 304 says about freshness wins, and what it leaves out (a 304 needn't repeat Cache-Control) is
+        // still what the stored response said, like updating the stored headers would have it (RFC 9111, section
+        // 4.3.4). The stored headers themselves stay what they were; only freshness and validators are taken over.
+        const char *age = NULL;
+        if(cache_control == NULL) {
+            cache_control = http_client_cache_entry_header(entry, "Cache-Control");
+        }
+        if(!http_try_get_key_from_header(&http->headers, "Age", &age)) {
+            age = http_client_cache_entry_header(entry, "Age");
+        }
+        http_client_cache_parse_cache_control(cache_control, &control);
+        entry->expires_ns = http_client_cache_expires_ns(&control, age, clock_now_ns());
+        http_client_cache_copy_validators(entry, &http->headers);
+
+        const bool copied = http_client_cache_entry_copy_to(entry, http); // Out of memory otherwise.
+        if(copied) {
+            metrics_count(Metric_Counter_HTTP_Client_Cache_Not_Modified, 1);
+        }
+        if(control.no_store) {
+            http_client_cache_remove(shard, entry);
+        }
+        return copied;
+    }
+
+    if(status_code == 200) {
+        http_client_cache_parse_cache_control(cache_control, &control);
+        http_client_cache_store(shard, method, hostname, port, path, hash, http, &control);
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef HTTP_CLIENT_CACHE_H
+#define HTTP_CLIENT_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "http/http.h"
+
+// An in-memory cache of responses, for requests made with HTTP_Client_Request_Options.cache set.
+//
+// Every thread that runs requests keeps its own part of it, so looking something up never needs to synchronize with
+// anyone, and a request only finds what was fetched on the same thread. Responses are keyed by method, hostname, port
+// and path, and each thread holds at most 'max_bytes' of them, least recently used out first.
+//
+// Only complete 200 responses to GETs are stored, and only if they can be reused: they have to say
+// 'Cache-Control: max-age=..', or come with an ETag or Last-Modified to revalidate them by. Never if they say
+// 'Cache-Control: no-store' (which also drops what was stored before) or 'Vary: *'.
+// - A request for a response that's still fresh (younger than its max-age, counting its Age) gets the stored one and
+//   never touches the network.
+// - One for a stale response (or one that said 'no-cache') goes out with If-None-Match and If-Modified-Since. A 304 is
+//   answered with the stored response, which is then fresh again for as long as the 304 says. A 304 that doesn't say
+//   (no Cache-Control or Age of its own) goes by what the stored response said.
+// - A POST or PUT that gets a 2xx drops the stored GET for the same path.
+//
+// What the request sends in HTTP_Client_Request_Options.headers isn't part of the key, so requests whose responses
+// depend on those shouldn't use the cache. 'Expires' isn't looked at, only max-age.
+
+#ifndef HTTP_CLIENT_CACHE_DEFAULT_MAX_BYTES
+#define HTTP_CLIENT_CACHE_DEFAULT_MAX_BYTES (16 * 1024 * 1024) // Per thread.
+#endif
+
+typedef struct {
+    // Per thread, counting bodies, headers and bookkeeping. 0 for HTTP_CLIENT_CACHE_DEFAULT_MAX_BYTES. Responses
+    // bigger than an eighth of this aren't stored, so one big one can't push out everything else.
+    uint64_t max_bytes;
+} HTTP_Client_Cache_Options;
+
+typedef struct HTTP_Client_Cache HTTP_Client_Cache;
+
+// Returns NULL if we're out of memory.
+HTTP_Client_Cache *http_client_cache_create(const HTTP_Client_Cache_Options *options);
+
+// Frees every thread's responses. Only once no request uses it anymore.
+void http_client_cache_destroy(HTTP_Client_Cache *cache);
+
+// The rest is for the HTTP client, which calls it on the thread running the request.
+
+typedef enum {
+    HTTP_Client_Cache_Lookup_Miss = 0,
+    HTTP_Client_Cache_Lookup_Stale, // Worth asking for conditionally. See http_client_cache_get_validators(..).
+    HTTP_Client_Cache_Lookup_Fresh, // The stored response is in 'out_http'.
+} HTTP_Client_Cache_Lookup;
+
+// Looks for a stored response. If it's fresh it's copied into 'out_http', which the caller disposes of like any
+// parsed response; if that copy can't be made it counts as a miss.
+HTTP_Client_Cache_Lookup http_client_cache_lookup(HTTP_Client_Cache *cache, HTTP_Method method, const char *hostname, uint16_t port, const char *path, HTTP *out_http);
+
+// Writes the If-None-Match and If-Modified-Since header lines for the stored response into 'out', null-terminated.
+// Returns their length, or 0 if nothing is stored (anymore) or they don't fit.
+uint32_t http_client_cache_get_validators(HTTP_Client_Cache *cache, HTTP_Method method, const char *hostname, uint16_t port, const char *path, char *out, uint32_t out_size);
+
+// Stores, refreshes or drops what's stored, depending on the complete response 'http' the request got. If the request
+// was 'revalidating' (sent the validators) and got a 304, that's replaced in place by the stored response. Returns false
+// if it can't be, because nothing is stored for it anymore (evicted while the request was out) or we're out of memory:
+// the 304 is then no answer to what the caller asked, and the request has to fail.
+bool http_client_cache_update(HTTP_Client_Cache *cache, HTTP_Method method, const char *hostname, uint16_t port, const char *path, bool revalidating, HTTP *http);
+
+#endif
@@ -0,0 +1,142 @@
+#include "http_client_coalesce.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert((HTTP_CLIENT_COALESCE_BUCKETS & (HTTP_CLIENT_COALESCE_BUCKETS - 1)) == 0, "HTTP_CLIENT_COALESCE_BUCKETS must be a power of two.");
+
+// Allocated the first time a thread begins a flight, and kept for as long as the thread lives.
+static __thread HTTP_Client_Flight **http_client_flights_of_this_thread;
+
+HTTP_Client_Shared_Response *http_client_shared_response_create(HTTP_Parser *http_parser, uint32_t references) {
+    assert(references > 0);
+
+    HTTP_Client_Shared_Response *shared = calloc(1, sizeof(HTTP_Client_Shared_Response));
+    if(shared == NULL) {
+        return NULL;
+    }
+
+    shared->http_parser = http_parser;
+    shared->references = references;
+    return shared;
+}
+
+void http_client_shared_response_release(HTTP_Client_Shared_Response *shared) {
+    assert(shared != NULL);
+
+    if(__atomic_sub_fetch(&shared->references, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+
+    if(shared->http_parser != NULL) {
+        http_dispose(&shared->http_parser->http);
+        http_parser_dispose(shared->http_parser);
+        free(shared->http_parser);
+    }
+    free(shared);
+}
+
+static inline uint64_t http_client_flight_hash_bytes(uint64_t hash, const void *data, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+        hash ^= ((const uint8_t *)data)[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t http_client_flight_hash(const Worker *worker, const char *hostname, uint16_t port, const char *path) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a.
+    hash = http_client_flight_hash_bytes(hash, &worker, sizeof(worker));
+    hash = http_client_flight_hash_bytes(hash, &port, sizeof(port));
+    hash = http_client_flight_hash_bytes(hash, hostname, strlen(hostname) + 1); // With the '\0', so "ab"+"c" isn't "a"+"bc".
+    hash = http_client_flight_hash_bytes(hash, path, strlen(path));
+    return hash;
+}
+
+HTTP_Client_Flight *http_client_flight_find(Worker *worker, const char *hostname, uint16_t port, const char *path) {
+    if(http_client_flights_of_this_thread == NULL) {
+        return NULL;
+    }
+
+    const uint64_t hash = http_client_flight_hash(worker, hostname, port, path);
+    for(HTTP_Client_Flight *flight = http_client_flights_of_this_thread[hash & (HTTP_CLIENT_COALESCE_BUCKETS - 1)]; flight != NULL; flight = flight->next) {
+        if(flight->hash == hash && flight->worker == worker && flight->port == port && strcmp(flight->hostname, hostname) == 0 && strcmp(flight->path, path) == 0) {
+            return flight;
+        }
+    }
+    return NULL;
+}
+
+HTTP_Client_Flight *http_client_flight_begin(Worker *worker, const char *hostname, uint16_t port, const char *path) {
+    assert(http_client_flight_find(worker, hostname, port, path) == NULL);
+
+    if(http_client_flights_of_this_thread == NULL) {
+        http_client_flights_of_this_thread = calloc(HTTP_CLIENT_COALESCE_BUCKETS, sizeof(HTTP_Client_Flight *));
+        if(http_client_flights_of_this_thread == NULL) {
+            return NULL;
+        }
+    }
+
+    HTTP_Client_Flight *flight = calloc(1, sizeof(HTTP_Client_Flight));
+    if(flight == NULL) {
+        return NULL;
+    }
+
+    flight->worker = worker;
+    flight->hostname = hostname;
+    flight->path = path;
+    flight->port = port;
+    flight->hash = http_client_flight_hash(worker, hostname, port, path);
+
+    HTTP_Client_Flight **bucket = &http_client_flights_of_this_thread[flight->hash & (HTTP_CLIENT_COALESCE_BUCKETS - 1)];
+    flight->next = *bucket;
+    *bucket = flight;
+    return flight;
+}
+
+bool http_client_flight_add_waiter(HTTP_Client_Flight *flight, const Worker_Task_Handle waiter) {
+    assert(flight != NULL);
+
+    if(flight->waiter_count == flight->waiter_capacity) {
+        uint32_t capacity = flight->waiter_capacity > 0 ? flight->waiter_capacity * 2 : 4;
+        Worker_Task_Handle *waiters = realloc(flight->waiters, capacity * sizeof(Worker_Task_Handle));
+        if(waiters == NULL) {
+            return false;
+        }
+        flight->waiters = waiters;
+        flight->waiter_capacity = capacity;
+    }
+
+    flight->waiters[flight->waiter_count] = waiter;
+    flight->waiter_count += 1;
+    return true;
+}
+
+void http_client_flight_remove_waiter(HTTP_Client_Flight *flight, const Worker_Task_Handle waiter) {
+    assert(flight != NULL);
+
+    for(uint32_t i = 0; i < flight->waiter_count; i++) {
+        if(flight->waiters[i].index == waiter.index && flight->waiters[i].generation == waiter.generation) {
+            flight->waiters[i] = flight->waiters[flight->waiter_count - 1];
+            flight->waiter_count -= 1;
+            return;
+        }
+    }
+    assert(false); // Not one of its waiters.
+}
+
+void http_client_flight_end(HTTP_Client_Flight *flight) {
+    assert(flight != NULL);
+    assert(http_client_flights_of_this_thread != NULL);
+
+    HTTP_Client_Flight **link = &http_client_flights_of_this_thread[flight->hash & (HTTP_CLIENT_COALESCE_BUCKETS - 1)];
+    while(*link != flight) {
+        assert(*link != NULL);
+        link = &(*link)->next;
+    }
+    *link = flight->next;
+
+    free(flight->waiters);
+    free(flight);
+}
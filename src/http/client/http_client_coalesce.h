@@ -0,0 +1,76 @@
+#ifndef HTTP_CLIENT_COALESCE_H
+#define HTTP_CLIENT_COALESCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "worker/worker.h"
+#include "http/http.h"
+#include "http/client/http_client_stats.h"
+
+// Single-flight for GETs, for requests made with HTTP_Client_Request_Options.coalesce set.
+//
+// The first such request for a hostname, port and path on a worker is a "flight". Identical ones that start on the
+// same worker while it's in flight don't make requests of their own; they wait for it. Once it's done every one of
+// them gets its result, whatever that is, including failures. The response is shared by all of them rather than
+// copied, so it has to be treated as read-only, and it's freed when the last of them lets go of it.
+//
+// If the request in flight is cancelled, the ones waiting for it aren't: one of them makes the request instead, and
+// the others wait for that one.
+//
+// Flights are kept per thread, like everything else the worker running them has, so nothing here is ever shared
+// between threads except the response. That's handed out with references that are safe to drop from any thread, since
+// completion queues carry it to other threads.
+
+#ifndef HTTP_CLIENT_COALESCE_BUCKETS
+#define HTTP_CLIENT_COALESCE_BUCKETS 256 // Per thread. Must be a power of two.
+#endif
+
+// A response (or the lack of one) handed to several requests.
+typedef struct {
+    HTTP_Parser *http_parser; // Holds the response. NULL if there was none.
+
+    // How far the request that got it came, and why it stopped there. See HTTP_Client_Completion.
+    HTTP_Client_Phase phases_completed;
+    uint64_t phase_end_ns[HTTP_Client_Phase_Total]; // On clock_now_ns(), for the ones it completed.
+    uint8_t socket_result; // TCP_Socket_Result.
+    uint8_t parse_result;  // HTTP_Parse_Result.
+
+    uint32_t references;
+} HTTP_Client_Shared_Response;
+
+// Takes over 'http_parser' (which may be NULL). Returns NULL if we're out of memory, in which case it doesn't.
+HTTP_Client_Shared_Response *http_client_shared_response_create(HTTP_Parser *http_parser, uint32_t references);
+
+// Safe from any thread. Frees the response with the last reference.
+void http_client_shared_response_release(HTTP_Client_Shared_Response *shared);
+
+typedef struct HTTP_Client_Flight HTTP_Client_Flight;
+struct HTTP_Client_Flight {
+    Worker *worker;
+    const char *hostname; // Borrowed from the request in flight, which outlives the flight.
+    const char *path;
+    uint16_t port;
+    uint64_t hash;
+
+    Worker_Task_Handle *waiters;
+    uint32_t waiter_count;
+    uint32_t waiter_capacity;
+
+    HTTP_Client_Flight *next; // In its bucket.
+};
+
+// The flight for this request on the calling thread, if there is one.
+HTTP_Client_Flight *http_client_flight_find(Worker *worker, const char *hostname, uint16_t port, const char *path);
+
+// Registers a new flight. There mustn't already be one. Returns NULL if we're out of memory.
+HTTP_Client_Flight *http_client_flight_begin(Worker *worker, const char *hostname, uint16_t port, const char *path);
+
+// Returns false if we're out of memory.
+bool http_client_flight_add_waiter(HTTP_Client_Flight *flight, const Worker_Task_Handle waiter);
+void http_client_flight_remove_waiter(HTTP_Client_Flight *flight, const Worker_Task_Handle waiter);
+
+// Unregisters and frees the flight. Whoever was waiting for it should have been dealt with by now.
+void http_client_flight_end(HTTP_Client_Flight *flight);
+
+#endif
@@ -0,0 +1,310 @@
+#include "http_client_sink.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef enum {
+    HTTP_Client_Sink_State_Idle = 0, // Not streaming (yet).
+    HTTP_Client_Sink_State_Identity,
+
+    // Chunked (RFC 9112, section 7.1): '<hex size>[;extensions]\r\n<data>\r\n' until a size of 0, then trailer lines
+    // and an empty line.
+    HTTP_Client_Sink_State_Chunk_Size,
+    HTTP_Client_Sink_State_Chunk_Extension,
+    HTTP_Client_Sink_State_Chunk_Size_LF,
+    HTTP_Client_Sink_State_Chunk_Data,
+    HTTP_Client_Sink_State_Chunk_Data_CR,
+    HTTP_Client_Sink_State_Chunk_Data_LF,
+    HTTP_Client_Sink_State_Trailer_Line_Start,
+    HTTP_Client_Sink_State_Trailer_Line,
+    HTTP_Client_Sink_State_Trailer_Line_LF,
+    HTTP_Client_Sink_State_Trailer_End_LF,
+
+    HTTP_Client_Sink_State_Done,
+} HTTP_Client_Sink_State;
+
+void http_client_sink_init(HTTP_Client_Sink *sink, int fd, uint64_t offset) {
+    assert(sink != NULL);
+    assert(fd >= 0);
+
+    memset(sink, 0, sizeof(HTTP_Client_Sink));
+    sink->fd = fd;
+    sink->offset = offset;
+}
+
+bool http_client_sink_wants(const HTTP_Status *status) {
+    return status->status_code >= 200 && status->status_code < 300 && status->status_code != 204;
+}
+
+// Writes out what's staged. Returns false if that didn't work out, with 'error' saying why.
+static bool http_client_sink_flush(HTTP_Client_Sink *sink) {
+    uint32_t written_so_far = 0;
+    while(written_so_far < sink->staged) {
+        ssize_t written = pwrite(sink->fd, &sink->staging[written_so_far], sink->staged - written_so_far, (off_t)(sink->offset + sink->bytes_written));
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            sink->error = errno;
+            return false;
+        }
+        written_so_far += (uint32_t)written;
+        sink->bytes_written += (uint64_t)written;
+    }
+    sink->staged = 0;
+
+    if(sink->sync == HTTP_Client_Sink_Sync_Every_Write && written_so_far > 0 && fdatasync(sink->fd) != 0) {
+        sink->error = errno;
+        return false;
+    }
+    return true;
+}
+
+static HTTP_Client_Sink_Result http_client_sink_finish(HTTP_Client_Sink *sink) {
+    if(!http_client_sink_flush(sink)) {
+        return HTTP_Client_Sink_Result_Failed_To_Write;
+    }
+    if(sink->sync == HTTP_Client_Sink_Sync_At_End && fdatasync(sink->fd) != 0) {
+        sink->error = errno;
+        return HTTP_Client_Sink_Result_Failed_To_Write;
+    }
+
+    sink->state = HTTP_Client_Sink_State_Done;
+    http_client_sink_release(sink); // Not needed anymore, even if the request has some way to go.
+    return HTTP_Client_Sink_Result_Done;
+}
+
+HTTP_Client_Sink_Result http_client_sink_begin(HTTP_Client_Sink *sink, const HTTP_Headers *headers) {
+    assert(sink->state == HTTP_Client_Sink_State_Idle);
+    assert(sink->staging == NULL);
+
+    const char *encoding = NULL;
+    const char *content_length_text = NULL;
+    if(http_try_get_key_from_header(headers, "Transfer-Encoding", &encoding) && strcmp(encoding, "identity") != 0) {
+        if(strcmp(encoding, "chunked") != 0) {
+            return HTTP_Client_Sink_Result_Invalid_Data; // Same as the parser.
+        }
+        sink->state = HTTP_Client_Sink_State_Chunk_Size;
+    }
+    else if(http_try_get_key_from_header(headers, "Content-Length", &content_length_text)) {
+        char *end = NULL;
+        errno = 0;
+        sink->remaining = strtoull(content_length_text, &end, 10);
+        if(errno != 0 || end == content_length_text || *end != '\0' || content_length_text[0] == '-') {
+            return HTTP_Client_Sink_Result_Invalid_Data;
+        }
+        if(sink->max_bytes > 0 && sink->remaining > sink->max_bytes) {
+            return HTTP_Client_Sink_Result_Invalid_Data;
+        }
+        if(sink->remaining == 0) {
+            return http_client_sink_finish(sink);
+        }
+        sink->state = HTTP_Client_Sink_State_Identity;
+    }
+    else {
+        return HTTP_Client_Sink_Result_Invalid_Data; // It would have to be read until the connection closes.
+    }
+
+    if(sink->staging_bytes == 0) {
+        sink->staging_bytes = HTTP_CLIENT_SINK_DEFAULT_STAGING_BYTES;
+    }
+    sink->staging = malloc(sink->staging_bytes);
+    if(sink->staging == NULL) {
+        sink->error = ENOMEM;
+        return HTTP_Client_Sink_Result_Failed_To_Write;
+    }
+    return HTTP_Client_Sink_Result_Needs_More_Data;
+}
+
+char *http_client_sink_reserve(HTTP_Client_Sink *sink, uint32_t *out_size) {
+    if(sink->state != HTTP_Client_Sink_State_Identity) {
+        return NULL;
+    }
+    assert(sink->staged < sink->staging_bytes); // Flushed when it fills up.
+
+    // Never past the end of the body, so nothing that comes after it is read into the file.
+    uint64_t size = sink->staging_bytes - sink->staged;
+    if(size > sink->remaining) {
+        size = sink->remaining;
+    }
+    *out_size = (uint32_t)size;
+    return &sink->staging[sink->staged];
+}
+
+HTTP_Client_Sink_Result http_client_sink_commit(HTTP_Client_Sink *sink, uint32_t length) {
+    assert(sink->state == HTTP_Client_Sink_State_Identity);
+    assert(length <= sink->remaining && sink->staged + length <= sink->staging_bytes);
+
+    sink->staged += length;
+    sink->remaining -= length;
+    if(sink->remaining == 0) {
+        return http_client_sink_finish(sink);
+    }
+    if(sink->staged == sink->staging_bytes && !http_client_sink_flush(sink)) {
+        return HTTP_Client_Sink_Result_Failed_To_Write;
+    }
+    return HTTP_Client_Sink_Result_Needs_More_Data;
+}
+
+// Copies body bytes into the staging buffer, writing it out as it fills up.
+static bool http_client_sink_stage(HTTP_Client_Sink *sink, const char *data, uint64_t length) {
+    while(length > 0) {
+        uint64_t room = sink->staging_bytes - sink->staged;
+        uint64_t amount = length < room ? length : room;
+        memcpy(&sink->staging[sink->staged], data, amount);
+        sink->staged += (uint32_t)amount;
+        data += amount;
+        length -= amount;
+
+        if(sink->staged == sink->staging_bytes && !http_client_sink_flush(sink)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline int http_client_sink_hex_digit(char c) {
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool http_client_sink_streaming(const HTTP_Client_Sink *sink) {
+    return sink->state != HTTP_Client_Sink_State_Idle;
+}
+
+HTTP_Client_Sink_Result http_client_sink_take(HTTP_Client_Sink *sink, const char *data, uint64_t length) {
+    assert(sink->state != HTTP_Client_Sink_State_Idle && sink->state != HTTP_Client_Sink_State_Done);
+
+    if(sink->state == HTTP_Client_Sink_State_Identity) {
+        uint64_t amount = length < sink->remaining ? length : sink->remaining;
+        if(!http_client_sink_stage(sink, data, amount)) {
+            return HTTP_Client_Sink_Result_Failed_To_Write;
+        }
+        sink->remaining -= amount;
+        return sink->remaining == 0 ? http_client_sink_finish(sink) : HTTP_Client_Sink_Result_Needs_More_Data;
+    }
+
+    // NOTE: One byte at a time, except for chunk data, so sizes and line breaks split between reads need no
+    // special care.
+    for(uint64_t i = 0; i < length; i++) {
+        const char c = data[i];
+
+        switch(sink->state) {
+            case HTTP_Client_Sink_State_Chunk_Size: {
+                int digit = http_client_sink_hex_digit(c);
+                if(digit >= 0) {
+                    if(sink->digits == 15) {
+                        return HTTP_Client_Sink_Result_Invalid_Data; // Nobody sends 2^60 bytes.
+                    }
+                    sink->remaining = sink->remaining * 16 + (uint64_t)digit;
+                    sink->digits += 1;
+                }
+                else if(sink->digits > 0 && (c == ';' || c == ' ' || c == '\t')) {
+                    sink->state = HTTP_Client_Sink_State_Chunk_Extension;
+                }
+                else if(sink->digits > 0 && c == '\r') {
+                    sink->state = HTTP_Client_Sink_State_Chunk_Size_LF;
+                }
+                else {
+                    return HTTP_Client_Sink_Result_Invalid_Data;
+                }
+                break;
+            }
+            case HTTP_Client_Sink_State_Chunk_Extension: {
+                if(c == '\r') {
+                    sink->state = HTTP_Client_Sink_State_Chunk_Size_LF;
+                }
+                break;
+            }
+            case HTTP_Client_Sink_State_Chunk_Size_LF: {
+                if(c != '\n') {
+                    return HTTP_Client_Sink_Result_Invalid_Data;
+                }
+                if(sink->remaining == 0) {
+                    sink->state = HTTP_Client_Sink_State_Trailer_Line_Start;
+                    break;
+                }
+                if(sink->max_bytes > 0 && sink->bytes_written + sink->staged + sink->remaining > sink->max_bytes) {
+                    return HTTP_Client_Sink_Result_Invalid_Data;
+                }
+                sink->state = HTTP_Client_Sink_State_Chunk_Data;
+                break;
+            }
+            case HTTP_Client_Sink_State_Chunk_Data: {
+                uint64_t available = length - i;
+                uint64_t amount = available < sink->remaining ? available : sink->remaining;
+                if(!http_client_sink_stage(sink, &data[i], amount)) {
+                    return HTTP_Client_Sink_Result_Failed_To_Write;
+                }
+                sink->remaining -= amount;
+                i += amount - 1; // The loop adds the last one.
+
+                if(sink->remaining == 0) {
+                    sink->state = HTTP_Client_Sink_State_Chunk_Data_CR;
+                }
+                break;
+            }
+            case HTTP_Client_Sink_State_Chunk_Data_CR: {
+                if(c != '\r') {
+                    return HTTP_Client_Sink_Result_Invalid_Data;
+                }
+                sink->state = HTTP_Client_Sink_State_Chunk_Data_LF;
+                break;
+            }
+            case HTTP_Client_Sink_State_Chunk_Data_LF: {
+                if(c != '\n') {
+                    return HTTP_Client_Sink_Result_Invalid_Data;
+                }
+                sink->digits = 0;
+                sink->state = HTTP_Client_Sink_State_Chunk_Size;
+                break;
+            }
+            case HTTP_Client_Sink_State_Trailer_Line_Start: {
+                sink->state = c == '\r' ? HTTP_Client_Sink_State_Trailer_End_LF : HTTP_Client_Sink_State_Trailer_Line;
+                break;
+            }
+            case HTTP_Client_Sink_State_Trailer_Line: {
+                if(c == '\r') {
+                    sink->state = HTTP_Client_Sink_State_Trailer_Line_LF;
+                }
+                break;
+            }
+            case HTTP_Client_Sink_State_Trailer_Line_LF: {
+                if(c != '\n') {
+                    return HTTP_Client_Sink_Result_Invalid_Data;
+                }
+                sink->state = HTTP_Client_Sink_State_Trailer_Line_Start;
+                break;
+            }
+            case HTTP_Client_Sink_State_Trailer_End_LF: {
+                if(c != '\n') {
+                    return HTTP_Client_Sink_Result_Invalid_Data;
+                }
+                return http_client_sink_finish(sink); // Whatever comes after the response isn't ours.
+            }
+            default: {
+                assert(false);
+                return HTTP_Client_Sink_Result_Invalid_Data;
+            }
+        }
+    }
+
+    return HTTP_Client_Sink_Result_Needs_More_Data;
+}
+
+void http_client_sink_release(HTTP_Client_Sink *sink) {
+    free(sink->staging);
+    sink->staging = NULL;
+    sink->staged = 0;
+}
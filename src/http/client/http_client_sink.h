@@ -0,0 +1,90 @@
+#ifndef HTTP_CLIENT_SINK_H
+#define HTTP_CLIENT_SINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "http/http.h"
+
+// Streams a response's body into a file as it arrives, for requests made with HTTP_Client_Request_Options.sink set,
+// instead of keeping it in memory until the response is complete.
+//
+// The body is decoded (chunks are put back together) into a fixed-size staging buffer, which is written out with
+// pwrite(..) whenever it fills up. However big the body is, the request holds that buffer and at most one read's worth
+// of what came off the socket. Identity-encoded bodies are read from the socket straight into the staging buffer.
+// Writes go to 'offset' onwards rather than to the fd's file position, so several requests can fill different parts
+// of one file at the same time.
+//
+// Only bodies of 2xx responses go to the file. Any other response is kept in memory like always, so an error page
+// never ends up in the file. For those that do, the response is handed over with its status and headers and an empty
+// body. Like the parser, only bodies with a Content-Length or 'Transfer-Encoding: chunked' can be streamed.
+//
+// If a write (or fsync) fails, the request fails without a complete response, and 'error' says why.
+
+#ifndef HTTP_CLIENT_SINK_DEFAULT_STAGING_BYTES
+#define HTTP_CLIENT_SINK_DEFAULT_STAGING_BYTES (256 * 1024)
+#endif
+
+typedef enum {
+    HTTP_Client_Sink_Sync_None = 0,    // Leave it to the kernel.
+    HTTP_Client_Sink_Sync_At_End,      // fdatasync(..) once the whole body is written, before the request completes.
+    HTTP_Client_Sink_Sync_Every_Write, // After every write, so no more than a staging buffer's worth is ever lost.
+} HTTP_Client_Sink_Sync;
+
+typedef struct {
+    // Set these (see http_client_sink_init(..)).
+    int fd;
+    uint64_t offset;        // Where the body starts in the file.
+    uint64_t max_bytes;     // Bodies bigger than this fail the request, before anything is written if it's known up
+                            // front. 0 for no limit.
+    uint32_t staging_bytes; // 0 for HTTP_CLIENT_SINK_DEFAULT_STAGING_BYTES.
+    HTTP_Client_Sink_Sync sync;
+
+    // What came of it, once the request is done.
+    uint64_t bytes_written;
+    int error; // errno of the write or sync that failed. 0 if none did.
+
+    // The client's, while the body streams in.
+    char *staging;
+    uint32_t staged;
+    uint8_t state;      // HTTP_Client_Sink_State.
+    uint64_t remaining; // Of the body if it's identity-encoded, or else of the current chunk.
+    uint32_t digits;    // Of the current chunk's size.
+} HTTP_Client_Sink;
+
+// A sink for one request, writing from 'offset' in 'fd' on, without syncing. Has to outlive the request, and can't
+// be shared with another one.
+void http_client_sink_init(HTTP_Client_Sink *sink, int fd, uint64_t offset);
+
+// The rest is for the HTTP client.
+
+typedef enum {
+    HTTP_Client_Sink_Result_Needs_More_Data,
+    HTTP_Client_Sink_Result_Done,           // The whole body is written (and synced, if it should be).
+    HTTP_Client_Sink_Result_Invalid_Data,   // Broken chunks, or more than 'max_bytes'.
+    HTTP_Client_Sink_Result_Failed_To_Write, // See 'error'.
+} HTTP_Client_Sink_Result;
+
+// Whether the body of a response that starts like this goes to the sink.
+bool http_client_sink_wants(const HTTP_Status *status);
+
+// Starts streaming the body of a response with these headers. Returns Invalid_Data if it can't be streamed, and Done
+// right away if it's empty.
+HTTP_Client_Sink_Result http_client_sink_begin(HTTP_Client_Sink *sink, const HTTP_Headers *headers);
+
+// Where the next read from the socket can go straight into the staging buffer, and how much of it. NULL unless the
+// body is identity-encoded and still coming; otherwise the bytes read go through http_client_sink_take(..).
+char *http_client_sink_reserve(HTTP_Client_Sink *sink, uint32_t *out_size);
+HTTP_Client_Sink_Result http_client_sink_commit(HTTP_Client_Sink *sink, uint32_t length);
+
+// Decodes and stages 'length' bytes of the body as they came off the socket. Bytes past the end of the body are
+// ignored.
+HTTP_Client_Sink_Result http_client_sink_take(HTTP_Client_Sink *sink, const char *data, uint64_t length);
+
+// Whether http_client_sink_begin(..) was called, i.e. the body is the sink's rather than the parser's.
+bool http_client_sink_streaming(const HTTP_Client_Sink *sink);
+
+// Frees the staging buffer, whether or not the body was all there. Whatever was staged and not written is dropped.
+void http_client_sink_release(HTTP_Client_Sink *sink);
+
+#endif
@@ -0,0 +1,177 @@
+#include "http_client_stats.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log/log.h"
+
+static const char *http_client_phase_names[HTTP_Client_Phase_Count] = {
+    [HTTP_Client_Phase_DNS]                = "DNS",
+    [HTTP_Client_Phase_Connect]            = "Connect",
+    [HTTP_Client_Phase_Request_Write]      = "Request write",
+    [HTTP_Client_Phase_Time_To_First_Byte] = "Time to first byte",
+    [HTTP_Client_Phase_Body_Transfer]      = "Body transfer",
+    [HTTP_Client_Phase_Total]              = "Total",
+};
+
+static __thread HTTP_Client_Stats *http_client_stats_of_this_thread;
+static HTTP_Client_Stats *http_client_stats_of_all_threads; // Pushed onto, never taken from.
+
+const char *http_client_phase_name(const HTTP_Client_Phase phase) {
+    assert(phase < HTTP_Client_Phase_Count);
+    return http_client_phase_names[phase];
+}
+
+static HTTP_Client_Stats *http_client_stats_for_this_thread(void) {
+    if(http_client_stats_of_this_thread != NULL) {
+        return http_client_stats_of_this_thread;
+    }
+
+    HTTP_Client_Stats *stats = calloc(1, sizeof(HTTP_Client_Stats));
+    if(stats == NULL) {
+        return NULL;
+    }
+
+    stats->next_thread = __atomic_load_n(&http_client_stats_of_all_threads, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&http_client_stats_of_all_threads, &stats->next_thread, stats, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // 'next_thread' got updated to the new head. Try again.
+    }
+
+    http_client_stats_of_this_thread = stats;
+    return stats;
+}
+
+// Only the thread that owns 'stats' may create hosts in it. Other threads only ever look at the first 'host_count'
+// hosts, so a host is fully set up before the count that makes it visible goes up.
+static HTTP_Client_Host_Stats *http_client_stats_find_host(HTTP_Client_Stats *stats, const char *hostname) {
+    uint32_t host_count = stats->host_count;
+    for(uint32_t i = 0; i < host_count; i++) {
+        if(strncmp(stats->hosts[i]->hostname, hostname, HTTP_CLIENT_STATS_HOSTNAME_SIZE - 1) == 0) {
+            return stats->hosts[i];
+        }
+    }
+
+    if(host_count >= HTTP_CLIENT_STATS_MAX_HOSTS) {
+        return NULL;
+    }
+
+    HTTP_Client_Host_Stats *host = calloc(1, sizeof(HTTP_Client_Host_Stats));
+    if(host == NULL) {
+        return NULL;
+    }
+    strncpy(host->hostname, hostname, HTTP_CLIENT_STATS_HOSTNAME_SIZE - 1);
+
+    stats->hosts[host_count] = host;
+    __atomic_store_n(&stats->host_count, host_count + 1, __ATOMIC_RELEASE);
+    return host;
+}
+
+static inline void http_client_stats_bump(uint64_t *counter, uint64_t amount) {
+    // NOTE: Single writer, see histogram.c.
+    __atomic_store_n(counter, *counter + amount, __ATOMIC_RELAXED);
+}
+
+void http_client_stats_record(const char *hostname, const HTTP_Client_Timings *timings) {
+    assert(hostname != NULL);
+    assert(timings != NULL);
+
+    HTTP_Client_Stats *stats = http_client_stats_for_this_thread();
+    if(stats == NULL) {
+        return;
+    }
+
+    HTTP_Client_Host_Stats *host = http_client_stats_find_host(stats, hostname);
+    if(host == NULL) {
+        http_client_stats_bump(&stats->requests_to_other_hosts, 1);
+        return;
+    }
+
+    for(uint32_t phase = 0; phase < (uint32_t)timings->phases_completed; phase++) {
+        histogram_record(&host->phases[phase], timings->duration_us[phase]);
+    }
+
+    if(timings->phases_completed == HTTP_Client_Phase_Total) {
+        histogram_record(&host->phases[HTTP_Client_Phase_Total], timings->duration_us[HTTP_Client_Phase_Total]);
+    }
+    else {
+        http_client_stats_bump(&host->failures, 1);
+    }
+}
+
+void http_client_stats_merge(HTTP_Client_Stats *into, const HTTP_Client_Stats *from) {
+    assert(into != NULL);
+    assert(from != NULL);
+
+    uint32_t host_count = __atomic_load_n(&from->host_count, __ATOMIC_ACQUIRE);
+    for(uint32_t i = 0; i < host_count; i++) {
+        const HTTP_Client_Host_Stats *from_host = from->hosts[i];
+        uint64_t failures = __atomic_load_n(&from_host->failures, __ATOMIC_RELAXED);
+
+        HTTP_Client_Host_Stats *into_host = http_client_stats_find_host(into, from_host->hostname);
+        if(into_host == NULL) {
+            into->requests_to_other_hosts += __atomic_load_n(&from_host->phases[HTTP_Client_Phase_Total].total_count, __ATOMIC_RELAXED) + failures;
+            continue;
+        }
+
+        for(uint32_t phase = 0; phase < HTTP_Client_Phase_Count; phase++) {
+            histogram_merge(&into_host->phases[phase], &from_host->phases[phase]);
+        }
+        into_host->failures += failures;
+    }
+
+    into->requests_to_other_hosts += __atomic_load_n(&from->requests_to_other_hosts, __ATOMIC_RELAXED);
+}
+
+void http_client_stats_collect(HTTP_Client_Stats *into) {
+    assert(into != NULL);
+
+    HTTP_Client_Stats *stats = __atomic_load_n(&http_client_stats_of_all_threads, __ATOMIC_ACQUIRE);
+    for(; stats != NULL; stats = stats->next_thread) {
+        http_client_stats_merge(into, stats);
+    }
+}
+
+void http_client_stats_print(const HTTP_Client_Stats *stats) {
+    assert(stats != NULL);
+
+    for(uint32_t i = 0; i < stats->host_count; i++) {
+        const HTTP_Client_Host_Stats *host = stats->hosts[i];
+        LOG_INFO("'%s': %llu completed, %llu failed.",
+            host->hostname,
+            (unsigned long long)host->phases[HTTP_Client_Phase_Total].total_count,
+            (unsigned long long)host->failures
+        );
+
+        for(uint32_t phase = 0; phase < HTTP_Client_Phase_Count; phase++) {
+            const Histogram *histogram = &host->phases[phase];
+            if(histogram->total_count == 0) {
+                continue;
+            }
+
+            LOG_INFO("    %-18s mean %8llu us, p50 %8llu us, p90 %8llu us, p99 %8llu us, p99.9 %8llu us, max %8llu us.",
+                http_client_phase_names[phase],
+                (unsigned long long)histogram_mean(histogram),
+                (unsigned long long)histogram_value_at_percentile(histogram, 50.0),
+                (unsigned long long)histogram_value_at_percentile(histogram, 90.0),
+                (unsigned long long)histogram_value_at_percentile(histogram, 99.0),
+                (unsigned long long)histogram_value_at_percentile(histogram, 99.9),
+                (unsigned long long)histogram->max
+            );
+        }
+    }
+
+    if(stats->requests_to_other_hosts > 0) {
+        LOG_INFO("%llu requests to hosts past the first %i.", (unsigned long long)stats->requests_to_other_hosts, HTTP_CLIENT_STATS_MAX_HOSTS);
+    }
+}
+
+void http_client_stats_dispose(HTTP_Client_Stats *stats) {
+    assert(stats != NULL);
+
+    for(uint32_t i = 0; i < stats->host_count; i++) {
+        free(stats->hosts[i]);
+    }
+    memset(stats, 0, sizeof(HTTP_Client_Stats));
+}
@@ -0,0 +1,75 @@
+#ifndef HTTP_CLIENT_STATS_H
+#define HTTP_CLIENT_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "histogram/histogram.h"
+
+// The phases of a request, in the order it goes through them.
+typedef enum {
+    HTTP_Client_Phase_DNS,                // Resolving the hostname.
+    HTTP_Client_Phase_Connect,            // From resolved to connected, including addresses that didn't work out.
+    HTTP_Client_Phase_Request_Write,      // From connected to the whole request handed to the kernel.
+    HTTP_Client_Phase_Time_To_First_Byte, // From the request written to the first byte of the response.
+    HTTP_Client_Phase_Body_Transfer,      // From the first byte to the complete response.
+
+    HTTP_Client_Phase_Total,              // The whole thing, from when the request first ran on its worker.
+
+    HTTP_Client_Phase_Count
+} HTTP_Client_Phase;
+
+// How long a request spent in each phase, in microseconds on clock_now_ns()'s clock.
+typedef struct {
+    uint64_t duration_us[HTTP_Client_Phase_Count];
+
+    // Phases before this one finished; the rest have a duration of 0. HTTP_Client_Phase_Total if the request went all
+    // the way. 'duration_us[HTTP_Client_Phase_Total]' is always set.
+    HTTP_Client_Phase phases_completed;
+} HTTP_Client_Timings;
+
+// E.g. "Time to first byte". Lives forever.
+const char *http_client_phase_name(const HTTP_Client_Phase phase);
+
+#ifndef HTTP_CLIENT_STATS_MAX_HOSTS
+#define HTTP_CLIENT_STATS_MAX_HOSTS 64 // Requests to hosts beyond this are only counted in 'requests_to_other_hosts'.
+#endif
+
+#ifndef HTTP_CLIENT_STATS_HOSTNAME_SIZE
+#define HTTP_CLIENT_STATS_HOSTNAME_SIZE 128 // Longer hostnames are cut off, and share stats if they start the same.
+#endif
+
+typedef struct {
+    char hostname[HTTP_CLIENT_STATS_HOSTNAME_SIZE];
+
+    Histogram phases[HTTP_Client_Phase_Count]; // Microseconds. Only phases that completed are recorded.
+    uint64_t failures; // Requests that didn't get a complete response.
+} HTTP_Client_Host_Stats;
+
+// Every thread that runs requests records into its own HTTP_Client_Stats, so recording never needs to synchronize
+// with anyone. To look at them, collect every thread's into one with http_client_stats_collect(..).
+typedef struct HTTP_Client_Stats HTTP_Client_Stats;
+struct HTTP_Client_Stats {
+    HTTP_Client_Host_Stats *hosts[HTTP_CLIENT_STATS_MAX_HOSTS]; // Allocated the first time a host is seen.
+    uint32_t host_count;
+    uint64_t requests_to_other_hosts;
+
+    HTTP_Client_Stats *next_thread; // The registry of every thread's stats.
+};
+
+// Called by the HTTP client when a request finishes, on the thread that ran it.
+void http_client_stats_record(const char *hostname, const HTTP_Client_Timings *timings);
+
+// Adds up what every thread has recorded so far into 'into'. Safe to call from any thread at any time; a thread that's
+// recording meanwhile may only be partly included. Threads' stats live on after the thread is gone, so nothing is lost.
+void http_client_stats_collect(HTTP_Client_Stats *into);
+
+void http_client_stats_merge(HTTP_Client_Stats *into, const HTTP_Client_Stats *from);
+
+// Count, mean and percentiles of every phase, per host.
+void http_client_stats_print(const HTTP_Client_Stats *stats);
+
+// For stats that were collected or merged into, not for a thread's own.
+void http_client_stats_dispose(HTTP_Client_Stats *stats);
+
+#endif
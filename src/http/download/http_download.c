@@ -0,0 +1,575 @@
+#include "http_download.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "clock/clock.h"
+#include "http/http.h"
+#include "http/client/http_client.h"
+#include "log/log.h"
+#include "string/buffer/string_buffer.h"
+#include "worker/worker.h"
+#include "worker/queue/worker_queue.h"
+
+// One byte range of the resource, and the request for it.
+typedef struct {
+    uint64_t first; // Both inclusive, like in Range and Content-Range.
+    uint64_t last;
+    char *headers;  // Range, If-Range and the caller's. Borrowed by the request while it's in flight.
+
+    uint32_t attempts;
+    uint64_t sent_ns;
+    HTTP_Client_Request_Handle handle;
+    HTTP_Client_Sink sink; // Of the attempt in flight. Writes the body to its place in the file as it arrives.
+    bool in_flight;
+} HTTP_Download_Segment;
+
+typedef enum {
+    HTTP_Download_Outcome_Done,
+    HTTP_Download_Outcome_Retry, // Worth another attempt, if it has any left.
+    HTTP_Download_Outcome_Failed,
+} HTTP_Download_Outcome;
+
+typedef struct {
+    const HTTP_Download_Options *options;
+    const char *file_path;
+    int fd;
+
+    uint32_t connections;
+    uint64_t max_segment_bytes;
+    uint32_t max_attempts;
+    uint64_t timeout_ns;
+
+    Worker worker;
+    Worker_Queue completions; // Room for 'connections' of them.
+    HTTP_Client_Request_Options request_options;
+    HTTP_Client_Sink sink;    // For the requests that aren't for a segment. They all start at the top of the file.
+
+    HTTP_Download_Segment *segments;
+    uint32_t segment_count;
+    uint32_t segments_done;
+    uint32_t in_flight;
+    uint32_t *retries; // A stack of indices into 'segments', to fetch again. They go before the ones not tried yet.
+    uint32_t retry_count;
+
+    HTTP_Download_Result result;
+} HTTP_Download;
+
+// Points the next request's body at 'offset' in the file, for no more than 'max_bytes' (0 for no limit).
+static void http_download_use_sink(HTTP_Download *download, HTTP_Client_Sink *sink, uint64_t offset, uint64_t max_bytes) {
+    http_client_sink_init(sink, download->fd, offset);
+    sink->max_bytes = max_bytes;
+    sink->sync = download->options->sync;
+    download->request_options.sink = sink;
+}
+
+static bool http_download_parse_number(const char **cursor, uint64_t *out_value) {
+    if(**cursor < '0' || **cursor > '9') {
+        return false; // strtoull(..) would take a sign or leading spaces.
+    }
+
+    char *end = NULL;
+    errno = 0;
+    *out_value = strtoull(*cursor, &end, 10);
+    if(errno != 0) {
+        return false;
+    }
+    *cursor = end;
+    return true;
+}
+
+// Reads 'Content-Range: bytes <first>-<last>/<size>' (RFC 9110, section 14.4). A 416 says 'bytes */<size>' instead,
+// which leaves 'out_first' and 'out_last' at UINT64_MAX. A size of '*' (not known) doesn't count.
+static bool http_download_parse_content_range(const HTTP *http, uint64_t *out_first, uint64_t *out_last, uint64_t *out_size) {
+    const char *value = NULL;
+    if(!http_try_get_key_from_header(&http->headers, "Content-Range", &value)) {
+        return false;
+    }
+    if(strncasecmp(value, "bytes ", 6) != 0) {
+        return false;
+    }
+    const char *cursor = &value[6];
+
+    *out_first = UINT64_MAX;
+    *out_last = UINT64_MAX;
+    if(*cursor == '*') {
+        cursor += 1;
+    }
+    else {
+        if(!http_download_parse_number(&cursor, out_first) || *cursor != '-') {
+            return false;
+        }
+        cursor += 1;
+        if(!http_download_parse_number(&cursor, out_last) || *out_last < *out_first) {
+            return false;
+        }
+    }
+
+    if(*cursor != '/') {
+        return false;
+    }
+    cursor += 1;
+    if(!http_download_parse_number(&cursor, out_size) || *cursor != '\0') {
+        return false;
+    }
+    return *out_first == UINT64_MAX || *out_last < *out_size;
+}
+
+static bool http_download_should_retry(const HTTP_Client_Completion *completion) {
+    return completion->timings.phases_completed != HTTP_Client_Phase_Total || completion->http->status.status_code >= 500;
+}
+
+static HTTP_Download_Outcome http_download_take_segment(HTTP_Download *download, const HTTP_Download_Segment *segment, const HTTP_Client_Completion *completion) {
+    if(segment->sink.error != 0) {
+        return HTTP_Download_Outcome_Failed; // Out of space or the like. Trying again won't change that.
+    }
+
+    // NOTE: Before checking whether it completed. The sink won't take more than the segment's length, so a 200 never does.
+    const HTTP *http = completion->http;
+    if(http->status.status_code == 200) {
+        // NOTE: Either If-Range didn't match, or the server has stopped doing ranges. Both mean what's in the file so
+        // far may not go with the rest.
+        LOG_ERROR("'%s/%s': Got all of it instead of bytes %llu-%llu. Did it change meanwhile?",
+            download->options->hostname, download->options->path, (unsigned long long)segment->first, (unsigned long long)segment->last);
+        return HTTP_Download_Outcome_Failed;
+    }
+    if(http_download_should_retry(completion)) {
+        return HTTP_Download_Outcome_Retry;
+    }
+    if(http->status.status_code != 206) {
+        LOG_ERROR("'%s/%s': Got %i for bytes %llu-%llu.",
+            download->options->hostname, download->options->path, http->status.status_code, (unsigned long long)segment->first, (unsigned long long)segment->last);
+        download->result.status_code = http->status.status_code;
+        return HTTP_Download_Outcome_Failed;
+    }
+
+    uint64_t first = 0;
+    uint64_t last = 0;
+    uint64_t size = 0;
+    const uint64_t length = segment->last - segment->first + 1;
+    bool as_asked = http_download_parse_content_range(http, &first, &last, &size)
+        && first == segment->first
+        && last == segment->last
+        && size == download->result.size;
+    if(!as_asked) {
+        LOG_ERROR("'%s/%s': Got a different range than bytes %llu-%llu of %llu.",
+            download->options->hostname, download->options->path, (unsigned long long)segment->first, (unsigned long long)segment->last, (unsigned long long)download->result.size);
+        return HTTP_Download_Outcome_Failed;
+    }
+    if(segment->sink.bytes_written != length) {
+        return HTTP_Download_Outcome_Retry; // Cut short.
+    }
+
+    download->result.bytes_written += length;
+    return HTTP_Download_Outcome_Done;
+}
+
+// Makes one request and works the worker until it's done. Returns NULL if it didn't complete in time.
+static HTTP_Client_Completion *http_download_fetch(HTTP_Download *download, const char *headers) {
+    download->request_options.headers = headers;
+    download->request_options.user_data = NULL;
+    http_download_use_sink(download, &download->sink, 0, 0);
+
+    HTTP_Client_Request_Handle handle;
+    if(!http_client_request(&download->worker, HTTP_Method_GET, download->options->hostname, download->options->path, NULL, &download->request_options, NULL, &handle)) {
+        return NULL;
+    }
+
+    const uint64_t deadline_ns = clock_now_ns() + download->timeout_ns;
+    while(true) {
+        worker_work(&download->worker);
+
+        HTTP_Client_Completion *completion = worker_queue_pop(&download->completions);
+        if(completion != NULL) {
+            return completion;
+        }
+
+        const uint64_t now_ns = clock_now_ns();
+        if(now_ns >= deadline_ns) {
+            if(http_client_request_cancel(handle)) {
+                return NULL;
+            }
+            continue; // It finished meanwhile. Its completion is on the way.
+        }
+        worker_wait(&download->worker, (int32_t)((deadline_ns - now_ns + CLOCK_NS_PER_MS - 1) / CLOCK_NS_PER_MS));
+    }
+}
+
+// Like http_download_fetch(..), but tries again while that looks like it could help. Returns the last attempt's
+// completion, which may be a failed one; NULL if none completed.
+static HTTP_Client_Completion *http_download_fetch_with_retries(HTTP_Download *download, const char *headers) {
+    HTTP_Client_Completion *completion = NULL;
+    for(uint32_t attempt = 0; attempt < download->max_attempts; attempt++) {
+        if(attempt > 0) {
+            LOG_WARNING("'%s/%s': Trying again (%u/%u).", download->options->hostname, download->options->path, attempt + 1, download->max_attempts);
+            download->result.retries += 1;
+        }
+
+        if(completion != NULL) {
+            http_client_completion_free(completion);
+        }
+        completion = http_download_fetch(download, headers);
+        if(download->sink.error != 0 || (completion != NULL && !http_download_should_retry(completion))) {
+            break;
+        }
+    }
+    return completion;
+}
+
+// Counts the segment out of flight, and writes it off, queues it to be fetched again, or gives up. Returns false if the
+// download has failed.
+static bool http_download_settle(HTTP_Download *download, HTTP_Download_Segment *segment, HTTP_Download_Outcome outcome) {
+    assert(segment->in_flight);
+    segment->in_flight = false;
+    download->in_flight -= 1;
+
+    const HTTP_Download_Options *options = download->options;
+    if(outcome == HTTP_Download_Outcome_Done) {
+        download->segments_done += 1;
+        free(segment->headers);
+        segment->headers = NULL;
+        return true;
+    }
+    if(outcome == HTTP_Download_Outcome_Failed) {
+        return false;
+    }
+    if(segment->attempts >= download->max_attempts) {
+        LOG_ERROR("'%s/%s': Gave up on bytes %llu-%llu after %u attempts.", options->hostname, options->path,
+            (unsigned long long)segment->first, (unsigned long long)segment->last, segment->attempts);
+        return false;
+    }
+
+    LOG_WARNING("'%s/%s': Trying bytes %llu-%llu again (%u/%u).", options->hostname, options->path,
+        (unsigned long long)segment->first, (unsigned long long)segment->last, segment->attempts + 1, download->max_attempts);
+    download->result.retries += 1;
+    download->retries[download->retry_count++] = (uint32_t)(segment - download->segments);
+    return true;
+}
+
+// Splits the resource into segments. At least one per connection, unless that makes them tiny, and none bigger than
+// 'max_segment_bytes'.
+static bool http_download_split(HTTP_Download *download, const char *validator) {
+    const uint64_t size = download->result.size;
+
+    uint64_t count = (size + download->max_segment_bytes - 1) / download->max_segment_bytes;
+    uint64_t worth_splitting = (size + HTTP_DOWNLOAD_MIN_SEGMENT_BYTES - 1) / HTTP_DOWNLOAD_MIN_SEGMENT_BYTES;
+    uint64_t wanted = download->connections < worth_splitting ? download->connections : worth_splitting;
+    if(count < wanted) {
+        count = wanted;
+    }
+    const uint64_t segment_bytes = (size + count - 1) / count;
+    count = (size + segment_bytes - 1) / segment_bytes; // Rounding up may have left the last ones with nothing.
+    if(count > UINT32_MAX) {
+        LOG_ERROR("'%s/%s': %llu bytes make too many segments.", download->options->hostname, download->options->path, (unsigned long long)size);
+        return false;
+    }
+
+    download->segments = calloc(count, sizeof(HTTP_Download_Segment));
+    download->retries = malloc(count * sizeof(uint32_t));
+    if(download->segments == NULL || download->retries == NULL) {
+        LOG_ERROR("Out of memory for %llu segments.", (unsigned long long)count);
+        return false;
+    }
+    download->segment_count = (uint32_t)count;
+    download->result.segments = (uint32_t)count;
+
+    String_Buffer headers;
+    string_buffer_init(&headers, 256);
+    bool ok = true;
+    for(uint32_t i = 0; ok && i < count; i++) {
+        HTTP_Download_Segment *segment = &download->segments[i];
+        segment->first = i * segment_bytes;
+        segment->last = (segment->first + segment_bytes < size ? segment->first + segment_bytes : size) - 1;
+
+        headers.length = 0;
+        string_buffer_appendf(&headers, "Range: bytes=%llu-%llu\r\n", (unsigned long long)segment->first, (unsigned long long)segment->last);
+        if(validator != NULL) {
+            string_buffer_appendf(&headers, "If-Range: %s\r\n", validator);
+        }
+        if(download->options->headers != NULL) {
+            string_buffer_appendf(&headers, "%s", download->options->headers);
+        }
+        segment->headers = strdup(headers.data);
+        ok = segment->headers != NULL;
+    }
+    string_buffer_free(&headers);
+
+    if(!ok) {
+        LOG_ERROR("Out of memory for %llu segments.", (unsigned long long)count);
+    }
+    return ok;
+}
+
+// Fetches all the segments, 'connections' at a time, failed ones first.
+static bool http_download_segments(HTTP_Download *download) {
+    const HTTP_Download_Options *options = download->options;
+    uint32_t next_segment = 0;
+    uint64_t next_timeout_ns = UINT64_MAX; // Of the segment in flight that times out first, or earlier.
+    bool ok = true;
+
+    while(ok && download->segments_done < download->segment_count) {
+        while(download->in_flight < download->connections && (download->retry_count > 0 || next_segment < download->segment_count)) {
+            uint32_t index = download->retry_count > 0 ? download->retries[--download->retry_count] : next_segment++;
+            HTTP_Download_Segment *segment = &download->segments[index];
+
+            download->request_options.headers = segment->headers;
+            download->request_options.user_data = segment;
+            http_download_use_sink(download, &segment->sink, segment->first, segment->last - segment->first + 1);
+            if(!http_client_request(&download->worker, HTTP_Method_GET, options->hostname, options->path, NULL, &download->request_options, NULL, &segment->handle)) {
+                LOG_ERROR("Out of memory for another request.");
+                ok = false;
+                break;
+            }
+            segment->attempts += 1;
+            segment->sent_ns = clock_now_ns();
+            segment->in_flight = true;
+            download->in_flight += 1;
+            if(segment->sent_ns + download->timeout_ns < next_timeout_ns) {
+                next_timeout_ns = segment->sent_ns + download->timeout_ns;
+            }
+        }
+        if(!ok) {
+            break;
+        }
+
+        worker_work(&download->worker);
+
+        bool got_any = false;
+        HTTP_Client_Completion *completion;
+        while(ok && (completion = worker_queue_pop(&download->completions)) != NULL) {
+            HTTP_Download_Segment *segment = completion->user_data;
+            HTTP_Download_Outcome outcome = http_download_take_segment(download, segment, completion);
+            http_client_completion_free(completion);
+
+            ok = http_download_settle(download, segment, outcome);
+            got_any = true;
+        }
+
+        // NOTE: Only once the completions are all in, so a segment that's timed out can't have one waiting anymore.
+        const uint64_t now_ns = clock_now_ns();
+        if(ok && now_ns >= next_timeout_ns) {
+            next_timeout_ns = UINT64_MAX;
+            for(uint32_t i = 0; ok && i < download->segment_count; i++) {
+                HTTP_Download_Segment *segment = &download->segments[i];
+                if(!segment->in_flight) {
+                    continue;
+                }
+                if(now_ns - segment->sent_ns < download->timeout_ns) {
+                    if(segment->sent_ns + download->timeout_ns < next_timeout_ns) {
+                        next_timeout_ns = segment->sent_ns + download->timeout_ns;
+                    }
+                    continue;
+                }
+
+                LOG_WARNING("'%s/%s': Bytes %llu-%llu timed out.", options->hostname, options->path, (unsigned long long)segment->first, (unsigned long long)segment->last);
+                bool cancelled = http_client_request_cancel(segment->handle);
+                assert(cancelled);
+                (void)cancelled;
+                ok = http_download_settle(download, segment, HTTP_Download_Outcome_Retry);
+                got_any = true;
+            }
+        }
+
+        if(!ok || got_any) {
+            continue; // There's room for more now.
+        }
+
+        // Sleep until a request has something to do, or the first one in flight times out.
+        if(next_timeout_ns > now_ns) {
+            uint64_t wait_ms = (next_timeout_ns - now_ns + CLOCK_NS_PER_MS - 1) / CLOCK_NS_PER_MS;
+            worker_wait(&download->worker, wait_ms > INT32_MAX ? -1 : (int32_t)wait_ms);
+        }
+    }
+
+    // After a failure, whatever is still in flight isn't needed anymore.
+    for(uint32_t i = 0; i < download->segment_count; i++) {
+        if(download->segments[i].in_flight) {
+            http_client_request_cancel(download->segments[i].handle); // If it finished meanwhile, its completion is freed below.
+        }
+    }
+    HTTP_Client_Completion *completion;
+    while((completion = worker_queue_pop(&download->completions)) != NULL) {
+        http_client_completion_free(completion);
+    }
+    return ok;
+}
+
+// Allocates the whole file and fetches the segments into it.
+static bool http_download_ranged(HTTP_Download *download, const char *validator) {
+    const uint64_t size = download->result.size;
+
+    // NOTE: Up front, so running out of space shows right away rather than partway through, and the file isn't grown
+    // piecemeal by writes landing all over it.
+    int allocate_error = posix_fallocate(download->fd, 0, (off_t)size);
+    if(allocate_error == EOPNOTSUPP || allocate_error == EINVAL) {
+        allocate_error = ftruncate(download->fd, (off_t)size) == 0 ? 0 : errno; // A sparse file does too.
+    }
+    if(allocate_error != 0) {
+        LOG_ERROR("Failed to make room for %llu bytes in '%s': %s.", (unsigned long long)size, download->file_path, strerror(allocate_error));
+        return false;
+    }
+
+    bool ok = http_download_split(download, validator) && http_download_segments(download);
+
+    for(uint32_t i = 0; i < download->segment_count; i++) {
+        free(download->segments[i].headers);
+    }
+    free(download->segments);
+    free(download->retries);
+    download->segments = NULL;
+    download->retries = NULL;
+    return ok;
+}
+
+// Asks for the first byte, to learn the size and whether ranges work, then gets the rest whichever way they do.
+static bool http_download_all(HTTP_Download *download) {
+    const HTTP_Download_Options *options = download->options;
+
+    String_Buffer probe_headers;
+    string_buffer_init(&probe_headers, 128);
+    string_buffer_appendf(&probe_headers, "Range: bytes=0-0\r\n%s", options->headers != NULL ? options->headers : "");
+    HTTP_Client_Completion *completion = http_download_fetch_with_retries(download, probe_headers.data);
+    string_buffer_free(&probe_headers);
+
+    if(download->sink.error != 0) {
+        if(completion != NULL) {
+            http_client_completion_free(completion);
+        }
+        return false; // The client has said why.
+    }
+    if(completion == NULL || completion->timings.phases_completed != HTTP_Client_Phase_Total) {
+        LOG_ERROR("'%s/%s': No response after %u attempts.", options->hostname, options->path, download->max_attempts);
+        if(completion != NULL) {
+            http_client_completion_free(completion);
+        }
+        return false;
+    }
+
+    const HTTP *http = completion->http;
+    uint64_t first = 0;
+    uint64_t last = 0;
+    uint64_t size = 0;
+    const bool knows_size = http_download_parse_content_range(http, &first, &last, &size);
+
+    if(http->status.status_code == 206 && knows_size) {
+        // NOTE: Only strong validators are any good for If-Range (RFC 9110, section 13.1.5). Without one the segments
+        // are just asked for, and the server had better not change the resource meanwhile.
+        char validator[HTTP_MAX_HEADER_VALUE_LENGTH];
+        const char *value = NULL;
+        bool has_validator = (http_try_get_key_from_header(&http->headers, "ETag", &value) && strncmp(value, "W/", 2) != 0)
+            || http_try_get_key_from_header(&http->headers, "Last-Modified", &value);
+        if(has_validator) {
+            snprintf(validator, sizeof(validator), "%s", value);
+        }
+        http_client_completion_free(completion);
+
+        download->result.size = size;
+        download->result.ranged = true;
+        return size == 0 || http_download_ranged(download, has_validator ? validator : NULL);
+    }
+    if(http->status.status_code == 416 && knows_size && size == 0) {
+        http_client_completion_free(completion); // Nothing to download. The file is empty already.
+        return true;
+    }
+
+    if(http->status.status_code == 206) {
+        // NOTE: It does ranges, but won't say how big the whole thing is. Then it has to come in one piece.
+        http_client_completion_free(completion);
+        completion = http_download_fetch_with_retries(download, options->headers);
+        if(download->sink.error != 0 || completion == NULL || completion->timings.phases_completed != HTTP_Client_Phase_Total) {
+            if(download->sink.error == 0) {
+                LOG_ERROR("'%s/%s': No response after %u attempts.", options->hostname, options->path, download->max_attempts);
+            }
+            if(completion != NULL) {
+                http_client_completion_free(completion);
+            }
+            return false;
+        }
+        http = completion->http;
+    }
+
+    bool ok = http->status.status_code == 200;
+    if(ok) {
+        // Range isn't for everyone. What came back is all of it, and went straight into the file.
+        download->result.size = download->sink.bytes_written;
+        download->result.bytes_written = download->sink.bytes_written;
+        download->result.segments = 1;
+
+        // NOTE: A first request that got a range has left its byte in the file, one too many if all of it is empty.
+        if(ftruncate(download->fd, (off_t)download->result.size) != 0) {
+            LOG_ERROR("Failed to write to '%s': %s.", download->file_path, strerror(errno));
+            ok = false;
+        }
+    }
+    else {
+        LOG_ERROR("'%s/%s': Got %i.", options->hostname, options->path, http->status.status_code);
+        download->result.status_code = http->status.status_code;
+    }
+
+    http_client_completion_free(completion);
+    return ok;
+}
+
+bool http_download_run(const HTTP_Download_Options *options, const char *file_path, HTTP_Download_Result *out_result) {
+    assert(options != NULL);
+    assert(options->hostname != NULL);
+    assert(options->path != NULL);
+    assert(file_path != NULL);
+
+    HTTP_Download download;
+    memset(&download, 0, sizeof(HTTP_Download));
+    download.options = options;
+    download.file_path = file_path;
+    download.connections = options->connections > 0 ? options->connections : HTTP_DOWNLOAD_DEFAULT_CONNECTIONS;
+    download.max_segment_bytes = options->max_segment_bytes > 0 ? options->max_segment_bytes : HTTP_DOWNLOAD_DEFAULT_MAX_SEGMENT_BYTES;
+    download.max_attempts = options->max_attempts > 0 ? options->max_attempts : HTTP_DOWNLOAD_DEFAULT_MAX_ATTEMPTS;
+    download.timeout_ns = (uint64_t)(options->timeout_ms > 0 ? options->timeout_ms : HTTP_DOWNLOAD_DEFAULT_TIMEOUT_MS) * CLOCK_NS_PER_MS;
+
+    download.worker.name = "Download";
+
+    // NOTE: Room for every request that can be in flight, so a completion is never dropped for lack of space.
+    if(!worker_queue_init(&download.completions, download.connections)) {
+        LOG_ERROR("Failed to create a completion queue for %u requests.", download.connections);
+        return false;
+    }
+    download.request_options.socket_options = options->socket_options;
+    download.request_options.port = options->port;
+    download.request_options.completion_queue = &download.completions;
+
+    download.fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(download.fd < 0) {
+        LOG_ERROR("Failed to open '%s': %s.", file_path, strerror(errno));
+        worker_queue_dispose(&download.completions);
+        return false;
+    }
+
+    struct stat file_stat;
+    const bool is_regular = fstat(download.fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+
+    const uint64_t start_ns = clock_now_ns();
+    bool ok = http_download_all(&download);
+    download.result.duration_ns = clock_now_ns() - start_ns;
+
+    worker_dispose(&download.worker);
+    worker_queue_dispose(&download.completions);
+
+    if(close(download.fd) != 0 && ok) {
+        LOG_ERROR("Failed to write to '%s': %s.", file_path, strerror(errno));
+        ok = false;
+    }
+    if(!ok && is_regular) {
+        unlink(file_path); // Whatever made it in has holes, and would look complete. Not for /dev/null and the like.
+    }
+
+    if(out_result != NULL) {
+        *out_result = download.result;
+    }
+    return ok;
+}
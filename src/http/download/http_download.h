@@ -0,0 +1,75 @@
+#ifndef HTTP_DOWNLOAD_H
+#define HTTP_DOWNLOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tcp/tcp_socket.h"
+#include "http/client/http_client_sink.h"
+
+// Downloads one resource into a file, in segments fetched over several connections at once with Range requests
+// (RFC 9110, section 14). A single connection tends to be held back by its own congestion window, or by what a
+// server allows per connection, long before a long fat pipe is full; a few of them side by side get past that.
+//
+// A first request for just the first byte ('Range: bytes=0-0') tells the size and whether the server does ranges at
+// all. The file is then allocated up front and split into segments, each one streamed to its place in the file as it
+// arrives (see http_client_sink.h), in whatever order they come back. A segment that fails, or takes longer than
+// 'timeout_ms', is fetched again, up to 'max_attempts' times in all; the others carry on meanwhile.
+//
+// Segments are asked for with If-Range and the first response's ETag (or Last-Modified), so if the resource changes
+// halfway, the server sends all of it instead of the range, and the download fails rather than stitching two versions
+// together. Servers that don't do ranges (or don't say how big the resource is) get one plain GET instead.
+//
+// Nothing is held in memory until it's complete, so however big the resource is, a download takes about 'connections'
+// times HTTP_CLIENT_SINK_DEFAULT_STAGING_BYTES. Everything runs on one Worker on the calling thread.
+
+#ifndef HTTP_DOWNLOAD_DEFAULT_CONNECTIONS
+#define HTTP_DOWNLOAD_DEFAULT_CONNECTIONS 4
+#endif
+
+#ifndef HTTP_DOWNLOAD_DEFAULT_MAX_SEGMENT_BYTES
+#define HTTP_DOWNLOAD_DEFAULT_MAX_SEGMENT_BYTES (8 * 1024 * 1024)
+#endif
+
+#ifndef HTTP_DOWNLOAD_MIN_SEGMENT_BYTES
+#define HTTP_DOWNLOAD_MIN_SEGMENT_BYTES (64 * 1024) // Smaller resources use fewer connections.
+#endif
+
+#ifndef HTTP_DOWNLOAD_DEFAULT_MAX_ATTEMPTS
+#define HTTP_DOWNLOAD_DEFAULT_MAX_ATTEMPTS 3
+#endif
+
+#ifndef HTTP_DOWNLOAD_DEFAULT_TIMEOUT_MS
+#define HTTP_DOWNLOAD_DEFAULT_TIMEOUT_MS 30000
+#endif
+
+typedef struct {
+    // What to download. Same meaning as for http_client_request(..); all borrowed.
+    const char *hostname;
+    const char *path;    // Without the leading '/'.
+    const char *headers; // Sent with every request, besides Range and If-Range. NULL for none.
+    uint16_t port;       // 0 for TCP_ENDPOINT_DEFAULT_PORT.
+    const TCP_Socket_Options *socket_options; // NULL for TCP_Socket_Profile_Default.
+
+    uint32_t connections;       // Segments in flight at once. 0 for HTTP_DOWNLOAD_DEFAULT_CONNECTIONS.
+    uint64_t max_segment_bytes; // 0 for HTTP_DOWNLOAD_DEFAULT_MAX_SEGMENT_BYTES.
+    uint32_t max_attempts;      // Per request, counting the first. 0 for HTTP_DOWNLOAD_DEFAULT_MAX_ATTEMPTS.
+    uint32_t timeout_ms;        // Per attempt. 0 for HTTP_DOWNLOAD_DEFAULT_TIMEOUT_MS.
+    HTTP_Client_Sink_Sync sync; // When to fdatasync(..) the file. 'At_End' is once per segment.
+} HTTP_Download_Options;
+
+typedef struct {
+    uint64_t duration_ns;
+    uint64_t size;      // Of the resource, as far as we got to know it.
+    uint64_t bytes_written;
+    bool ranged;        // Whether it came in segments, rather than in one plain GET.
+    uint32_t segments;
+    uint32_t retries;   // Attempts besides the first ones, for all requests together.
+    int status_code;    // Of the response that made the download fail, if that's why it did. 0 otherwise.
+} HTTP_Download_Result;
+
+// Downloads into 'file_path', replacing whatever is there, and blocks until it's done. Returns false if it didn't
+// work out, in which case the file is removed again. 'out_result' may be NULL.
+bool http_download_run(const HTTP_Download_Options *options, const char *file_path, HTTP_Download_Result *out_result);
+
+#endif
@@ -3,9 +3,13 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 
 #include "string/buffer/string_buffer.h"
+#include "log/log.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
 
 const char *http_status_codes[] = { // https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
     // 1xx informational response – the request was received, continuing process
@@ -111,6 +115,41 @@ bool http_string_to_method_type(const char *text, HTTP_Method *out_method) {
     return false;
 }
 
+const char *http_method_to_string(const HTTP_Method method) {
+    switch(method) {
+        case HTTP_Method_GET:  return "GET";
+        case HTTP_Method_POST: return "POST";
+        case HTTP_Method_PUT:  return "PUT";
+    }
+
+    assert(false);
+    return "GET";
+}
+
+const char *http_parse_result_to_string(const HTTP_Parse_Result result) {
+    switch(result) {
+        case HTTP_Parse_Result_Done:            return "Done";
+        case HTTP_Parse_Result_Needs_More_Data: return "Needs more data";
+        case HTTP_Parse_Result_Invalid_Data:    return "Invalid data";
+        case HTTP_Parse_Result_TODO:            return "Not supported yet";
+        case HTTP_Parse_Result_Count:           break;
+    }
+
+    assert(false);
+    return "?";
+}
+
+// Counts the results that mean the parser gave up. Passes 'result' through.
+static inline HTTP_Parse_Result http_count_parse_result(HTTP_Parse_Result result) {
+    if(result == HTTP_Parse_Result_Invalid_Data) {
+        metrics_count(Metric_Counter_HTTP_Parse_Invalid_Data, 1);
+    }
+    else if(result == HTTP_Parse_Result_TODO) {
+        metrics_count(Metric_Counter_HTTP_Parse_TODO, 1);
+    }
+    return result;
+}
+
 HTTP_Parse_Result http_try_parse(HTTP_Parser *parser, const char *buf, const uint64_t buf_len, HTTP *out_http) {
     assert(parser != NULL);
 
@@ -118,41 +157,46 @@ HTTP_Parse_Result http_try_parse(HTTP_Parser *parser, const char *buf, const uin
     parser->buffer_length = buf_len;
 
     if(parser->state == HTTP_Parse_Status_Parsing_Status) {
-        // printf("Trying to read HTTP status ...\n");
+        // LOG_TRACE("Trying to read HTTP status ...");
+        TRACE_BEGIN(Trace_Category_Parse, "http_parse_status", parser->buffer_length - parser->bytes_parsed_offset);
         HTTP_Parse_Result result = http_try_parse_status(
             &parser->buffer[parser->bytes_parsed_offset],
             parser->buffer_length - parser->bytes_parsed_offset,
             &parser->http.status,
             &parser->bytes_parsed_offset
         );
+        TRACE_END(Trace_Category_Parse, "http_parse_status", result);
 
         if(result != HTTP_Parse_Result_Done) {
-            // printf("**A** result: %i.\n", result);
-            return result;
+            // LOG_TRACE("**A** result: %i.", result);
+            return http_count_parse_result(result);
         }
 
         parser->state = HTTP_Parse_Status_Parsing_Headers;
     }
 
     if(parser->state == HTTP_Parse_Status_Parsing_Headers) {
-        // printf("Trying to read HTTP headers ...\n");
+        // LOG_TRACE("Trying to read HTTP headers ...");
+        TRACE_BEGIN(Trace_Category_Parse, "http_parse_headers", parser->buffer_length - parser->bytes_parsed_offset);
         HTTP_Parse_Result result = http_try_parse_headers(
             &parser->buffer[parser->bytes_parsed_offset],
             parser->buffer_length - parser->bytes_parsed_offset,
             &parser->http.headers,
             &parser->bytes_parsed_offset
         );
+        TRACE_END(Trace_Category_Parse, "http_parse_headers", result);
 
         if(result != HTTP_Parse_Result_Done) {
-            // printf("**B** result: %i.\n", result);
-            return result;
+            // LOG_TRACE("**B** result: %i.", result);
+            return http_count_parse_result(result);
         }
 
         parser->state = HTTP_Parse_Status_Parsing_Body;
     }
 
     if(parser->state == HTTP_Parse_Status_Parsing_Body) {
-        // printf("Trying to read HTTP body ...\n");
+        // LOG_TRACE("Trying to read HTTP body ...");
+        TRACE_BEGIN(Trace_Category_Parse, "http_parse_body", parser->buffer_length - parser->bytes_parsed_offset);
         HTTP_Parse_Result result = http_try_parse_body(
             &parser->http.status,
             &parser->http.headers,
@@ -160,12 +204,14 @@ HTTP_Parse_Result http_try_parse(HTTP_Parser *parser, const char *buf, const uin
             parser->buffer_length - parser->bytes_parsed_offset,
             &parser->http.body
         );
+        TRACE_END(Trace_Category_Parse, "http_parse_body", result);
 
         if(result != HTTP_Parse_Result_Done) {
-            // printf("**C** result: %i\n", result);
-            return result;
+            // LOG_TRACE("**C** result: %i", result);
+            return http_count_parse_result(result);
         }
 
+        parser->http.body.bytes_missing = 0;
         parser->state = HTTP_Parse_Status_Parsing_Done;
     }
 
@@ -179,7 +225,7 @@ HTTP_Parse_Result http_try_parse(HTTP_Parser *parser, const char *buf, const uin
 
 HTTP_Parse_Result http_try_parse_status(const char *buf, const uint64_t buf_len, HTTP_Status *out_status, uint64_t *out_consumed_bytes) {
     if (buf == NULL || buf_len == 0) {
-        return false;
+        return HTTP_Parse_Result_Needs_More_Data;
     }
 
     bool got_status_type = false;
@@ -195,9 +241,9 @@ HTTP_Parse_Result http_try_parse_status(const char *buf, const uint64_t buf_len,
             int http_version_minor = 0;
 
             int n = sscanf(buf,
-                "%s" // Method.
+                "%63s" // Method. NOTE: The widths are sizeof(..) - 1 of the buffers above.
                 " "
-                "%s" // Path.
+                "%2047s" // Path.
                 " "
                 "HTTP/%d.%d" // Version.
                 ,
@@ -220,7 +266,7 @@ HTTP_Parse_Result http_try_parse_status(const char *buf, const uint64_t buf_len,
                 
                 out_status->status_code = 0;
                 
-                printf("Request! Method: '%s', Path: '%s'. HTTP-version is %d.%d.\n", method_str, path_str, http_version_major, http_version_minor);
+                LOG_DEBUG("Request! Method: '%s', Path: '%s'. HTTP-version is %d.%d.", method_str, path_str, http_version_major, http_version_minor);
             }
         }
 
@@ -240,7 +286,7 @@ HTTP_Parse_Result http_try_parse_status(const char *buf, const uint64_t buf_len,
                 " "
                 "%d" // Status-code.
                 " "
-                "%s" // Status-description.
+                "%255s" // Status-description.
                 ,
                 &http_version_major, &http_version_minor,
                 &status_code,
@@ -255,7 +301,7 @@ HTTP_Parse_Result http_try_parse_status(const char *buf, const uint64_t buf_len,
                 out_status->http_version_major = (uint8_t)http_version_major;
                 out_status->http_version_minor = (uint8_t)http_version_minor;
                 
-                printf("Response! HTTP-version is %d.%d, status code: %d (%s).\n", http_version_major, http_version_minor, status_code, status_str);
+                LOG_DEBUG("Response! HTTP-version is %d.%d, status code: %d (%s).", http_version_major, http_version_minor, status_code, status_str);
             }
         }
     }
@@ -336,7 +382,7 @@ HTTP_Parse_Result http_try_parse_headers(const char *buf, const uint64_t buf_len
                 break;
             }
         
-            // printf("%s\n", line);
+            // LOG_TRACE("%s", line);
 
             if(out_headers->header_count >= HTTP_MAX_HEADERS) {
                 break;
@@ -346,12 +392,13 @@ HTTP_Parse_Result http_try_parse_headers(const char *buf, const uint64_t buf_len
             HTTP_Parse_Result parse_header_result = http_try_parse_header(&line[0], header);
             switch(parse_header_result) {
                 case HTTP_Parse_Result_Done: {
-                    printf("Found header! Index: %i. Key: '%s', value: '%s'.\n", out_headers->header_count, header->key, header->value);
+                    LOG_TRACE("Found header! Index: %i. Key: '%s', value: '%s'.", out_headers->header_count, header->key, header->value);
                     out_headers->header_count += 1;
                     break;
                 }
                 case HTTP_Parse_Result_Needs_More_Data:
                 case HTTP_Parse_Result_TODO:
+                case HTTP_Parse_Result_Count:
                 case HTTP_Parse_Result_Invalid_Data: {
                     return parse_header_result;
                 }
@@ -364,13 +411,14 @@ HTTP_Parse_Result http_try_parse_headers(const char *buf, const uint64_t buf_len
 
     headers_end_index += 1;
     
-    // printf("Done with headers.\n");
+    // LOG_TRACE("Done with headers.");
     *out_consumed_bytes += headers_end_index;
 
     return HTTP_Parse_Result_Done;
 }
 
 // NOTE: SS - Returns true when a chunk has been fully read. Has an out-parameter for the size of the read chunk and for offsetting.
+// If the size-line has been read but not the whole chunk, the out-parameters are still set so the caller knows how much is missing.
 static inline bool get_chunk_start_and_length(const char *buf, const uint64_t buf_len, uint32_t *out_chunk_start, uint32_t *out_chunk_length) {
     assert(buf != NULL);
 
@@ -398,8 +446,12 @@ static inline bool get_chunk_start_and_length(const char *buf, const uint64_t bu
         i++;
     }
 
+    if (i < limit && i + 1 >= buf_len) {
+        return false; // The size-line hasn't fully arrived yet.
+    }
+
     if (i == limit || buf[i] != '\r' || buf[i+1] != '\n') {
-        printf("Chunk size format is incorrect.\n");
+        LOG_ERROR("Chunk size format is incorrect.");
         assert(false);
         return false;
     }
@@ -409,11 +461,11 @@ static inline bool get_chunk_start_and_length(const char *buf, const uint64_t bu
     assert(strlen(size_text) > 0);
 
 
-    // printf("Size text: '%s'\n", size_text);
+    // LOG_TRACE("Size text: '%s'", size_text);
     int result = sscanf(size_text, "%x", &expected_chunk_length);
     assert(result == 1);
 
-    // printf("EXPECTED CHUNK LENGTH: %u.\n", expected_chunk_length);
+    // LOG_TRACE("EXPECTED CHUNK LENGTH: %u.", expected_chunk_length);
 
     if (expected_chunk_length == 0) {
         return true;
@@ -421,14 +473,15 @@ static inline bool get_chunk_start_and_length(const char *buf, const uint64_t bu
 
     start_of_chunk_after_size = i + 2; // Skip \r\n
 
+    *out_chunk_start = start_of_chunk_after_size;
+    *out_chunk_length = expected_chunk_length;
+
     if ((buf_len - start_of_chunk_after_size) >= expected_chunk_length) {
-        // printf("Enough! :)\n");
-        *out_chunk_start = start_of_chunk_after_size;
-        *out_chunk_length = expected_chunk_length;
+        // LOG_TRACE("Enough! :)");
         return true;
     }
 
-    // printf("Not enough! :( I have %lu but I expect at least %u. Waiting for more bytes ...\n", buf_len, expected_chunk_length);
+    // LOG_TRACE("Not enough! :( I have %lu but I expect at least %u. Waiting for more bytes ...", buf_len, expected_chunk_length);
     return false;
 }
 
@@ -447,7 +500,7 @@ HTTP_Parse_Result http_try_parse_body(const HTTP_Status *status, const HTTP_Head
                 break;
             }
             default: {
-                printf("Unimplemented HTTP-method %i when trying to parse the body. Assuming that no body should be parsed.", status->method);
+                LOG_WARNING("Unimplemented HTTP-method %i when trying to parse the body. Assuming that no body should be parsed.", status->method);
                 should_parse_body = false;
                 break;
             }
@@ -457,6 +510,9 @@ HTTP_Parse_Result http_try_parse_body(const HTTP_Status *status, const HTTP_Head
             return HTTP_Parse_Result_Done;
         }
     }
+    else if(status->status_code < 200 || status->status_code == 204 || status->status_code == 304) {
+        return HTTP_Parse_Result_Done; // Never have a body, whatever the headers say.
+    }
 
     if(!out_body->has_encoding_set) {
         const char *encoding = NULL;
@@ -481,7 +537,7 @@ HTTP_Parse_Result http_try_parse_body(const HTTP_Status *status, const HTTP_Head
         }
         else {
             // TODO: SS - Multiple encodings may be listed, for example: 'Transfer-Encoding: gzip, chunked'. Implement that.
-            printf("Unimplemented HTTP encoding '%s'.\n", encoding);
+            LOG_WARNING("Unimplemented HTTP encoding '%s'.", encoding);
             return HTTP_Parse_Result_TODO;
         }
 
@@ -500,7 +556,7 @@ HTTP_Parse_Result http_try_parse_body(const HTTP_Status *status, const HTTP_Head
                 bool success = get_chunk_start_and_length(&buf[out_body->offset], buf_len - out_body->offset, &chunk_start, &chunk_length);
                 if(success) {
                     if(chunk_length == 0) {
-                        // printf("Chunk length: %u\n", chunk_length);
+                        // LOG_TRACE("Chunk length: %u", chunk_length);
                         return HTTP_Parse_Result_Done; // Return 'done' because we're now done parsing the body. :)
                     }
 
@@ -509,6 +565,12 @@ HTTP_Parse_Result http_try_parse_body(const HTTP_Status *status, const HTTP_Head
                 }
                 else {
                     // Wait for more data.
+                    out_body->bytes_missing = 0;
+                    if(chunk_length > 0) {
+                        uint64_t available = buf_len - out_body->offset - chunk_start;
+                        out_body->bytes_missing = (chunk_length + 2) - available; // Include the trailing \r\n.
+                    }
+
                     return HTTP_Parse_Result_Needs_More_Data;
                 }
             }
@@ -521,15 +583,16 @@ HTTP_Parse_Result http_try_parse_body(const HTTP_Status *status, const HTTP_Head
 
             if(content_length_text == NULL) {
                 // We don't have a 'Content-Length'. Wait for the socket to close.
-                printf("TODO: SS - Missing 'Content-Length'. Support this.\n");
+                LOG_WARNING("TODO: SS - Missing 'Content-Length'. Support this.");
                 return HTTP_Parse_Result_TODO;
             }
             else {
                 // We have a 'Content-Length'. Wait for 'Content-Length' bytes.
                 uint64_t content_length = atoi(content_length_text);
                 if(content_length > 0) {
-                    // printf("I have %lu, need %lu.\n", buf_len, content_length);
+                    // LOG_TRACE("I have %lu, need %lu.", buf_len, content_length);
                     if(buf_len < content_length) {
+                        out_body->bytes_missing = content_length - buf_len;
                         return HTTP_Parse_Result_Needs_More_Data;
                     }
 
@@ -540,7 +603,7 @@ HTTP_Parse_Result http_try_parse_body(const HTTP_Status *status, const HTTP_Head
             break;
         }
         default: {
-            printf("Unhandled Transfer-Encoding %i!\n", out_body->encoding);
+            LOG_WARNING("Unhandled Transfer-Encoding %i!", out_body->encoding);
             return HTTP_Parse_Result_TODO;
         }
     }
@@ -551,8 +614,8 @@ HTTP_Parse_Result http_try_parse_body(const HTTP_Status *status, const HTTP_Head
 bool http_try_get_key_from_header(const HTTP_Headers *headers, const char *key, const char **out_value) {
     for(uint32_t i = 0; i < headers->header_count; i++) {
         const HTTP_Header *header = &headers->headers[i];
-        // printf("Comparing '%s' with '%s' ...\n", header->key, key);
-        if(strcmp(header->key, key) == 0) {
+        // LOG_TRACE("Comparing '%s' with '%s' ...", header->key, key);
+        if(strcasecmp(header->key, key) == 0) { // Header names are case-insensitive.
             *out_value = &header->value[0];
             return true;
         }
@@ -563,6 +626,9 @@ bool http_try_get_key_from_header(const HTTP_Headers *headers, const char *key,
 }
 
 const char *http_get_status_text_for_status_code(int status_code) {
+    if(status_code < 0 || status_code >= (int)(sizeof(http_status_codes) / sizeof(http_status_codes[0]))) {
+        return NULL;
+    }
     return http_status_codes[status_code];
 }
 
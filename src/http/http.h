@@ -32,6 +32,10 @@ typedef enum {
     // ..
 } HTTP_Method;
 
+// "GET", "POST" etc. The reverse returns false for methods we don't know.
+const char *http_method_to_string(const HTTP_Method method);
+bool http_string_to_method_type(const char *text, HTTP_Method *out_method);
+
 typedef enum {
     HTTP_Status_Type_Request,
     HTTP_Status_Type_Response,
@@ -65,6 +69,9 @@ typedef struct {
 
     // Chunked.
     uint32_t offset;
+
+    // Hint of how many more bytes are needed before the body can make progress. 0 if unknown.
+    uint64_t bytes_missing;
 } HTTP_Body;
 
 typedef enum {
@@ -97,9 +104,14 @@ typedef enum {
     HTTP_Parse_Result_Done,
     HTTP_Parse_Result_Needs_More_Data,
     HTTP_Parse_Result_Invalid_Data,
-    HTTP_Parse_Result_TODO
+    HTTP_Parse_Result_TODO,
+
+    HTTP_Parse_Result_Count
 } HTTP_Parse_Result;
 
+// E.g. "Invalid data". Lives forever.
+const char *http_parse_result_to_string(const HTTP_Parse_Result result);
+
 HTTP_Parse_Result http_try_parse(HTTP_Parser *parser, const char *buf, const uint64_t buf_len, HTTP *out_http);
 HTTP_Parse_Result http_try_parse_status(const char *buf, const uint64_t buf_len, HTTP_Status *out_status, uint64_t *out_consumed_bytes);
 HTTP_Parse_Result http_try_parse_headers(const char *buf, const uint64_t buf_len, HTTP_Headers *out_headers, uint64_t *out_consumed_bytes);
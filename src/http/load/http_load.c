@@ -0,0 +1,442 @@
+#include "http_load.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "clock/clock.h"
+#include "http/client/http_client.h"
+#include "log/log.h"
+#include "trace/trace.h"
+#include "worker/worker.h"
+#include "worker/queue/worker_queue.h"
+
+#define HTTP_LOAD_MIN_TIMEOUT_CHECK_INTERVAL_NS CLOCK_NS_PER_MS
+
+// One request's worth of room in flight.
+typedef struct {
+    uint64_t intended_ns; // When it should have gone out. What the latency is measured from.
+    uint64_t sent_ns;     // When it did.
+    HTTP_Client_Request_Handle handle;
+    bool in_flight;
+} HTTP_Load_Slot;
+
+typedef struct {
+    const HTTP_Load_Options *options;
+    uint32_t index;
+    char name[32];
+
+    uint32_t connections;
+    uint64_t interval_ns;   // Between this thread's requests in an open loop. 0 for a closed loop.
+    uint64_t first_send_ns; // Where this thread's schedule starts, in an open loop.
+    uint64_t end_ns;        // Nothing is sent from here on.
+    uint64_t timeout_ns;
+
+    HTTP_Load_Result *result;
+    uint64_t last_done_ns;
+    bool ok;
+
+    pthread_t thread;
+} HTTP_Load_Thread;
+
+static void http_load_record(HTTP_Load_Result *result, const HTTP_Load_Slot *slot, const HTTP_Client_Completion *completion, const uint64_t now_ns) {
+    const HTTP_Client_Timings *timings = &completion->timings;
+
+    for(uint32_t phase = 0; phase < (uint32_t)timings->phases_completed; phase++) {
+        histogram_record(&result->phases[phase], timings->duration_us[phase]);
+    }
+
+    if(timings->phases_completed != HTTP_Client_Phase_Total) {
+        result->failed_in_phase[timings->phases_completed] += 1;
+        if(completion->socket_result != TCP_Socket_Result_OK) {
+            result->socket_errors[completion->socket_result] += 1;
+        }
+        if(timings->phases_completed == HTTP_Client_Phase_Body_Transfer && completion->parse_result != HTTP_Parse_Result_Done) {
+            result->parse_errors[completion->parse_result] += 1;
+        }
+        return;
+    }
+
+    histogram_record(&result->phases[HTTP_Client_Phase_Total], timings->duration_us[HTTP_Client_Phase_Total]);
+    histogram_record(&result->latency, (now_ns - slot->intended_ns) / CLOCK_NS_PER_US);
+    histogram_record(&result->latency_uncorrected, (now_ns - slot->sent_ns) / CLOCK_NS_PER_US);
+
+    int status_class = completion->http->status.status_code / 100;
+    result->status_classes[status_class >= 1 && status_class <= 5 ? status_class : 0] += 1;
+    result->responses += 1;
+    result->body_bytes += completion->http->body.string_buffer.length;
+}
+
+static void *http_load_thread_main(void *argument) {
+    HTTP_Load_Thread *thread = (HTTP_Load_Thread *)argument;
+    const HTTP_Load_Options *options = thread->options;
+    HTTP_Load_Result *result = thread->result;
+
+    trace_set_thread_name(thread->name);
+
+    HTTP_Load_Slot *slots = calloc(thread->connections, sizeof(HTTP_Load_Slot));
+    uint32_t *free_slots = malloc(thread->connections * sizeof(uint32_t)); // A stack of indices into 'slots'.
+    Worker_Queue completions;
+    bool got_queue = worker_queue_init(&completions, thread->connections);
+    if(slots == NULL || free_slots == NULL || !got_queue) {
+        LOG_ERROR("'%s': Out of memory.", thread->name);
+        if(got_queue) {
+            worker_queue_dispose(&completions);
+        }
+        free(slots);
+        free(free_slots);
+        return NULL;
+    }
+
+    uint32_t free_slot_count = thread->connections;
+    for(uint32_t i = 0; i < thread->connections; i++) {
+        free_slots[i] = thread->connections - 1 - i;
+    }
+
+    Worker worker;
+    memset(&worker, 0, sizeof(Worker));
+    worker.name = thread->name;
+
+    HTTP_Client_Request_Options request_options = {
+        .socket_options = options->socket_options,
+        .port = options->port,
+        .headers = options->headers,
+        .completion_queue = &completions,
+    };
+
+    // NOTE: Scanning every slot for timeouts on every tick would cost more than the requests at high rates. Only look
+    // every so often; a request may go a little past its timeout before it's noticed, which doesn't matter.
+    uint64_t timeout_check_interval_ns = thread->timeout_ns / 16;
+    if(timeout_check_interval_ns < HTTP_LOAD_MIN_TIMEOUT_CHECK_INTERVAL_NS) {
+        timeout_check_interval_ns = HTTP_LOAD_MIN_TIMEOUT_CHECK_INTERVAL_NS;
+    }
+    uint64_t next_timeout_check_ns = 0;
+
+    uint64_t next_send_ns = thread->first_send_ns;
+    uint32_t in_flight = 0;
+
+    while(true) {
+        uint64_t now_ns = clock_now_ns();
+
+        // Send whatever is due, as long as there's room. In an open loop, whatever didn't get room stays due and will
+        // go out late, but its latency still counts from its place in the schedule.
+        bool failed_to_start = false;
+        while(free_slot_count > 0 && now_ns < thread->end_ns) {
+            uint64_t intended_ns = now_ns;
+            if(thread->interval_ns > 0) {
+                if(next_send_ns > now_ns || next_send_ns >= thread->end_ns) {
+                    break;
+                }
+                intended_ns = next_send_ns;
+            }
+
+            uint32_t slot_index = free_slots[free_slot_count - 1];
+            HTTP_Load_Slot *slot = &slots[slot_index];
+            slot->intended_ns = intended_ns;
+            slot->sent_ns = now_ns;
+
+            request_options.user_data = slot;
+            if(!http_client_request(&worker, options->method, options->hostname, options->path, options->body, &request_options, NULL, &slot->handle)) {
+                result->failed_to_start += 1;
+                failed_to_start = true;
+                break; // Try again in a bit.
+            }
+
+            free_slot_count -= 1;
+            slot->in_flight = true;
+            in_flight += 1;
+            result->requests += 1;
+            next_send_ns += thread->interval_ns;
+        }
+
+        bool nothing_more_to_send = now_ns >= thread->end_ns || (thread->interval_ns > 0 && next_send_ns >= thread->end_ns);
+        if(in_flight == 0 && nothing_more_to_send) {
+            break;
+        }
+
+        worker_work(&worker);
+
+        now_ns = clock_now_ns();
+        bool got_any = false;
+        HTTP_Client_Completion *completion;
+        while((completion = worker_queue_pop(&completions)) != NULL) {
+            HTTP_Load_Slot *slot = completion->user_data;
+            http_load_record(result, slot, completion, now_ns);
+            http_client_completion_free(completion);
+
+            slot->in_flight = false;
+            free_slots[free_slot_count++] = (uint32_t)(slot - slots);
+            in_flight -= 1;
+            thread->last_done_ns = now_ns;
+            got_any = true;
+        }
+
+        if(in_flight > 0 && now_ns >= next_timeout_check_ns) {
+            for(uint32_t i = 0; i < thread->connections; i++) {
+                HTTP_Load_Slot *slot = &slots[i];
+                if(!slot->in_flight || now_ns - slot->sent_ns < thread->timeout_ns) {
+                    continue;
+                }
+                if(!http_client_request_cancel(slot->handle)) {
+                    continue; // It finished meanwhile. Its completion is on the way.
+                }
+
+                // NOTE: Into the latencies too, as of now; it took at least that long. Leaving it out would drop a stalled
+                // server from the percentiles all over again, which is what measuring from 'intended_ns' is there to
+                // prevent.
+                result->timeouts += 1;
+                histogram_record(&result->latency, (now_ns - slot->intended_ns) / CLOCK_NS_PER_US);
+                histogram_record(&result->latency_uncorrected, (now_ns - slot->sent_ns) / CLOCK_NS_PER_US);
+                slot->in_flight = false;
+                free_slots[free_slot_count++] = i;
+                in_flight -= 1;
+                thread->last_done_ns = now_ns;
+                got_any = true;
+            }
+            next_timeout_check_ns = now_ns + timeout_check_interval_ns;
+        }
+
+        if(got_any) {
+            continue; // There's room for more now.
+        }
+
+        // Sleep until a request has something to do, the next one is due, or it's time to look for timeouts.
+        uint64_t wake_ns = UINT64_MAX;
+        if(free_slot_count > 0 && !nothing_more_to_send) {
+            if(thread->interval_ns > 0) {
+                wake_ns = next_send_ns;
+            }
+            else if(failed_to_start) {
+                wake_ns = now_ns + CLOCK_NS_PER_MS;
+            }
+        }
+        if(in_flight > 0 && next_timeout_check_ns < wake_ns) {
+            wake_ns = next_timeout_check_ns;
+        }
+
+        if(wake_ns == UINT64_MAX) {
+            worker_wait(&worker, -1);
+        }
+        else if(wake_ns > now_ns) {
+            uint64_t wait_ms = (wake_ns - now_ns + CLOCK_NS_PER_MS - 1) / CLOCK_NS_PER_MS;
+            worker_wait(&worker, (int32_t)wait_ms);
+        }
+    }
+
+    worker_dispose(&worker);
+    worker_queue_dispose(&completions);
+    free(slots);
+    free(free_slots);
+
+    thread->ok = true;
+    return NULL;
+}
+
+static void http_load_merge(HTTP_Load_Result *into, const HTTP_Load_Result *from) {
+    into->requests += from->requests;
+    into->responses += from->responses;
+    for(uint32_t i = 0; i < 6; i++) {
+        into->status_classes[i] += from->status_classes[i];
+    }
+    into->body_bytes += from->body_bytes;
+
+    for(uint32_t i = 0; i < HTTP_Client_Phase_Count; i++) {
+        into->failed_in_phase[i] += from->failed_in_phase[i];
+        histogram_merge(&into->phases[i], &from->phases[i]);
+    }
+    for(uint32_t i = 0; i < TCP_Socket_Result_Count; i++) {
+        into->socket_errors[i] += from->socket_errors[i];
+    }
+    for(uint32_t i = 0; i < HTTP_Parse_Result_Count; i++) {
+        into->parse_errors[i] += from->parse_errors[i];
+    }
+    into->timeouts += from->timeouts;
+    into->failed_to_start += from->failed_to_start;
+
+    histogram_merge(&into->latency, &from->latency);
+    histogram_merge(&into->latency_uncorrected, &from->latency_uncorrected);
+}
+
+bool http_load_run(const HTTP_Load_Options *options, HTTP_Load_Result *out_result) {
+    assert(options != NULL);
+    assert(options->hostname != NULL);
+    assert(options->path != NULL);
+    assert(options->rate >= 0);
+    assert(out_result != NULL);
+
+    memset(out_result, 0, sizeof(HTTP_Load_Result));
+
+    uint32_t connections = options->connections > 0 ? options->connections : HTTP_LOAD_DEFAULT_CONNECTIONS;
+    uint32_t thread_count = options->threads > 0 ? options->threads : 1;
+    if(thread_count > connections) {
+        thread_count = connections;
+    }
+    uint64_t duration_ns = (uint64_t)(options->duration_s > 0 ? options->duration_s : HTTP_LOAD_DEFAULT_DURATION_S) * CLOCK_NS_PER_S;
+    uint64_t timeout_ns = (uint64_t)(options->timeout_ms > 0 ? options->timeout_ms : HTTP_LOAD_DEFAULT_TIMEOUT_MS) * CLOCK_NS_PER_MS;
+
+    HTTP_Load_Thread *threads = calloc(thread_count, sizeof(HTTP_Load_Thread));
+    if(threads == NULL) {
+        return false;
+    }
+
+    // Every thread takes every 'thread_count'th slot of the schedule, so together they send at 'rate', evenly spaced.
+    uint64_t start_ns = clock_now_ns();
+    double ns_between_requests = options->rate > 0 ? (double)CLOCK_NS_PER_S / options->rate : 0;
+
+    uint32_t threads_started = 0;
+    for(uint32_t i = 0; i < thread_count; i++) {
+        HTTP_Load_Thread *thread = &threads[i];
+        thread->options = options;
+        thread->index = i;
+        snprintf(thread->name, sizeof(thread->name), "Load %u", i);
+
+        thread->connections = connections / thread_count + (i < connections % thread_count ? 1 : 0);
+        if(options->rate > 0) {
+            thread->interval_ns = (uint64_t)(ns_between_requests * thread_count);
+            if(thread->interval_ns == 0) {
+                thread->interval_ns = 1;
+            }
+            thread->first_send_ns = start_ns + (uint64_t)(ns_between_requests * i);
+        }
+        thread->end_ns = start_ns + duration_ns;
+        thread->timeout_ns = timeout_ns;
+
+        thread->result = calloc(1, sizeof(HTTP_Load_Result));
+        if(thread->result == NULL) {
+            break;
+        }
+        if(pthread_create(&thread->thread, NULL, http_load_thread_main, thread) != 0) {
+            LOG_ERROR("Failed to start load thread %u.", i);
+            free(thread->result);
+            thread->result = NULL;
+            break;
+        }
+        threads_started += 1;
+    }
+
+    uint64_t last_done_ns = start_ns;
+    bool ok = threads_started == thread_count;
+    for(uint32_t i = 0; i < threads_started; i++) {
+        HTTP_Load_Thread *thread = &threads[i];
+        pthread_join(thread->thread, NULL);
+
+        ok = ok && thread->ok;
+        http_load_merge(out_result, thread->result);
+        if(thread->last_done_ns > last_done_ns) {
+            last_done_ns = thread->last_done_ns;
+        }
+        free(thread->result);
+    }
+    out_result->duration_ns = last_done_ns - start_ns;
+
+    free(threads);
+    return ok;
+}
+
+static void http_load_print_histogram(const char *name, const Histogram *histogram) {
+    LOG_INFO("    %-20s mean %8llu, p50 %8llu, p90 %8llu, p99 %8llu, p99.9 %8llu, p99.99 %8llu, max %8llu.",
+        name,
+        (unsigned long long)histogram_mean(histogram),
+        (unsigned long long)histogram_value_at_percentile(histogram, 50.0),
+        (unsigned long long)histogram_value_at_percentile(histogram, 90.0),
+        (unsigned long long)histogram_value_at_percentile(histogram, 99.0),
+        (unsigned long long)histogram_value_at_percentile(histogram, 99.9),
+        (unsigned long long)histogram_value_at_percentile(histogram, 99.99),
+        (unsigned long long)histogram->max
+    );
+}
+
+void http_load_print(const HTTP_Load_Options *options, const HTTP_Load_Result *result) {
+    assert(options != NULL);
+    assert(result != NULL);
+
+    double seconds = (double)result->duration_ns / (double)CLOCK_NS_PER_S;
+    if(seconds <= 0) {
+        seconds = 1e-9;
+    }
+
+    if(options->rate > 0) {
+        LOG_INFO("%s %s:%u/%s, open loop at %.1f requests/s, at most %u in flight.",
+            http_method_to_string(options->method), options->hostname, options->port != 0 ? options->port : TCP_ENDPOINT_DEFAULT_PORT, options->path,
+            options->rate, options->connections > 0 ? options->connections : HTTP_LOAD_DEFAULT_CONNECTIONS
+        );
+    }
+    else {
+        LOG_INFO("%s %s:%u/%s, closed loop with %u in flight.",
+            http_method_to_string(options->method), options->hostname, options->port != 0 ? options->port : TCP_ENDPOINT_DEFAULT_PORT, options->path,
+            options->connections > 0 ? options->connections : HTTP_LOAD_DEFAULT_CONNECTIONS
+        );
+    }
+
+    LOG_INFO("  %llu requests in %.2f s, %llu responses, %.2f MB of body.",
+        (unsigned long long)result->requests,
+        seconds,
+        (unsigned long long)result->responses,
+        (double)result->body_bytes / (1024.0 * 1024.0)
+    );
+    LOG_INFO("  Requests/s: %.1f. Responses/s: %.1f. Body MB/s: %.2f.",
+        (double)result->requests / seconds,
+        (double)result->responses / seconds,
+        (double)result->body_bytes / (1024.0 * 1024.0) / seconds
+    );
+
+    if(result->latency.total_count > 0) {
+        LOG_INFO("  Latency of complete responses and timeouts (us):");
+        http_load_print_histogram("Latency", &result->latency);
+        if(options->rate > 0) {
+            http_load_print_histogram("Uncorrected", &result->latency_uncorrected);
+        }
+
+        if(result->phases[0].total_count > 0) { // Timeouts alone don't have any.
+            LOG_INFO("  Phases (us):");
+        }
+        for(uint32_t phase = 0; phase < HTTP_Client_Phase_Count; phase++) {
+            if(result->phases[phase].total_count > 0) {
+                http_load_print_histogram(http_client_phase_name((HTTP_Client_Phase)phase), &result->phases[phase]);
+            }
+        }
+    }
+
+    LOG_INFO("  Status: 1xx %llu, 2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu, other %llu.",
+        (unsigned long long)result->status_classes[1],
+        (unsigned long long)result->status_classes[2],
+        (unsigned long long)result->status_classes[3],
+        (unsigned long long)result->status_classes[4],
+        (unsigned long long)result->status_classes[5],
+        (unsigned long long)result->status_classes[0]
+    );
+
+    uint64_t failures = result->timeouts + result->failed_to_start;
+    for(uint32_t phase = 0; phase < HTTP_Client_Phase_Count; phase++) {
+        failures += result->failed_in_phase[phase];
+    }
+    if(failures == 0) {
+        LOG_INFO("  No errors.");
+        return;
+    }
+
+    LOG_INFO("  Errors: %llu.", (unsigned long long)failures);
+    if(result->timeouts > 0) {
+        LOG_INFO("    Timed out: %llu.", (unsigned long long)result->timeouts);
+    }
+    if(result->failed_to_start > 0) {
+        LOG_INFO("    Failed to start: %llu.", (unsigned long long)result->failed_to_start);
+    }
+    for(uint32_t phase = 0; phase < HTTP_Client_Phase_Count; phase++) {
+        if(result->failed_in_phase[phase] > 0) {
+            LOG_INFO("    Failed during %s: %llu.", http_client_phase_name((HTTP_Client_Phase)phase), (unsigned long long)result->failed_in_phase[phase]);
+        }
+    }
+    for(uint32_t i = 0; i < TCP_Socket_Result_Count; i++) {
+        if(result->socket_errors[i] > 0) {
+            LOG_INFO("    Socket: %s: %llu.", tcp_socket_result_to_string((TCP_Socket_Result)i), (unsigned long long)result->socket_errors[i]);
+        }
+    }
+    for(uint32_t i = 0; i < HTTP_Parse_Result_Count; i++) {
+        if(result->parse_errors[i] > 0) {
+            LOG_INFO("    Parse: %s: %llu.", http_parse_result_to_string((HTTP_Parse_Result)i), (unsigned long long)result->parse_errors[i]);
+        }
+    }
+}
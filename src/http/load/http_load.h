@@ -0,0 +1,87 @@
+#ifndef HTTP_LOAD_H
+#define HTTP_LOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "http/http.h"
+#include "http/client/http_client_stats.h"
+#include "histogram/histogram.h"
+#include "tcp/tcp_socket.h"
+
+// Load generator, like wrk, driving the same HTTP client everything else uses. Two ways to put on load:
+//
+// - Closed loop ('rate' 0): 'connections' requests are kept in flight. Each one that finishes is replaced right away,
+//   so the server sets the pace. Latency is from send to complete response.
+// - Open loop ('rate' > 0): requests go out on a fixed schedule, 'rate' per second, whether or not earlier ones have
+//   come back, with at most 'connections' in flight. A request that had to wait for room (or for us) still counts its
+//   latency from when the schedule said it should have gone out. Otherwise a stalled server holds back exactly the
+//   requests that would have seen the stall, and the percentiles look far better than what users would see
+//   ("coordinated omission"). The uncorrected latency is kept too, to show the difference.
+//
+// The client makes a new connection per request, so 'connections' is really requests in flight. The load is split
+// over 'threads' threads, each with its own Worker, and their results are added up at the end.
+
+#ifndef HTTP_LOAD_DEFAULT_CONNECTIONS
+#define HTTP_LOAD_DEFAULT_CONNECTIONS 10
+#endif
+
+#ifndef HTTP_LOAD_DEFAULT_DURATION_S
+#define HTTP_LOAD_DEFAULT_DURATION_S 10
+#endif
+
+#ifndef HTTP_LOAD_DEFAULT_TIMEOUT_MS
+#define HTTP_LOAD_DEFAULT_TIMEOUT_MS 2000
+#endif
+
+typedef struct {
+    // The request. Same meaning as for http_client_request(..); all borrowed.
+    HTTP_Method method;
+    const char *hostname;
+    const char *path; // Without the leading '/'.
+    const char *body;
+    const char *headers;
+    uint16_t port;    // 0 for TCP_ENDPOINT_DEFAULT_PORT.
+    const TCP_Socket_Options *socket_options; // NULL for TCP_Socket_Profile_Default.
+
+    uint32_t threads;     // 0 for 1.
+    uint32_t connections; // 0 for HTTP_LOAD_DEFAULT_CONNECTIONS. At least one per thread.
+    double rate;          // Requests per second, over all threads. 0 for a closed loop.
+    uint32_t duration_s;  // 0 for HTTP_LOAD_DEFAULT_DURATION_S.
+    uint32_t timeout_ms;  // Requests still out after this long are cancelled. 0 for HTTP_LOAD_DEFAULT_TIMEOUT_MS.
+} HTTP_Load_Options;
+
+// Counts and histograms are for requests that were sent during the run. Requests still out when it ends are given
+// until their timeout to finish.
+typedef struct {
+    uint64_t duration_ns; // From the first request to the last one finishing.
+
+    uint64_t requests;        // Sent.
+    uint64_t responses;       // Complete responses, whatever their status code.
+    uint64_t status_classes[6]; // Responses by the first digit of their status code. [0] for anything outside 1xx-5xx.
+    uint64_t body_bytes;      // Of complete responses.
+
+    // Requests without a complete response, by the phase they failed in, and why as far as the client knows.
+    uint64_t failed_in_phase[HTTP_Client_Phase_Count];
+    uint64_t socket_errors[TCP_Socket_Result_Count];
+    uint64_t parse_errors[HTTP_Parse_Result_Count]; // Only for responses that started arriving.
+    uint64_t timeouts;        // Cancelled after 'timeout_ms'. Not in 'failed_in_phase', but in the latencies.
+    uint64_t failed_to_start; // http_client_request(..) itself failed, i.e. out of memory.
+
+    // Microseconds. 'latency' is corrected for coordinated omission (see above), so it's the one to look at.
+    // 'latency_uncorrected' is from when each request actually went out; the same as 'latency' in a closed loop. Both
+    // are for complete responses and timeouts, the latter counted up to when they were given up on. Other failures
+    // aren't in them.
+    Histogram latency;
+    Histogram latency_uncorrected;
+    Histogram phases[HTTP_Client_Phase_Count]; // As the client measured them. Only phases that completed.
+} HTTP_Load_Result;
+
+// Runs the load and blocks until it's done. 'out_result' is big (tens of KB), so best not on the stack. Returns false
+// if it couldn't get going.
+bool http_load_run(const HTTP_Load_Options *options, HTTP_Load_Result *out_result);
+
+// Throughput, latency percentiles, per-phase timings and errors.
+void http_load_print(const HTTP_Load_Options *options, const HTTP_Load_Result *result);
+
+#endif
@@ -0,0 +1,821 @@
+#define _GNU_SOURCE // memmem(..).
+
+#include "http_server.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "clock/clock.h"
+#include "log/log.h"
+#include "metrics/metrics.h"
+#include "worker/worker.h"
+#include "worker/coroutine/worker_coroutine.h"
+
+// How long to back off when accepting fails for something other than there being nothing to accept, e.g. running out
+// of file descriptors. Retrying right away would only spin.
+#define HTTP_SERVER_ACCEPT_RETRY_NS (10 * CLOCK_NS_PER_MS)
+
+typedef struct HTTP_Server_Connection HTTP_Server_Connection;
+
+struct HTTP_Server_Thread {
+    HTTP_Server *server;
+    uint32_t index;
+    char name[32];
+
+    Worker worker;
+    TCP_Socket listener;
+    bool owns_listener; // A Unix socket can't be listened on more than once, so every thread shares the first one's.
+
+    // For the request being answered. There's only ever one at a time per thread.
+    HTTP_Headers headers;
+    HTTP_Server_Response response;
+    String_Buffer response_head;
+
+    HTTP_Server_Connection *connections; // Every open connection, to close them when stopping.
+
+    pthread_t thread;
+    bool started;
+};
+
+struct HTTP_Server_Connection {
+    Worker_Coroutine coroutine;
+    HTTP_Server_Thread *thread;
+    TCP_Socket socket;
+
+    String_Buffer input;
+    uint64_t input_offset; // Where the next request starts. Everything before it has been answered.
+
+    // What's left of a response the socket didn't take in one go. Only allocated while there is some.
+    String_Buffer output;
+    uint64_t output_offset;
+    bool has_output;
+
+    // The file a response is being sent from, after 'output'. See HTTP_Server_Response.file.
+    bool has_file;
+    int file_fd;
+    uint64_t file_offset;
+    uint64_t file_remaining;
+    HTTP_Server_Release_Callback file_release;
+    void *file_release_data;
+
+    uint64_t idle_deadline_ns;
+    bool close_after; // Close once 'output' is sent.
+
+    HTTP_Server_Connection *previous;
+    HTTP_Server_Connection *next;
+};
+
+static inline bool http_server_stopping(const HTTP_Server *server) {
+    return __atomic_load_n(&server->stopping, __ATOMIC_ACQUIRE);
+}
+
+static void http_server_release_file(HTTP_Server_Connection *connection) {
+    if(!connection->has_file) {
+        return;
+    }
+
+    connection->has_file = false;
+    if(connection->file_release != NULL) {
+        connection->file_release(connection->file_release_data);
+    }
+}
+
+static void http_server_connection_close(HTTP_Server_Connection *connection) {
+    HTTP_Server_Thread *thread = connection->thread;
+
+    if(connection->previous != NULL) {
+        connection->previous->next = connection->next;
+    } else {
+        thread->connections = connection->next;
+    }
+    if(connection->next != NULL) {
+        connection->next->previous = connection->previous;
+    }
+    connection->previous = NULL;
+    connection->next = NULL;
+
+    http_server_release_file(connection);
+    tcp_socket_close(&connection->socket);
+    string_buffer_free(&connection->input);
+    if(connection->has_output) {
+        string_buffer_free(&connection->output);
+        connection->has_output = false;
+    }
+
+    metrics_gauge_add(Metric_Gauge_HTTP_Server_Connections_Open, -1);
+}
+
+// Sends as much of the file as the socket takes. Returns false if the socket is gone.
+static bool http_server_flush_file(HTTP_Server_Connection *connection) {
+    while(connection->file_remaining > 0) {
+        uint64_t bytes_sent = 0;
+        TCP_Socket_Result result = tcp_socket_send_file(&connection->socket, connection->file_fd, &connection->file_offset, connection->file_remaining, &bytes_sent);
+        if(result == TCP_Socket_Result_Not_Ready_To_Be_Written_To) {
+            return true;
+        }
+        if(result != TCP_Socket_Result_OK || bytes_sent == 0) {
+            // NOTE: 0 means the file got shorter since it was opened. What we said the Content-Length was is a lie
+            // now, so the connection can't be used for anything else.
+            return false;
+        }
+        connection->file_remaining -= bytes_sent;
+    }
+
+    http_server_release_file(connection);
+    return true;
+}
+
+// Sends what's left of the current response, as far as the socket takes it. Returns false if the socket is gone.
+static bool http_server_flush_output(HTTP_Server_Connection *connection) {
+    while(connection->has_output && connection->output_offset < connection->output.length) {
+        uint32_t bytes_sent = 0;
+        TCP_Socket_Result result = tcp_socket_send(
+            &connection->socket,
+            &connection->output.data[connection->output_offset],
+            connection->output.length - connection->output_offset,
+            &bytes_sent
+        );
+        if(result == TCP_Socket_Result_Not_Ready_To_Be_Written_To) {
+            return true;
+        }
+        if(result != TCP_Socket_Result_OK) {
+            return false;
+        }
+        connection->output_offset += bytes_sent;
+    }
+
+    if(connection->has_output) {
+        string_buffer_free(&connection->output);
+        connection->has_output = false;
+        connection->output_offset = 0;
+    }
+
+    return !connection->has_file || http_server_flush_file(connection);
+}
+
+static inline bool http_server_output_pending(const HTTP_Server_Connection *connection) {
+    return connection->has_output || connection->has_file;
+}
+
+// A corked socket holds on to the last partial segment until it's uncorked. Once a response is all out, that's what
+// we want gone.
+static inline void http_server_push_corked(HTTP_Server_Connection *connection) {
+    if(connection->socket.corked) {
+        tcp_socket_set_cork(&connection->socket, false);
+        tcp_socket_set_cork(&connection->socket, true);
+    }
+}
+
+// Sends head and body in one go, if the socket takes it. Whatever it doesn't is copied to the connection's output.
+// With 'more', the kernel is told the connection's file follows right after.
+static void http_server_send(HTTP_Server_Connection *connection, const char *head, const uint64_t head_length, const char *body, const uint64_t body_length, const bool more) {
+    assert(!connection->has_output);
+
+    struct iovec parts[2];
+    uint32_t part_count = 0;
+    parts[part_count++] = (struct iovec){ .iov_base = (void *)head, .iov_len = head_length };
+    if(body_length > 0) {
+        parts[part_count++] = (struct iovec){ .iov_base = (void *)body, .iov_len = body_length };
+    }
+
+    uint32_t bytes_sent = 0;
+    TCP_Socket_Result result = more
+        ? tcp_socket_send_vectored_more(&connection->socket, parts, part_count, &bytes_sent)
+        : tcp_socket_send_vectored(&connection->socket, parts, part_count, &bytes_sent);
+    if(result != TCP_Socket_Result_OK && result != TCP_Socket_Result_Not_Ready_To_Be_Written_To) {
+        connection->close_after = true;
+        return;
+    }
+
+    uint64_t total_length = head_length + body_length;
+    if(bytes_sent == total_length) {
+        if(!more) {
+            http_server_push_corked(connection);
+        }
+        return;
+    }
+
+    uint64_t remaining = total_length - bytes_sent;
+    string_buffer_init(&connection->output, remaining + 1);
+    connection->has_output = true;
+    connection->output_offset = 0;
+
+    if(bytes_sent < head_length) {
+        string_buffer_append_buf(&connection->output, &head[bytes_sent], head_length - bytes_sent);
+        if(body_length > 0) {
+            string_buffer_append_buf(&connection->output, body, body_length);
+        }
+    } else {
+        string_buffer_append_buf(&connection->output, &body[bytes_sent - head_length], remaining);
+    }
+}
+
+// Answers without bothering the handler, and closes the connection afterwards. Whatever else the client sent is
+// dropped.
+static void http_server_reject(HTTP_Server_Connection *connection, const int status_code) {
+    HTTP_Server_Thread *thread = connection->thread;
+
+    LOG_DEBUG("'%s': Rejecting a request with %i.", thread->name, status_code);
+
+    String_Buffer *head = &thread->response_head;
+    head->length = 0;
+    string_buffer_appendf(head,
+        "HTTP/1.1 %i %s\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        status_code, http_get_status_text_for_status_code(status_code)
+    );
+
+    connection->close_after = true;
+    connection->input_offset = connection->input.length;
+    http_server_send(connection, head->data, head->length, NULL, 0, false);
+
+    metrics_count(Metric_Counter_HTTP_Server_Requests_Rejected, 1);
+}
+
+// 1xx, 204 and 304 never have a body, and don't say how long it is either.
+static inline bool http_server_status_has_body(const int status_code) {
+    return status_code >= 200 && status_code != 204 && status_code != 304;
+}
+
+// Strict, unlike atoi(..): digits only, and no overflow.
+static bool http_server_parse_content_length(const char *text, uint64_t *out_length) {
+    uint64_t length = 0;
+    if(*text == '\0') {
+        return false;
+    }
+    for(const char *c = text; *c != '\0'; c++) {
+        if(*c < '0' || *c > '9' || length > (UINT64_MAX - 9) / 10) {
+            return false;
+        }
+        length = length * 10 + (uint64_t)(*c - '0');
+    }
+    *out_length = length;
+    return true;
+}
+
+// Answers the request at the start of the connection's unanswered input, if all of it is there. Returns false if it
+// isn't yet. Sets 'close_after' if the connection shouldn't be used for anything else.
+static bool http_server_answer_next_request(HTTP_Server_Connection *connection) {
+    HTTP_Server_Thread *thread = connection->thread;
+    const HTTP_Server_Options *options = &thread->server->options;
+
+    char *start = &connection->input.data[connection->input_offset];
+    uint64_t available = connection->input.length - connection->input_offset;
+    if(available == 0) {
+        return false;
+    }
+
+    const char *head_end = memmem(start, available, "\r\n\r\n", 4);
+    if(head_end == NULL) {
+        if(available >= HTTP_SERVER_MAX_HEAD_SIZE) {
+            http_server_reject(connection, 431);
+            return true;
+        }
+        return false;
+    }
+    uint64_t head_length = (uint64_t)(head_end - start) + 4;
+    if(head_length > HTTP_SERVER_MAX_HEAD_SIZE) {
+        http_server_reject(connection, 431);
+        return true;
+    }
+
+    // The request line: METHOD SP target SP HTTP/1.x. Cut up in place below, once it's known to be good.
+    char *line_end = memchr(start, '\r', head_length);
+    assert(line_end != NULL);
+    char *method_end = memchr(start, ' ', (size_t)(line_end - start));
+    char *target = method_end != NULL ? method_end + 1 : NULL;
+    char *target_end = target != NULL ? memchr(target, ' ', (size_t)(line_end - target)) : NULL;
+    if(target_end == NULL || target_end == target || target[0] != '/') {
+        http_server_reject(connection, 400);
+        return true;
+    }
+
+    const char *version = target_end + 1;
+    uint64_t version_length = (uint64_t)(line_end - version);
+    uint8_t http_version_minor = 0;
+    if(version_length == 8 && memcmp(version, "HTTP/1.1", 8) == 0) {
+        http_version_minor = 1;
+    }
+    else if(version_length == 8 && memcmp(version, "HTTP/1.0", 8) == 0) {
+        http_version_minor = 0;
+    }
+    else {
+        http_server_reject(connection, version_length >= 5 && memcmp(version, "HTTP/", 5) == 0 ? 505 : 400);
+        return true;
+    }
+
+    HTTP_Method method;
+    {
+        char method_text[8];
+        uint64_t method_length = (uint64_t)(method_end - start);
+        if(method_length == 0 || method_length >= sizeof(method_text)) {
+            http_server_reject(connection, method_length == 0 ? 400 : 501);
+            return true;
+        }
+        memcpy(method_text, start, method_length);
+        method_text[method_length] = '\0';
+        if(!http_string_to_method_type(method_text, &method)) {
+            http_server_reject(connection, 501);
+            return true;
+        }
+    }
+
+    // The headers go through the same parser as the client's responses. It stops early past HTTP_MAX_HEADERS, so
+    // count them first.
+    char *headers_start = line_end + 2;
+    uint32_t header_count = 0;
+    for(const char *c = headers_start; c < head_end; c++) {
+        if(*c == '\n') {
+            header_count += 1;
+        }
+    }
+    if(headers_start < head_end) {
+        header_count += 1; // The last one ends in the "\r\n\r\n".
+    }
+    if(header_count > HTTP_MAX_HEADERS) {
+        http_server_reject(connection, 431);
+        return true;
+    }
+
+    HTTP_Headers *headers = &thread->headers;
+    headers->header_count = 0;
+    uint64_t headers_length = 0;
+    if(http_try_parse_headers(headers_start, (uint64_t)(head_end + 4 - headers_start), headers, &headers_length) != HTTP_Parse_Result_Done) {
+        http_server_reject(connection, 400);
+        return true;
+    }
+
+    const char *value = NULL;
+    if(http_try_get_key_from_header(headers, "Transfer-Encoding", &value)) {
+        http_server_reject(connection, 501); // Only Content-Length bodies.
+        return true;
+    }
+
+    uint64_t body_length = 0;
+    if(http_try_get_key_from_header(headers, "Content-Length", &value)) {
+        if(!http_server_parse_content_length(value, &body_length)) {
+            http_server_reject(connection, 400);
+            return true;
+        }
+        if(body_length > options->max_body_size) {
+            http_server_reject(connection, 413);
+            return true;
+        }
+    }
+
+    uint64_t request_length = head_length + body_length;
+    if(available < request_length) {
+        return false; // Wait for the rest of the body.
+    }
+
+    uint64_t arrived_ns = clock_now_ns();
+
+    bool keep_alive = http_version_minor == 1;
+    if(http_try_get_key_from_header(headers, "Connection", &value)) {
+        if(strcasestr(value, "close") != NULL) {
+            keep_alive = false;
+        }
+        else if(strcasestr(value, "keep-alive") != NULL) {
+            keep_alive = true;
+        }
+    }
+
+    // Cut the target into path and query, and null-terminate the body. The byte after the body may be the start of
+    // the next request, so it's put back afterwards.
+    *target_end = '\0';
+    char *query = strchr(target, '?');
+    if(query != NULL) {
+        *query = '\0';
+        query += 1;
+    }
+    char *body = &start[head_length];
+    char byte_after_body = body[body_length];
+    body[body_length] = '\0';
+
+    HTTP_Server_Request request = {
+        .method = method,
+        .path = target,
+        .query = query != NULL ? query : "",
+        .http_version_minor = http_version_minor,
+        .headers = headers,
+        .body = body,
+        .body_length = body_length,
+    };
+
+    HTTP_Server_Response *response = &thread->response;
+    response->status_code = 200;
+    response->content_type = NULL;
+    response->headers.length = 0;
+    response->headers.data[0] = '\0';
+    response->body.length = 0;
+    response->body.data[0] = '\0';
+    memset(&response->file, 0, sizeof(response->file));
+    response->file.fd = -1;
+    response->close_connection = false;
+
+    options->handler(&request, response, options->user_data);
+
+    body[body_length] = byte_after_body;
+    connection->input_offset += request_length;
+
+    if(response->status_code < 100 || response->status_code > 599) {
+        LOG_ERROR("'%s': The handler answered '%s' with status code %i. Sending 500 instead.", thread->name, target, response->status_code);
+        response->status_code = 500;
+        response->body.length = 0;
+    }
+
+    bool has_body = http_server_status_has_body(response->status_code);
+    bool has_file = response->file.fd != -1;
+    if(has_file && (!has_body || response->file.length == 0)) {
+        if(response->file.release != NULL) {
+            response->file.release(response->file.release_data);
+        }
+        has_file = false;
+        response->body.length = 0;
+    }
+    uint64_t content_length = has_file ? response->file.length : response->body.length;
+
+    bool close_after = !keep_alive || response->close_connection || http_server_stopping(thread->server);
+
+    String_Buffer *head = &thread->response_head;
+    head->length = 0;
+    const char *status_text = http_get_status_text_for_status_code(response->status_code);
+    string_buffer_appendf(head, "HTTP/1.1 %i %s\r\n", response->status_code, status_text != NULL ? status_text : "");
+
+    if(has_body) {
+        string_buffer_appendf(head, "Content-Length: %llu\r\n", (unsigned long long)content_length);
+    }
+    if(close_after) {
+        string_buffer_appendf(head, "Connection: close\r\n");
+    }
+    else if(http_version_minor == 0) {
+        string_buffer_appendf(head, "Connection: keep-alive\r\n");
+    }
+    if(response->content_type != NULL) {
+        string_buffer_appendf(head, "Content-Type: %s\r\n", response->content_type);
+    }
+    if(response->headers.length > 0) {
+        string_buffer_appendf(head, "%s", response->headers.data);
+    }
+    string_buffer_appendf(head, "\r\n");
+
+    connection->close_after = close_after;
+    if(has_file) {
+        connection->has_file = true;
+        connection->file_fd = response->file.fd;
+        connection->file_offset = response->file.offset;
+        connection->file_remaining = response->file.length;
+        connection->file_release = response->file.release;
+        connection->file_release_data = response->file.release_data;
+
+        http_server_send(connection, head->data, head->length, NULL, 0, true);
+        if(!connection->has_output && !connection->close_after && !http_server_flush_file(connection)) {
+            connection->close_after = true;
+        }
+        if(!http_server_output_pending(connection)) {
+            http_server_push_corked(connection);
+        }
+    }
+    else {
+        http_server_send(connection, head->data, head->length, response->body.data, has_body ? response->body.length : 0, false);
+    }
+
+    metrics_count(Metric_Counter_HTTP_Server_Requests_Handled, 1);
+    metrics_observe(Metric_Histogram_HTTP_Server_Request_Duration, (clock_now_ns() - arrived_ns) / CLOCK_NS_PER_US);
+
+    return true;
+}
+
+typedef enum {
+    HTTP_Server_Receive_Got_Data,
+    HTTP_Server_Receive_Nothing_Yet,
+    HTTP_Server_Receive_Closed, // By the client, or the socket failed.
+} HTTP_Server_Receive_Result;
+
+static HTTP_Server_Receive_Result http_server_receive(HTTP_Server_Connection *connection) {
+    bool got_data = false;
+
+    while(true) {
+        char *into = string_buffer_reserve(&connection->input, HTTP_SERVER_RECEIVE_SIZE);
+
+        uint32_t bytes_received = 0;
+        TCP_Socket_Result result = tcp_socket_receive(&connection->socket, into, HTTP_SERVER_RECEIVE_SIZE, &bytes_received);
+        if(result == TCP_Socket_Result_Not_Ready_To_Be_Read) {
+            break;
+        }
+        if(result != TCP_Socket_Result_OK || bytes_received == 0) {
+            return HTTP_Server_Receive_Closed;
+        }
+
+        string_buffer_commit(&connection->input, bytes_received);
+        got_data = true;
+
+        // NOTE: A read that didn't fill the space means the socket is drained for now. Asking again would just be
+        // another syscall to hear EAGAIN.
+        if(bytes_received < HTTP_SERVER_RECEIVE_SIZE) {
+            break;
+        }
+    }
+
+    return got_data ? HTTP_Server_Receive_Got_Data : HTTP_Server_Receive_Nothing_Yet;
+}
+
+// Drops what's been answered, so the buffer doesn't grow with every request on a long-lived connection.
+static void http_server_compact_input(HTTP_Server_Connection *connection) {
+    if(connection->input_offset == 0) {
+        return;
+    }
+
+    uint64_t remaining = connection->input.length - connection->input_offset;
+    memmove(connection->input.data, &connection->input.data[connection->input_offset], remaining);
+    connection->input.length = remaining;
+    connection->input.data[remaining] = '\0';
+    connection->input_offset = 0;
+}
+
+static bool http_server_connection_task(Worker *worker, Worker_Context *context, const uint32_t lifetime) {
+    (void)lifetime;
+
+    HTTP_Server_Connection *connection = (HTTP_Server_Connection *)context;
+    HTTP_Server_Thread *thread = connection->thread;
+
+    WORKER_COROUTINE_BEGIN(&connection->coroutine);
+
+    while(true) {
+        // Answer everything that's here. With pipelining that can be several requests, answered in order.
+        while(http_server_answer_next_request(connection)) {
+            while(http_server_output_pending(connection)) {
+                WORKER_AWAIT_WRITABLE(worker, &connection->coroutine, connection->socket.fd);
+                if(!http_server_flush_output(connection)) {
+                    connection->close_after = true;
+                    break;
+                }
+                if(!http_server_output_pending(connection)) {
+                    http_server_push_corked(connection);
+                }
+            }
+            if(connection->close_after) {
+                break;
+            }
+        }
+
+        if(connection->close_after) {
+            http_server_connection_close(connection);
+            WORKER_COROUTINE_EXIT(&connection->coroutine);
+        }
+
+        http_server_compact_input(connection);
+
+        // Wait for more, but not forever. The timeout starts over whenever something arrives.
+        connection->idle_deadline_ns = clock_now_ns() + (uint64_t)thread->server->options.keep_alive_timeout_ms * CLOCK_NS_PER_MS;
+        while(true) {
+            HTTP_Server_Receive_Result result = http_server_receive(connection);
+            if(result == HTTP_Server_Receive_Got_Data) {
+                break;
+            }
+            if(result == HTTP_Server_Receive_Closed || clock_now_ns() >= connection->idle_deadline_ns) {
+                http_server_connection_close(connection);
+                WORKER_COROUTINE_EXIT(&connection->coroutine);
+            }
+
+            worker_task_wait_for_fd(worker, connection->socket.fd, Worker_Wait_Events_Readable);
+            worker_task_wait_until(worker, connection->idle_deadline_ns);
+            WORKER_COROUTINE_YIELD(&connection->coroutine);
+        }
+    }
+
+    WORKER_COROUTINE_END(&connection->coroutine);
+}
+
+static void http_server_connection_start(HTTP_Server_Thread *thread, TCP_Socket socket) {
+    HTTP_Server_Connection connection;
+    memset(&connection, 0, sizeof(HTTP_Server_Connection));
+    connection.thread = thread;
+    connection.socket = socket;
+
+    Worker_Task_Handle handle;
+    if(!worker_add_task(&thread->worker, &connection, sizeof(HTTP_Server_Connection), http_server_connection_task, &handle)) {
+        LOG_ERROR("'%s': Out of memory. Dropping a connection.", thread->name);
+        tcp_socket_close(&socket);
+        return;
+    }
+
+    // NOTE: The worker keeps its own copy of the context, and that's the one that has to be in the list. It stays put
+    // for as long as the task is alive.
+    HTTP_Server_Connection *added = worker_get_task_context(&thread->worker, handle);
+    assert(added != NULL);
+    string_buffer_init(&added->input, HTTP_SERVER_RECEIVE_SIZE + 1);
+
+    added->next = thread->connections;
+    if(thread->connections != NULL) {
+        thread->connections->previous = added;
+    }
+    thread->connections = added;
+
+    metrics_count(Metric_Counter_HTTP_Server_Connections_Accepted, 1);
+    metrics_gauge_add(Metric_Gauge_HTTP_Server_Connections_Open, 1);
+}
+
+static bool http_server_accept_task(Worker *worker, Worker_Context *context, const uint32_t lifetime) {
+    (void)lifetime;
+
+    HTTP_Server_Thread *thread = *(HTTP_Server_Thread **)context;
+
+    for(uint32_t i = 0; i < HTTP_SERVER_ACCEPT_BATCH_SIZE; i++) {
+        TCP_Socket socket;
+        TCP_Socket_Result result = tcp_socket_accept(&thread->listener, thread->server->options.socket_options, &socket);
+        if(result == TCP_Socket_Result_Not_Ready_To_Be_Read) {
+            worker_task_wait_for_fd(worker, thread->listener.fd, Worker_Wait_Events_Readable);
+            return false;
+        }
+        if(result != TCP_Socket_Result_OK) {
+            worker_task_wait_until(worker, clock_now_ns() + HTTP_SERVER_ACCEPT_RETRY_NS);
+            return false;
+        }
+
+        http_server_connection_start(thread, socket);
+    }
+
+    return false; // There may be more waiting. Back next tick, after the connections had their turn.
+}
+
+static void *http_server_thread_main(void *argument) {
+    HTTP_Server_Thread *thread = (HTTP_Server_Thread *)argument;
+    HTTP_Server *server = thread->server;
+
+    if(server->options.pin_threads) {
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_pin_to_cpu(&thread->worker, thread->index % (uint32_t)(cpu_count > 0 ? cpu_count : 1));
+    }
+
+    string_buffer_init(&thread->response.headers, 256);
+    string_buffer_init(&thread->response.body, 1024);
+    string_buffer_init(&thread->response_head, 256);
+
+    if(!worker_add_task(&thread->worker, &thread, sizeof(HTTP_Server_Thread *), http_server_accept_task, NULL)) {
+        LOG_ERROR("'%s': Out of memory.", thread->name);
+    }
+    else {
+        while(!http_server_stopping(server)) {
+            worker_work(&thread->worker);
+            if(http_server_stopping(server)) {
+                break;
+            }
+            worker_wait(&thread->worker, -1);
+        }
+    }
+
+    while(thread->connections != NULL) {
+        http_server_connection_close(thread->connections);
+    }
+    worker_dispose(&thread->worker);
+
+    string_buffer_free(&thread->response.headers);
+    string_buffer_free(&thread->response.body);
+    string_buffer_free(&thread->response_head);
+
+    return NULL;
+}
+
+static void http_server_close_listeners(HTTP_Server *server) {
+    for(uint32_t i = 0; i < server->thread_count; i++) {
+        HTTP_Server_Thread *thread = &server->threads[i];
+        if(thread->owns_listener && thread->listener.fd != -1) {
+            tcp_socket_close(&thread->listener);
+        }
+    }
+}
+
+bool http_server_start(HTTP_Server *server, const HTTP_Server_Options *options) {
+    assert(server != NULL);
+    assert(options != NULL);
+    assert(options->handler != NULL);
+
+    memset(server, 0, sizeof(HTTP_Server));
+    server->options = *options;
+    if(server->options.keep_alive_timeout_ms == 0) {
+        server->options.keep_alive_timeout_ms = HTTP_SERVER_DEFAULT_KEEP_ALIVE_TIMEOUT_MS;
+    }
+    if(server->options.max_body_size == 0) {
+        server->options.max_body_size = HTTP_SERVER_DEFAULT_MAX_BODY_SIZE;
+    }
+
+    const char *address = options->address != NULL ? options->address : "0.0.0.0";
+    TCP_Endpoint endpoint;
+    if(!tcp_endpoint_try_parse_unix(address, &endpoint)) {
+        IP_Address ip_address;
+        if(!ip_try_parse(address, &ip_address)) {
+            LOG_ERROR("Can't listen on '%s'. It has to be an IP address or 'unix:/some/path'.", address);
+            return false;
+        }
+        memset(&endpoint, 0, sizeof(TCP_Endpoint));
+        endpoint.type = TCP_Endpoint_Type_IP;
+        endpoint.ip_address = ip_address;
+        endpoint.port = options->port;
+    }
+
+    uint32_t thread_count = options->threads;
+    if(thread_count == 0) {
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpu_count > 0 ? (uint32_t)cpu_count : 1;
+    }
+
+    server->threads = calloc(thread_count, sizeof(HTTP_Server_Thread));
+    if(server->threads == NULL) {
+        return false;
+    }
+    server->thread_count = thread_count;
+
+    // Every listener is set up before any thread starts, so a port that's taken fails right here rather than on some
+    // thread later. With port 0 the first listener gets one from the kernel, and the rest join it on that one.
+    bool ok = true;
+    for(uint32_t i = 0; i < thread_count && ok; i++) {
+        HTTP_Server_Thread *thread = &server->threads[i];
+        thread->server = server;
+        thread->index = i;
+        thread->listener.fd = -1;
+        snprintf(thread->name, sizeof(thread->name), "HTTP Server %u", i);
+        thread->worker.name = thread->name;
+
+        if(endpoint.type == TCP_Endpoint_Type_Unix && i > 0) {
+            thread->listener = server->threads[0].listener;
+        }
+        else {
+            ok = tcp_socket_listen(endpoint, options->backlog, endpoint.type == TCP_Endpoint_Type_IP, &thread->listener) == TCP_Socket_Result_OK;
+            thread->owns_listener = ok;
+            if(ok && i == 0 && endpoint.type == TCP_Endpoint_Type_IP) {
+                server->port = tcp_socket_local_port(&thread->listener);
+                endpoint.port = server->port;
+            }
+        }
+
+        // NOTE: http_server_stop(..) wakes the workers from another thread, so their event loops can't wait to be made lazily.
+        ok = ok && worker_event_loop_init(&thread->worker);
+    }
+
+    if(!ok) {
+        http_server_close_listeners(server);
+        for(uint32_t i = 0; i < thread_count; i++) {
+            worker_dispose(&server->threads[i].worker);
+        }
+        free(server->threads);
+        server->threads = NULL;
+        server->thread_count = 0;
+        return false;
+    }
+
+    for(uint32_t i = 0; i < thread_count; i++) {
+        HTTP_Server_Thread *thread = &server->threads[i];
+        if(pthread_create(&thread->thread, NULL, http_server_thread_main, thread) != 0) {
+            LOG_ERROR("Failed to start server thread %u.", i);
+            ok = false;
+            break;
+        }
+        thread->started = true;
+    }
+
+    if(!ok) {
+        http_server_stop(server);
+        return false;
+    }
+
+    char endpoint_text[TCP_ENDPOINT_STRING_SIZE];
+    LOG_INFO("Listening on %s with %u thread(s).", tcp_endpoint_to_string(endpoint, endpoint_text, sizeof(endpoint_text)), thread_count);
+    return true;
+}
+
+void http_server_stop(HTTP_Server *server) {
+    assert(server != NULL);
+
+    if(server->threads == NULL) {
+        return;
+    }
+
+    __atomic_store_n(&server->stopping, true, __ATOMIC_RELEASE);
+    for(uint32_t i = 0; i < server->thread_count; i++) {
+        if(server->threads[i].started) {
+            worker_wake(&server->threads[i].worker);
+        }
+    }
+
+    for(uint32_t i = 0; i < server->thread_count; i++) {
+        HTTP_Server_Thread *thread = &server->threads[i];
+        if(thread->started) {
+            pthread_join(thread->thread, NULL);
+        } else {
+            worker_dispose(&thread->worker);
+        }
+    }
+
+    http_server_close_listeners(server);
+
+    free(server->threads);
+    server->threads = NULL;
+    server->thread_count = 0;
+}
@@ -0,0 +1,124 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "http/http.h"
+#include "string/buffer/string_buffer.h"
+#include "tcp/tcp_socket.h"
+
+// A small HTTP/1.1 server, for internal endpoints and as a local backend to point the client at.
+//
+// Every thread has its own listening socket on the same port (SO_REUSEPORT, so the kernel spreads new connections over
+// them), its own Worker and its own connections, and shares nothing with the other threads. A connection stays on the
+// thread that accepted it. Connections are kept alive between requests, and pipelined requests are answered in order.
+//
+// Requests are handed to one handler, which fills in the response and returns. It runs on the server thread, so it's
+// called from several threads at once and should be quick: while it runs, nothing else on that thread does.
+//
+// What's not supported is answered by the server itself, without calling the handler: methods other than GET, POST and
+// PUT (501), request bodies that aren't sent with a Content-Length (501), more than HTTP_MAX_HEADERS headers or a head
+// bigger than HTTP_SERVER_MAX_HEAD_SIZE (431), and bodies bigger than 'max_body_size' (413). Those close the connection.
+
+#ifndef HTTP_SERVER_DEFAULT_KEEP_ALIVE_TIMEOUT_MS
+#define HTTP_SERVER_DEFAULT_KEEP_ALIVE_TIMEOUT_MS 5000
+#endif
+
+#ifndef HTTP_SERVER_DEFAULT_MAX_BODY_SIZE
+#define HTTP_SERVER_DEFAULT_MAX_BODY_SIZE (1024 * 1024)
+#endif
+
+// Request line and headers, including the empty line after them.
+#ifndef HTTP_SERVER_MAX_HEAD_SIZE
+#define HTTP_SERVER_MAX_HEAD_SIZE 8192
+#endif
+
+// How much is read from a connection at a time.
+#ifndef HTTP_SERVER_RECEIVE_SIZE
+#define HTTP_SERVER_RECEIVE_SIZE 16384
+#endif
+
+// How many connections a thread accepts per tick, at most, before its connections get a turn.
+#ifndef HTTP_SERVER_ACCEPT_BATCH_SIZE
+#define HTTP_SERVER_ACCEPT_BATCH_SIZE 64
+#endif
+
+typedef struct {
+    HTTP_Method method;
+    const char *path;  // E.g. "/items", as sent (not decoded).
+    const char *query; // What came after the '?', without it. "" if there was none.
+    uint8_t http_version_minor; // HTTP/1.0 or HTTP/1.1.
+
+    const HTTP_Headers *headers; // Use http_try_get_key_from_header(..).
+
+    const char *body; // Null-terminated, for convenience. Empty for requests without one.
+    uint64_t body_length;
+} HTTP_Server_Request;
+
+typedef void (*HTTP_Server_Release_Callback)(void *release_data);
+
+// The handler gets this set to 200 with nothing in it. The server adds Content-Length and, if needed, Connection.
+typedef struct {
+    int status_code;
+    const char *content_type; // NULL to leave it out. Has to outlive the handler, e.g. a literal.
+
+    String_Buffer headers; // Any other headers, each ending in "\r\n". string_buffer_appendf(..) is handy.
+    String_Buffer body;
+
+    // Instead of 'body': 'length' bytes of the file 'fd' from 'offset', sent with sendfile(..) so they never pass
+    // through user space. The fd is borrowed and has to stay open until 'release' (which may be NULL) is called with
+    // 'release_data'. That's once it's all sent or the connection is gone, on the thread the handler ran on, or right
+    // after the handler returns for a status code that doesn't have a body.
+    struct {
+        int fd; // -1 for none.
+        uint64_t offset;
+        uint64_t length;
+        HTTP_Server_Release_Callback release;
+        void *release_data;
+    } file;
+
+    bool close_connection; // Close once this is sent.
+} HTTP_Server_Response;
+
+// Everything it gets is only valid until it returns.
+typedef void (*HTTP_Server_Handler)(const HTTP_Server_Request *request, HTTP_Server_Response *response, void *user_data);
+
+typedef struct {
+    const char *address; // An IPv4 or IPv6 address to listen on, or 'unix:/some/path'. NULL for "0.0.0.0".
+    uint16_t port;       // 0 for one the kernel picks. See HTTP_Server.port.
+    uint32_t threads;    // 0 for one per online CPU.
+    int backlog;         // TCP_SOCKET_DEFAULT_BACKLOG for SOMAXCONN.
+    bool pin_threads;    // Pin thread n to CPU n.
+
+    uint32_t keep_alive_timeout_ms; // Idle connections are closed after this long. 0 for HTTP_SERVER_DEFAULT_KEEP_ALIVE_TIMEOUT_MS.
+    uint64_t max_body_size;         // 0 for HTTP_SERVER_DEFAULT_MAX_BODY_SIZE.
+
+    const TCP_Socket_Options *socket_options; // For accepted connections. NULL for TCP_Socket_Profile_Default.
+
+    HTTP_Server_Handler handler;
+    void *user_data; // Passed to the handler.
+} HTTP_Server_Options;
+
+typedef struct HTTP_Server_Thread HTTP_Server_Thread;
+
+typedef struct {
+    HTTP_Server_Options options;
+    uint16_t port; // What it's listening on. 0 for a Unix socket.
+
+    uint32_t thread_count;
+    HTTP_Server_Thread *threads;
+
+    bool stopping;
+} HTTP_Server;
+
+// Starts listening and returns right away; the server runs on threads of its own. Returns false if it couldn't listen
+// (or start its threads), in which case there's nothing to stop. 'options' is copied, but 'address' is borrowed.
+bool http_server_start(HTTP_Server *server, const HTTP_Server_Options *options);
+
+// Stops accepting, closes every connection (whether or not it's in the middle of a request) and waits for the threads
+// to finish. Not from a handler.
+void http_server_stop(HTTP_Server *server);
+
+#endif
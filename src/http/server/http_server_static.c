@@ -0,0 +1,634 @@
+#define _GNU_SOURCE // strptime(..) and timegm(..).
+
+#include "http_server_static.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "clock/clock.h"
+#include "log/log.h"
+#include "metrics/metrics.h"
+
+typedef struct HTTP_Server_Static_Cache HTTP_Server_Static_Cache;
+typedef struct HTTP_Server_Static_Entry HTTP_Server_Static_Entry;
+
+struct HTTP_Server_Static_Entry {
+    char *path; // Relative to the root, decoded. The key.
+    uint64_t hash;
+
+    int fd;
+    uint64_t size;
+    dev_t device;
+    ino_t inode;
+    struct timespec modified;
+    uint64_t checked_ns; // When the stat(..) above was last known to be right.
+
+    char etag[48];          // With its quotes.
+    char last_modified[40]; // E.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+    const char *content_type;
+
+    // Responses still sending from 'fd'. An entry that is evicted (or replaced) meanwhile is only closed once the last
+    // of them is done.
+    uint32_t references;
+    bool cached;
+
+    HTTP_Server_Static_Entry *bucket_next;
+    HTTP_Server_Static_Entry *lru_previous; // Towards more recently used.
+    HTTP_Server_Static_Entry *lru_next;
+};
+
+// One per server thread (per HTTP_Server_Static), so nothing in here is ever shared.
+struct HTTP_Server_Static_Cache {
+    HTTP_Server_Static *files;
+
+    HTTP_Server_Static_Entry **buckets;
+    uint32_t bucket_mask;
+    uint32_t entry_count;
+
+    HTTP_Server_Static_Entry *most_recent;
+    HTTP_Server_Static_Entry *least_recent;
+
+    HTTP_Server_Static_Cache *next_of_thread; // The calling thread's caches, one per HTTP_Server_Static.
+    HTTP_Server_Static_Cache *next_of_files;  // Every thread's cache for the same HTTP_Server_Static.
+};
+
+struct HTTP_Server_Static {
+    int root_fd;
+    uint32_t cache_size;
+    uint64_t revalidate_ns;
+
+    HTTP_Server_Static_Cache *caches; // Pushed to by every thread that serves from it. Walked by destroy.
+};
+
+static __thread HTTP_Server_Static_Cache *http_server_static_thread_caches;
+
+typedef struct {
+    const char *extension;
+    const char *content_type;
+} HTTP_Server_Static_Content_Type;
+
+static const HTTP_Server_Static_Content_Type http_server_static_content_types[] = {
+    { "html",  "text/html; charset=utf-8" },
+    { "htm",   "text/html; charset=utf-8" },
+    { "css",   "text/css; charset=utf-8" },
+    { "js",    "text/javascript; charset=utf-8" },
+    { "mjs",   "text/javascript; charset=utf-8" },
+    { "json",  "application/json" },
+    { "txt",   "text/plain; charset=utf-8" },
+    { "csv",   "text/csv; charset=utf-8" },
+    { "xml",   "application/xml" },
+    { "svg",   "image/svg+xml" },
+    { "png",   "image/png" },
+    { "jpg",   "image/jpeg" },
+    { "jpeg",  "image/jpeg" },
+    { "gif",   "image/gif" },
+    { "webp",  "image/webp" },
+    { "ico",   "image/x-icon" },
+    { "wasm",  "application/wasm" },
+    { "pdf",   "application/pdf" },
+    { "zip",   "application/zip" },
+    { "gz",    "application/gzip" },
+    { "tar",   "application/x-tar" },
+    { "mp4",   "video/mp4" },
+    { "webm",  "video/webm" },
+    { "woff",  "font/woff" },
+    { "woff2", "font/woff2" },
+};
+
+static const char *http_server_static_content_type_for_path(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    if(dot != NULL && (slash == NULL || dot > slash)) {
+        for(uint32_t i = 0; i < sizeof(http_server_static_content_types) / sizeof(http_server_static_content_types[0]); i++) {
+            if(strcasecmp(&dot[1], http_server_static_content_types[i].extension) == 0) {
+                return http_server_static_content_types[i].content_type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+HTTP_Server_Static *http_server_static_create(const HTTP_Server_Static_Options *options) {
+    assert(options != NULL);
+    assert(options->root != NULL);
+
+    int root_fd = open(options->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(root_fd == -1) {
+        LOG_ERROR("Can't serve files from '%s' (errno %i).", options->root, errno);
+        return NULL;
+    }
+
+    HTTP_Server_Static *files = calloc(1, sizeof(HTTP_Server_Static));
+    if(files == NULL) {
+        close(root_fd);
+        return NULL;
+    }
+
+    files->root_fd = root_fd;
+    files->cache_size = options->cache_size > 0 ? options->cache_size : HTTP_SERVER_STATIC_DEFAULT_CACHE_SIZE;
+    files->revalidate_ns = (uint64_t)(options->revalidate_ms > 0 ? options->revalidate_ms : HTTP_SERVER_STATIC_DEFAULT_REVALIDATE_MS) * CLOCK_NS_PER_MS;
+    return files;
+}
+
+static void http_server_static_entry_free(HTTP_Server_Static_Entry *entry) {
+    close(entry->fd);
+    free(entry->path);
+    free(entry);
+}
+
+void http_server_static_destroy(HTTP_Server_Static *files) {
+    if(files == NULL) {
+        return;
+    }
+
+    HTTP_Server_Static_Cache *cache = __atomic_load_n(&files->caches, __ATOMIC_ACQUIRE);
+    while(cache != NULL) {
+        HTTP_Server_Static_Entry *entry = cache->most_recent;
+        while(entry != NULL) {
+            HTTP_Server_Static_Entry *next = entry->lru_next;
+            assert(entry->references == 0);
+            http_server_static_entry_free(entry);
+            entry = next;
+        }
+
+        HTTP_Server_Static_Cache *next = cache->next_of_files;
+        free(cache->buckets);
+        free(cache);
+        cache = next;
+    }
+
+    close(files->root_fd);
+    free(files);
+}
+
+static HTTP_Server_Static_Cache *http_server_static_cache_for_thread(HTTP_Server_Static *files) {
+    for(HTTP_Server_Static_Cache *cache = http_server_static_thread_caches; cache != NULL; cache = cache->next_of_thread) {
+        if(cache->files == files) {
+            return cache;
+        }
+    }
+
+    HTTP_Server_Static_Cache *cache = calloc(1, sizeof(HTTP_Server_Static_Cache));
+    if(cache == NULL) {
+        return NULL;
+    }
+
+    // At most half full, so chains stay short.
+    uint32_t bucket_count = 16;
+    while(bucket_count < files->cache_size * 2) {
+        bucket_count *= 2;
+    }
+    cache->buckets = calloc(bucket_count, sizeof(HTTP_Server_Static_Entry *));
+    if(cache->buckets == NULL) {
+        free(cache);
+        return NULL;
+    }
+    cache->bucket_mask = bucket_count - 1;
+    cache->files = files;
+
+    cache->next_of_thread = http_server_static_thread_caches;
+    http_server_static_thread_caches = cache;
+
+    cache->next_of_files = __atomic_load_n(&files->caches, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&files->caches, &cache->next_of_files, cache, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // 'next_of_files' was updated to the current head. Try again.
+    }
+
+    return cache;
+}
+
+static uint64_t http_server_static_hash(const char *text) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a.
+    for(const char *c = text; *c != '\0'; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void http_server_static_lru_unlink(HTTP_Server_Static_Cache *cache, HTTP_Server_Static_Entry *entry) {
+    if(entry->lru_previous != NULL) {
+        entry->lru_previous->lru_next = entry->lru_next;
+    } else {
+        cache->most_recent = entry->lru_next;
+    }
+    if(entry->lru_next != NULL) {
+        entry->lru_next->lru_previous = entry->lru_previous;
+    } else {
+        cache->least_recent = entry->lru_previous;
+    }
+    entry->lru_previous = NULL;
+    entry->lru_next = NULL;
+}
+
+static void http_server_static_lru_push(HTTP_Server_Static_Cache *cache, HTTP_Server_Static_Entry *entry) {
+    entry->lru_previous = NULL;
+    entry->lru_next = cache->most_recent;
+    if(cache->most_recent != NULL) {
+        cache->most_recent->lru_previous = entry;
+    } else {
+        cache->least_recent = entry;
+    }
+    cache->most_recent = entry;
+}
+
+// Takes the entry out of the cache. It's closed right away, or by the last response still sending from it.
+static void http_server_static_evict(HTTP_Server_Static_Cache *cache, HTTP_Server_Static_Entry *entry) {
+    assert(entry->cached);
+
+    HTTP_Server_Static_Entry **link = &cache->buckets[entry->hash & cache->bucket_mask];
+    while(*link != entry) {
+        assert(*link != NULL);
+        link = &(*link)->bucket_next;
+    }
+    *link = entry->bucket_next;
+    entry->bucket_next = NULL;
+
+    http_server_static_lru_unlink(cache, entry);
+    cache->entry_count -= 1;
+    entry->cached = false;
+
+    if(entry->references == 0) {
+        http_server_static_entry_free(entry);
+    }
+}
+
+static HTTP_Server_Static_Entry *http_server_static_find(HTTP_Server_Static_Cache *cache, const char *path, const uint64_t hash) {
+    for(HTTP_Server_Static_Entry *entry = cache->buckets[hash & cache->bucket_mask]; entry != NULL; entry = entry->bucket_next) {
+        if(entry->hash == hash && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static inline bool http_server_static_same_file(const HTTP_Server_Static_Entry *entry, const struct stat *file_stat) {
+    return entry->device == file_stat->st_dev
+        && entry->inode == file_stat->st_ino
+        && entry->size == (uint64_t)file_stat->st_size
+        && entry->modified.tv_sec == file_stat->st_mtim.tv_sec
+        && entry->modified.tv_nsec == file_stat->st_mtim.tv_nsec;
+}
+
+// Opens 'path' and adds it to the cache. Returns the status code to answer with if that didn't work.
+static int http_server_static_open(HTTP_Server_Static_Cache *cache, const char *path, const uint64_t hash, const uint64_t now_ns, HTTP_Server_Static_Entry **out_entry) {
+    int fd = openat(cache->files->root_fd, path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if(fd == -1) {
+        if(errno == ENOENT || errno == ENOTDIR || errno == ENAMETOOLONG || errno == ELOOP) return 404;
+        if(errno == EACCES || errno == EPERM) return 403;
+        LOG_ERROR("Failed to open '%s' (errno %i).", path, errno);
+        return 500;
+    }
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return 404; // NOTE: Directories too. Their index is only served for paths that end in '/'.
+    }
+
+    HTTP_Server_Static_Entry *entry = calloc(1, sizeof(HTTP_Server_Static_Entry));
+    char *path_copy = strdup(path);
+    if(entry == NULL || path_copy == NULL) {
+        free(entry);
+        free(path_copy);
+        close(fd);
+        return 500;
+    }
+
+    entry->path = path_copy;
+    entry->hash = hash;
+    entry->fd = fd;
+    entry->size = (uint64_t)file_stat.st_size;
+    entry->device = file_stat.st_dev;
+    entry->inode = file_stat.st_ino;
+    entry->modified = file_stat.st_mtim;
+    entry->checked_ns = now_ns;
+    entry->content_type = http_server_static_content_type_for_path(path);
+
+    snprintf(entry->etag, sizeof(entry->etag), "\"%llx-%llx-%llx\"",
+        (unsigned long long)entry->inode,
+        (unsigned long long)entry->modified.tv_sec * 1000000000ULL + (unsigned long long)entry->modified.tv_nsec,
+        (unsigned long long)entry->size
+    );
+
+    struct tm modified_utc;
+    time_t modified_s = entry->modified.tv_sec;
+    gmtime_r(&modified_s, &modified_utc);
+    strftime(entry->last_modified, sizeof(entry->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &modified_utc);
+
+    while(cache->entry_count >= cache->files->cache_size && cache->least_recent != NULL) {
+        http_server_static_evict(cache, cache->least_recent);
+    }
+
+    HTTP_Server_Static_Entry **bucket = &cache->buckets[hash & cache->bucket_mask];
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+    http_server_static_lru_push(cache, entry);
+    cache->entry_count += 1;
+    entry->cached = true;
+
+    *out_entry = entry;
+    return 200;
+}
+
+// Finds 'path' in the cache, or opens it. Returns the status code to answer with if neither worked.
+static int http_server_static_lookup(HTTP_Server_Static_Cache *cache, const char *path, HTTP_Server_Static_Entry **out_entry) {
+    uint64_t now_ns = clock_now_ns();
+    uint64_t hash = http_server_static_hash(path);
+
+    HTTP_Server_Static_Entry *entry = http_server_static_find(cache, path, hash);
+    if(entry != NULL && now_ns - entry->checked_ns >= cache->files->revalidate_ns) {
+        struct stat file_stat;
+        if(fstatat(cache->files->root_fd, path, &file_stat, 0) == 0 && http_server_static_same_file(entry, &file_stat)) {
+            entry->checked_ns = now_ns;
+        } else {
+            http_server_static_evict(cache, entry); // Changed, replaced or gone. Open it again.
+            entry = NULL;
+        }
+    }
+
+    if(entry == NULL) {
+        metrics_count(Metric_Counter_HTTP_Server_File_Cache_Misses, 1);
+        return http_server_static_open(cache, path, hash, now_ns, out_entry);
+    }
+
+    metrics_count(Metric_Counter_HTTP_Server_File_Cache_Hits, 1);
+    http_server_static_lru_unlink(cache, entry);
+    http_server_static_lru_push(cache, entry);
+
+    *out_entry = entry;
+    return 200;
+}
+
+static void http_server_static_release(void *release_data) {
+    HTTP_Server_Static_Entry *entry = (HTTP_Server_Static_Entry *)release_data;
+    assert(entry->references > 0);
+
+    entry->references -= 1;
+    if(entry->references == 0 && !entry->cached) {
+        http_server_static_entry_free(entry);
+    }
+}
+
+static inline int http_server_static_hex_value(const char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Percent-decodes the request path into a path relative to the root, without a leading '/'. "." segments and empty
+// ones are dropped. Returns false for anything that could leave the root, or isn't a path at all.
+static bool http_server_static_resolve_path(const char *request_path, char out_path[HTTP_SERVER_STATIC_MAX_PATH]) {
+    assert(request_path[0] == '/');
+
+    char decoded[HTTP_SERVER_STATIC_MAX_PATH];
+    uint32_t length = 0;
+    for(const char *c = request_path; *c != '\0'; c++) {
+        char character = *c;
+        if(character == '%') {
+            int high = http_server_static_hex_value(c[1]);
+            int low = high >= 0 ? http_server_static_hex_value(c[2]) : -1;
+            if(low < 0) {
+                return false;
+            }
+            character = (char)(high * 16 + low);
+            c += 2;
+            if(character == '\0') {
+                return false;
+            }
+        }
+        if(length + 1 >= sizeof(decoded)) {
+            return false;
+        }
+        decoded[length++] = character;
+    }
+    decoded[length] = '\0';
+
+    bool is_directory = decoded[length - 1] == '/';
+
+    uint32_t out_length = 0;
+    const char *segment = decoded;
+    while(*segment != '\0') {
+        while(*segment == '/') {
+            segment++;
+        }
+        uint32_t segment_length = (uint32_t)strcspn(segment, "/");
+        if(segment_length == 0) {
+            break;
+        }
+
+        if(segment_length == 2 && segment[0] == '.' && segment[1] == '.') {
+            return false;
+        }
+        if(!(segment_length == 1 && segment[0] == '.')) {
+            if(out_length + segment_length + 2 >= HTTP_SERVER_STATIC_MAX_PATH) {
+                return false;
+            }
+            if(out_length > 0) {
+                out_path[out_length++] = '/';
+            }
+            memcpy(&out_path[out_length], segment, segment_length);
+            out_length += segment_length;
+        }
+        segment += segment_length;
+    }
+    out_path[out_length] = '\0';
+
+    if(is_directory || out_length == 0) {
+        const char *index = out_length > 0 ? "/" HTTP_SERVER_STATIC_INDEX : HTTP_SERVER_STATIC_INDEX;
+        if(out_length + strlen(index) + 1 > HTTP_SERVER_STATIC_MAX_PATH) {
+            return false;
+        }
+        strcpy(&out_path[out_length], index);
+    }
+
+    return true;
+}
+
+// "Sun, 06 Nov 1994 08:49:37 GMT". The obsolete formats aren't worth it; a date we can't read is just ignored.
+static bool http_server_static_parse_date(const char *text, time_t *out_time) {
+    struct tm date;
+    memset(&date, 0, sizeof(date));
+    const char *end = strptime(text, "%a, %d %b %Y %H:%M:%S GMT", &date);
+    if(end == NULL || *end != '\0') {
+        return false;
+    }
+    *out_time = timegm(&date);
+    return true;
+}
+
+static bool http_server_static_not_modified(const HTTP_Server_Request *request, const HTTP_Server_Static_Entry *entry) {
+    const char *value = NULL;
+
+    // NOTE: If-None-Match wins over If-Modified-Since when both are there. A weak comparison is fine here, so our
+    // quoted tag showing up anywhere in the list (W/ or not) is a match.
+    if(http_try_get_key_from_header(request->headers, "If-None-Match", &value)) {
+        return strcmp(value, "*") == 0 || strstr(value, entry->etag) != NULL;
+    }
+
+    time_t since = 0;
+    if(http_try_get_key_from_header(request->headers, "If-Modified-Since", &value) && http_server_static_parse_date(value, &since)) {
+        return entry->modified.tv_sec <= since;
+    }
+
+    return false;
+}
+
+typedef enum {
+    HTTP_Server_Static_Range_None,          // Send the whole file.
+    HTTP_Server_Static_Range_Satisfiable,
+    HTTP_Server_Static_Range_Not_Satisfiable,
+} HTTP_Server_Static_Range;
+
+// Only "bytes=first-last", "bytes=first-" and "bytes=-suffix_length". Anything else, including several ranges, is
+// ignored, and the whole file sent.
+static HTTP_Server_Static_Range http_server_static_parse_range(const HTTP_Server_Request *request, const HTTP_Server_Static_Entry *entry, uint64_t *out_first, uint64_t *out_last) {
+    const char *range = NULL;
+    if(!http_try_get_key_from_header(request->headers, "Range", &range)) {
+        return HTTP_Server_Static_Range_None;
+    }
+
+    // If-Range: Only if the file is still what the client has the rest of. Otherwise it gets all of it.
+    const char *if_range = NULL;
+    if(http_try_get_key_from_header(request->headers, "If-Range", &if_range)) {
+        time_t date = 0;
+        bool still_same = if_range[0] == '"'
+            ? strcmp(if_range, entry->etag) == 0
+            : http_server_static_parse_date(if_range, &date) && entry->modified.tv_sec <= date;
+        if(!still_same) {
+            return HTTP_Server_Static_Range_None;
+        }
+    }
+
+    if(strncasecmp(range, "bytes=", 6) != 0 || strchr(range, ',') != NULL) {
+        return HTTP_Server_Static_Range_None;
+    }
+    const char *spec = &range[6];
+
+    char *end = NULL;
+    if(spec[0] == '-') {
+        if(spec[1] < '0' || spec[1] > '9') {
+            return HTTP_Server_Static_Range_None;
+        }
+        unsigned long long suffix_length = strtoull(&spec[1], &end, 10);
+        if(*end != '\0') {
+            return HTTP_Server_Static_Range_None;
+        }
+        if(suffix_length == 0 || entry->size == 0) {
+            return HTTP_Server_Static_Range_Not_Satisfiable;
+        }
+        *out_first = suffix_length >= entry->size ? 0 : entry->size - suffix_length;
+        *out_last = entry->size - 1;
+        return HTTP_Server_Static_Range_Satisfiable;
+    }
+
+    if(spec[0] < '0' || spec[0] > '9') {
+        return HTTP_Server_Static_Range_None;
+    }
+    unsigned long long first = strtoull(spec, &end, 10);
+    if(*end != '-') {
+        return HTTP_Server_Static_Range_None;
+    }
+    unsigned long long last = UINT64_MAX;
+    if(end[1] != '\0') {
+        const char *last_text = &end[1];
+        if(last_text[0] < '0' || last_text[0] > '9') {
+            return HTTP_Server_Static_Range_None;
+        }
+        last = strtoull(last_text, &end, 10);
+        if(*end != '\0' || last < first) {
+            return HTTP_Server_Static_Range_None;
+        }
+    }
+
+    if(first >= entry->size) {
+        return HTTP_Server_Static_Range_Not_Satisfiable;
+    }
+    *out_first = first;
+    *out_last = last < entry->size - 1 ? last : entry->size - 1;
+    return HTTP_Server_Static_Range_Satisfiable;
+}
+
+void http_server_static_handle(const HTTP_Server_Request *request, HTTP_Server_Response *response, void *user_data) {
+    HTTP_Server_Static *files = (HTTP_Server_Static *)user_data;
+    assert(files != NULL);
+
+    if(request->method != HTTP_Method_GET) {
+        response->status_code = 405;
+        string_buffer_appendf(&response->headers, "Allow: GET\r\n");
+        return;
+    }
+
+    char path[HTTP_SERVER_STATIC_MAX_PATH];
+    if(!http_server_static_resolve_path(request->path, path)) {
+        response->status_code = 400;
+        return;
+    }
+
+    HTTP_Server_Static_Cache *cache = http_server_static_cache_for_thread(files);
+    if(cache == NULL) {
+        response->status_code = 503;
+        return;
+    }
+
+    HTTP_Server_Static_Entry *entry = NULL;
+    int status_code = http_server_static_lookup(cache, path, &entry);
+    if(status_code != 200) {
+        response->status_code = status_code;
+        return;
+    }
+
+    string_buffer_appendf(&response->headers,
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n"
+        "Accept-Ranges: bytes\r\n",
+        entry->etag, entry->last_modified
+    );
+
+    if(http_server_static_not_modified(request, entry)) {
+        response->status_code = 304;
+        return;
+    }
+
+    uint64_t first = 0;
+    uint64_t last = 0;
+    switch(http_server_static_parse_range(request, entry, &first, &last)) {
+        case HTTP_Server_Static_Range_None: {
+            first = 0;
+            last = entry->size > 0 ? entry->size - 1 : 0;
+            break;
+        }
+        case HTTP_Server_Static_Range_Satisfiable: {
+            response->status_code = 206;
+            string_buffer_appendf(&response->headers, "Content-Range: bytes %llu-%llu/%llu\r\n",
+                (unsigned long long)first, (unsigned long long)last, (unsigned long long)entry->size);
+            break;
+        }
+        case HTTP_Server_Static_Range_Not_Satisfiable: {
+            response->status_code = 416;
+            string_buffer_appendf(&response->headers, "Content-Range: bytes */%llu\r\n", (unsigned long long)entry->size);
+            return;
+        }
+    }
+
+    response->content_type = entry->content_type;
+    if(entry->size == 0) {
+        return;
+    }
+
+    entry->references += 1;
+    response->file.fd = entry->fd;
+    response->file.offset = first;
+    response->file.length = last - first + 1;
+    response->file.release = http_server_static_release;
+    response->file.release_data = entry;
+}
@@ -0,0 +1,56 @@
+#ifndef HTTP_SERVER_STATIC_H
+#define HTTP_SERVER_STATIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "http/server/http_server.h"
+
+// Serves the files in a directory, as an HTTP_Server handler. File contents go out with sendfile(..), and never pass
+// through user space.
+//
+// Every server thread keeps its own cache of open files, least recently used out first, with what stat(..) said
+// about them and the headers that follow from that (ETag, Last-Modified, Content-Type). A hit costs no syscalls at
+// all until the entry is 'revalidate_ms' old; then it's checked against a new stat(..), and reopened if the file was
+// changed or replaced.
+//
+// Supports If-None-Match and If-Modified-Since (304), and single byte ranges (206, or 416), with If-Range. Requests for
+// several ranges at once get the whole file. Only GET; anything else gets 405. A path ending in '/' means its
+// HTTP_SERVER_STATIC_INDEX. Paths are percent-decoded, and any with a ".." segment are refused. Symbolic links are
+// followed, even out of the directory.
+
+#ifndef HTTP_SERVER_STATIC_DEFAULT_CACHE_SIZE
+#define HTTP_SERVER_STATIC_DEFAULT_CACHE_SIZE 256 // Per server thread. Each one is an open fd.
+#endif
+
+#ifndef HTTP_SERVER_STATIC_DEFAULT_REVALIDATE_MS
+#define HTTP_SERVER_STATIC_DEFAULT_REVALIDATE_MS 1000
+#endif
+
+#ifndef HTTP_SERVER_STATIC_INDEX
+#define HTTP_SERVER_STATIC_INDEX "index.html"
+#endif
+
+#ifndef HTTP_SERVER_STATIC_MAX_PATH
+#define HTTP_SERVER_STATIC_MAX_PATH 1024
+#endif
+
+typedef struct {
+    const char *root;       // The directory to serve.
+    uint32_t cache_size;    // Files kept open per server thread. 0 for HTTP_SERVER_STATIC_DEFAULT_CACHE_SIZE.
+    uint32_t revalidate_ms; // How long what stat(..) said is trusted. 0 for HTTP_SERVER_STATIC_DEFAULT_REVALIDATE_MS.
+} HTTP_Server_Static_Options;
+
+typedef struct HTTP_Server_Static HTTP_Server_Static;
+
+// Returns NULL if 'root' isn't a directory we can open (or we're out of memory).
+HTTP_Server_Static *http_server_static_create(const HTTP_Server_Static_Options *options);
+
+// Closes every cached file. Only once no server uses it anymore, i.e. after http_server_stop(..).
+void http_server_static_destroy(HTTP_Server_Static *files);
+
+// The handler. 'user_data' is the HTTP_Server_Static. Can also be called from another handler, for the requests that
+// one doesn't answer itself.
+void http_server_static_handle(const HTTP_Server_Request *request, HTTP_Server_Response *response, void *user_data);
+
+#endif
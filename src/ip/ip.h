@@ -8,6 +8,8 @@
 
 #include <arpa/inet.h>
 
+#include "log/log.h"
+
 typedef union {
     uint8_t ipv4[4];
     uint8_t ipv6[16];
@@ -19,27 +21,39 @@ typedef struct {
 } IP_Address;
 
 
-static inline void print_ipv4_address(const uint8_t ipv4[4]) {
-    char ip_str[INET_ADDRSTRLEN];
-    
-    assert(inet_ntop(AF_INET, ipv4, ip_str, sizeof(ip_str)) != NULL);
-    printf("%s\n", ip_str); // TODO: SS - Print port?
-}
+#define IP_ADDRESS_STRING_SIZE INET6_ADDRSTRLEN
 
-static inline void print_ipv6_address(const uint8_t ipv6[16]) {
-    char ip_str[INET6_ADDRSTRLEN];
-    
-    assert(inet_ntop(AF_INET6, ipv6, ip_str, sizeof(ip_str)) != NULL);
-    printf("%s\n", ip_str); // TODO: SS - Print port?
+// Formats the address into 'out' and returns it, for logging.
+static inline const char *ip_to_string(const IP_Address ip, char out[IP_ADDRESS_STRING_SIZE]) {
+    // TODO: SS - Print port?
+    const char *result = ip.is_ipv6
+        ? inet_ntop(AF_INET6, ip.address.ipv6, out, IP_ADDRESS_STRING_SIZE)
+        : inet_ntop(AF_INET, ip.address.ipv4, out, IP_ADDRESS_STRING_SIZE);
+    assert(result != NULL);
+    (void)result;
+
+    return out;
 }
 
-static inline void ip_print(const IP_Address ip) {
-    if(ip.is_ipv6) {
-        print_ipv6_address(ip.address.ipv6);
+// Reads a textual IPv4 ("127.0.0.1") or IPv6 ("::1") address. Returns false if it's neither.
+static inline bool ip_try_parse(const char *text, IP_Address *out_ip) {
+    assert(text != NULL);
+    assert(out_ip != NULL);
+
+    if(inet_pton(AF_INET, text, out_ip->address.ipv4) == 1) {
+        out_ip->is_ipv6 = false;
+        return true;
     }
-    else {
-        print_ipv4_address(ip.address.ipv4);
+    if(inet_pton(AF_INET6, text, out_ip->address.ipv6) == 1) {
+        out_ip->is_ipv6 = true;
+        return true;
     }
+    return false;
+}
+
+static inline void ip_print(const IP_Address ip) {
+    char ip_str[IP_ADDRESS_STRING_SIZE];
+    LOG_INFO("%s", ip_to_string(ip, ip_str));
 }
 
 
@@ -0,0 +1,459 @@
+#include "json.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+void json_reader_init(JSON_Reader *reader, const char *text, const size_t length) {
+    assert(reader != NULL);
+    assert(text != NULL || length == 0);
+
+    reader->text = text;
+    reader->length = length;
+    reader->position = 0;
+}
+
+static inline void json_skip_whitespace(JSON_Reader *reader) {
+    while(reader->position < reader->length) {
+        char c = reader->text[reader->position];
+        if(c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            break;
+        }
+        reader->position += 1;
+    }
+}
+
+// Skips whitespace and consumes 'c' if it's next.
+static inline bool json_consume(JSON_Reader *reader, char c) {
+    json_skip_whitespace(reader);
+    if(reader->position >= reader->length || reader->text[reader->position] != c) {
+        return false;
+    }
+    reader->position += 1;
+    return true;
+}
+
+static inline bool json_consume_literal(JSON_Reader *reader, const char *literal) {
+    json_skip_whitespace(reader);
+    size_t length = strlen(literal);
+    if(reader->length - reader->position < length || memcmp(&reader->text[reader->position], literal, length) != 0) {
+        return false;
+    }
+    reader->position += length;
+    return true;
+}
+
+// Like string_buffer_append_buf(..), but keeps 'out' null-terminated and takes empty appends.
+static inline void json_append(String_Buffer *out, const char *data, const size_t length) {
+    if(length == 0) {
+        return;
+    }
+    char *write_into = string_buffer_reserve(out, length);
+    memcpy(write_into, data, length);
+    string_buffer_commit(out, length);
+}
+
+JSON_Type json_peek(JSON_Reader *reader) {
+    assert(reader != NULL);
+
+    json_skip_whitespace(reader);
+    if(reader->position >= reader->length) {
+        return JSON_Type_Invalid;
+    }
+
+    switch(reader->text[reader->position]) {
+        case 'n': return JSON_Type_Null;
+        case 't':
+        case 'f': return JSON_Type_Bool;
+        case '"': return JSON_Type_String;
+        case '[': return JSON_Type_Array;
+        case '{': return JSON_Type_Object;
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9': return JSON_Type_Number;
+        default: return JSON_Type_Invalid;
+    }
+}
+
+bool json_read_null(JSON_Reader *reader) {
+    assert(reader != NULL);
+    return json_consume_literal(reader, "null");
+}
+
+bool json_read_bool(JSON_Reader *reader, bool *out_value) {
+    assert(reader != NULL);
+    assert(out_value != NULL);
+
+    if(json_consume_literal(reader, "true")) {
+        *out_value = true;
+        return true;
+    }
+    if(json_consume_literal(reader, "false")) {
+        *out_value = false;
+        return true;
+    }
+    return false;
+}
+
+// Moves 'position' past one or more digits. False if there weren't any.
+static inline bool json_skip_digits(const JSON_Reader *reader, size_t *position) {
+    size_t start = *position;
+    while(*position < reader->length && reader->text[*position] >= '0' && reader->text[*position] <= '9') {
+        *position += 1;
+    }
+    return *position > start;
+}
+
+bool json_read_number(JSON_Reader *reader, double *out_value) {
+    assert(reader != NULL);
+    assert(out_value != NULL);
+
+    if(json_peek(reader) != JSON_Type_Number) {
+        return false;
+    }
+
+    // NOTE: strtod(..) needs a terminated string and takes more than JSON allows (hex, 'inf', '.5', leading zeros).
+    // Walk the JSON grammar for a number first, then let strtod(..) have what that covered.
+    //     -? (0 | [1-9][0-9]*) (.[0-9]+)? ([eE][+-]?[0-9]+)?
+    const char *text = reader->text;
+    size_t end = reader->position;
+    if(text[end] == '-') {
+        end += 1;
+    }
+    if(end < reader->length && text[end] == '0') {
+        end += 1;
+    }
+    else if(!json_skip_digits(reader, &end)) {
+        return false;
+    }
+    if(end < reader->length && text[end] == '.') {
+        end += 1;
+        if(!json_skip_digits(reader, &end)) {
+            return false;
+        }
+    }
+    if(end < reader->length && (text[end] == 'e' || text[end] == 'E')) {
+        end += 1;
+        if(end < reader->length && (text[end] == '+' || text[end] == '-')) {
+            end += 1;
+        }
+        if(!json_skip_digits(reader, &end)) {
+            return false;
+        }
+    }
+
+    char number_text[64];
+    size_t length = end - reader->position;
+    if(length == 0 || length >= sizeof(number_text)) {
+        return false;
+    }
+    memcpy(number_text, &reader->text[reader->position], length);
+    number_text[length] = '\0';
+
+    char *parsed_until = NULL;
+    double value = strtod(number_text, &parsed_until);
+    if(parsed_until != &number_text[length]) {
+        return false;
+    }
+
+    *out_value = value;
+    reader->position = end;
+    return true;
+}
+
+static inline int json_hex_digit(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// The four hex digits after '\u'.
+static bool json_read_code_unit(JSON_Reader *reader, uint32_t *out_code_unit) {
+    if(reader->length - reader->position < 4) {
+        return false;
+    }
+
+    uint32_t code_unit = 0;
+    for(uint32_t i = 0; i < 4; i++) {
+        int digit = json_hex_digit(reader->text[reader->position + i]);
+        if(digit < 0) {
+            return false;
+        }
+        code_unit = (code_unit << 4) | (uint32_t)digit;
+    }
+
+    reader->position += 4;
+    *out_code_unit = code_unit;
+    return true;
+}
+
+static void json_append_utf8(String_Buffer *out, uint32_t code_point) {
+    char bytes[4];
+    size_t length = 0;
+
+    if(code_point < 0x80) {
+        bytes[length++] = (char)code_point;
+    }
+    else if(code_point < 0x800) {
+        bytes[length++] = (char)(0xC0 | (code_point >> 6));
+        bytes[length++] = (char)(0x80 | (code_point & 0x3F));
+    }
+    else if(code_point < 0x10000) {
+        bytes[length++] = (char)(0xE0 | (code_point >> 12));
+        bytes[length++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        bytes[length++] = (char)(0x80 | (code_point & 0x3F));
+    }
+    else {
+        bytes[length++] = (char)(0xF0 | (code_point >> 18));
+        bytes[length++] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+        bytes[length++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        bytes[length++] = (char)(0x80 | (code_point & 0x3F));
+    }
+
+    json_append(out, bytes, length);
+}
+
+// Everything after the backslash of an escape.
+static bool json_read_escape(JSON_Reader *reader, String_Buffer *out) {
+    if(reader->position >= reader->length) {
+        return false;
+    }
+
+    char c = reader->text[reader->position];
+    reader->position += 1;
+
+    switch(c) {
+        case '"':  json_append(out, "\"", 1); return true;
+        case '\\': json_append(out, "\\", 1); return true;
+        case '/':  json_append(out, "/", 1);  return true;
+        case 'b':  json_append(out, "\b", 1); return true;
+        case 'f':  json_append(out, "\f", 1); return true;
+        case 'n':  json_append(out, "\n", 1); return true;
+        case 'r':  json_append(out, "\r", 1); return true;
+        case 't':  json_append(out, "\t", 1); return true;
+        case 'u': {
+            uint32_t code_point = 0;
+            if(!json_read_code_unit(reader, &code_point)) {
+                return false;
+            }
+
+            // Outside the Basic Multilingual Plane it's a surrogate pair.
+            if(code_point >= 0xD800 && code_point <= 0xDBFF) {
+                uint32_t low = 0;
+                if(!json_consume_literal(reader, "\\u") || !json_read_code_unit(reader, &low) || low < 0xDC00 || low > 0xDFFF) {
+                    return false;
+                }
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if(code_point >= 0xDC00 && code_point <= 0xDFFF) {
+                return false; // A low surrogate on its own.
+            }
+
+            json_append_utf8(out, code_point);
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+bool json_read_string(JSON_Reader *reader, String_Buffer *out) {
+    assert(reader != NULL);
+    assert(out != NULL);
+    assert(out->capacity > 0);
+
+    out->length = 0;
+    out->data[0] = '\0';
+
+    if(!json_consume(reader, '"')) {
+        return false;
+    }
+
+    while(reader->position < reader->length) {
+        // Copy everything up to the next quote or escape in one go.
+        size_t run_start = reader->position;
+        while(reader->position < reader->length) {
+            unsigned char c = (unsigned char)reader->text[reader->position];
+            if(c == '"' || c == '\\' || c < 0x20) {
+                break;
+            }
+            reader->position += 1;
+        }
+        json_append(out, &reader->text[run_start], reader->position - run_start);
+
+        if(reader->position >= reader->length) {
+            break;
+        }
+
+        char c = reader->text[reader->position];
+        reader->position += 1;
+        if(c == '"') {
+            return true;
+        }
+        if(c != '\\' || !json_read_escape(reader, out)) {
+            return false; // Control characters have to be escaped.
+        }
+    }
+
+    return false; // Never closed.
+}
+
+// One value that isn't a container, or the start of one.
+static bool json_skip_scalar(JSON_Reader *reader, const JSON_Type type, String_Buffer *scratch) {
+    switch(type) {
+        case JSON_Type_Null: {
+            return json_read_null(reader);
+        }
+        case JSON_Type_Bool: {
+            bool value;
+            return json_read_bool(reader, &value);
+        }
+        case JSON_Type_Number: {
+            double value;
+            return json_read_number(reader, &value);
+        }
+        case JSON_Type_String: {
+            return json_read_string(reader, scratch); // Read properly, so whatever was skipped is known to be valid.
+        }
+        case JSON_Type_Invalid:
+        case JSON_Type_Array:
+        case JSON_Type_Object: {
+            break;
+        }
+    }
+    return false;
+}
+
+bool json_skip_value(JSON_Reader *reader) {
+    assert(reader != NULL);
+
+    // NOTE: Containers are skipped by keeping a stack of what closes them rather than by recursing, so a hostile line
+    // can't blow the stack.
+    char closers[JSON_MAX_DEPTH];
+    uint32_t depth = 0;
+
+    String_Buffer scratch; // Strings and keys end up in here, just to be thrown away.
+    string_buffer_init(&scratch, 64);
+
+    bool ok = true;
+    do {
+        JSON_Type type = json_peek(reader);
+        if(type == JSON_Type_Array || type == JSON_Type_Object) {
+            if(depth == JSON_MAX_DEPTH) {
+                ok = false;
+                break;
+            }
+            closers[depth++] = type == JSON_Type_Array ? ']' : '}';
+            reader->position += 1;
+
+            if(!json_consume(reader, closers[depth - 1])) {
+                if(type == JSON_Type_Object && !(json_read_string(reader, &scratch) && json_consume(reader, ':'))) {
+                    ok = false;
+                    break;
+                }
+                continue; // On to its first value.
+            }
+            depth -= 1; // It was empty.
+        }
+        else if(!json_skip_scalar(reader, type, &scratch)) {
+            ok = false;
+            break;
+        }
+
+        // A value is done. Close whatever ends right after it, then move on to the next value of the innermost one.
+        while(depth > 0) {
+            if(json_consume(reader, closers[depth - 1])) {
+                depth -= 1;
+                continue;
+            }
+            if(!json_consume(reader, ',')) {
+                ok = false;
+            }
+            else if(closers[depth - 1] == '}' && !(json_read_string(reader, &scratch) && json_consume(reader, ':'))) {
+                ok = false;
+            }
+            break;
+        }
+    } while(ok && depth > 0);
+
+    string_buffer_free(&scratch);
+    return ok;
+}
+
+bool json_read_object_begin(JSON_Reader *reader) {
+    assert(reader != NULL);
+    return json_consume(reader, '{');
+}
+
+bool json_read_object_next(JSON_Reader *reader, String_Buffer *out_key, bool *out_has_member) {
+    assert(reader != NULL);
+    assert(out_key != NULL);
+    assert(out_has_member != NULL);
+
+    *out_has_member = false;
+    if(json_consume(reader, '}')) {
+        return true;
+    }
+
+    // Every member but the first comes after a comma. The first comes right after the '{', which is what the last
+    // thing before the whitespace we're at is then.
+    size_t before = reader->position;
+    while(before > 0 && strchr(" \t\r\n", reader->text[before - 1]) != NULL) {
+        before -= 1;
+    }
+    bool is_first = before > 0 && reader->text[before - 1] == '{';
+    if(!is_first && !json_consume(reader, ',')) {
+        return false;
+    }
+
+    if(!json_read_string(reader, out_key) || !json_consume(reader, ':')) {
+        return false;
+    }
+
+    *out_has_member = true;
+    return true;
+}
+
+bool json_at_end(JSON_Reader *reader) {
+    assert(reader != NULL);
+    json_skip_whitespace(reader);
+    return reader->position >= reader->length;
+}
+
+void json_append_string(String_Buffer *out, const char *text, const size_t length) {
+    assert(out != NULL);
+    assert(text != NULL || length == 0);
+
+    static const char hex[] = "0123456789abcdef";
+
+    json_append(out, "\"", 1);
+
+    size_t run_start = 0;
+    for(size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if(c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        json_append(out, &text[run_start], i - run_start);
+        run_start = i + 1;
+
+        switch(c) {
+            case '"':  json_append(out, "\\\"", 2); break;
+            case '\\': json_append(out, "\\\\", 2); break;
+            case '\n': json_append(out, "\\n", 2);  break;
+            case '\r': json_append(out, "\\r", 2);  break;
+            case '\t': json_append(out, "\\t", 2);  break;
+            default: {
+                char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                json_append(out, escaped, sizeof(escaped));
+                break;
+            }
+        }
+    }
+    json_append(out, &text[run_start], length - run_start);
+
+    json_append(out, "\"", 1);
+}
@@ -0,0 +1,62 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "string/buffer/string_buffer.h"
+
+// Just enough JSON for line-based input and output: a pull reader that walks a document in place without building a
+// tree, and a writer for strings. Numbers are read as doubles. Nesting is limited to JSON_MAX_DEPTH when skipping.
+
+#ifndef JSON_MAX_DEPTH
+#define JSON_MAX_DEPTH 64
+#endif
+
+typedef enum {
+    JSON_Type_Invalid, // Not the start of a value, or the end of the text.
+    JSON_Type_Null,
+    JSON_Type_Bool,
+    JSON_Type_Number,
+    JSON_Type_String,
+    JSON_Type_Array,
+    JSON_Type_Object,
+} JSON_Type;
+
+typedef struct {
+    const char *text; // Not copied.
+    size_t length;
+    size_t position;
+} JSON_Reader;
+
+void json_reader_init(JSON_Reader *reader, const char *text, const size_t length);
+
+// What the next value is, after skipping whitespace. Doesn't consume anything.
+JSON_Type json_peek(JSON_Reader *reader);
+
+// Each of these consumes one value of its type and returns false, leaving 'position' where it went wrong, if the next
+// value isn't one or is malformed.
+bool json_read_null(JSON_Reader *reader);
+bool json_read_bool(JSON_Reader *reader, bool *out_value);
+bool json_read_number(JSON_Reader *reader, double *out_value);
+bool json_read_string(JSON_Reader *reader, String_Buffer *out); // Unescaped into 'out', which is cleared first.
+bool json_skip_value(JSON_Reader *reader); // Any value, including everything in it.
+
+// Walking an object:
+//     json_read_object_begin(reader);
+//     while(json_read_object_next(reader, &key, &has_member) && has_member) {
+//         .. read or skip the value ..
+//     }
+// json_read_object_next(..) returns false if the object is malformed, and sets 'has_member' to false at its end.
+bool json_read_object_begin(JSON_Reader *reader);
+bool json_read_object_next(JSON_Reader *reader, String_Buffer *out_key, bool *out_has_member);
+
+// True if there's nothing but whitespace left.
+bool json_at_end(JSON_Reader *reader);
+
+// Appends 'length' bytes of 'text' as a quoted, escaped JSON string. Bytes above 0x7F are passed through as they are,
+// so UTF-8 stays UTF-8.
+void json_append_string(String_Buffer *out, const char *text, const size_t length);
+
+#endif
@@ -0,0 +1,665 @@
+#include "log.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "clock/clock.h"
+#include "string/buffer/string_buffer.h"
+
+_Static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two.");
+_Static_assert(LOG_MAX_RECORD_SIZE <= LOG_RING_SIZE / 2, "LOG_MAX_RECORD_SIZE has to fit in the ring comfortably.");
+
+// A thread's records. Only the thread writes records and 'write_position', only the drain moves 'read_position'.
+typedef struct Log_Ring Log_Ring;
+struct Log_Ring {
+    uint8_t bytes[LOG_RING_SIZE];
+
+    uint64_t write_position __attribute__((aligned(64)));
+    uint64_t read_position __attribute__((aligned(64)));
+
+    uint64_t dropped;          // Records that didn't fit. Written by the thread.
+    uint64_t dropped_reported; // How many of those the drain has told about.
+
+    Log_Ring *next_thread;
+};
+
+// Comes first in every record, followed by the arguments packed back to back. Records are a multiple of 8 bytes, so
+// there's always room for 'size' and 'level' at the end of the ring, which is all a padding record needs.
+typedef struct {
+    uint32_t size; // Of the whole record.
+    uint8_t level; // LOG_LEVEL_NONE for padding up to the end of the ring.
+    bool truncated;
+    uint16_t arguments_size;
+    uint64_t timestamp_ns;
+    const char *format;
+} Log_Record_Header;
+
+typedef enum {
+    Log_Length_None,
+    Log_Length_HH,
+    Log_Length_H,
+    Log_Length_L,
+    Log_Length_LL,
+    Log_Length_Z,
+    Log_Length_J,
+    Log_Length_T,
+    Log_Length_Big_L,
+} Log_Length;
+
+// One conversion in a format, e.g. '%-8.3llu'.
+typedef struct {
+    char text[32];
+    uint32_t text_length;
+    uint32_t star_count; // Width and/or precision given as arguments.
+    bool width_is_star;
+    bool precision_is_star;
+    int precision; // -1 for none or '*'.
+    uint32_t flags_and_width_length; // How much of 'text' comes before the precision.
+    Log_Length length;
+    char conversion;
+} Log_Spec;
+
+static __thread Log_Ring *log_ring_of_this_thread;
+static Log_Ring *log_rings_of_all_threads; // Pushed onto, never taken from.
+
+static pthread_once_t log_drain_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t log_drain_mutex = PTHREAD_MUTEX_INITIALIZER; // Only the draining side takes it.
+static String_Buffer log_output; // Guarded by 'log_drain_mutex'.
+static uint64_t log_first_timestamp_ns; // Guarded by 'log_drain_mutex'.
+
+// The drain waits on 'log_wake_condition' while every ring is empty. 'log_drain_sleeping' is set by the drain and
+// cleared by whoever wakes it, under 'log_wake_mutex'.
+static pthread_mutex_t log_wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_wake_condition = PTHREAD_COND_INITIALIZER;
+static bool log_drain_sleeping;
+static FILE *log_output_file; // NULL for stdout.
+
+// 'format' points at a '%'. Returns false if what follows isn't a conversion we know, in which case the '%' is just
+// text. The logging thread and the drain both go through here, so they always agree on what the arguments are.
+static bool log_parse_spec(const char *format, Log_Spec *out_spec) {
+    assert(*format == '%');
+    memset(out_spec, 0, sizeof(Log_Spec));
+
+    const char *at = format + 1;
+    while(*at != '\0' && strchr("-+ #0'", *at) != NULL) {
+        at++;
+    }
+
+    if(*at == '*') {
+        out_spec->star_count += 1;
+        out_spec->width_is_star = true;
+        at++;
+    }
+    while(*at >= '0' && *at <= '9') {
+        at++;
+    }
+
+    out_spec->flags_and_width_length = (uint32_t)(at - format);
+    out_spec->precision = -1;
+    if(*at == '.') {
+        at++;
+        if(*at == '*') {
+            out_spec->star_count += 1;
+            out_spec->precision_is_star = true;
+            at++;
+        }
+        else {
+            out_spec->precision = 0;
+        }
+        while(*at >= '0' && *at <= '9') {
+            out_spec->precision = out_spec->precision * 10 + (*at - '0');
+            at++;
+        }
+    }
+
+    switch(*at) {
+        case 'h': {
+            at++;
+            out_spec->length = Log_Length_H;
+            if(*at == 'h') {
+                at++;
+                out_spec->length = Log_Length_HH;
+            }
+            break;
+        }
+        case 'l': {
+            at++;
+            out_spec->length = Log_Length_L;
+            if(*at == 'l') {
+                at++;
+                out_spec->length = Log_Length_LL;
+            }
+            break;
+        }
+        case 'z': { at++; out_spec->length = Log_Length_Z; break; }
+        case 'j': { at++; out_spec->length = Log_Length_J; break; }
+        case 't': { at++; out_spec->length = Log_Length_T; break; }
+        case 'L': { at++; out_spec->length = Log_Length_Big_L; break; }
+        default: {
+            break;
+        }
+    }
+
+    if(*at == '\0' || strchr("diouxXeEfFgGaAcsp%", *at) == NULL) {
+        return false; // Includes '%n'.
+    }
+    out_spec->conversion = *at;
+    at++;
+
+    out_spec->text_length = (uint32_t)(at - format);
+    if(out_spec->text_length >= sizeof(out_spec->text)) {
+        return false;
+    }
+    memcpy(out_spec->text, format, out_spec->text_length);
+
+    return true;
+}
+
+static inline bool log_conversion_is_signed(char conversion) {
+    return conversion == 'd' || conversion == 'i';
+}
+
+static inline bool log_conversion_is_unsigned(char conversion) {
+    return conversion == 'o' || conversion == 'u' || conversion == 'x' || conversion == 'X';
+}
+
+static inline bool log_conversion_is_floating(char conversion) {
+    return strchr("eEfFgGaA", conversion) != NULL;
+}
+
+// Packs arguments into a record, giving up on the rest once one doesn't fit.
+typedef struct {
+    uint8_t *bytes;
+    uint32_t length;
+    uint32_t capacity;
+    bool truncated;
+} Log_Packer;
+
+static inline void log_pack(Log_Packer *packer, const void *value, uint32_t size) {
+    if(packer->truncated || packer->length + size > packer->capacity) {
+        packer->truncated = true;
+        return;
+    }
+    memcpy(&packer->bytes[packer->length], value, size);
+    packer->length += size;
+}
+
+// Strings are stored as their length followed by the bytes, cut to 'precision' (if >= 0) so the drain can print them
+// with '%.*s'.
+static inline void log_pack_string(Log_Packer *packer, const char *string, int precision) {
+    if(string == NULL) {
+        string = "(null)";
+    }
+
+    size_t max_length = LOG_MAX_STRING_ARGUMENT_LENGTH;
+    if(precision >= 0 && (size_t)precision < max_length) {
+        max_length = (size_t)precision;
+    }
+    uint32_t length = (uint32_t)strnlen(string, max_length);
+    if(packer->length + sizeof(uint32_t) + length > packer->capacity && packer->length + sizeof(uint32_t) <= packer->capacity) {
+        length = packer->capacity - packer->length - sizeof(uint32_t); // Take what fits.
+        packer->truncated = true;
+    }
+
+    uint32_t needed = sizeof(uint32_t) + length;
+    if(packer->length + needed > packer->capacity) {
+        packer->truncated = true;
+        return;
+    }
+    memcpy(&packer->bytes[packer->length], &length, sizeof(uint32_t));
+    memcpy(&packer->bytes[packer->length + sizeof(uint32_t)], string, length);
+    packer->length += needed;
+}
+
+static void *log_drain(void *argument);
+
+static void log_wake_drain(void) {
+    pthread_mutex_lock(&log_wake_mutex);
+    __atomic_store_n(&log_drain_sleeping, false, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&log_wake_condition);
+    pthread_mutex_unlock(&log_wake_mutex);
+}
+
+static void log_start_drain(void) {
+    string_buffer_init(&log_output, 4096);
+    atexit(log_flush);
+
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, log_drain, NULL) == 0) {
+        pthread_detach(thread);
+    }
+    // Without the thread records still come out, on log_flush(..) and at exit.
+}
+
+static Log_Ring *log_ring_for_this_thread(void) {
+    if(log_ring_of_this_thread != NULL) {
+        return log_ring_of_this_thread;
+    }
+
+    pthread_once(&log_drain_once, log_start_drain);
+
+    Log_Ring *ring = calloc(1, sizeof(Log_Ring));
+    if(ring == NULL) {
+        return NULL;
+    }
+
+    ring->next_thread = __atomic_load_n(&log_rings_of_all_threads, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&log_rings_of_all_threads, &ring->next_thread, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // 'next_thread' got updated to the new head. Try again.
+    }
+
+    log_ring_of_this_thread = ring;
+    return ring;
+}
+
+void log_write(const uint8_t level, const char *format, ...) {
+    assert(format != NULL);
+    assert(level < LOG_LEVEL_NONE);
+
+    Log_Ring *ring = log_ring_for_this_thread();
+    if(ring == NULL) {
+        return;
+    }
+
+    union {
+        uint8_t bytes[LOG_MAX_RECORD_SIZE];
+        Log_Record_Header align_header;
+    } record;
+
+    Log_Packer packer;
+    packer.bytes = &record.bytes[sizeof(Log_Record_Header)];
+    packer.length = 0;
+    packer.capacity = LOG_MAX_RECORD_SIZE - sizeof(Log_Record_Header);
+    packer.truncated = false;
+
+    va_list arguments;
+    va_start(arguments, format);
+
+    for(const char *at = format; *at != '\0' && !packer.truncated; at++) {
+        Log_Spec spec;
+        if(*at != '%' || !log_parse_spec(at, &spec)) {
+            continue;
+        }
+        at += spec.text_length - 1;
+
+        int stars[2] = {0, 0};
+        for(uint32_t i = 0; i < spec.star_count; i++) {
+            stars[i] = va_arg(arguments, int);
+            log_pack(&packer, &stars[i], sizeof(int));
+        }
+
+        if(log_conversion_is_signed(spec.conversion)) {
+            int64_t value;
+            switch(spec.length) {
+                case Log_Length_L:  { value = va_arg(arguments, long); break; }
+                case Log_Length_LL: { value = va_arg(arguments, long long); break; }
+                case Log_Length_Z:  { value = va_arg(arguments, ssize_t); break; }
+                case Log_Length_J:  { value = va_arg(arguments, intmax_t); break; }
+                case Log_Length_T:  { value = va_arg(arguments, ptrdiff_t); break; }
+                default:            { value = va_arg(arguments, int); break; }
+            }
+            log_pack(&packer, &value, sizeof(value));
+        }
+        else if(log_conversion_is_unsigned(spec.conversion)) {
+            uint64_t value;
+            switch(spec.length) {
+                case Log_Length_L:  { value = va_arg(arguments, unsigned long); break; }
+                case Log_Length_LL: { value = va_arg(arguments, unsigned long long); break; }
+                case Log_Length_Z:  { value = va_arg(arguments, size_t); break; }
+                case Log_Length_J:  { value = va_arg(arguments, uintmax_t); break; }
+                case Log_Length_T:  { value = (uint64_t)va_arg(arguments, ptrdiff_t); break; }
+                default:            { value = va_arg(arguments, unsigned int); break; }
+            }
+            log_pack(&packer, &value, sizeof(value));
+        }
+        else if(log_conversion_is_floating(spec.conversion)) {
+            long double value = spec.length == Log_Length_Big_L ? va_arg(arguments, long double) : va_arg(arguments, double);
+            log_pack(&packer, &value, sizeof(value));
+        }
+        else if(spec.conversion == 'c') {
+            int value = va_arg(arguments, int);
+            log_pack(&packer, &value, sizeof(value));
+        }
+        else if(spec.conversion == 's') {
+            int precision = spec.precision_is_star ? stars[spec.star_count - 1] : spec.precision;
+            log_pack_string(&packer, va_arg(arguments, const char *), precision);
+        }
+        else if(spec.conversion == 'p') {
+            void *value = va_arg(arguments, void *);
+            log_pack(&packer, &value, sizeof(value));
+        }
+    }
+
+    va_end(arguments);
+
+    uint32_t size = (uint32_t)((sizeof(Log_Record_Header) + packer.length + 7) & ~(uint32_t)7);
+
+    Log_Record_Header header;
+    memset(&header, 0, sizeof(header));
+    header.size = size;
+    header.level = level;
+    header.truncated = packer.truncated;
+    header.arguments_size = (uint16_t)packer.length;
+    header.timestamp_ns = clock_now_ns();
+    header.format = format;
+    memcpy(&record.bytes[0], &header, sizeof(header));
+
+    // Into the ring. A record never wraps around the end; what's left there becomes padding.
+    const uint64_t first_write_position = ring->write_position;
+    uint64_t write_position = first_write_position;
+    uint64_t read_position = __atomic_load_n(&ring->read_position, __ATOMIC_ACQUIRE);
+
+    uint32_t offset = (uint32_t)(write_position & (LOG_RING_SIZE - 1));
+    uint32_t left_until_end = LOG_RING_SIZE - offset;
+    uint32_t padding = left_until_end < size ? left_until_end : 0;
+
+    if(write_position + padding + size - read_position > LOG_RING_SIZE) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    if(padding > 0) {
+        Log_Record_Header padding_header;
+        padding_header.size = padding;
+        padding_header.level = LOG_LEVEL_NONE;
+        memcpy(&ring->bytes[offset], &padding_header, offsetof(Log_Record_Header, level) + sizeof(uint8_t));
+        write_position += padding;
+        offset = 0;
+    }
+
+    memcpy(&ring->bytes[offset], &record.bytes[0], size);
+    __atomic_store_n(&ring->write_position, write_position + size, __ATOMIC_SEQ_CST);
+
+    // NOTE: Only a record going into a ring the drain had emptied can find it asleep. Otherwise it's still busy with
+    // the ring, or it will see the record when it looks over every ring once more before it goes to sleep.
+    if(__atomic_load_n(&ring->read_position, __ATOMIC_SEQ_CST) == first_write_position && __atomic_load_n(&log_drain_sleeping, __ATOMIC_SEQ_CST)) {
+        log_wake_drain();
+    }
+}
+
+// Reads arguments back out of a record, in the order log_write(..) packed them.
+typedef struct {
+    const uint8_t *bytes;
+    uint32_t length;
+    uint32_t offset;
+} Log_Unpacker;
+
+static inline bool log_unpack(Log_Unpacker *unpacker, void *out_value, uint32_t size) {
+    if(unpacker->offset + size > unpacker->length) {
+        return false;
+    }
+    memcpy(out_value, &unpacker->bytes[unpacker->offset], size);
+    unpacker->offset += size;
+    return true;
+}
+
+#define LOG_APPEND_SPEC(out, spec, stars, value) \
+    do { \
+        if((spec)->star_count == 0) { \
+            string_buffer_appendf((out), (spec)->text, (value)); \
+        } \
+        else if((spec)->star_count == 1) { \
+            string_buffer_appendf((out), (spec)->text, (stars)[0], (value)); \
+        } \
+        else { \
+            string_buffer_appendf((out), (spec)->text, (stars)[0], (stars)[1], (value)); \
+        } \
+    } while(0)
+
+// Appends one conversion. Returns false if its arguments were cut off.
+static bool log_format_spec(const Log_Spec *spec, Log_Unpacker *unpacker, String_Buffer *out) {
+    if(spec->conversion == '%') {
+        string_buffer_appendf(out, "%%");
+        return true;
+    }
+
+    int stars[2] = {0, 0};
+    for(uint32_t i = 0; i < spec->star_count; i++) {
+        if(!log_unpack(unpacker, &stars[i], sizeof(int))) {
+            return false;
+        }
+    }
+
+    if(log_conversion_is_signed(spec->conversion)) {
+        int64_t value;
+        if(!log_unpack(unpacker, &value, sizeof(value))) {
+            return false;
+        }
+        switch(spec->length) {
+            case Log_Length_L:  { LOG_APPEND_SPEC(out, spec, stars, (long)value); break; }
+            case Log_Length_LL: { LOG_APPEND_SPEC(out, spec, stars, (long long)value); break; }
+            case Log_Length_Z:  { LOG_APPEND_SPEC(out, spec, stars, (ssize_t)value); break; }
+            case Log_Length_J:  { LOG_APPEND_SPEC(out, spec, stars, (intmax_t)value); break; }
+            case Log_Length_T:  { LOG_APPEND_SPEC(out, spec, stars, (ptrdiff_t)value); break; }
+            default:            { LOG_APPEND_SPEC(out, spec, stars, (int)value); break; }
+        }
+    }
+    else if(log_conversion_is_unsigned(spec->conversion)) {
+        uint64_t value;
+        if(!log_unpack(unpacker, &value, sizeof(value))) {
+            return false;
+        }
+        switch(spec->length) {
+            case Log_Length_L:  { LOG_APPEND_SPEC(out, spec, stars, (unsigned long)value); break; }
+            case Log_Length_LL: { LOG_APPEND_SPEC(out, spec, stars, (unsigned long long)value); break; }
+            case Log_Length_Z:  { LOG_APPEND_SPEC(out, spec, stars, (size_t)value); break; }
+            case Log_Length_J:  { LOG_APPEND_SPEC(out, spec, stars, (uintmax_t)value); break; }
+            case Log_Length_T:  { LOG_APPEND_SPEC(out, spec, stars, (ptrdiff_t)value); break; }
+            default:            { LOG_APPEND_SPEC(out, spec, stars, (unsigned int)value); break; }
+        }
+    }
+    else if(log_conversion_is_floating(spec->conversion)) {
+        long double value;
+        if(!log_unpack(unpacker, &value, sizeof(value))) {
+            return false;
+        }
+        if(spec->length == Log_Length_Big_L) {
+            LOG_APPEND_SPEC(out, spec, stars, value);
+        }
+        else {
+            LOG_APPEND_SPEC(out, spec, stars, (double)value);
+        }
+    }
+    else if(spec->conversion == 'c') {
+        int value;
+        if(!log_unpack(unpacker, &value, sizeof(value))) {
+            return false;
+        }
+        LOG_APPEND_SPEC(out, spec, stars, value);
+    }
+    else if(spec->conversion == 's') {
+        uint32_t length;
+        if(!log_unpack(unpacker, &length, sizeof(length)) || unpacker->offset + length > unpacker->length) {
+            return false;
+        }
+
+        // The copy isn't null-terminated, and was already cut to the precision. Print it as '%.*s' with the original
+        // flags and width.
+        const char *string = (const char *)&unpacker->bytes[unpacker->offset];
+        unpacker->offset += length;
+
+        char string_spec[sizeof(spec->text) + 4];
+        memcpy(string_spec, spec->text, spec->flags_and_width_length);
+        memcpy(&string_spec[spec->flags_and_width_length], ".*s", 4);
+
+        if(spec->width_is_star) {
+            string_buffer_appendf(out, string_spec, stars[0], (int)length, string);
+        }
+        else {
+            string_buffer_appendf(out, string_spec, (int)length, string);
+        }
+    }
+    else if(spec->conversion == 'p') {
+        void *value;
+        if(!log_unpack(unpacker, &value, sizeof(value))) {
+            return false;
+        }
+        LOG_APPEND_SPEC(out, spec, stars, value);
+    }
+
+    return true;
+}
+
+static void log_format_record(const Log_Record_Header *header, const uint8_t *arguments, String_Buffer *out) {
+    if(log_first_timestamp_ns == 0) {
+        log_first_timestamp_ns = header->timestamp_ns;
+    }
+#if LOG_TIMESTAMPS
+    string_buffer_appendf(out, "[%12.6f] ", (double)(header->timestamp_ns - log_first_timestamp_ns) / (double)CLOCK_NS_PER_S);
+#endif
+
+    if(header->level == LOG_LEVEL_WARNING) {
+        string_buffer_appendf(out, "Warning: ");
+    }
+    else if(header->level == LOG_LEVEL_ERROR) {
+        string_buffer_appendf(out, "Error: ");
+    }
+
+    Log_Unpacker unpacker;
+    unpacker.bytes = arguments;
+    unpacker.length = header->arguments_size;
+    unpacker.offset = 0;
+
+    const char *text_start = header->format;
+    for(const char *at = header->format; ; at++) {
+        Log_Spec spec;
+        bool is_spec = *at == '%' && log_parse_spec(at, &spec);
+        if(*at != '\0' && !is_spec) {
+            continue;
+        }
+
+        if(at > text_start) {
+            string_buffer_appendf(out, "%.*s", (int)(at - text_start), text_start);
+        }
+        if(*at == '\0') {
+            break;
+        }
+
+        if(!log_format_spec(&spec, &unpacker, out)) {
+            string_buffer_appendf(out, " ...");
+            break;
+        }
+
+        at += spec.text_length - 1;
+        text_start = at + 1;
+    }
+
+    if(header->truncated && unpacker.offset >= unpacker.length) {
+        string_buffer_appendf(out, " (cut off)");
+    }
+    string_buffer_appendf(out, "\n");
+}
+
+// Formats everything that's in the ring into 'log_output'. Returns false if there was nothing.
+static bool log_drain_ring(Log_Ring *ring) {
+    uint64_t read_position = ring->read_position;
+    uint64_t write_position = __atomic_load_n(&ring->write_position, __ATOMIC_ACQUIRE);
+    bool drained_any = read_position < write_position;
+
+    while(read_position < write_position) {
+        uint32_t offset = (uint32_t)(read_position & (LOG_RING_SIZE - 1));
+
+        Log_Record_Header header;
+        memcpy(&header, &ring->bytes[offset], offsetof(Log_Record_Header, level) + sizeof(uint8_t));
+        if(header.level != LOG_LEVEL_NONE) {
+            memcpy(&header, &ring->bytes[offset], sizeof(Log_Record_Header));
+            log_format_record(&header, &ring->bytes[offset + sizeof(Log_Record_Header)], &log_output);
+        }
+
+        read_position += header.size;
+    }
+    __atomic_store_n(&ring->read_position, read_position, __ATOMIC_SEQ_CST);
+
+    uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    if(dropped > ring->dropped_reported) {
+        string_buffer_appendf(&log_output, "(%llu log records dropped, the ring was full.)\n", (unsigned long long)(dropped - ring->dropped_reported));
+        ring->dropped_reported = dropped;
+        drained_any = true;
+    }
+
+    return drained_any;
+}
+
+static bool log_drain_all(void) {
+    bool drained_any = false;
+
+    Log_Ring *ring = __atomic_load_n(&log_rings_of_all_threads, __ATOMIC_ACQUIRE);
+    for(; ring != NULL; ring = ring->next_thread) {
+        if(log_drain_ring(ring)) {
+            drained_any = true;
+        }
+    }
+
+    if(log_output.length > 0) {
+        FILE *file = __atomic_load_n(&log_output_file, __ATOMIC_ACQUIRE);
+        if(file == NULL) {
+            file = stdout;
+        }
+        fwrite(log_output.data, 1, log_output.length, file);
+        fflush(file);
+        log_output.length = 0;
+        log_output.data[0] = '\0';
+    }
+
+    return drained_any;
+}
+
+static bool log_any_ring_has_records(void) {
+    Log_Ring *ring = __atomic_load_n(&log_rings_of_all_threads, __ATOMIC_ACQUIRE);
+    for(; ring != NULL; ring = ring->next_thread) {
+        if(__atomic_load_n(&ring->read_position, __ATOMIC_SEQ_CST) != __atomic_load_n(&ring->write_position, __ATOMIC_SEQ_CST)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *log_drain(void *argument) {
+    (void)argument;
+
+    while(true) {
+        pthread_mutex_lock(&log_drain_mutex);
+        bool drained_any = log_drain_all();
+        pthread_mutex_unlock(&log_drain_mutex);
+
+        if(drained_any) {
+            continue;
+        }
+
+        // NOTE: Saying so before looking at the rings again means a record that comes in after the look sees the flag,
+        // and wakes the drain up.
+        __atomic_store_n(&log_drain_sleeping, true, __ATOMIC_SEQ_CST);
+        if(log_any_ring_has_records()) {
+            __atomic_store_n(&log_drain_sleeping, false, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        pthread_mutex_lock(&log_wake_mutex);
+        while(__atomic_load_n(&log_drain_sleeping, __ATOMIC_SEQ_CST)) {
+            pthread_cond_wait(&log_wake_condition, &log_wake_mutex);
+        }
+        pthread_mutex_unlock(&log_wake_mutex);
+    }
+
+    return NULL;
+}
+
+void log_set_output(FILE *file) {
+    __atomic_store_n(&log_output_file, file, __ATOMIC_RELEASE);
+}
+
+void log_flush(void) {
+    if(__atomic_load_n(&log_rings_of_all_threads, __ATOMIC_ACQUIRE) == NULL) {
+        return; // Nothing was ever logged.
+    }
+
+    pthread_mutex_lock(&log_drain_mutex);
+    log_drain_all();
+    pthread_mutex_unlock(&log_drain_mutex);
+}
@@ -0,0 +1,93 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Logging that stays off the hot path.
+//
+// Levels below LOG_LEVEL are compiled away entirely (their arguments are still type checked against the format, but
+// never evaluated). Enabled records aren't formatted by the thread that logs them: log_write(..) copies the format
+// pointer and the raw arguments into the calling thread's ring, and a background thread formats and writes them out.
+// No stdio lock, no formatting, no syscall on the logging thread. If a thread's ring is full its records are dropped
+// (and counted) rather than making it wait.
+//
+// Because of that, the format has to be a string literal (or otherwise live forever); only the pointer is kept.
+// Strings passed for '%s' are copied, up to LOG_MAX_STRING_ARGUMENT_LENGTH bytes. '%n' isn't supported.
+// Records from one thread come out in order. Records from different threads may interleave in any order.
+
+#define LOG_LEVEL_TRACE   0
+#define LOG_LEVEL_DEBUG   1
+#define LOG_LEVEL_INFO    2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_ERROR   4
+#define LOG_LEVEL_NONE    5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE (64 * 1024) // Per thread. Must be a power of two.
+#endif
+
+#ifndef LOG_MAX_RECORD_SIZE
+#define LOG_MAX_RECORD_SIZE 2048 // Arguments that don't fit are cut off.
+#endif
+
+#ifndef LOG_MAX_STRING_ARGUMENT_LENGTH
+#define LOG_MAX_STRING_ARGUMENT_LENGTH 512
+#endif
+
+#ifndef LOG_TIMESTAMPS
+#define LOG_TIMESTAMPS 0 // Prefix every line with the seconds since the first record.
+#endif
+
+// Every record becomes one line; don't end the format with a newline.
+void log_write(const uint8_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Writes out everything that has been logged so far, on the calling thread. Done at exit as well.
+void log_flush(void);
+
+// Where the lines go from now on. stdout until this is called, e.g. to keep stdout for a program's actual output.
+void log_set_output(FILE *file);
+
+static inline void log_discard(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static inline void log_discard(const char *format, ...) {
+    (void)format;
+}
+
+#define LOG_DISCARD(...) do { if(0) { log_discard(__VA_ARGS__); } } while(0)
+
+#if LOG_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) log_write(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) log_write(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#endif
@@ -4,10 +4,22 @@
 #include <string.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <signal.h>
 
+#include "clock/clock.h"
 #include "string/buffer/string_buffer.h"
 // #include "http/client/http_client.h"
 #include "http/http.h"
+#include "http/client/http_client_stats.h"
+#include "http/client/http_client_cache.h"
+#include "http/batch/http_batch.h"
+#include "http/download/http_download.h"
+#include "http/load/http_load.h"
+#include "http/server/http_server.h"
+#include "http/server/http_server_static.h"
+#include "metrics/metrics.h"
+#include "log/log.h"
+#include "trace/trace.h"
 
 typedef enum {
     HTTP_Fuzz_Result_OK,
@@ -72,6 +84,7 @@ HTTP_Fuzz_Result http_fuzz(const char *input_file_path) {
         }
         case HTTP_Parse_Result_Invalid_Data:
         case HTTP_Parse_Result_Needs_More_Data:
+        case HTTP_Parse_Result_Count:
         case HTTP_Parse_Result_TODO: {
             free(input_buffer);
             return HTTP_Fuzz_Result_Failed_To_Parse;
@@ -82,49 +95,530 @@ HTTP_Fuzz_Result http_fuzz(const char *input_file_path) {
     return HTTP_Fuzz_Result_OK;
 }
 
-void http_client_request_callback(const char *hostname, const char *path, HTTP *http) {
+void http_client_request_callback(const char *hostname, const char *path, HTTP *http, const HTTP_Client_Timings *timings) {
     HTTP_Status *status = &http->status;
     HTTP_Headers *headers = &http->headers;
     HTTP_Body *body = &http->body;
 
-    printf("Got HTTP response from '%s/%s'!\n", hostname, path);
-    printf("   Status code: %i (%s).\n", status->status_code, http_get_status_text_for_status_code(status->status_code));
+    LOG_INFO("Got HTTP response from '%s/%s'!", hostname, path);
+    LOG_INFO("   Status code: %i (%s).", status->status_code, http_get_status_text_for_status_code(status->status_code));
 
-    printf("   Headers:\n");
+    LOG_INFO("   Headers:");
     for(uint32_t i = 0; i < headers->header_count; i++) {
         HTTP_Header *header = &headers->headers[i];
-        printf("    - %i. Key: '%s', Value: '%s'.\n", i, header->key, header->value);
+        LOG_INFO("    - %i. Key: '%s', Value: '%s'.", i, header->key, header->value);
     }
 
-    printf("Body (%lu):\n%s\n", body->string_buffer.length, body->string_buffer.data);
+    LOG_INFO("Body (%lu):\n%s", body->string_buffer.length, body->string_buffer.data);
+
+    LOG_INFO("Took %llu us (DNS %llu us, connect %llu us, write %llu us, first byte %llu us, body %llu us).",
+        (unsigned long long)timings->duration_us[HTTP_Client_Phase_Total],
+        (unsigned long long)timings->duration_us[HTTP_Client_Phase_DNS],
+        (unsigned long long)timings->duration_us[HTTP_Client_Phase_Connect],
+        (unsigned long long)timings->duration_us[HTTP_Client_Phase_Request_Write],
+        (unsigned long long)timings->duration_us[HTTP_Client_Phase_Time_To_First_Byte],
+        (unsigned long long)timings->duration_us[HTTP_Client_Phase_Body_Transfer]
+    );
+}
+
+// For '--trace <file>': writes what every thread's trace ring holds by now. Nothing without a file.
+bool dump_trace(const char *file_path) {
+    if(file_path == NULL) {
+        return true;
+    }
+    if(!trace_dump(file_path)) {
+        LOG_ERROR("Failed to write the trace to '%s'.", file_path);
+        return false;
+    }
+    LOG_INFO("Wrote the trace to '%s'. Open it in chrome://tracing or Perfetto.", file_path);
+    return true;
+}
+
+// main batch [--in-flight <n>] [--body] [--cache] [--coalesce] [--trace <file>] [<requests.jsonl> | -]
+// Requests come from the file (stdin if it's '-' or left out), results go to stdout and logs to stderr.
+int http_batch_main(int argc, char *argv[]) {
+    HTTP_Batch_Options options = {0};
+    const char *input_file_path = "-";
+    const char *trace_file_path = NULL;
+    bool use_cache = false;
+
+    for(int i = 2; i < argc; i++) {
+        if(strcmp(argv[i], "--in-flight") == 0 && i + 1 < argc) {
+            char *end = NULL;
+            long max_in_flight = strtol(argv[++i], &end, 10);
+            if(*end != '\0' || max_in_flight < 1 || max_in_flight > 65536) {
+                LOG_ERROR("--in-flight has to be from 1 to 65536, not '%s'.", argv[i]);
+                return 1;
+            }
+            options.max_in_flight = (uint32_t)max_in_flight;
+        }
+        else if(strcmp(argv[i], "--body") == 0) {
+            options.include_body = true;
+        }
+        else if(strcmp(argv[i], "--cache") == 0) {
+            use_cache = true;
+        }
+        else if(strcmp(argv[i], "--coalesce") == 0) {
+            options.coalesce = true;
+        }
+        else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_file_path = argv[++i];
+        }
+        else if(i == argc - 1) {
+            input_file_path = argv[i];
+        }
+        else {
+            LOG_ERROR("Unknown argument '%s'.", argv[i]);
+            return 1;
+        }
+    }
+
+    if(use_cache) {
+        options.cache = http_client_cache_create(NULL);
+        if(options.cache == NULL) {
+            LOG_ERROR("Failed to create a response cache.");
+            return 1;
+        }
+    }
+
+    FILE *input_file = stdin;
+    if(strcmp(input_file_path, "-") != 0) {
+        input_file = fopen(input_file_path, "rb");
+        if(input_file == NULL) {
+            LOG_ERROR("Failed to open '%s'.", input_file_path);
+            http_client_cache_destroy(options.cache);
+            return 1;
+        }
+    }
+
+    HTTP_Batch_Summary summary;
+    bool ok = http_batch_run(input_file, stdout, &options, &summary);
+
+    if(input_file != stdin) {
+        fclose(input_file);
+    }
+    http_client_cache_destroy(options.cache);
+
+    LOG_INFO("Batch done: %llu lines, %llu invalid, %llu succeeded, %llu failed.",
+        (unsigned long long)summary.lines_read,
+        (unsigned long long)summary.invalid_lines,
+        (unsigned long long)summary.succeeded,
+        (unsigned long long)summary.failed
+    );
+    if(!dump_trace(trace_file_path)) {
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
+
+// Reads a whole number from 'min' to 'max' for the option 'name'.
+bool parse_option_number(const char *name, const char *text, const double min, const double max, double *out_value) {
+    char *end = NULL;
+    double value = strtod(text, &end);
+    if(end == text || *end != '\0' || value < min || value > max) {
+        LOG_ERROR("%s has to be from %.0f to %.0f, not '%s'.", name, min, max, text);
+        return false;
+    }
+    *out_value = value;
+    return true;
+}
+
+// main load [--threads <n>] [--connections <n>] [--rate <requests/s>] [--duration <s>] [--timeout <ms>]
+//           [--method <method>] [--body <body>] [--header <name: value>].. [--port <port>] [--trace <file>]
+//           <host> [<path>]
+int http_load_main(int argc, char *argv[]) {
+    HTTP_Load_Options options = {0};
+    options.method = HTTP_Method_GET;
+    options.path = "";
+    const char *trace_file_path = NULL;
+
+    String_Buffer headers;
+    string_buffer_init(&headers, 256);
+
+    bool ok = true;
+    int positional = 0;
+    for(int i = 2; i < argc && ok; i++) {
+        const char *argument = argv[i];
+        bool has_value = i + 1 < argc;
+        double number = 0;
+
+        if(strcmp(argument, "--threads") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 1024, &number);
+            options.threads = (uint32_t)number;
+        }
+        else if(strcmp(argument, "--connections") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 1000000, &number);
+            options.connections = (uint32_t)number;
+        }
+        else if(strcmp(argument, "--rate") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 0, 100000000, &number);
+            options.rate = number;
+        }
+        else if(strcmp(argument, "--duration") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 86400, &number);
+            options.duration_s = (uint32_t)number;
+        }
+        else if(strcmp(argument, "--timeout") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 3600000, &number);
+            options.timeout_ms = (uint32_t)number;
+        }
+        else if(strcmp(argument, "--port") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 65535, &number);
+            options.port = (uint16_t)number;
+        }
+        else if(strcmp(argument, "--method") == 0 && has_value) {
+            ok = http_string_to_method_type(argv[++i], &options.method);
+            if(!ok) {
+                LOG_ERROR("Unknown method '%s'.", argv[i]);
+            }
+        }
+        else if(strcmp(argument, "--body") == 0 && has_value) {
+            options.body = argv[++i];
+        }
+        else if(strcmp(argument, "--trace") == 0 && has_value) {
+            trace_file_path = argv[++i];
+        }
+        else if(strcmp(argument, "--header") == 0 && has_value) {
+            const char *header = argv[++i];
+            ok = strchr(header, ':') != NULL && strpbrk(header, "\r\n") == NULL;
+            if(!ok) {
+                LOG_ERROR("Headers look like 'Name: value', not '%s'.", header);
+            }
+            else {
+                string_buffer_appendf(&headers, "%s\r\n", header);
+            }
+        }
+        else if(argument[0] != '-' && positional == 0) {
+            options.hostname = argument;
+            positional += 1;
+        }
+        else if(argument[0] != '-' && positional == 1) {
+            options.path = argument[0] == '/' ? &argument[1] : argument;
+            positional += 1;
+        }
+        else {
+            LOG_ERROR("Unknown argument '%s'.", argument);
+            ok = false;
+        }
+    }
+
+    if(ok && options.hostname == NULL) {
+        LOG_ERROR("Which host?");
+        ok = false;
+    }
+    if(ok && (options.method == HTTP_Method_GET) != (options.body == NULL)) {
+        LOG_ERROR("GET requests can't have a --body, and POST and PUT need one.");
+        ok = false;
+    }
+    if(ok && headers.length > 0) {
+        options.headers = headers.data;
+    }
+
+    HTTP_Load_Result *result = ok ? malloc(sizeof(HTTP_Load_Result)) : NULL;
+    if(result != NULL) {
+        ok = http_load_run(&options, result);
+        http_load_print(&options, result);
+        free(result);
+        if(!dump_trace(trace_file_path)) {
+            ok = false;
+        }
+    }
+
+    string_buffer_free(&headers);
+    return ok ? 0 : 1;
+}
+
+// main download [--connections <n>] [--segment-size <bytes>] [--attempts <n>] [--timeout <ms>] [--sync none|end|always]
+//               [--header <name: value>].. [--port <port>] [--trace <file>] <host> <path> <file>
+int http_download_main(int argc, char *argv[]) {
+    HTTP_Download_Options options = {0};
+    const char *file_path = NULL;
+    const char *trace_file_path = NULL;
+
+    String_Buffer headers;
+    string_buffer_init(&headers, 256);
+
+    bool ok = true;
+    int positional = 0;
+    for(int i = 2; i < argc && ok; i++) {
+        const char *argument = argv[i];
+        bool has_value = i + 1 < argc;
+        double number = 0;
+
+        if(strcmp(argument, "--connections") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 1024, &number);
+            options.connections = (uint32_t)number;
+        }
+        else if(strcmp(argument, "--segment-size") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 1024.0 * 1024 * 1024, &number);
+            options.max_segment_bytes = (uint64_t)number;
+        }
+        else if(strcmp(argument, "--attempts") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 100, &number);
+            options.max_attempts = (uint32_t)number;
+        }
+        else if(strcmp(argument, "--timeout") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 3600000, &number);
+            options.timeout_ms = (uint32_t)number;
+        }
+        else if(strcmp(argument, "--sync") == 0 && has_value) {
+            const char *sync = argv[++i];
+            if(strcmp(sync, "none") == 0) {
+                options.sync = HTTP_Client_Sink_Sync_None;
+            }
+            else if(strcmp(sync, "end") == 0) {
+                options.sync = HTTP_Client_Sink_Sync_At_End;
+            }
+            else if(strcmp(sync, "always") == 0) {
+                options.sync = HTTP_Client_Sink_Sync_Every_Write;
+            }
+            else {
+                LOG_ERROR("'--sync' is 'none', 'end' or 'always', not '%s'.", sync);
+                ok = false;
+            }
+        }
+        else if(strcmp(argument, "--trace") == 0 && has_value) {
+            trace_file_path = argv[++i];
+        }
+        else if(strcmp(argument, "--port") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 65535, &number);
+            options.port = (uint16_t)number;
+        }
+        else if(strcmp(argument, "--header") == 0 && has_value) {
+            const char *header = argv[++i];
+            ok = strchr(header, ':') != NULL && strpbrk(header, "\r\n") == NULL;
+            if(!ok) {
+                LOG_ERROR("Headers look like 'Name: value', not '%s'.", header);
+            }
+            else {
+                string_buffer_appendf(&headers, "%s\r\n", header);
+            }
+        }
+        else if(argument[0] != '-' && positional == 0) {
+            options.hostname = argument;
+            positional += 1;
+        }
+        else if(argument[0] != '-' && positional == 1) {
+            options.path = argument[0] == '/' ? &argument[1] : argument;
+            positional += 1;
+        }
+        else if(argument[0] != '-' && positional == 2) {
+            file_path = argument;
+            positional += 1;
+        }
+        else {
+            LOG_ERROR("Unknown argument '%s'.", argument);
+            ok = false;
+        }
+    }
+
+    if(ok && file_path == NULL) {
+        LOG_ERROR("Which host, path and file?");
+        ok = false;
+    }
+    if(ok && headers.length > 0) {
+        options.headers = headers.data;
+    }
+
+    HTTP_Download_Result result;
+    const bool ran = ok;
+    if(ok) {
+        ok = http_download_run(&options, file_path, &result);
+    }
+    if(ok) {
+        double seconds = (double)result.duration_ns / CLOCK_NS_PER_S;
+        LOG_INFO("Downloaded %llu bytes to '%s' in %.2f s (%.1f MB/s), %u segment%s, %u retr%s.",
+            (unsigned long long)result.bytes_written,
+            file_path,
+            seconds,
+            seconds > 0 ? (double)result.bytes_written / (1024 * 1024) / seconds : 0,
+            result.segments, result.segments == 1 ? "" : "s",
+            result.retries, result.retries == 1 ? "y" : "ies"
+        );
+    }
+    if(ran && !dump_trace(trace_file_path)) { // Failed downloads too; they're the ones worth looking at.
+        ok = false;
+    }
+
+    string_buffer_free(&headers);
+    return ok ? 0 : 1;
+}
+
+#define SERVE_MAX_BYTES (64 * 1024 * 1024)
+
+// A few endpoints to point the client, 'batch' and 'load' at:
+//     GET  /           "Hello!"
+//     GET  /bytes/<n>  n bytes of 'x'
+//     POST /echo       The request body back (PUT too)
+//     GET  /metrics    Our own metrics, for Prometheus
+//     GET  /trace      What every thread's trace ring holds right now, as Chrome Trace Event JSON
+void serve_handler(const HTTP_Server_Request *request, HTTP_Server_Response *response, void *user_data) {
+    (void)user_data;
+
+    if(request->method == HTTP_Method_GET && strcmp(request->path, "/") == 0) {
+        response->content_type = "text/plain";
+        string_buffer_appendf(&response->body, "Hello!\n");
+    }
+    else if(request->method == HTTP_Method_GET && strncmp(request->path, "/bytes/", 7) == 0) {
+        char *end = NULL;
+        unsigned long long byte_count = strtoull(&request->path[7], &end, 10);
+        if(end == &request->path[7] || *end != '\0' || byte_count > SERVE_MAX_BYTES) {
+            response->status_code = 400;
+            return;
+        }
+
+        response->content_type = "application/octet-stream";
+        if(byte_count > 0) {
+            memset(string_buffer_reserve(&response->body, byte_count), 'x', byte_count);
+            string_buffer_commit(&response->body, byte_count);
+        }
+    }
+    else if((request->method == HTTP_Method_POST || request->method == HTTP_Method_PUT) && strcmp(request->path, "/echo") == 0) {
+        const char *content_type = NULL;
+        http_try_get_key_from_header(request->headers, "Content-Type", &content_type);
+        if(content_type != NULL) {
+            string_buffer_appendf(&response->headers, "Content-Type: %s\r\n", content_type);
+        }
+        if(request->body_length > 0) {
+            string_buffer_append_buf(&response->body, request->body, (uint32_t)request->body_length);
+        }
+    }
+    else if(request->method == HTTP_Method_GET && strcmp(request->path, "/metrics") == 0) {
+        response->content_type = "text/plain; version=0.0.4";
+        metrics_render(Metrics_Format_Prometheus, &response->body);
+    }
+    else if(request->method == HTTP_Method_GET && strcmp(request->path, "/trace") == 0) {
+        response->content_type = "application/json";
+        trace_render(&response->body);
+    }
+    else {
+        response->status_code = 404;
+    }
+}
+
+// main serve [--threads <n>] [--address <address>] [--port <port>] [--keep-alive <ms>] [--pin] [--root <directory>]
+// With a root, serves the files in it instead of the endpoints above.
+int http_serve_main(int argc, char *argv[]) {
+    HTTP_Server_Options options = {0};
+    options.port = 8080;
+    options.handler = serve_handler;
+
+    HTTP_Server_Static_Options static_options = {0};
+
+    bool ok = true;
+    for(int i = 2; i < argc && ok; i++) {
+        const char *argument = argv[i];
+        bool has_value = i + 1 < argc;
+        double number = 0;
+
+        if(strcmp(argument, "--threads") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 1024, &number);
+            options.threads = (uint32_t)number;
+        }
+        else if(strcmp(argument, "--address") == 0 && has_value) {
+            options.address = argv[++i];
+        }
+        else if(strcmp(argument, "--port") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 0, 65535, &number);
+            options.port = (uint16_t)number;
+        }
+        else if(strcmp(argument, "--keep-alive") == 0 && has_value) {
+            ok = parse_option_number(argument, argv[++i], 1, 3600000, &number);
+            options.keep_alive_timeout_ms = (uint32_t)number;
+        }
+        else if(strcmp(argument, "--pin") == 0) {
+            options.pin_threads = true;
+        }
+        else if(strcmp(argument, "--root") == 0 && has_value) {
+            static_options.root = argv[++i];
+        }
+        else {
+            LOG_ERROR("Unknown argument '%s'.", argument);
+            ok = false;
+        }
+    }
+    if(!ok) {
+        return 1;
+    }
+
+    HTTP_Server_Static *static_files = NULL;
+    if(static_options.root != NULL) {
+        static_files = http_server_static_create(&static_options);
+        if(static_files == NULL) {
+            return 1;
+        }
+        options.handler = http_server_static_handle;
+        options.user_data = static_files;
+    }
+
+    // NOTE: Blocked before the server threads start, so they inherit it and the signals only ever reach sigwait(..).
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    HTTP_Server server;
+    if(!http_server_start(&server, &options)) {
+        http_server_static_destroy(static_files);
+        return 1;
+    }
+
+    int signal_number = 0;
+    sigwait(&stop_signals, &signal_number);
+    LOG_INFO("Got signal %i. Stopping ...", signal_number);
+
+    http_server_stop(&server);
+    http_server_static_destroy(static_files);
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
     if(argc < 2) {
-        printf("Usage: %s <http-file> ..\n", argv[0]);
+        LOG_INFO("Usage: %s <http-file> ..", argv[0]);
+        LOG_INFO("       %s batch [--in-flight <n>] [--body] [--cache] [--coalesce] [--trace <file>] [<requests.jsonl> | -]", argv[0]);
+        LOG_INFO("       %s load [--threads <n>] [--connections <n>] [--rate <requests/s>] [--duration <s>] [--timeout <ms>]", argv[0]);
+        LOG_INFO("               [--method <method>] [--body <body>] [--header <name: value>].. [--port <port>] [--trace <file>]");
+        LOG_INFO("               <host> [<path>]");
+        LOG_INFO("       %s download [--connections <n>] [--segment-size <bytes>] [--attempts <n>] [--timeout <ms>] [--sync none|end|always]", argv[0]);
+        LOG_INFO("                 [--header <name: value>].. [--port <port>] [--trace <file>] <host> <path> <file>");
+        LOG_INFO("       %s serve [--threads <n>] [--address <address>] [--port <port>] [--keep-alive <ms>] [--pin] [--root <directory>]", argv[0]);
         return 0;
     }
 
-    printf("Fuzzing HTTP-parser with %i files ...\n", argc - 1);
+    if(strcmp(argv[1], "batch") == 0) {
+        log_set_output(stderr); // Results have stdout to themselves.
+        return http_batch_main(argc, argv);
+    }
+    if(strcmp(argv[1], "load") == 0) {
+        return http_load_main(argc, argv);
+    }
+    if(strcmp(argv[1], "download") == 0) {
+        return http_download_main(argc, argv);
+    }
+    if(strcmp(argv[1], "serve") == 0) {
+        return http_serve_main(argc, argv);
+    }
+
+    LOG_INFO("Fuzzing HTTP-parser with %i files ...", argc - 1);
 
     int amount_ok = 0;
     
     uint32_t i;
     for(i = 1; i < (uint32_t)argc; i++) {
-        printf("%i. '%s' ...\n", i, argv[i]);
+        LOG_INFO("%i. '%s' ...", i, argv[i]);
         HTTP_Fuzz_Result fuzz_result = http_fuzz(argv[i]);
 
-        printf("\nResult: ");
         if(fuzz_result != HTTP_Fuzz_Result_OK) {
-            printf("\033[31;1mFail!\033[0m (%s)\n\n", fuzz_result_descriptions[fuzz_result]); // TODO: SS - fuzz_result_to_string(fuzz_result)
+            LOG_INFO("\nResult: \033[31;1mFail!\033[0m (%s)", fuzz_result_descriptions[fuzz_result]); // TODO: SS - fuzz_result_to_string(fuzz_result)
             continue;
         }
 
-        printf("\033[32;1mOK!\033[0m\n\n");
+        LOG_INFO("\nResult: \033[32;1mOK!\033[0m");
         amount_ok += 1;
     }
 
-    printf("Result: %i/%i OK.\n", amount_ok, argc - 1);
+    LOG_INFO("Result: %i/%i OK.", amount_ok, argc - 1);
 
 
     /////////////////////////////////////
@@ -142,7 +636,10 @@ int main(int argc, char *argv[]) {
     //     "    \"time\": \"<time>\",\r\n"
     //     "    \"temperature\": \"<temperature>°C\"\r\n"
     //     "}\r\n",
-    //     http_client_request_callback
+    //     NULL,
+    //     NULL,
+    //     http_client_request_callback,
+    //     NULL
     // );
 
     // http_client_request(
@@ -150,7 +647,9 @@ int main(int argc, char *argv[]) {
     //     HTTP_Method_GET,
     //     "api.open-meteo.com", "v1/forecast?latitude=52.52&longitude=13.41&hourly=temperature_2m",
     //     NULL,
-    //     http_client_request_callback
+    //     NULL,
+    //     http_client_request_callback,
+    //     NULL
     // );
 
 
@@ -159,10 +658,12 @@ int main(int argc, char *argv[]) {
     //     HTTP_Method_GET,
     //     "chasacademy.instructure.com", "courses/589",
     //     NULL,
-    //     http_client_request_callback
+    //     NULL,
+    //     http_client_request_callback,
+    //     NULL
     // );
 
-    // while(worker_work(&worker) > 0);
+    // worker_run(&worker);
     
     return 0;
 }
\ No newline at end of file
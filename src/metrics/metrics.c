@@ -0,0 +1,220 @@
+#include "metrics.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    const char *help;
+    const char *label; // 'key="value"', or NULL. Consecutive metrics with the same name are one family.
+} Metric_Description;
+
+static const Metric_Description metric_counter_descriptions[Metric_Counter_Count] = {
+    [Metric_Counter_Worker_Ticks]                  = { "worker_ticks_total", "Ticks run by all workers.", NULL },
+
+    [Metric_Counter_DNS_Lookups]                   = { "dns_lookups_total", "Hostnames resolved. There is no DNS cache; every lookup goes to the resolver.", NULL },
+    [Metric_Counter_DNS_Lookup_Failures]           = { "dns_lookup_failures_total", "Hostnames that failed to resolve.", NULL },
+
+    [Metric_Counter_TCP_Connects]                  = { "tcp_connects_total", "Sockets created to connect somewhere.", NULL },
+    [Metric_Counter_TCP_Connect_Failures]          = { "tcp_connect_failures_total", "Connection attempts that failed.", NULL },
+    [Metric_Counter_TCP_Bytes_Sent]                = { "tcp_sent_bytes_total", "Bytes handed to the kernel for sending.", NULL },
+    [Metric_Counter_TCP_Bytes_Received]            = { "tcp_received_bytes_total", "Bytes received from the kernel.", NULL },
+
+    [Metric_Counter_HTTP_Parse_Invalid_Data]       = { "http_parse_failures_total", "Messages the HTTP parser gave up on, by result.", "result=\"invalid_data\"" },
+    [Metric_Counter_HTTP_Parse_TODO]               = { "http_parse_failures_total", "Messages the HTTP parser gave up on, by result.", "result=\"todo\"" },
+
+    [Metric_Counter_HTTP_Client_Requests]          = { "http_client_requests_total", "Requests the HTTP client started.", NULL },
+    [Metric_Counter_HTTP_Client_Requests_Succeeded] = { "http_client_requests_finished_total", "Requests the HTTP client finished, by outcome.", "outcome=\"succeeded\"" },
+    [Metric_Counter_HTTP_Client_Requests_Failed]   = { "http_client_requests_finished_total", "Requests the HTTP client finished, by outcome.", "outcome=\"failed\"" },
+    [Metric_Counter_HTTP_Client_Requests_Cancelled] = { "http_client_requests_finished_total", "Requests the HTTP client finished, by outcome.", "outcome=\"cancelled\"" },
+    [Metric_Counter_HTTP_Client_Cache_Hits]        = { "http_client_cache_lookups_total", "GETs looked up in a response cache, by what they found.", "result=\"hit\"" },
+    [Metric_Counter_HTTP_Client_Cache_Stale]       = { "http_client_cache_lookups_total", "GETs looked up in a response cache, by what they found.", "result=\"stale\"" },
+    [Metric_Counter_HTTP_Client_Cache_Misses]      = { "http_client_cache_lookups_total", "GETs looked up in a response cache, by what they found.", "result=\"miss\"" },
+    [Metric_Counter_HTTP_Client_Cache_Not_Modified] = { "http_client_cache_not_modified_total", "Stale responses a 304 made fresh again.", NULL },
+    [Metric_Counter_HTTP_Client_Requests_Coalesced] = { "http_client_requests_coalesced_total", "GETs that got the response of an identical one in flight instead of making their own.", NULL },
+
+    [Metric_Counter_HTTP_Server_Connections_Accepted] = { "http_server_connections_accepted_total", "Connections the HTTP server accepted.", NULL },
+    [Metric_Counter_HTTP_Server_Requests_Handled]  = { "http_server_requests_total", "Requests the HTTP server answered, by outcome.", "outcome=\"handled\"" },
+    [Metric_Counter_HTTP_Server_Requests_Rejected] = { "http_server_requests_total", "Requests the HTTP server answered, by outcome.", "outcome=\"rejected\"" },
+    [Metric_Counter_HTTP_Server_File_Cache_Hits]   = { "http_server_file_cache_lookups_total", "Files served, by whether they were open already.", "result=\"hit\"" },
+    [Metric_Counter_HTTP_Server_File_Cache_Misses] = { "http_server_file_cache_lookups_total", "Files served, by whether they were open already.", "result=\"miss\"" },
+};
+
+static const Metric_Description metric_gauge_descriptions[Metric_Gauge_Count] = {
+    [Metric_Gauge_TCP_Sockets_Open]                = { "tcp_sockets_open", "Sockets that are open right now.", NULL },
+    [Metric_Gauge_HTTP_Client_Requests_In_Flight]  = { "http_client_requests_in_flight", "Requests the HTTP client is working on right now.", NULL },
+    [Metric_Gauge_HTTP_Client_Cache_Bytes]         = { "http_client_cache_bytes", "Bytes held by response caches, for bodies, headers and bookkeeping.", NULL },
+    [Metric_Gauge_HTTP_Server_Connections_Open]    = { "http_server_connections_open", "Connections the HTTP server has open right now.", NULL },
+};
+
+// Without the unit. That's '_seconds' for Prometheus and '_us' in JSON.
+static const Metric_Description metric_histogram_descriptions[Metric_Histogram_Count] = {
+    [Metric_Histogram_Worker_Tick_Duration]         = { "worker_tick_duration", "How long a worker tick took.", NULL },
+    [Metric_Histogram_HTTP_Client_Request_Duration] = { "http_client_request_duration", "How long a finished request took, from when it first ran.", NULL },
+    [Metric_Histogram_HTTP_Server_Request_Duration] = { "http_server_request_duration", "From a request having fully arrived to its response being handed to the kernel.", NULL },
+};
+
+// Bucket bounds rendered for Prometheus, in microseconds. Our own buckets are much finer, but nobody wants ~900 series
+// per histogram.
+static const uint64_t metric_histogram_bounds_us[] = {
+    10, 25, 50, 100, 250, 500,
+    1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000,
+};
+
+__thread Metrics_Shard *metrics_shard_of_this_thread;
+static Metrics_Shard *metrics_shards_of_all_threads; // Pushed onto, never taken from, so no update is ever lost.
+
+Metrics_Shard *metrics_shard_create(void) {
+    assert(metrics_shard_of_this_thread == NULL);
+
+    Metrics_Shard *shard = calloc(1, sizeof(Metrics_Shard));
+    if(shard == NULL) {
+        return NULL;
+    }
+
+    shard->next_thread = __atomic_load_n(&metrics_shards_of_all_threads, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&metrics_shards_of_all_threads, &shard->next_thread, shard, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // 'next_thread' got updated to the new head. Try again.
+    }
+
+    metrics_shard_of_this_thread = shard;
+    return shard;
+}
+
+void metrics_snapshot(Metrics_Snapshot *out_snapshot) {
+    assert(out_snapshot != NULL);
+    memset(out_snapshot, 0, sizeof(Metrics_Snapshot));
+
+    Metrics_Shard *shard = __atomic_load_n(&metrics_shards_of_all_threads, __ATOMIC_ACQUIRE);
+    for(; shard != NULL; shard = shard->next_thread) {
+        for(uint32_t i = 0; i < Metric_Counter_Count; i++) {
+            out_snapshot->counters[i] += __atomic_load_n(&shard->counters[i], __ATOMIC_RELAXED);
+        }
+        for(uint32_t i = 0; i < Metric_Gauge_Count; i++) {
+            out_snapshot->gauges[i] += __atomic_load_n(&shard->gauges[i], __ATOMIC_RELAXED);
+        }
+        for(uint32_t i = 0; i < Metric_Histogram_Count; i++) {
+            histogram_merge(&out_snapshot->histograms[i], &shard->histograms[i]);
+        }
+    }
+}
+
+static inline bool metric_starts_family(const Metric_Description *descriptions, uint32_t index) {
+    return index == 0 || strcmp(descriptions[index - 1].name, descriptions[index].name) != 0;
+}
+
+static void metrics_render_prometheus(const Metrics_Snapshot *snapshot, String_Buffer *out) {
+    for(uint32_t i = 0; i < Metric_Counter_Count; i++) {
+        const Metric_Description *description = &metric_counter_descriptions[i];
+        if(metric_starts_family(metric_counter_descriptions, i)) {
+            string_buffer_appendf(out, "# HELP %s %s\n# TYPE %s counter\n", description->name, description->help, description->name);
+        }
+        if(description->label != NULL) {
+            string_buffer_appendf(out, "%s{%s} %llu\n", description->name, description->label, (unsigned long long)snapshot->counters[i]);
+        }
+        else {
+            string_buffer_appendf(out, "%s %llu\n", description->name, (unsigned long long)snapshot->counters[i]);
+        }
+    }
+
+    for(uint32_t i = 0; i < Metric_Gauge_Count; i++) {
+        const Metric_Description *description = &metric_gauge_descriptions[i];
+        string_buffer_appendf(out, "# HELP %s %s\n# TYPE %s gauge\n", description->name, description->help, description->name);
+        string_buffer_appendf(out, "%s %lld\n", description->name, (long long)snapshot->gauges[i]);
+    }
+
+    for(uint32_t i = 0; i < Metric_Histogram_Count; i++) {
+        const Metric_Description *description = &metric_histogram_descriptions[i];
+        const Histogram *histogram = &snapshot->histograms[i];
+
+        string_buffer_appendf(out, "# HELP %s_seconds %s\n# TYPE %s_seconds histogram\n", description->name, description->help, description->name);
+        for(uint32_t b = 0; b < sizeof(metric_histogram_bounds_us) / sizeof(metric_histogram_bounds_us[0]); b++) {
+            string_buffer_appendf(out, "%s_seconds_bucket{le=\"%g\"} %llu\n",
+                description->name,
+                (double)metric_histogram_bounds_us[b] / 1000000.0,
+                (unsigned long long)histogram_count_at_or_below(histogram, metric_histogram_bounds_us[b])
+            );
+        }
+        string_buffer_appendf(out, "%s_seconds_bucket{le=\"+Inf\"} %llu\n", description->name, (unsigned long long)histogram->total_count);
+        string_buffer_appendf(out, "%s_seconds_sum %.6f\n", description->name, (double)histogram->sum / 1000000.0);
+        string_buffer_appendf(out, "%s_seconds_count %llu\n", description->name, (unsigned long long)histogram->total_count);
+    }
+}
+
+// Appends '"labels":{"key":"value"},' for a 'key="value"' label. Our labels never contain quotes or backslashes.
+static void metrics_render_json_label(const char *label, String_Buffer *out) {
+    if(label == NULL) {
+        return;
+    }
+
+    const char *equals = strchr(label, '=');
+    assert(equals != NULL);
+    string_buffer_appendf(out, "\"labels\":{\"%.*s\":%s},", (int)(equals - label), label, equals + 1);
+}
+
+static void metrics_render_json(const Metrics_Snapshot *snapshot, String_Buffer *out) {
+    string_buffer_appendf(out, "[");
+    bool first = true;
+
+    for(uint32_t i = 0; i < Metric_Counter_Count; i++) {
+        const Metric_Description *description = &metric_counter_descriptions[i];
+        string_buffer_appendf(out, "%s{\"name\":\"%s\",\"type\":\"counter\",", first ? "" : ",", description->name);
+        metrics_render_json_label(description->label, out);
+        string_buffer_appendf(out, "\"value\":%llu}", (unsigned long long)snapshot->counters[i]);
+        first = false;
+    }
+
+    for(uint32_t i = 0; i < Metric_Gauge_Count; i++) {
+        const Metric_Description *description = &metric_gauge_descriptions[i];
+        string_buffer_appendf(out, ",{\"name\":\"%s\",\"type\":\"gauge\",", description->name);
+        metrics_render_json_label(description->label, out);
+        string_buffer_appendf(out, "\"value\":%lld}", (long long)snapshot->gauges[i]);
+    }
+
+    for(uint32_t i = 0; i < Metric_Histogram_Count; i++) {
+        const Metric_Description *description = &metric_histogram_descriptions[i];
+        const Histogram *histogram = &snapshot->histograms[i];
+
+        string_buffer_appendf(out, ",{\"name\":\"%s_us\",\"type\":\"histogram\",", description->name);
+        metrics_render_json_label(description->label, out);
+        string_buffer_appendf(out, "\"count\":%llu,\"sum\":%llu,\"min\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+            (unsigned long long)histogram->total_count,
+            (unsigned long long)histogram->sum,
+            (unsigned long long)(histogram->total_count > 0 ? histogram->min : 0),
+            (unsigned long long)histogram_value_at_percentile(histogram, 50.0),
+            (unsigned long long)histogram_value_at_percentile(histogram, 90.0),
+            (unsigned long long)histogram_value_at_percentile(histogram, 99.0),
+            (unsigned long long)histogram_value_at_percentile(histogram, 99.9),
+            (unsigned long long)histogram->max
+        );
+    }
+
+    string_buffer_appendf(out, "]\n");
+}
+
+void metrics_render(const Metrics_Format format, String_Buffer *out) {
+    assert(out != NULL);
+    assert(out->capacity > 0);
+
+    // Histograms make this a few pages big. Keep it off the stack.
+    Metrics_Snapshot *snapshot = malloc(sizeof(Metrics_Snapshot));
+    if(snapshot == NULL) {
+        return;
+    }
+    metrics_snapshot(snapshot);
+
+    switch(format) {
+        case Metrics_Format_Prometheus: {
+            metrics_render_prometheus(snapshot, out);
+            break;
+        }
+        case Metrics_Format_JSON: {
+            metrics_render_json(snapshot, out);
+            break;
+        }
+    }
+
+    free(snapshot);
+}
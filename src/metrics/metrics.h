@@ -0,0 +1,152 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "histogram/histogram.h"
+#include "string/buffer/string_buffer.h"
+
+// Process-wide counters, gauges and histograms, for scraping.
+//
+// Every thread updates its own shard, so the hot path is a thread-local lookup and a plain add; no locked instructions,
+// no shared cache lines. Reading (metrics_render(..)) adds up every thread's shard at that moment. Build with
+// -DMETRICS_ENABLED=0 to compile every update away.
+
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED 1
+#endif
+
+// Monotonic counts. Names, help texts and labels are in metrics.c; keep the two in the same order.
+typedef enum {
+    Metric_Counter_Worker_Ticks,
+
+    Metric_Counter_DNS_Lookups,
+    Metric_Counter_DNS_Lookup_Failures,
+
+    Metric_Counter_TCP_Connects,
+    Metric_Counter_TCP_Connect_Failures,
+    Metric_Counter_TCP_Bytes_Sent,
+    Metric_Counter_TCP_Bytes_Received,
+
+    Metric_Counter_HTTP_Parse_Invalid_Data, // One per HTTP_Parse_Result that is a failure.
+    Metric_Counter_HTTP_Parse_TODO,
+
+    Metric_Counter_HTTP_Client_Requests,
+    Metric_Counter_HTTP_Client_Requests_Succeeded,
+    Metric_Counter_HTTP_Client_Requests_Failed,
+    Metric_Counter_HTTP_Client_Requests_Cancelled,
+    Metric_Counter_HTTP_Client_Cache_Hits,        // One per result.
+    Metric_Counter_HTTP_Client_Cache_Stale,
+    Metric_Counter_HTTP_Client_Cache_Misses,
+    Metric_Counter_HTTP_Client_Cache_Not_Modified,
+    Metric_Counter_HTTP_Client_Requests_Coalesced,
+
+    Metric_Counter_HTTP_Server_Connections_Accepted,
+    Metric_Counter_HTTP_Server_Requests_Handled,  // One per outcome.
+    Metric_Counter_HTTP_Server_Requests_Rejected,
+    Metric_Counter_HTTP_Server_File_Cache_Hits,   // One per result.
+    Metric_Counter_HTTP_Server_File_Cache_Misses,
+
+    Metric_Counter_Count
+} Metric_Counter;
+
+// Values that go up and down. Each thread keeps how much it moved the gauge, so one thread may raise it and another
+// lower it again; the sum is what counts.
+typedef enum {
+    Metric_Gauge_TCP_Sockets_Open,
+    Metric_Gauge_HTTP_Client_Requests_In_Flight,
+    Metric_Gauge_HTTP_Client_Cache_Bytes,
+    Metric_Gauge_HTTP_Server_Connections_Open,
+
+    Metric_Gauge_Count
+} Metric_Gauge;
+
+// Distributions, in microseconds.
+typedef enum {
+    Metric_Histogram_Worker_Tick_Duration,
+    Metric_Histogram_HTTP_Client_Request_Duration,
+    Metric_Histogram_HTTP_Server_Request_Duration,
+
+    Metric_Histogram_Count
+} Metric_Histogram;
+
+typedef struct Metrics_Shard Metrics_Shard;
+struct Metrics_Shard {
+    uint64_t counters[Metric_Counter_Count];
+    int64_t gauges[Metric_Gauge_Count];
+    Histogram histograms[Metric_Histogram_Count];
+
+    Metrics_Shard *next_thread; // The registry of every thread's shard.
+};
+
+extern __thread Metrics_Shard *metrics_shard_of_this_thread;
+
+// Creates and registers the calling thread's shard. NULL if we're out of memory, in which case the update is dropped.
+Metrics_Shard *metrics_shard_create(void);
+
+static inline Metrics_Shard *metrics_shard(void) {
+    Metrics_Shard *shard = metrics_shard_of_this_thread;
+    if(__builtin_expect(shard == NULL, 0)) {
+        shard = metrics_shard_create();
+    }
+    return shard;
+}
+
+// NOTE: Only the owning thread writes to a shard. The stores are atomic just so a reader never sees a torn value;
+// they compile to plain moves.
+static inline void metrics_count(const Metric_Counter counter, const uint64_t amount) {
+#if METRICS_ENABLED
+    Metrics_Shard *shard = metrics_shard();
+    if(shard != NULL) {
+        __atomic_store_n(&shard->counters[counter], shard->counters[counter] + amount, __ATOMIC_RELAXED);
+    }
+#else
+    (void)counter;
+    (void)amount;
+#endif
+}
+
+static inline void metrics_gauge_add(const Metric_Gauge gauge, const int64_t delta) {
+#if METRICS_ENABLED
+    Metrics_Shard *shard = metrics_shard();
+    if(shard != NULL) {
+        __atomic_store_n(&shard->gauges[gauge], shard->gauges[gauge] + delta, __ATOMIC_RELAXED);
+    }
+#else
+    (void)gauge;
+    (void)delta;
+#endif
+}
+
+static inline void metrics_observe(const Metric_Histogram histogram, const uint64_t value_us) {
+#if METRICS_ENABLED
+    Metrics_Shard *shard = metrics_shard();
+    if(shard != NULL) {
+        histogram_record(&shard->histograms[histogram], value_us);
+    }
+#else
+    (void)histogram;
+    (void)value_us;
+#endif
+}
+
+// Every thread's shard added up.
+typedef struct {
+    uint64_t counters[Metric_Counter_Count];
+    int64_t gauges[Metric_Gauge_Count];
+    Histogram histograms[Metric_Histogram_Count];
+} Metrics_Snapshot;
+
+// Safe from any thread at any time. Updates that happen meanwhile may or may not be included.
+void metrics_snapshot(Metrics_Snapshot *out_snapshot);
+
+typedef enum {
+    Metrics_Format_Prometheus, // Text exposition format, version 0.0.4. Durations in seconds, as Prometheus likes them.
+    Metrics_Format_JSON,       // One object per metric. Histograms as count, sum and percentiles, in microseconds.
+} Metrics_Format;
+
+// Appends every metric to 'out', which has to be initialized.
+void metrics_render(const Metrics_Format format, String_Buffer *out);
+
+#endif
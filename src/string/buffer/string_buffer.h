@@ -2,6 +2,7 @@
 #define STRING_BUFFER_H
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -39,6 +40,21 @@ static inline void string_buffer_resize(String_Buffer *buf, size_t required_capa
     }
 }
 
+// Makes sure that atleast 'additional' bytes (plus a null-terminator) can be written directly at &data[length].
+static inline char *string_buffer_reserve(String_Buffer *buf, size_t additional) {
+    assert(buf != NULL);
+    string_buffer_resize(buf, buf->length + additional + 1);
+    return &buf->data[buf->length];
+}
+
+// Call after writing 'length' bytes into the space given by string_buffer_reserve(..).
+static inline void string_buffer_commit(String_Buffer *buf, size_t length) {
+    assert(buf != NULL);
+    assert(buf->length + length < buf->capacity);
+    buf->length += length;
+    buf->data[buf->length] = '\0';
+}
+
 static inline void string_buffer_append_buf(String_Buffer *buf, const char *char_buffer, uint32_t length) {
     assert(buf != NULL);
     assert(char_buffer != NULL);
@@ -49,4 +65,24 @@ static inline void string_buffer_append_buf(String_Buffer *buf, const char *char
     buf->length += length;
 }
 
+// Appends printf-style and keeps the buffer null-terminated.
+static inline void string_buffer_appendf(String_Buffer *buf, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static inline void string_buffer_appendf(String_Buffer *buf, const char *format, ...) {
+    assert(buf != NULL);
+    assert(format != NULL);
+
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(NULL, 0, format, arguments);
+    va_end(arguments);
+    assert(length >= 0);
+
+    char *write_into = string_buffer_reserve(buf, (size_t)length);
+    va_start(arguments, format);
+    vsnprintf(write_into, (size_t)length + 1, format, arguments);
+    va_end(arguments);
+
+    string_buffer_commit(buf, (size_t)length);
+}
+
 #endif
@@ -1,20 +1,24 @@
 #include "tcp_client.h"
 
-TCP_Client_Start_Connecting_Result tcp_client_connect(TCP_Client *client, IP_Address ip_address) {
+#include "log/log.h"
+#include "metrics/metrics.h"
+
+TCP_Client_Start_Connecting_Result tcp_client_connect(TCP_Client *client, const TCP_Endpoint endpoint, const TCP_Socket_Options *options) {
     assert(client != NULL);
     assert(client->connection_state == TCP_Client_Connection_State_Disconnected);
     
-    printf("Trying to connect to ip: ");
-    ip_print(ip_address);
+    char endpoint_text[TCP_ENDPOINT_STRING_SIZE];
+    LOG_DEBUG("Trying to connect to: %s", tcp_endpoint_to_string(endpoint, endpoint_text, sizeof(endpoint_text)));
 
     // Create socket and start connecting to the server.
-    TCP_Socket_Result create_socket_error = tcp_socket_create_and_start_connecting_to_ip(
-        ip_address,
+    TCP_Socket_Result create_socket_error = tcp_socket_create_and_start_connecting(
+        endpoint,
         10,
+        options,
         &client->socket
     );
     if(create_socket_error != TCP_Socket_Result_OK) {
-        printf("Failed to create a socket! Got error: %i.\n", create_socket_error);
+        LOG_ERROR("Failed to create a socket! Got error: %i.", create_socket_error);
         return TCP_Client_Start_Connecting_Result_Failed_To_Create_Socket;
     }
 
@@ -24,9 +28,22 @@ TCP_Client_Start_Connecting_Result tcp_client_connect(TCP_Client *client, IP_Add
 
 void tcp_client_disconnect(TCP_Client *client) {
     assert(client != NULL);
-    assert(client->connection_state == TCP_Client_Connection_State_Connected);
-    
-    client->connection_state = TCP_Client_Connection_State_Disconnecting;
+
+    if(client->connection_state == TCP_Client_Connection_State_Connecting || client->connection_state == TCP_Client_Connection_State_Connected) {
+        client->connection_state = TCP_Client_Connection_State_Disconnecting;
+    }
+}
+
+void tcp_client_close(TCP_Client *client) {
+    assert(client != NULL);
+
+    if(client->connection_state == TCP_Client_Connection_State_Disconnected) {
+        return;
+    }
+
+    TCP_Socket_Result close_result = tcp_socket_close(&client->socket);
+    assert(close_result == TCP_Socket_Result_OK);
+    client->connection_state = TCP_Client_Connection_State_Disconnected;
 }
 
 void tcp_client_work(TCP_Client *client) {
@@ -38,6 +55,14 @@ void tcp_client_work(TCP_Client *client) {
             break;
         }
         case TCP_Client_Connection_State_Connecting: {
+            int error = tcp_socket_take_error(&client->socket);
+            if(error != 0) {
+                LOG_WARNING("Failed to connect (errno %i).", error);
+                metrics_count(Metric_Counter_TCP_Connect_Failures, 1);
+                client->connection_state = TCP_Client_Connection_State_Disconnecting;
+                break;
+            }
+
             if(tcp_socket_connected(&client->socket)) {
                 client->connection_state = TCP_Client_Connection_State_Connected;
                 break;
@@ -53,13 +78,8 @@ void tcp_client_work(TCP_Client *client) {
             break;
         }
         case TCP_Client_Connection_State_Disconnecting: {
-            printf("CLOSING SOCKET!\n");
-            assert(false);
-            // Close socket.
-            TCP_Socket_Result close_result = tcp_socket_close(&client->socket);
-            assert(close_result == TCP_Socket_Result_OK);
-            client->connection_state = TCP_Client_Connection_State_Disconnected;
-
+            // LOG_TRACE("Closing socket %i.", client->socket.fd);
+            tcp_client_close(client);
             break;
         }
     }
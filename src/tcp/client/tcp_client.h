@@ -22,8 +22,9 @@ typedef enum {
     TCP_Client_Start_Connecting_Result_Failed_To_Create_Socket,
 } TCP_Client_Start_Connecting_Result;
 
-TCP_Client_Start_Connecting_Result tcp_client_connect(TCP_Client *client, IP_Address ip_address);
-void tcp_client_disconnect(TCP_Client *client);
+TCP_Client_Start_Connecting_Result tcp_client_connect(TCP_Client *client, const TCP_Endpoint endpoint, const TCP_Socket_Options *options); // NULL options for TCP_Socket_Profile_Default.
+void tcp_client_disconnect(TCP_Client *client); // Closes the socket on the next tcp_client_work(..).
+void tcp_client_close(TCP_Client *client);      // Closes the socket right away, whatever state the client is in.
 
 void tcp_client_work(TCP_Client *client);
 
@@ -1,24 +1,230 @@
+#define _GNU_SOURCE // accept4(..).
+
 #include "tcp_socket.h"
 
 #include <fcntl.h>
+#include <assert.h>
 #include <errno.h>
 #include <unistd.h>
 #include <poll.h>
 #include <string.h>
 #include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "log/log.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+
+#define TCP_SOCKET_MAX_SEND_FILE_SIZE (1024 * 1024 * 1024)
+
+TCP_Socket_Options tcp_socket_options_for_profile(const TCP_Socket_Profile profile) {
+    TCP_Socket_Options options;
+    memset(&options, 0, sizeof(TCP_Socket_Options));
+
+    options.no_delay = true;
+    options.reuse_address = true;
+    options.reuse_port = true;
+
+    switch(profile) {
+        case TCP_Socket_Profile_Default: {
+            break;
+        }
+        case TCP_Socket_Profile_Bulk_Transfer: {
+            // Big buffers so the window can open up, and let the kernel coalesce small writes.
+            options.no_delay = false;
+            options.receive_buffer_size = 4 * 1024 * 1024;
+            options.send_buffer_size = 4 * 1024 * 1024;
+            options.keep_alive_idle_s = 60;
+            options.keep_alive_interval_s = 10;
+            options.keep_alive_count = 6;
+            break;
+        }
+        case TCP_Socket_Profile_Low_Latency: {
+            // Small requests and responses. Ack right away, busy-poll the device queue, and give up quickly on a dead peer.
+            options.quick_ack = true;
+            options.cork = true;
+            options.busy_poll_us = 50;
+            options.user_timeout_ms = 5000;
+            options.not_sent_low_water_mark = 16 * 1024;
+            options.keep_alive_idle_s = 10;
+            options.keep_alive_interval_s = 2;
+            options.keep_alive_count = 3;
+            break;
+        }
+    }
+
+    return options;
+}
+
+// NOTE: Every option is best-effort. Not all kernels support all of them, and a missing tweak isn't a reason to fail the connect.
+static inline void set_socket_option(int socket_fd, int level, int option_name, int value, const char *option_text) {
+    if (setsockopt(socket_fd, level, option_name, &value, sizeof(value)) < 0) {
+        LOG_WARNING("Failed to set %s (errno %i). Continuing without it.", option_text, errno);
+    }
+}
+
+static inline void apply_socket_options(int socket_fd, const TCP_Endpoint_Type endpoint_type, const TCP_Socket_Options *options) {
+    if(options->receive_buffer_size > 0) set_socket_option(socket_fd, SOL_SOCKET, SO_RCVBUF, options->receive_buffer_size, "SO_RCVBUF");
+    if(options->send_buffer_size > 0)    set_socket_option(socket_fd, SOL_SOCKET, SO_SNDBUF, options->send_buffer_size,    "SO_SNDBUF");
+
+    if(endpoint_type == TCP_Endpoint_Type_Unix) {
+        return; // The rest are TCP/IP options and don't mean anything for an AF_UNIX socket.
+    }
+
+    if(options->no_delay)       set_socket_option(socket_fd, IPPROTO_TCP, TCP_NODELAY,  1, "TCP_NODELAY");
+    if(options->reuse_address)  set_socket_option(socket_fd, SOL_SOCKET,  SO_REUSEADDR, 1, "SO_REUSEADDR");
+    if(options->reuse_port)     set_socket_option(socket_fd, SOL_SOCKET,  SO_REUSEPORT, 1, "SO_REUSEPORT");
+    if(options->quick_ack)      set_socket_option(socket_fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+    if(options->cork)           set_socket_option(socket_fd, IPPROTO_TCP, TCP_CORK,     1, "TCP_CORK");
+
+#if defined(SO_BUSY_POLL)
+    if(options->busy_poll_us > 0) set_socket_option(socket_fd, SOL_SOCKET, SO_BUSY_POLL, options->busy_poll_us, "SO_BUSY_POLL");
+#endif
+
+    if(options->keep_alive_idle_s > 0) {
+        set_socket_option(socket_fd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+        set_socket_option(socket_fd, IPPROTO_TCP, TCP_KEEPIDLE, options->keep_alive_idle_s, "TCP_KEEPIDLE");
+        if(options->keep_alive_interval_s > 0) set_socket_option(socket_fd, IPPROTO_TCP, TCP_KEEPINTVL, options->keep_alive_interval_s, "TCP_KEEPINTVL");
+        if(options->keep_alive_count > 0)      set_socket_option(socket_fd, IPPROTO_TCP, TCP_KEEPCNT,   options->keep_alive_count,      "TCP_KEEPCNT");
+    }
+
+    if(options->user_timeout_ms > 0)         set_socket_option(socket_fd, IPPROTO_TCP, TCP_USER_TIMEOUT,  options->user_timeout_ms,         "TCP_USER_TIMEOUT");
+    if(options->not_sent_low_water_mark > 0) set_socket_option(socket_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options->not_sent_low_water_mark, "TCP_NOTSENT_LOWAT");
+
+#if defined(TCP_FASTOPEN_CONNECT)
+    // Try to put the first send(..) in the SYN. A plain connect is fine too.
+    if(options->fast_open) set_socket_option(socket_fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1, "TCP_FASTOPEN_CONNECT");
+#endif
+}
+
+bool tcp_endpoint_try_parse_unix(const char *hostname, TCP_Endpoint *out_endpoint) {
+    assert(hostname != NULL);
+
+    const uint32_t prefix_length = strlen(TCP_ENDPOINT_UNIX_PREFIX);
+    if(strncmp(hostname, TCP_ENDPOINT_UNIX_PREFIX, prefix_length) != 0) {
+        return false;
+    }
+
+    memset(out_endpoint, 0, sizeof(TCP_Endpoint));
+    out_endpoint->type = TCP_Endpoint_Type_Unix;
+    out_endpoint->unix_path = &hostname[prefix_length];
+    return true;
+}
+
+const char *tcp_endpoint_to_string(const TCP_Endpoint endpoint, char *out, const size_t out_size) {
+    assert(out != NULL);
+    assert(out_size > 0);
+
+    switch(endpoint.type) {
+        case TCP_Endpoint_Type_IP: {
+            char ip_text[IP_ADDRESS_STRING_SIZE];
+            snprintf(out, out_size, endpoint.ip_address.is_ipv6 ? "[%s]:%u" : "%s:%u", ip_to_string(endpoint.ip_address, ip_text), (unsigned)endpoint.port);
+            break;
+        }
+        case TCP_Endpoint_Type_Unix: {
+            snprintf(out, out_size, "%s%s", TCP_ENDPOINT_UNIX_PREFIX, endpoint.unix_path);
+            break;
+        }
+    }
+    return out;
+}
+
+const char *tcp_socket_result_to_string(const TCP_Socket_Result result) {
+    switch(result) {
+        case TCP_Socket_Result_OK:                         return "OK";
+        case TCP_Socket_Result_Failed_To_Create:           return "Failed to create";
+        case TCP_Socket_Result_Failed_To_Connect:          return "Failed to connect";
+        case TCP_Socket_Result_Failed_To_Send:             return "Failed to send";
+        case TCP_Socket_Result_Failed_To_Read:             return "Failed to read";
+        case TCP_Socket_Result_Not_Ready_To_Be_Written_To: return "Not ready to be written to";
+        case TCP_Socket_Result_Not_Ready_To_Be_Read:       return "Not ready to be read";
+        case TCP_Socket_Result_Not_Connected:              return "Not connected";
+        case TCP_Socket_Result_Count:                      break;
+    }
+
+    assert(false);
+    return "?";
+}
+
+void tcp_endpoint_print(const TCP_Endpoint endpoint) {
+    char text[TCP_ENDPOINT_STRING_SIZE];
+    LOG_INFO("%s", tcp_endpoint_to_string(endpoint, text, sizeof(text)));
+}
+
+// Fills in the sockaddr for 'endpoint'. Returns false if it can't be one, e.g. a Unix path that's too long.
+static bool tcp_endpoint_to_address(const TCP_Endpoint endpoint, struct sockaddr_storage *out_address, socklen_t *out_address_length) {
+    memset(out_address, 0, sizeof(struct sockaddr_storage));
+    *out_address_length = 0;
+
+    switch(endpoint.type) {
+        case TCP_Endpoint_Type_IP: {
+            const IP_Address ip_address = endpoint.ip_address;
+            if (ip_address.is_ipv6) {
+                struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)out_address;
+
+                addr6->sin6_family = AF_INET6;
+                memcpy(addr6->sin6_addr.s6_addr, ip_address.address.ipv6, 16);
+                addr6->sin6_port = htons(endpoint.port);
+
+                *out_address_length = sizeof(struct sockaddr_in6);
+            } else {
+                struct sockaddr_in *addr4 = (struct sockaddr_in *)out_address;
+
+                addr4->sin_family = AF_INET;
+                memcpy(&addr4->sin_addr.s_addr, ip_address.address.ipv4, 4);
+                addr4->sin_port = htons(endpoint.port);
+
+                *out_address_length = sizeof(struct sockaddr_in);
+            }
+            break;
+        }
+        case TCP_Endpoint_Type_Unix: {
+            assert(endpoint.unix_path != NULL);
+
+            struct sockaddr_un *addr_un = (struct sockaddr_un *)out_address;
+            if(strlen(endpoint.unix_path) == 0 || strlen(endpoint.unix_path) >= sizeof(addr_un->sun_path)) {
+                LOG_ERROR("Unix socket path '%s' is empty or too long.", endpoint.unix_path);
+                return false;
+            }
+
+            addr_un->sun_family = AF_UNIX;
+            strcpy(addr_un->sun_path, endpoint.unix_path);
+
+            *out_address_length = sizeof(struct sockaddr_un);
+            break;
+        }
+    }
+
+    return true;
+}
 
-TCP_Socket_Result tcp_socket_create_and_start_connecting_to_ip(const IP_Address ip_address, const uint32_t timeout_s, TCP_Socket *out_socket) {
+TCP_Socket_Result tcp_socket_create_and_start_connecting(const TCP_Endpoint endpoint, const uint32_t timeout_s, const TCP_Socket_Options *options, TCP_Socket *out_socket) {
     (void)timeout_s; // TODO: SS - Use the timeout.
-    
+
+    TCP_Socket_Options default_options;
+    if(options == NULL) {
+        default_options = tcp_socket_options_for_profile(TCP_Socket_Profile_Default);
+        options = &default_options;
+    }
+
+    struct sockaddr_storage server_address;
+    socklen_t address_length = 0;
+    if(!tcp_endpoint_to_address(endpoint, &server_address, &address_length)) {
+        return TCP_Socket_Result_Failed_To_Create;
+    }
+
     // Create a socket.
     int socket_fd = socket(
-        ip_address.is_ipv6 ? AF_INET6 : AF_INET,
+        server_address.ss_family,
         SOCK_STREAM,
         0
     );
     if(socket_fd == -1) {
-        close(socket_fd);
+        metrics_count(Metric_Counter_TCP_Connect_Failures, 1);
         return TCP_Socket_Result_Failed_To_Create;
     }
 
@@ -27,75 +233,151 @@ TCP_Socket_Result tcp_socket_create_and_start_connecting_to_ip(const IP_Address
         fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK);
     }
 
-    { // Enable TCP_NODELAY and more.        
-        const int flag = 1;
-        if (setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) {
-            printf("Failed to set TCP_NODELAY.\n"); 
-            close(socket_fd);
-            return TCP_Socket_Result_Failed_To_Create;
-        }
+    apply_socket_options(socket_fd, endpoint.type, options);
 
-        const int enable = 1;
-        if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0) {
-            printf("Failed to set SO_REUSEADDR.\n"); 
-            close(socket_fd);
-            return TCP_Socket_Result_Failed_To_Create;
-        }
+    // Start connecting.
+    TRACE_BEGIN(Trace_Category_Syscall, "connect", socket_fd);
+    int connect_result = connect(
+        socket_fd,
+        (struct sockaddr *)&server_address,
+        address_length
+    );
+    TRACE_END(Trace_Category_Syscall, "connect", connect_result);
 
-        if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
-            printf("Failed to set SO_REUSEPORT.\n"); 
+    // Check connect_result.
+    if(connect_result == -1) {
+        if(errno != EINPROGRESS) {
+            LOG_ERROR("Got error %i when trying to connect socket.", errno);
             close(socket_fd);
-            return TCP_Socket_Result_Failed_To_Create;
+            metrics_count(Metric_Counter_TCP_Connect_Failures, 1);
+            return TCP_Socket_Result_Failed_To_Connect;
         }
     }
 
-    struct sockaddr *server_address;
-    socklen_t address_length;
-    if (ip_address.is_ipv6) {
-        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)malloc(sizeof(struct sockaddr_in6));
-        memset(addr6, 0, sizeof(struct sockaddr_in6));
+    // NOTE: Both are TCP-only, so apply_socket_options(..) skipped them for Unix endpoints. Claiming them anyway would
+    // cost a failing setsockopt(..) after every read, or on every tcp_socket_set_cork(..).
+    const bool is_tcp = endpoint.type != TCP_Endpoint_Type_Unix;
+    out_socket->fd = socket_fd;
+    out_socket->quick_ack = options->quick_ack && is_tcp;
+    out_socket->corked = options->cork && is_tcp;
+
+    metrics_count(Metric_Counter_TCP_Connects, 1);
+    metrics_gauge_add(Metric_Gauge_TCP_Sockets_Open, 1);
+    
+    return TCP_Socket_Result_OK;
+}
+
+TCP_Socket_Result tcp_socket_listen(const TCP_Endpoint endpoint, const int backlog, const bool reuse_port, TCP_Socket *out_socket) {
+    assert(out_socket != NULL);
+
+    struct sockaddr_storage address;
+    socklen_t address_length = 0;
+    if(!tcp_endpoint_to_address(endpoint, &address, &address_length)) {
+        return TCP_Socket_Result_Failed_To_Create;
+    }
 
-        addr6->sin6_family = AF_INET6;
-        memcpy(addr6->sin6_addr.s6_addr, ip_address.address.ipv6, 16);
-        addr6->sin6_port = htons(80); // TEMP: SS - Port hardcoded to http.
+    int socket_fd = socket(address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(socket_fd == -1) {
+        LOG_ERROR("Failed to create listening socket (errno %i).", errno);
+        return TCP_Socket_Result_Failed_To_Create;
+    }
 
-        server_address = (struct sockaddr *)addr6;
-        address_length = sizeof(struct sockaddr_in6);
+    if(endpoint.type == TCP_Endpoint_Type_IP) {
+        set_socket_option(socket_fd, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+        if(reuse_port) {
+            // NOTE: Unlike the other options this one isn't a nice-to-have. Without it the second listener on the port fails to bind.
+            const int enable = 1;
+            if(setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+                LOG_ERROR("Failed to set SO_REUSEPORT (errno %i).", errno);
+                close(socket_fd);
+                return TCP_Socket_Result_Failed_To_Create;
+            }
+        }
+        if(endpoint.ip_address.is_ipv6) {
+            // Stay IPv6-only, so "::" and "0.0.0.0" can be listened on side by side.
+            set_socket_option(socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, 1, "IPV6_V6ONLY");
+        }
     } else {
-        struct sockaddr_in *addr4 = (struct sockaddr_in *)malloc(sizeof(struct sockaddr_in));
-        memset(addr4, 0, sizeof(struct sockaddr_in));
+        struct stat path_stat;
+        if(stat(endpoint.unix_path, &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) {
+            unlink(endpoint.unix_path);
+        }
+    }
 
-        addr4->sin_family = AF_INET;
-        memcpy(&addr4->sin_addr.s_addr, ip_address.address.ipv4, 4);
-        addr4->sin_port = htons(80); // TEMP: SS - Port hardcoded to http.
+    if(bind(socket_fd, (struct sockaddr *)&address, address_length) == -1) {
+        char endpoint_text[TCP_ENDPOINT_STRING_SIZE];
+        LOG_ERROR("Failed to bind to %s (errno %i).", tcp_endpoint_to_string(endpoint, endpoint_text, sizeof(endpoint_text)), errno);
+        close(socket_fd);
+        return TCP_Socket_Result_Failed_To_Create;
+    }
 
-        server_address = (struct sockaddr *)addr4;
-        address_length = sizeof(struct sockaddr_in);
+    if(listen(socket_fd, backlog > 0 ? backlog : SOMAXCONN) == -1) {
+        LOG_ERROR("Failed to listen (errno %i).", errno);
+        close(socket_fd);
+        return TCP_Socket_Result_Failed_To_Create;
     }
 
-    // Start connecting.
-    int connect_result = connect(
-        socket_fd,
-        server_address,
-        address_length
-    );
+    out_socket->fd = socket_fd;
+    out_socket->quick_ack = false;
+    out_socket->corked = false;
 
-    // Check connect_result.
-    if(connect_result == -1) {
-        if(errno != EINPROGRESS) {
-            printf("Got error %i when trying to connect socket.\n", errno);
-            close(socket_fd);
-            return TCP_Socket_Result_Failed_To_Connect;
+    metrics_gauge_add(Metric_Gauge_TCP_Sockets_Open, 1);
+
+    return TCP_Socket_Result_OK;
+}
+
+TCP_Socket_Result tcp_socket_accept(const TCP_Socket *listener, const TCP_Socket_Options *options, TCP_Socket *out_socket) {
+    assert(listener != NULL);
+    assert(out_socket != NULL);
+
+    TCP_Socket_Options default_options;
+    if(options == NULL) {
+        default_options = tcp_socket_options_for_profile(TCP_Socket_Profile_Default);
+        options = &default_options;
+    }
+
+    struct sockaddr_storage peer_address;
+    socklen_t peer_address_length = sizeof(peer_address);
+
+    TRACE_BEGIN(Trace_Category_Syscall, "accept", listener->fd);
+    int socket_fd = accept4(listener->fd, (struct sockaddr *)&peer_address, &peer_address_length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    TRACE_END(Trace_Category_Syscall, "accept", socket_fd);
+    if(socket_fd == -1) {
+        // NOTE: ECONNABORTED is a connection that went away while it was queued. There may well be more behind it.
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED || errno == EINTR) {
+            return TCP_Socket_Result_Not_Ready_To_Be_Read;
         }
+
+        LOG_ERROR("Failed to accept connection (errno %i).", errno);
+        return TCP_Socket_Result_Failed_To_Create;
     }
 
-    free(server_address);
+    const bool is_tcp = peer_address.ss_family != AF_UNIX;
+    apply_socket_options(socket_fd, is_tcp ? TCP_Endpoint_Type_IP : TCP_Endpoint_Type_Unix, options);
 
     out_socket->fd = socket_fd;
-    
+    out_socket->quick_ack = options->quick_ack && is_tcp; // Skipped for Unix peers, like cork.
+    out_socket->corked = options->cork && is_tcp;
+
+    metrics_gauge_add(Metric_Gauge_TCP_Sockets_Open, 1);
+
     return TCP_Socket_Result_OK;
 }
 
+uint16_t tcp_socket_local_port(const TCP_Socket *socket) {
+    struct sockaddr_storage address;
+    socklen_t address_length = sizeof(address);
+    if(getsockname(socket->fd, (struct sockaddr *)&address, &address_length) == -1) {
+        return 0;
+    }
+
+    switch(address.ss_family) {
+        case AF_INET:  return ntohs(((struct sockaddr_in *)&address)->sin_port);
+        case AF_INET6: return ntohs(((struct sockaddr_in6 *)&address)->sin6_port);
+        default:       return 0;
+    }
+}
+
 static inline bool socket_writable(const TCP_Socket *socket) {
     struct pollfd fds;
     fds.fd = socket->fd;
@@ -124,7 +406,7 @@ bool tcp_socket_connected(const TCP_Socket *socket) {
     socklen_t len = sizeof(error);
 
     if (getsockopt(socket->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
-        printf("Failed to getsockopt(..) on socket.\n");
+        LOG_ERROR("Failed to getsockopt(..) on socket.");
         return false;
     }
 
@@ -133,87 +415,129 @@ bool tcp_socket_connected(const TCP_Socket *socket) {
     }
 
     if(!socket_writable(socket)) {
-        // printf("Not connected: Socket is not writable.\n");
+        // LOG_TRACE("Not connected: Socket is not writable.");
         return false;
     }
     
     return true;
 }
 
+int tcp_socket_take_error(const TCP_Socket *socket) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+
+    if (getsockopt(socket->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+        return errno;
+    }
+
+    return error;
+}
+
 TCP_Socket_Result tcp_socket_close(TCP_Socket *socket) {
+    if(socket->fd != -1) {
+        metrics_gauge_add(Metric_Gauge_TCP_Sockets_Open, -1);
+    }
+    TRACE_BEGIN(Trace_Category_Syscall, "close", socket->fd);
     close(socket->fd);
-    socket->fd = 0;
+    TRACE_END(Trace_Category_Syscall, "close", 0);
+    socket->fd = -1;
     return TCP_Socket_Result_OK;
 }
 
+static TCP_Socket_Result send_result_from_errno(int error) {
+    if(error == EAGAIN || error == EWOULDBLOCK) {
+        return TCP_Socket_Result_Not_Ready_To_Be_Written_To;
+    }
+    if(error == EINPROGRESS) {
+        // TCP Fast Open without a cached cookie. The SYN went out without our data, so try again once connected.
+        return TCP_Socket_Result_Not_Ready_To_Be_Written_To;
+    }
+    if(error == EPIPE || error == ECONNRESET || error == ENOTCONN) {
+        return TCP_Socket_Result_Not_Connected;
+    }
+
+    LOG_ERROR("Failed to send bytes over socket. Errno is %i.", error);
+    return TCP_Socket_Result_Failed_To_Send;
+}
+
 TCP_Socket_Result tcp_socket_send(const TCP_Socket *socket, const void *buf, const size_t buf_size, uint32_t *out_bytes_sent) {
     assert(buf != NULL);
     assert(buf_size > 0); // NOTE: SS - Might want to avoid crashing here.
     
     *out_bytes_sent = 0;
 
-    if(!tcp_socket_connected(socket)) {
-        return TCP_Socket_Result_Not_Connected;
-    }
-    
-    if (!socket_writable(socket)) {
-        return TCP_Socket_Result_Not_Ready_To_Be_Written_To;
-    }
-
-    int flags = 0; // NOTE: SS - Make this customizable?
+    // NOTE: Like tcp_socket_receive(..), just try and let send(..) tell us what's wrong. A full send buffer shows up
+    // as EAGAIN, not as the socket being disconnected.
+    // MSG_NOSIGNAL: A peer that hung up gives us EPIPE instead of killing the process with SIGPIPE.
+    int flags = MSG_NOSIGNAL; // NOTE: SS - Make this customizable?
+    TRACE_BEGIN(Trace_Category_Syscall, "send", socket->fd);
     ssize_t bytes_sent = send(socket->fd, buf, buf_size, flags);
+    TRACE_END(Trace_Category_Syscall, "send", bytes_sent);
     if(bytes_sent == -1) {
-        if(errno == EAGAIN) {
-            // printf("EAGAIN\n");
-            return TCP_Socket_Result_Not_Ready_To_Be_Written_To;
-        }
-        if(errno == EWOULDBLOCK) {
-            // printf("EWOULDBLOCK\n");
-            return TCP_Socket_Result_Not_Ready_To_Be_Written_To;
-        }
-
-        printf("Failed to send bytes over socket. Errno is %i.\n", errno);
-        assert(false);
-        return TCP_Socket_Result_Failed_To_Send;
+        return send_result_from_errno(errno);
     }
 
     *out_bytes_sent = bytes_sent;
+    metrics_count(Metric_Counter_TCP_Bytes_Sent, (uint64_t)bytes_sent);
     
     return TCP_Socket_Result_OK;
 }
 
-static inline bool socket_readable(const TCP_Socket *socket) {
-    struct pollfd fds;
-    fds.fd = socket->fd;
-    fds.events = POLLIN;
-    fds.revents = 0;
-    errno = 0;
-    
-    
-    // printf("Checking if socket %i is readable ...\n", socket->fd);
-    
-    int poll_result = poll(&fds, 1, 0);
+static TCP_Socket_Result tcp_socket_send_message(const TCP_Socket *socket, const struct iovec *parts, const uint32_t part_count, const int flags, uint32_t *out_bytes_sent) {
+    assert(parts != NULL);
+    assert(part_count > 0);
 
-    // printf("fds.revents: %i\n", fds.revents);
+    *out_bytes_sent = 0;
 
-    if (poll_result == -1) {
-        printf("Poll result -1: %s\n", strerror(errno));
-        return false;
-    }
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = (struct iovec *)parts;
+    message.msg_iovlen = part_count;
 
-    if (poll_result == 0) {
-        // printf("Poll result 0.\n");
-        return false;
+    TRACE_BEGIN(Trace_Category_Syscall, "sendmsg", socket->fd);
+    ssize_t bytes_sent = sendmsg(socket->fd, &message, MSG_NOSIGNAL | flags);
+    TRACE_END(Trace_Category_Syscall, "sendmsg", bytes_sent);
+    if(bytes_sent == -1) {
+        return send_result_from_errno(errno);
     }
 
-    if (fds.revents & POLLIN) {
-        return true;
-    }
+    *out_bytes_sent = bytes_sent;
+    metrics_count(Metric_Counter_TCP_Bytes_Sent, (uint64_t)bytes_sent);
 
-    assert(false);
-    return false;
+    return TCP_Socket_Result_OK;
+}
+
+TCP_Socket_Result tcp_socket_send_vectored(const TCP_Socket *socket, const struct iovec *parts, const uint32_t part_count, uint32_t *out_bytes_sent) {
+    return tcp_socket_send_message(socket, parts, part_count, 0, out_bytes_sent);
+}
+
+TCP_Socket_Result tcp_socket_send_vectored_more(const TCP_Socket *socket, const struct iovec *parts, const uint32_t part_count, uint32_t *out_bytes_sent) {
+    return tcp_socket_send_message(socket, parts, part_count, MSG_MORE, out_bytes_sent);
 }
 
+TCP_Socket_Result tcp_socket_send_file(const TCP_Socket *socket, const int file_fd, uint64_t *offset, const uint64_t length, uint64_t *out_bytes_sent) {
+    assert(offset != NULL);
+    assert(length > 0);
+
+    *out_bytes_sent = 0;
+
+    // NOTE: sendfile(..) sends at most ~2 GB per call anyway. Bigger files just take a few calls.
+    size_t count = length < TCP_SOCKET_MAX_SEND_FILE_SIZE ? (size_t)length : TCP_SOCKET_MAX_SEND_FILE_SIZE;
+    off_t file_offset = (off_t)*offset;
+
+    TRACE_BEGIN(Trace_Category_Syscall, "sendfile", socket->fd);
+    ssize_t bytes_sent = sendfile(socket->fd, file_fd, &file_offset, count);
+    TRACE_END(Trace_Category_Syscall, "sendfile", bytes_sent);
+    if(bytes_sent == -1) {
+        return send_result_from_errno(errno);
+    }
+
+    *offset = (uint64_t)file_offset;
+    *out_bytes_sent = (uint64_t)bytes_sent;
+    metrics_count(Metric_Counter_TCP_Bytes_Sent, (uint64_t)bytes_sent);
+
+    return TCP_Socket_Result_OK;
+}
 
 TCP_Socket_Result tcp_socket_receive(const TCP_Socket *socket, void *buf, const size_t buf_size, uint32_t *out_bytes_received) {
     assert(buf != NULL);
@@ -221,34 +545,62 @@ TCP_Socket_Result tcp_socket_receive(const TCP_Socket *socket, void *buf, const
     
     *out_bytes_received = 0;
 
-    if(!tcp_socket_connected(socket)) {
-        return TCP_Socket_Result_Not_Connected;
-    }
-    
-    if (!socket_readable(socket)) {
-        return TCP_Socket_Result_Not_Ready_To_Be_Read;
-    }
-
-    int flags = 0; // NOTE: SS - Make this customizable?
+    // NOTE: The socket is non-blocking, so we just try to read and let recv(..) tell us if the socket isn't
+    // connected or doesn't have anything for us yet. This lets callers drain the socket until EAGAIN without
+    // paying for a getsockopt(..) and a poll(..) per read.
+    int flags = 0;
+    TRACE_BEGIN(Trace_Category_Syscall, "recv", socket->fd);
     ssize_t bytes_received = recv(socket->fd, buf, buf_size, flags);
+    TRACE_END(Trace_Category_Syscall, "recv", bytes_received);
     if(bytes_received == -1) {
-        if(errno == EAGAIN) {
-            // printf("EAGAIN\n");
+        if(errno == EAGAIN || errno == EWOULDBLOCK) {
             return TCP_Socket_Result_Not_Ready_To_Be_Read;
         }
-        if(errno == EWOULDBLOCK) {
-            // printf("EWOULDBLOCK\n");
-            return TCP_Socket_Result_Not_Ready_To_Be_Read;
+        if(errno == ENOTCONN) {
+            return TCP_Socket_Result_Not_Connected;
         }
 
-        printf("Failed to read bytes in socket. Errno is %i.\n", errno);
-        assert(false);
+        LOG_ERROR("Failed to read bytes in socket. Errno is %i.", errno);
         return TCP_Socket_Result_Failed_To_Read;
     }
 
-    // printf("Socket %i received %lu bytes.\n", socket->fd, bytes_received);
+    // LOG_TRACE("Socket %i received %lu bytes.", socket->fd, bytes_received);
+
+    if(socket->quick_ack && bytes_received > 0) {
+        // TCP_QUICKACK isn't sticky. The kernel may fall back to delayed ACKs, so re-arm it after each read.
+        const int enable = 1;
+        setsockopt(socket->fd, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+    }
 
     *out_bytes_received = bytes_received;
+    metrics_count(Metric_Counter_TCP_Bytes_Received, (uint64_t)bytes_received);
     
     return TCP_Socket_Result_OK;
 }
+
+TCP_Socket_Result tcp_socket_set_cork(TCP_Socket *socket, const bool cork) {
+    if(socket->corked == cork) {
+        return TCP_Socket_Result_OK;
+    }
+
+    const int value = cork ? 1 : 0;
+    if (setsockopt(socket->fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) < 0) {
+        return TCP_Socket_Result_Failed_To_Send;
+    }
+
+    socket->corked = cork;
+    return TCP_Socket_Result_OK;
+}
+
+uint32_t tcp_socket_bytes_available(const TCP_Socket *socket) {
+    int bytes_available = 0;
+    if(ioctl(socket->fd, FIONREAD, &bytes_available) == -1) {
+        return 0;
+    }
+
+    if(bytes_available < 0) {
+        return 0;
+    }
+
+    return (uint32_t)bytes_available;
+}
@@ -1,12 +1,62 @@
 #ifndef TCP_SOCKET_H
 #define TCP_SOCKET_H
 
+#include <sys/uio.h>
+
 #include "ip/ip.h"
 
 typedef struct {
     int fd;
+
+    bool quick_ack; // Re-arm TCP_QUICKACK after every read.
+    bool corked;    // TCP_CORK is set. Call tcp_socket_set_cork(.., false) to flush what's been written.
 } TCP_Socket;
 
+typedef enum {
+    TCP_Endpoint_Type_IP,
+    TCP_Endpoint_Type_Unix, // AF_UNIX stream socket on this host. Skips DNS and the TCP/IP stack.
+} TCP_Endpoint_Type;
+
+// Hostnames starting with this are Unix socket paths, for example 'unix:/run/metrics-agent.sock'.
+#define TCP_ENDPOINT_UNIX_PREFIX "unix:"
+
+#define TCP_ENDPOINT_DEFAULT_PORT 80
+
+typedef struct {
+    TCP_Endpoint_Type type;
+
+    IP_Address ip_address; // TCP_Endpoint_Type_IP.
+    uint16_t port;         // TCP_Endpoint_Type_IP. Host byte order.
+    const char *unix_path; // TCP_Endpoint_Type_Unix. Not copied.
+} TCP_Endpoint;
+
+typedef enum {
+    TCP_Socket_Profile_Default,       // TCP_NODELAY, SO_REUSEADDR and SO_REUSEPORT. What we've always used.
+    TCP_Socket_Profile_Bulk_Transfer, // Large socket buffers and keepalive, Nagle left on.
+    TCP_Socket_Profile_Low_Latency,   // Quick-ack, busy-poll, corked header+body and a short user-timeout.
+} TCP_Socket_Profile;
+
+// Every option is applied best-effort when the socket is created. 0/false means "leave the kernel default".
+typedef struct {
+    bool no_delay;      // TCP_NODELAY.
+    bool reuse_address; // SO_REUSEADDR.
+    bool reuse_port;    // SO_REUSEPORT.
+    bool quick_ack;     // TCP_QUICKACK.
+    bool cork;          // TCP_CORK. Lets headers and body leave as full segments. Uncork with tcp_socket_set_cork(..).
+    bool fast_open;     // TCP_FASTOPEN_CONNECT. The first tcp_socket_send(..) goes out in the SYN if the kernel has a TFO-cookie for the server.
+
+    int receive_buffer_size; // SO_RCVBUF, in bytes.
+    int send_buffer_size;    // SO_SNDBUF, in bytes.
+    int busy_poll_us;        // SO_BUSY_POLL, in microseconds.
+
+    int keep_alive_idle_s;     // SO_KEEPALIVE + TCP_KEEPIDLE.
+    int keep_alive_interval_s; // TCP_KEEPINTVL.
+    int keep_alive_count;      // TCP_KEEPCNT.
+
+    int user_timeout_ms;         // TCP_USER_TIMEOUT.
+    int not_sent_low_water_mark; // TCP_NOTSENT_LOWAT, in bytes.
+} TCP_Socket_Options;
+
 typedef enum {
     TCP_Socket_Result_OK,
     TCP_Socket_Result_Failed_To_Create,
@@ -17,14 +67,66 @@ typedef enum {
     TCP_Socket_Result_Not_Ready_To_Be_Read,
     TCP_Socket_Result_Not_Connected,
 
+    TCP_Socket_Result_Count
 } TCP_Socket_Result;
 
-TCP_Socket_Result tcp_socket_create_and_start_connecting_to_ip(const IP_Address ip_address, const uint32_t timeout_s, TCP_Socket *out_socket);
+// E.g. "Failed to connect". Lives forever.
+const char *tcp_socket_result_to_string(const TCP_Socket_Result result);
+
+TCP_Socket_Options tcp_socket_options_for_profile(const TCP_Socket_Profile profile);
+
+// 'port' 0 for TCP_ENDPOINT_DEFAULT_PORT.
+static inline TCP_Endpoint tcp_endpoint_from_ip(const IP_Address ip_address, const uint16_t port) {
+    TCP_Endpoint endpoint = {0};
+    endpoint.type = TCP_Endpoint_Type_IP;
+    endpoint.ip_address = ip_address;
+    endpoint.port = port != 0 ? port : TCP_ENDPOINT_DEFAULT_PORT;
+    return endpoint;
+}
+
+// Returns true and points the endpoint at the path if 'hostname' is 'unix:/some/path'.
+bool tcp_endpoint_try_parse_unix(const char *hostname, TCP_Endpoint *out_endpoint);
+
+#define TCP_ENDPOINT_STRING_SIZE 128 // Unix paths that don't fit are cut off.
+
+// Writes "1.2.3.4:80", "[::1]:80" or "unix:/some/path" to 'out' and returns 'out'.
+const char *tcp_endpoint_to_string(const TCP_Endpoint endpoint, char *out, const size_t out_size);
+void tcp_endpoint_print(const TCP_Endpoint endpoint);
+
+// 'options' may be NULL for TCP_Socket_Profile_Default. TCP-only options are skipped for Unix endpoints.
+TCP_Socket_Result tcp_socket_create_and_start_connecting(const TCP_Endpoint endpoint, const uint32_t timeout_s, const TCP_Socket_Options *options, TCP_Socket *out_socket);
+// Whether a non-blocking connect(..) has finished: no error, and writable. Only means something while connecting; later
+// on a full send buffer (or a Fast Open handshake that's still going) makes a connected socket unwritable too.
 bool tcp_socket_connected(const TCP_Socket *socket);
 
+#define TCP_SOCKET_DEFAULT_BACKLOG 0 // SOMAXCONN.
+
+// Binds a non-blocking listening socket to 'endpoint'. IP endpoints may use port 0 to let the kernel pick one (see
+// tcp_socket_local_port(..)). With 'reuse_port' several sockets can listen on the same port, and the kernel spreads
+// incoming connections over them. For a Unix endpoint, a stale socket file left at the path is removed first.
+TCP_Socket_Result tcp_socket_listen(const TCP_Endpoint endpoint, const int backlog, const bool reuse_port, TCP_Socket *out_socket);
+// Takes one pending connection off 'listener'. The new socket is non-blocking and gets 'options' (NULL for
+// TCP_Socket_Profile_Default). Returns TCP_Socket_Result_Not_Ready_To_Be_Read if there's nothing to take.
+TCP_Socket_Result tcp_socket_accept(const TCP_Socket *listener, const TCP_Socket_Options *options, TCP_Socket *out_socket);
+// The port the socket is bound to, host byte order. 0 if it isn't bound or isn't an IP socket.
+uint16_t tcp_socket_local_port(const TCP_Socket *socket);
+int tcp_socket_take_error(const TCP_Socket *socket); // SO_ERROR. Clears it. 0 if there's none, e.g. a connect(..) that went fine.
+
 TCP_Socket_Result tcp_socket_close(TCP_Socket *socket);
+TCP_Socket_Result tcp_socket_set_cork(TCP_Socket *socket, const bool cork);
 
 TCP_Socket_Result tcp_socket_send(const TCP_Socket *socket, const void *buf, const size_t buf_size, uint32_t *out_bytes_sent);
+// Sends several buffers in one go (sendmsg(..)), so a request can be put together from shared pieces without copying.
+TCP_Socket_Result tcp_socket_send_vectored(const TCP_Socket *socket, const struct iovec *parts, const uint32_t part_count, uint32_t *out_bytes_sent);
+// The same, but tells the kernel more is coming right after (MSG_MORE), so a small head doesn't leave as a segment of
+// its own ahead of a body that's sent separately, e.g. with tcp_socket_send_file(..).
+TCP_Socket_Result tcp_socket_send_vectored_more(const TCP_Socket *socket, const struct iovec *parts, const uint32_t part_count, uint32_t *out_bytes_sent);
+// Sends up to 'length' bytes of the file 'file_fd' from '*offset' straight from the page cache (sendfile(..)), without
+// copying them through user space. Moves '*offset' past what was sent.
+TCP_Socket_Result tcp_socket_send_file(const TCP_Socket *socket, const int file_fd, uint64_t *offset, const uint64_t length, uint64_t *out_bytes_sent);
 TCP_Socket_Result tcp_socket_receive(const TCP_Socket *socket, void *buf, const size_t buf_size, uint32_t *out_bytes_received);
 
+// Returns the amount of bytes that can be read from the socket right now (FIONREAD). 0 if unknown.
+uint32_t tcp_socket_bytes_available(const TCP_Socket *socket);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "trace.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "clock/clock.h"
+
+_Static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "TRACE_RING_EVENTS must be a power of two.");
+
+#define TRACE_MIN_CALIBRATION_NS (10 * CLOCK_NS_PER_MS)
+
+static const char *trace_category_names[Trace_Category_Count] = {
+    [Trace_Category_Worker]      = "worker",
+    [Trace_Category_Task]        = "task",
+    [Trace_Category_HTTP_Client] = "http_client",
+    [Trace_Category_Syscall]     = "syscall",
+    [Trace_Category_Parse]       = "parse",
+};
+
+static const char trace_phase_letters[] = {
+    [Trace_Phase_Begin]       = 'B',
+    [Trace_Phase_End]         = 'E',
+    [Trace_Phase_Async_Begin] = 'b',
+    [Trace_Phase_Async_End]   = 'e',
+};
+
+__thread Trace_Ring *trace_ring_of_this_thread;
+static Trace_Ring *trace_rings_of_all_threads; // Pushed onto, never taken from.
+
+// Where timestamps start, in trace_now() ticks and on CLOCK_MONOTONIC_RAW. Used to turn ticks into time.
+static pthread_once_t trace_epoch_once = PTHREAD_ONCE_INIT;
+static uint64_t trace_epoch_ticks;
+static uint64_t trace_epoch_ns;
+
+static inline uint64_t trace_raw_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * CLOCK_NS_PER_S + (uint64_t)ts.tv_nsec;
+}
+
+static void trace_take_epoch(void) {
+    trace_epoch_ns = trace_raw_now_ns();
+    trace_epoch_ticks = trace_now();
+}
+
+Trace_Ring *trace_ring_create(void) {
+    assert(trace_ring_of_this_thread == NULL);
+    pthread_once(&trace_epoch_once, trace_take_epoch);
+
+    Trace_Ring *ring = calloc(1, sizeof(Trace_Ring));
+    if(ring == NULL) {
+        return NULL;
+    }
+    ring->thread_id = (int)syscall(SYS_gettid);
+
+    ring->next_thread = __atomic_load_n(&trace_rings_of_all_threads, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&trace_rings_of_all_threads, &ring->next_thread, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // 'next_thread' got updated to the new head. Try again.
+    }
+
+    trace_ring_of_this_thread = ring;
+    return ring;
+}
+
+void trace_set_thread_name(const char *name) {
+    assert(name != NULL);
+#if TRACE_ENABLED
+    Trace_Ring *ring = trace_ring_of_this_thread;
+    if(ring == NULL) {
+        ring = trace_ring_create();
+        if(ring == NULL) {
+            return;
+        }
+    }
+
+    // NOTE: It goes in the JSON as is, so anything that would need escaping is replaced.
+    char text[sizeof(ring->thread_name)];
+    uint32_t i = 0;
+    for(; i < sizeof(text) - 1 && name[i] != '\0'; i++) {
+        bool plain = name[i] >= ' ' && name[i] != '"' && name[i] != '\\' && name[i] != 0x7F;
+        text[i] = plain ? name[i] : '_';
+    }
+    text[i] = '\0';
+
+    for(i = 0; i < sizeof(text); i++) {
+        __atomic_store_n(&ring->thread_name[i], text[i], __ATOMIC_RELAXED);
+    }
+#else
+    (void)name;
+#endif
+}
+
+// How many nanoseconds a trace_now() tick is. Measured against CLOCK_MONOTONIC_RAW over everything since the first
+// event, which is plenty precise unless that was only just now.
+static double trace_ns_per_tick(void) {
+#if TRACE_USE_RDTSC
+    pthread_once(&trace_epoch_once, trace_take_epoch);
+
+    uint64_t now_ns = trace_raw_now_ns();
+    if(now_ns - trace_epoch_ns < TRACE_MIN_CALIBRATION_NS) {
+        uint64_t wait_ns = TRACE_MIN_CALIBRATION_NS - (now_ns - trace_epoch_ns);
+        struct timespec wait = { .tv_sec = 0, .tv_nsec = (long)wait_ns };
+        nanosleep(&wait, NULL);
+        now_ns = trace_raw_now_ns();
+    }
+    uint64_t now_ticks = trace_now();
+
+    if(now_ticks <= trace_epoch_ticks) {
+        return 1.0;
+    }
+    return (double)(now_ns - trace_epoch_ns) / (double)(now_ticks - trace_epoch_ticks);
+#else
+    return 1.0;
+#endif
+}
+
+// Copies out the events of 'ring' that are still there, oldest first. Returns how many went into 'out_events'.
+static uint32_t trace_ring_copy(const Trace_Ring *ring, Trace_Event *out_events) {
+    const uint64_t end = __atomic_load_n(&ring->write_position, __ATOMIC_ACQUIRE);
+    uint64_t start = end > TRACE_RING_EVENTS ? end - TRACE_RING_EVENTS : 0;
+
+    for(uint64_t position = start; position < end; position++) {
+        const Trace_Event *event = &ring->events[position & (TRACE_RING_EVENTS - 1)];
+        Trace_Event *copy = &out_events[position - start];
+        copy->timestamp = __atomic_load_n(&event->timestamp, __ATOMIC_RELAXED);
+        copy->name = __atomic_load_n(&event->name, __ATOMIC_RELAXED);
+        copy->argument = __atomic_load_n(&event->argument, __ATOMIC_RELAXED);
+        copy->phase = __atomic_load_n(&event->phase, __ATOMIC_RELAXED);
+        copy->category = __atomic_load_n(&event->category, __ATOMIC_RELAXED);
+    }
+
+    // NOTE: The thread kept going while we copied. Whatever it got to meanwhile, plus the slot it may be writing to
+    // right now, was overwritten under us. Those are dropped; everything after them was stable.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const uint64_t end_after_copy = __atomic_load_n(&ring->write_position, __ATOMIC_RELAXED);
+    uint64_t first_intact = end_after_copy + 1 > TRACE_RING_EVENTS ? end_after_copy + 1 - TRACE_RING_EVENTS : 0;
+    if(first_intact <= start) {
+        return (uint32_t)(end - start);
+    }
+    if(first_intact >= end) {
+        return 0;
+    }
+
+    memmove(&out_events[0], &out_events[first_intact - start], (end - first_intact) * sizeof(Trace_Event));
+    return (uint32_t)(end - first_intact);
+}
+
+void trace_render(String_Buffer *out) {
+    assert(out != NULL);
+    assert(out->capacity > 0);
+
+    const double ns_per_tick = trace_ns_per_tick();
+    const int process_id = (int)getpid();
+
+    // A ring's worth is a few hundred KB. Keep it off the stack.
+    Trace_Event *events = malloc(TRACE_RING_EVENTS * sizeof(Trace_Event));
+    if(events == NULL) {
+        return;
+    }
+
+    string_buffer_appendf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    bool first = true;
+
+    Trace_Ring *ring = __atomic_load_n(&trace_rings_of_all_threads, __ATOMIC_ACQUIRE);
+    for(; ring != NULL; ring = ring->next_thread) {
+        char thread_name[sizeof(ring->thread_name)];
+        for(uint32_t i = 0; i < sizeof(thread_name); i++) {
+            thread_name[i] = __atomic_load_n(&ring->thread_name[i], __ATOMIC_RELAXED);
+        }
+        thread_name[sizeof(thread_name) - 1] = '\0';
+
+        if(thread_name[0] != '\0') {
+            string_buffer_appendf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%i,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",", process_id, ring->thread_id, thread_name
+            );
+            first = false;
+        }
+
+        uint32_t event_count = trace_ring_copy(ring, events);
+        for(uint32_t i = 0; i < event_count; i++) {
+            const Trace_Event *event = &events[i];
+            assert(event->category < Trace_Category_Count);
+
+            // Microseconds since the first event anywhere. Events from before the epoch was taken can't exist, but a
+            // TSC that's a little out of sync between cores could make one look like it.
+            int64_t ticks = (int64_t)(event->timestamp - trace_epoch_ticks);
+            double timestamp_us = (double)ticks * ns_per_tick / 1000.0;
+
+            string_buffer_appendf(out, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%i,\"tid\":%i,",
+                first ? "" : ",",
+                event->name,
+                trace_category_names[event->category],
+                trace_phase_letters[event->phase],
+                timestamp_us,
+                process_id,
+                ring->thread_id
+            );
+            if(event->phase == Trace_Phase_Async_Begin || event->phase == Trace_Phase_Async_End) {
+                string_buffer_appendf(out, "\"id\":\"0x%llx\"}", (unsigned long long)event->argument);
+            }
+            else {
+                string_buffer_appendf(out, "\"args\":{\"argument\":%lld}}", (long long)event->argument);
+            }
+            first = false;
+        }
+    }
+
+    string_buffer_appendf(out, "\n]}\n");
+    free(events);
+}
+
+bool trace_dump(const char *file_path) {
+    assert(file_path != NULL);
+
+    String_Buffer json;
+    string_buffer_init(&json, 64 * 1024);
+    trace_render(&json);
+
+    FILE *file = fopen(file_path, "w");
+    if(file == NULL) {
+        string_buffer_free(&json);
+        return false;
+    }
+
+    bool written = fwrite(json.data, 1, json.length, file) == json.length;
+    if(fclose(file) != 0) {
+        written = false;
+    }
+
+    string_buffer_free(&json);
+    return written;
+}
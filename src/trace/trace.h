@@ -0,0 +1,138 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "string/buffer/string_buffer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Begin and end events for following individual ticks, tasks and requests, to be looked at in chrome://tracing or
+// Perfetto.
+//
+// Every thread records into its own fixed-size ring, so recording is a timestamp and a few stores; no locks, no
+// allocation after the first event. The ring wraps, keeping the last TRACE_RING_EVENTS events of each thread, like a
+// flight recorder. trace_render(..) turns what's in every ring right now into Chrome Trace Event JSON; 'main serve'
+// answers GET /trace with it, and 'batch', 'load' and 'download' write it to a file with --trace <file> once they're
+// done. Build with -DTRACE_ENABLED=0 to compile every event away.
+//
+// Names have to be string literals (or otherwise live forever); only the pointer is kept.
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+#ifndef TRACE_RING_EVENTS
+#define TRACE_RING_EVENTS 8192 // Per thread. Must be a power of two.
+#endif
+
+#ifndef TRACE_USE_RDTSC // Timestamps from the TSC where there is one. Assumes it's invariant, like on any x86 CPU from
+                        // the last decade or so. Otherwise CLOCK_MONOTONIC_RAW.
+#if defined(__x86_64__) || defined(__i386__)
+#define TRACE_USE_RDTSC 1
+#else
+#define TRACE_USE_RDTSC 0
+#endif
+#endif
+
+typedef enum {
+    Trace_Category_Worker,      // Ticks.
+    Trace_Category_Task,        // Task callbacks.
+    Trace_Category_HTTP_Client, // A request and the phase it's in. These span ticks, so they're async events.
+    Trace_Category_Syscall,
+    Trace_Category_Parse,
+
+    Trace_Category_Count
+} Trace_Category;
+
+typedef enum {
+    Trace_Phase_Begin,       // Begin and end have to nest on the thread, like a call stack.
+    Trace_Phase_End,
+    Trace_Phase_Async_Begin, // Matched by name and id instead, so they may span ticks (and threads).
+    Trace_Phase_Async_End,
+} Trace_Phase;
+
+typedef struct {
+    uint64_t timestamp; // In trace_now() ticks.
+    const char *name;
+    uint64_t argument;  // The id for async events. Shown signed otherwise, so results of -1 look like it.
+    uint8_t phase;
+    uint8_t category;
+} Trace_Event;
+
+typedef struct Trace_Ring Trace_Ring;
+struct Trace_Ring {
+    Trace_Event events[TRACE_RING_EVENTS];
+    uint64_t write_position; // Events ever recorded. Only the thread writes it.
+
+    int thread_id;
+    char thread_name[32];
+
+    Trace_Ring *next_thread; // The registry of every thread's ring.
+};
+
+extern __thread Trace_Ring *trace_ring_of_this_thread;
+
+// Creates and registers the calling thread's ring. NULL if we're out of memory, in which case the event is dropped.
+Trace_Ring *trace_ring_create(void);
+
+static inline uint64_t trace_now(void) {
+#if TRACE_USE_RDTSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// NOTE: Only the owning thread writes to a ring. The stores are atomic just so a reader never sees a torn value; they
+// compile to plain moves.
+static inline void trace_record(const Trace_Phase phase, const Trace_Category category, const char *name, const uint64_t argument) {
+    Trace_Ring *ring = trace_ring_of_this_thread;
+    if(__builtin_expect(ring == NULL, 0)) {
+        ring = trace_ring_create();
+        if(ring == NULL) {
+            return;
+        }
+    }
+
+    const uint64_t position = ring->write_position;
+    Trace_Event *event = &ring->events[position & (TRACE_RING_EVENTS - 1)];
+    __atomic_store_n(&event->timestamp, trace_now(), __ATOMIC_RELAXED);
+    __atomic_store_n(&event->name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->argument, argument, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->phase, (uint8_t)phase, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->category, (uint8_t)category, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->write_position, position + 1, __ATOMIC_RELEASE);
+}
+
+#if TRACE_ENABLED
+#define TRACE_BEGIN(category, name, argument) trace_record(Trace_Phase_Begin, (category), (name), (uint64_t)(argument))
+#define TRACE_END(category, name, argument) trace_record(Trace_Phase_End, (category), (name), (uint64_t)(argument))
+#define TRACE_ASYNC_BEGIN(category, name, id) trace_record(Trace_Phase_Async_Begin, (category), (name), (uint64_t)(id))
+#define TRACE_ASYNC_END(category, name, id) trace_record(Trace_Phase_Async_End, (category), (name), (uint64_t)(id))
+#else
+#define TRACE_BEGIN(category, name, argument) do { } while(0)
+#define TRACE_END(category, name, argument) do { } while(0)
+#define TRACE_ASYNC_BEGIN(category, name, id) do { } while(0)
+#define TRACE_ASYNC_END(category, name, id) do { } while(0)
+#endif
+
+// Shows up instead of the thread id in the trace. Cut off at 31 characters.
+void trace_set_thread_name(const char *name);
+
+// Appends every thread's events to 'out', which has to be initialized, as a Chrome Trace Event JSON object. Safe from
+// any thread at any time; events recorded meanwhile may or may not be included. Events whose begin or end already
+// fell out of the ring show up unmatched.
+void trace_render(String_Buffer *out);
+
+// trace_render(..) to a file. Returns false if it couldn't be written.
+bool trace_dump(const char *file_path);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef WORKER_COROUTINE_H
+#define WORKER_COROUTINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "worker/worker.h"
+#include "clock/clock.h"
+
+// Stackless coroutines for Worker tasks. A task callback written with these reads top to bottom like blocking code,
+// but every await returns from the callback and the next call picks up right after it.
+//
+//     bool my_task(Worker *worker, Worker_Context *context, const uint32_t lifetime) {
+//         My_Context *ctx = (My_Context *)context;
+//         WORKER_COROUTINE_BEGIN(&ctx->coroutine);
+//
+//         WORKER_AWAIT_READABLE(worker, &ctx->coroutine, ctx->fd);
+//         ...
+//
+//         WORKER_COROUTINE_END(&ctx->coroutine);
+//     }
+//
+// Rules:
+// - Local variables do not survive an await. Anything needed afterwards has to live in the task's context.
+// - An await can't be inside a 'switch' of its own (the resume point is a 'case' label of the coroutine's switch).
+// - Only one coroutine per function, and at most one await per line.
+
+typedef struct {
+    uint32_t resume_line; // 0 before the first call.
+} Worker_Coroutine;
+
+#define WORKER_COROUTINE_FINISHED UINT32_MAX
+
+#define WORKER_COROUTINE_BEGIN(coroutine) \
+    switch((coroutine)->resume_line) { \
+        case WORKER_COROUTINE_FINISHED: return true; \
+        case 0:
+
+// Marks the task as done. Every coroutine has to end with this.
+#define WORKER_COROUTINE_END(coroutine) \
+    } \
+    (coroutine)->resume_line = WORKER_COROUTINE_FINISHED; \
+    return true
+
+// Finishes the task early, from anywhere between BEGIN and END.
+#define WORKER_COROUTINE_EXIT(coroutine) \
+    do { \
+        (coroutine)->resume_line = WORKER_COROUTINE_FINISHED; \
+        return true; \
+    } while(0)
+
+// Gives the other tasks a turn. Resumes on the next tick.
+#define WORKER_COROUTINE_YIELD(coroutine) \
+    do { \
+        (coroutine)->resume_line = __LINE__; \
+        return false; \
+        case __LINE__:; \
+    } while(0)
+
+// Resumes once 'fd' is readable (or has hung up, or has an error - whatever the next read would tell us).
+#define WORKER_AWAIT_READABLE(worker, coroutine, fd) \
+    do { \
+        worker_task_wait_for_fd((worker), (fd), Worker_Wait_Events_Readable); \
+        WORKER_COROUTINE_YIELD(coroutine); \
+    } while(0)
+
+// Resumes once 'fd' is writable (or has an error). This is also how a non-blocking connect(..) reports it's done.
+#define WORKER_AWAIT_WRITABLE(worker, coroutine, fd) \
+    do { \
+        worker_task_wait_for_fd((worker), (fd), Worker_Wait_Events_Writable); \
+        WORKER_COROUTINE_YIELD(coroutine); \
+    } while(0)
+
+// Resumes once another task calls worker_wake_task(..) for this one. Nothing else wakes it, so whoever it's waiting on
+// has to know its handle (see worker_current_task_handle(..)).
+#define WORKER_AWAIT_WOKEN(worker, coroutine) \
+    do { \
+        worker_task_wait_for_wake(worker); \
+        WORKER_COROUTINE_YIELD(coroutine); \
+    } while(0)
+
+// Resumes once clock_now_ns() has reached 'deadline_ns'. The deadline is evaluated again every time the task resumes,
+// so it should be something stored in the context.
+#define WORKER_AWAIT_TIMER(worker, coroutine, deadline_ns) \
+    do { \
+        while(clock_now_ns() < (deadline_ns)) { \
+            worker_task_wait_until((worker), (deadline_ns)); \
+            WORKER_COROUTINE_YIELD(coroutine); \
+        } \
+    } while(0)
+
+#endif
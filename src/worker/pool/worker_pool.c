@@ -0,0 +1,344 @@
+#include "worker_pool.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log/log.h"
+#include "trace/trace.h"
+
+#define WORKER_POOL_DEQUE_MASK (WORKER_POOL_DEQUE_CAPACITY - 1)
+
+// Deque.
+
+static bool worker_pool_deque_push(Worker_Pool_Deque *deque, Worker_Pool_Job *job) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+    if(bottom - top >= WORKER_POOL_DEQUE_CAPACITY) {
+        return false; // Full.
+    }
+
+    __atomic_store_n(&deque->jobs[bottom & WORKER_POOL_DEQUE_MASK], job, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE); // Publishes the job (and everything written to it) to thieves.
+
+    return true;
+}
+
+static Worker_Pool_Job *worker_pool_deque_pop(Worker_Pool_Deque *deque) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if(top > bottom) {
+        // Empty.
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    Worker_Pool_Job *job = __atomic_load_n(&deque->jobs[bottom & WORKER_POOL_DEQUE_MASK], __ATOMIC_RELAXED);
+    if(top == bottom) {
+        // Last job. Race the thieves for it.
+        if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            job = NULL;
+        }
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+
+    return job;
+}
+
+static Worker_Pool_Job *worker_pool_deque_steal(Worker_Pool_Deque *deque) {
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+    if(top >= bottom) {
+        return NULL; // Empty.
+    }
+
+    Worker_Pool_Job *job = __atomic_load_n(&deque->jobs[top & WORKER_POOL_DEQUE_MASK], __ATOMIC_RELAXED);
+    if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL; // Lost the race to the owner or another thief.
+    }
+
+    return job;
+}
+
+// Threads.
+
+static bool worker_pool_thread_adopt(Worker_Pool_Thread *thread, Worker_Pool_Job *job) {
+    if(!worker_add_task(&thread->worker, job->context, job->context_size, job->callback, NULL)) {
+        // Out of memory. Hand the job back so it isn't lost; we or someone else will try again later.
+        Worker_Pool *pool = thread->pool;
+        pthread_mutex_lock(&pool->submit_lock);
+        job->next = pool->submitted_first;
+        pool->submitted_first = job;
+        if(pool->submitted_last == NULL) {
+            pool->submitted_last = job;
+        }
+        pthread_mutex_unlock(&pool->submit_lock);
+        return false;
+    }
+
+    __atomic_store_n(&thread->active_task_count, thread->worker.task_count, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&thread->pool->unadopted_job_count, 1, __ATOMIC_ACQ_REL);
+
+    free(job->context);
+    free(job);
+    return true;
+}
+
+// Moves a batch of submitted jobs onto this thread's deque. Returns how many were moved.
+static uint32_t worker_pool_thread_take_submitted(Worker_Pool_Thread *thread, bool *out_more_left) {
+    Worker_Pool *pool = thread->pool;
+
+    uint32_t taken = 0;
+    pthread_mutex_lock(&pool->submit_lock);
+    while(pool->submitted_first != NULL && taken < WORKER_POOL_SUBMIT_BATCH_SIZE) {
+        Worker_Pool_Job *job = pool->submitted_first;
+        Worker_Pool_Job *next = job->next;
+
+        // Unlink before pushing; once it's on the deque another thread may steal (and free) it.
+        job->next = NULL;
+        if(!worker_pool_deque_push(&thread->deque, job)) {
+            job->next = next;
+            break; // Our deque is full. Leave the rest for the others.
+        }
+
+        pool->submitted_first = next;
+        if(pool->submitted_first == NULL) {
+            pool->submitted_last = NULL;
+        }
+        taken += 1;
+    }
+    *out_more_left = pool->submitted_first != NULL;
+    pthread_mutex_unlock(&pool->submit_lock);
+
+    return taken;
+}
+
+static Worker_Pool_Job *worker_pool_thread_steal(Worker_Pool_Thread *thread) {
+    Worker_Pool *pool = thread->pool;
+
+    // Start at our neighbour so the threads don't all hammer thread 0.
+    for(uint32_t i = 1; i < pool->thread_count; i++) {
+        Worker_Pool_Thread *victim = &pool->threads[(thread->index + i) % pool->thread_count];
+
+        Worker_Pool_Job *job = worker_pool_deque_steal(&victim->deque);
+        if(job != NULL) {
+            thread->jobs_stolen += 1;
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+static inline bool worker_pool_thread_has_room(const Worker_Pool_Thread *thread) {
+    return thread->worker.task_count < WORKER_POOL_THREAD_MAX_ACTIVE_TASKS;
+}
+
+static void *worker_pool_thread_main(void *argument) {
+    Worker_Pool_Thread *thread = (Worker_Pool_Thread *)argument;
+    Worker_Pool *pool = thread->pool;
+
+    trace_set_thread_name(thread->name);
+
+    while(true) {
+        bool more_submitted = false;
+        worker_pool_thread_take_submitted(thread, &more_submitted);
+        if(more_submitted) {
+            // Don't let one thread be the only one draining the submissions.
+            worker_wake(&pool->threads[(thread->index + 1) % pool->thread_count].worker);
+        }
+
+        // Adopt from our own deque first, then help out whoever is busiest.
+        while(worker_pool_thread_has_room(thread)) {
+            Worker_Pool_Job *job = worker_pool_deque_pop(&thread->deque);
+            if(job == NULL) {
+                job = worker_pool_thread_steal(thread);
+            }
+            if(job == NULL) {
+                break;
+            }
+
+            if(!worker_pool_thread_adopt(thread, job)) {
+                break;
+            }
+        }
+
+        if(thread->worker.task_count > 0) {
+            uint32_t tasks_left = worker_work(&thread->worker);
+            __atomic_store_n(&thread->active_task_count, tasks_left, __ATOMIC_RELEASE);
+        }
+
+        if(__atomic_load_n(&pool->stopping, __ATOMIC_ACQUIRE) && thread->worker.task_count == 0) {
+            break;
+        }
+
+        // Sleep until one of our tasks can make progress or someone submits something. If there's work sitting in
+        // other threads' deques that we have room for, only nap briefly so we get to steal it.
+        bool could_steal = worker_pool_thread_has_room(thread) && __atomic_load_n(&pool->unadopted_job_count, __ATOMIC_ACQUIRE) > 0;
+        worker_wait(&thread->worker, could_steal ? WORKER_POOL_STEAL_INTERVAL_MS : -1);
+    }
+
+    return NULL;
+}
+
+// Pool.
+
+bool worker_pool_init(Worker_Pool *pool, uint32_t thread_count) {
+    assert(pool != NULL);
+    memset(pool, 0, sizeof(Worker_Pool));
+
+    if(thread_count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cores > 0 ? (uint32_t)cores : 1;
+    }
+    if(thread_count > WORKER_POOL_MAX_THREADS) {
+        thread_count = WORKER_POOL_MAX_THREADS;
+    }
+
+    pool->threads = (Worker_Pool_Thread *)calloc(thread_count, sizeof(Worker_Pool_Thread));
+    if(pool->threads == NULL) {
+        return false;
+    }
+
+    pthread_mutex_init(&pool->submit_lock, NULL);
+
+    // Set everything up before starting any thread, since they look at (and wake) each other.
+    for(uint32_t i = 0; i < thread_count; i++) {
+        Worker_Pool_Thread *thread = &pool->threads[i];
+        thread->pool = pool;
+        thread->index = i;
+
+        snprintf(thread->name, sizeof(thread->name), "Pool Worker %u", i);
+        thread->worker.name = thread->name;
+
+        if(!worker_event_loop_init(&thread->worker)) {
+            for(uint32_t j = 0; j < i; j++) {
+                worker_dispose(&pool->threads[j].worker);
+            }
+            pthread_mutex_destroy(&pool->submit_lock);
+            free(pool->threads);
+            memset(pool, 0, sizeof(Worker_Pool));
+            return false;
+        }
+    }
+    pool->thread_count = thread_count;
+
+    for(uint32_t i = 0; i < thread_count; i++) {
+        Worker_Pool_Thread *thread = &pool->threads[i];
+        if(pthread_create(&thread->thread, NULL, worker_pool_thread_main, thread) != 0) {
+            LOG_ERROR("Failed to start worker pool thread %u.", i);
+
+            __atomic_store_n(&pool->stopping, true, __ATOMIC_RELEASE);
+            for(uint32_t j = 0; j < i; j++) {
+                worker_wake(&pool->threads[j].worker);
+            }
+            for(uint32_t j = 0; j < i; j++) {
+                pthread_join(pool->threads[j].thread, NULL);
+            }
+            for(uint32_t j = 0; j < thread_count; j++) {
+                worker_dispose(&pool->threads[j].worker);
+            }
+
+            pthread_mutex_destroy(&pool->submit_lock);
+            free(pool->threads);
+            memset(pool, 0, sizeof(Worker_Pool));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool worker_pool_submit(Worker_Pool *pool, Worker_Context *context, uint32_t context_size, const Worker_Task_Callback callback) {
+    assert(pool != NULL);
+    assert(callback != NULL);
+
+    Worker_Pool_Job *job = (Worker_Pool_Job *)malloc(sizeof(Worker_Pool_Job));
+    if(job == NULL) {
+        return false;
+    }
+
+    job->context = malloc(context_size);
+    if(job->context == NULL) {
+        free(job);
+        return false;
+    }
+
+    memcpy(job->context, context, context_size);
+    job->context_size = context_size;
+    job->callback = callback;
+    job->next = NULL;
+
+    __atomic_add_fetch(&pool->unadopted_job_count, 1, __ATOMIC_ACQ_REL);
+
+    pthread_mutex_lock(&pool->submit_lock);
+    if(pool->submitted_last != NULL) {
+        pool->submitted_last->next = job;
+    }
+    else {
+        pool->submitted_first = job;
+    }
+    pool->submitted_last = job;
+    pthread_mutex_unlock(&pool->submit_lock);
+
+    // Round-robin who gets woken up. Whoever it is passes the wake-up along if there's more than one batch waiting.
+    uint32_t wake_index = __atomic_fetch_add(&pool->next_wake_index, 1, __ATOMIC_RELAXED) % pool->thread_count;
+    worker_wake(&pool->threads[wake_index].worker);
+
+    return true;
+}
+
+static bool worker_pool_idle(Worker_Pool *pool) {
+    // NOTE: Check the unadopted count first. A job is published as active before it stops being unadopted.
+    if(__atomic_load_n(&pool->unadopted_job_count, __ATOMIC_ACQUIRE) > 0) {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < pool->thread_count; i++) {
+        if(__atomic_load_n(&pool->threads[i].active_task_count, __ATOMIC_ACQUIRE) > 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void worker_pool_wait(Worker_Pool *pool) {
+    assert(pool != NULL);
+
+    while(!worker_pool_idle(pool)) {
+        struct timespec nap = { 0, 100 * 1000 };
+        nanosleep(&nap, NULL);
+    }
+}
+
+void worker_pool_dispose(Worker_Pool *pool) {
+    assert(pool != NULL);
+
+    worker_pool_wait(pool);
+
+    __atomic_store_n(&pool->stopping, true, __ATOMIC_RELEASE);
+    for(uint32_t i = 0; i < pool->thread_count; i++) {
+        worker_wake(&pool->threads[i].worker);
+    }
+
+    for(uint32_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i].thread, NULL);
+        worker_dispose(&pool->threads[i].worker);
+    }
+
+    pthread_mutex_destroy(&pool->submit_lock);
+
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->thread_count = 0;
+}
\ No newline at end of file
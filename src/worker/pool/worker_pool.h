@@ -0,0 +1,88 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "worker/worker.h"
+
+#ifndef WORKER_POOL_MAX_THREADS
+#define WORKER_POOL_MAX_THREADS 64
+#endif
+
+#ifndef WORKER_POOL_DEQUE_CAPACITY
+#define WORKER_POOL_DEQUE_CAPACITY 1024 // Must be a power of two.
+#endif
+
+#ifndef WORKER_POOL_SUBMIT_BATCH_SIZE
+#define WORKER_POOL_SUBMIT_BATCH_SIZE 16 // How many submitted jobs a thread moves to its own deque at once.
+#endif
+
+#ifndef WORKER_POOL_STEAL_INTERVAL_MS
+#define WORKER_POOL_STEAL_INTERVAL_MS 1 // How long a thread with room sleeps before looking for work to steal again.
+#endif
+
+#ifndef WORKER_POOL_THREAD_MAX_ACTIVE_TASKS
+#define WORKER_POOL_THREAD_MAX_ACTIVE_TASKS 1024 // Jobs past this stay in the deque where others can steal them.
+#endif
+
+typedef struct Worker_Pool_Job Worker_Pool_Job;
+struct Worker_Pool_Job {
+    Worker_Context *context; // Owned by the job until a thread adopts it into its Worker.
+    uint32_t context_size;
+    Worker_Task_Callback callback;
+
+    Worker_Pool_Job *next; // Used while waiting in the pool's submission list.
+};
+
+// Chase-Lev work-stealing deque. The owning thread pushes and pops at the bottom, any other thread steals from the top.
+typedef struct {
+    int64_t top;
+    int64_t bottom;
+    Worker_Pool_Job *jobs[WORKER_POOL_DEQUE_CAPACITY];
+} Worker_Pool_Deque;
+
+typedef struct Worker_Pool Worker_Pool;
+
+typedef struct {
+    Worker_Pool *pool;
+    uint32_t index;
+    pthread_t thread;
+    char name[32];
+
+    // Only touched by this thread. Tasks (and the sockets they own) never move between threads once adopted.
+    Worker worker;
+    Worker_Pool_Deque deque;
+
+    uint32_t active_task_count; // Published copy of worker.task_count for worker_pool_wait(..).
+    uint64_t jobs_stolen;
+} Worker_Pool_Thread;
+
+struct Worker_Pool {
+    Worker_Pool_Thread *threads;
+    uint32_t thread_count;
+
+    // Submissions from any thread land here. Pool threads move them to their own deque in batches.
+    pthread_mutex_t submit_lock;
+    Worker_Pool_Job *submitted_first;
+    Worker_Pool_Job *submitted_last;
+    uint32_t next_wake_index;
+
+    uint32_t unadopted_job_count; // Submitted, but not yet added to a thread's Worker.
+    bool stopping;
+};
+
+// 'thread_count' 0 means one thread per online core.
+bool worker_pool_init(Worker_Pool *pool, uint32_t thread_count);
+
+// Safe to call from any thread. The context is copied.
+bool worker_pool_submit(Worker_Pool *pool, Worker_Context *context, uint32_t context_size, const Worker_Task_Callback callback);
+
+// Blocks until every submitted job has finished.
+void worker_pool_wait(Worker_Pool *pool);
+
+// Waits for outstanding jobs, then stops and joins the threads.
+void worker_pool_dispose(Worker_Pool *pool);
+
+#endif
\ No newline at end of file
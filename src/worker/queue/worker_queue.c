@@ -0,0 +1,91 @@
+#include "worker_queue.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool worker_queue_init(Worker_Queue *queue, uint32_t capacity) {
+    assert(queue != NULL);
+    assert(capacity > 0);
+
+    uint32_t rounded_capacity = 1;
+    while(rounded_capacity < capacity) {
+        rounded_capacity <<= 1;
+    }
+
+    memset(queue, 0, sizeof(Worker_Queue));
+    queue->cells = malloc(sizeof(Worker_Queue_Cell) * rounded_capacity);
+    if(queue->cells == NULL) {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < rounded_capacity; i++) {
+        queue->cells[i].sequence = i;
+        queue->cells[i].value = NULL;
+    }
+
+    queue->capacity = rounded_capacity;
+    queue->mask = rounded_capacity - 1;
+    return true;
+}
+
+void worker_queue_dispose(Worker_Queue *queue) {
+    assert(queue != NULL);
+
+    free(queue->cells);
+    memset(queue, 0, sizeof(Worker_Queue));
+}
+
+bool worker_queue_push(Worker_Queue *queue, void *value) {
+    assert(queue != NULL);
+    assert(value != NULL);
+
+    uint64_t position = __atomic_load_n(&queue->push_position, __ATOMIC_RELAXED);
+    while(true) {
+        Worker_Queue_Cell *cell = &queue->cells[position & queue->mask];
+        uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+
+        int64_t difference = (int64_t)sequence - (int64_t)position;
+        if(difference == 0) {
+            // The cell is free for this position. Try to claim it.
+            if(__atomic_compare_exchange_n(&queue->push_position, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->value = value;
+                __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE); // Publish it to the consumer.
+                return true;
+            }
+            // Someone else got it. 'position' now holds the current one, so go again.
+        }
+        else if(difference < 0) {
+            return false; // Full. The consumer hasn't taken the value from a lap ago yet.
+        }
+        else {
+            position = __atomic_load_n(&queue->push_position, __ATOMIC_RELAXED); // Fell behind other producers.
+        }
+    }
+}
+
+void *worker_queue_pop(Worker_Queue *queue) {
+    assert(queue != NULL);
+
+    uint64_t position = queue->pop_position;
+    Worker_Queue_Cell *cell = &queue->cells[position & queue->mask];
+    uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+
+    if(sequence != position + 1) {
+        return NULL; // Empty, or the producer that claimed it hasn't published yet.
+    }
+
+    void *value = cell->value;
+    __atomic_store_n(&queue->pop_position, position + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&cell->sequence, position + queue->capacity, __ATOMIC_RELEASE); // Free for the next lap.
+
+    return value;
+}
+
+bool worker_queue_probably_empty(const Worker_Queue *queue) {
+    assert(queue != NULL);
+
+    uint64_t pop_position = __atomic_load_n(&queue->pop_position, __ATOMIC_RELAXED);
+    uint64_t push_position = __atomic_load_n(&queue->push_position, __ATOMIC_RELAXED);
+    return push_position == pop_position;
+}
@@ -0,0 +1,44 @@
+#ifndef WORKER_QUEUE_H
+#define WORKER_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Bounded lock-free queue of pointers. Any number of threads may push, one thread pops. Used to hand tasks to a Worker
+// from other threads, and to hand finished results back from workers to whoever is waiting for them.
+//
+// Every cell carries a sequence number that says whose turn it is: a producer claims a position with a CAS and then
+// publishes the cell by bumping its sequence, and the consumer only takes cells that have been published. Nobody ever
+// waits on a lock, and a full queue just makes the push fail.
+
+#define WORKER_QUEUE_CACHE_LINE_SIZE 64
+
+typedef struct {
+    uint64_t sequence;
+    void *value;
+} Worker_Queue_Cell;
+
+typedef struct {
+    Worker_Queue_Cell *cells;
+    uint32_t capacity; // Power of two.
+    uint32_t mask;
+
+    // Producers and the consumer hammer these from different threads. Keep them on separate cache lines.
+    uint64_t push_position __attribute__((aligned(WORKER_QUEUE_CACHE_LINE_SIZE)));
+    uint64_t pop_position __attribute__((aligned(WORKER_QUEUE_CACHE_LINE_SIZE)));
+} Worker_Queue;
+
+// 'capacity' is rounded up to a power of two.
+bool worker_queue_init(Worker_Queue *queue, uint32_t capacity);
+void worker_queue_dispose(Worker_Queue *queue);
+
+// Safe from any thread. Returns false if the queue is full. 'value' must not be NULL.
+bool worker_queue_push(Worker_Queue *queue, void *value);
+
+// Only from the consumer's thread. Returns NULL if the queue is empty.
+void *worker_queue_pop(Worker_Queue *queue);
+
+// Racy by nature: only a hint, e.g. for deciding whether it's worth going to sleep.
+bool worker_queue_probably_empty(const Worker_Queue *queue);
+
+#endif
@@ -1,73 +1,1079 @@
+#define _GNU_SOURCE // sched_setaffinity(..) and CPU_SET(..).
+
 #include "worker.h"
 
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "clock/clock.h"
+#include "log/log.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+
+#define WORKER_WAKE_EVENT_DATA UINT64_MAX
+#define WORKER_MAX_EVENTS_PER_WAIT 64
+
+// A task on its way in from another thread. Carries its own copy of the context.
+struct Worker_Submission {
+    Worker_Task_Callback callback;
+    uint32_t context_size;
+    uint8_t context[];
+};
+
+static inline uint32_t worker_page_start(uint32_t page) {
+    return page == 0 ? 0 : (WORKER_TASK_FIRST_PAGE_SIZE << (page - 1));
+}
+
+static inline uint32_t worker_page_size(uint32_t page) {
+    return page == 0 ? WORKER_TASK_FIRST_PAGE_SIZE : (WORKER_TASK_FIRST_PAGE_SIZE << (page - 1));
+}
+
+static inline Worker_Task *worker_task_at(const Worker *worker, uint32_t index) {
+    uint32_t q = index / WORKER_TASK_FIRST_PAGE_SIZE;
+    uint32_t page = q == 0 ? 0 : (32 - __builtin_clz(q));
+    assert(page < worker->page_count);
+
+    return &worker->pages[page][index - worker_page_start(page)];
+}
+
+static bool worker_grow(Worker *worker) {
+    if(worker->page_count >= WORKER_TASK_MAX_PAGES) {
+        return false;
+    }
+
+    uint32_t page = worker->page_count;
+    uint32_t page_size = worker_page_size(page);
+
+    Worker_Task *tasks = (Worker_Task *)calloc(page_size, sizeof(Worker_Task));
+    if(tasks == NULL) {
+        return false;
+    }
+
+    // NOTE: Whatever got bigger before one of these fails just stays bigger. Nothing goes by their size but 'slot_count'.
+    const uint32_t slot_count = worker_page_start(page) + page_size;
+    Worker_Task_Handle *ready = (Worker_Task_Handle *)realloc(worker->ready, 2 * slot_count * sizeof(Worker_Task_Handle));
+    if(ready == NULL) {
+        free(tasks);
+        return false;
+    }
+    worker->ready = ready;
+
+    Worker_Task_Handle *running = (Worker_Task_Handle *)realloc(worker->running, 2 * slot_count * sizeof(Worker_Task_Handle));
+    if(running == NULL) {
+        free(tasks);
+        return false;
+    }
+    worker->running = running;
+
+    uint32_t *timers = (uint32_t *)realloc(worker->timers, slot_count * sizeof(uint32_t));
+    if(timers == NULL) {
+        free(tasks);
+        return false;
+    }
+    worker->timers = timers;
+
+    uint32_t *finished = (uint32_t *)realloc(worker->finished, slot_count * sizeof(uint32_t));
+    if(finished == NULL) {
+        free(tasks);
+        return false;
+    }
+    worker->finished = finished;
+
+    worker->slot_count = slot_count;
+    worker->run_list_capacity = 2 * slot_count;
+
+    worker->pages[page] = tasks;
+    worker->page_count += 1;
+
+    // Put the new slots on the free-list, lowest index first.
+    uint32_t first_index = worker_page_start(page);
+    for(uint32_t i = 0; i < page_size; i++) {
+        tasks[i].next_free = (i + 1 < page_size) ? (first_index + i + 2) : worker->first_free;
+    }
+    worker->first_free = first_index + 1;
+
+    return true;
+}
+
+static inline uint64_t worker_task_event_data(const Worker_Task *task, uint32_t index) {
+    return ((uint64_t)task->generation << 32) | index;
+}
+
+// The entry's task, unless it went away (or was queued again, under a new generation) since the entry was made.
+static inline Worker_Task *worker_run_list_task(const Worker *worker, const Worker_Task_Handle entry) {
+    Worker_Task *task = worker_task_at(worker, entry.index);
+    if(!task->in_use || task->generation != entry.generation || task->done) {
+        return NULL;
+    }
+    return task;
+}
+
+// Puts the task on the list for the next tick, unless it's on one already.
+static void worker_queue_task(Worker *worker, Worker_Task *task, uint32_t index) {
+    if(task->queued) {
+        return;
+    }
+
+    if(worker->ready_count == worker->run_list_capacity) {
+        // Full of entries for tasks that went away. Every live task is in here at most once, so dropping those makes room.
+        uint32_t kept = 0;
+        for(uint32_t i = 0; i < worker->ready_count; i++) {
+            Worker_Task *queued_task = worker_run_list_task(worker, worker->ready[i]);
+            if(queued_task != NULL && queued_task->queued) {
+                worker->ready[kept] = worker->ready[i];
+                kept += 1;
+            }
+        }
+        worker->ready_count = kept;
+        assert(kept < worker->run_list_capacity);
+    }
+
+    worker->ready[worker->ready_count].index = index;
+    worker->ready[worker->ready_count].generation = task->generation;
+    worker->ready_count += 1;
+    task->queued = true;
+}
 
-bool worker_add_task(Worker *worker, Worker_Context *context, uint32_t context_size, const Worker_Task_Callback callback) {
+static inline uint64_t worker_timer_at(const Worker *worker, uint32_t slot) {
+    return worker_task_at(worker, worker->timers[slot])->wait_until_ns;
+}
+
+static inline void worker_timer_place(Worker *worker, uint32_t slot, uint32_t index) {
+    worker->timers[slot] = index;
+    worker_task_at(worker, index)->timer_slot = slot + 1;
+}
+
+static void worker_timer_sift_up(Worker *worker, uint32_t slot) {
+    const uint32_t index = worker->timers[slot];
+    const uint64_t wait_until_ns = worker_task_at(worker, index)->wait_until_ns;
+    while(slot > 0) {
+        uint32_t parent = (slot - 1) / 2;
+        if(worker_timer_at(worker, parent) <= wait_until_ns) {
+            break;
+        }
+        worker_timer_place(worker, slot, worker->timers[parent]);
+        slot = parent;
+    }
+    worker_timer_place(worker, slot, index);
+}
+
+static void worker_timer_sift_down(Worker *worker, uint32_t slot) {
+    const uint32_t index = worker->timers[slot];
+    const uint64_t wait_until_ns = worker_task_at(worker, index)->wait_until_ns;
+    while(true) {
+        uint32_t child = 2 * slot + 1;
+        if(child >= worker->timer_count) {
+            break;
+        }
+        if(child + 1 < worker->timer_count && worker_timer_at(worker, child + 1) < worker_timer_at(worker, child)) {
+            child += 1;
+        }
+        if(wait_until_ns <= worker_timer_at(worker, child)) {
+            break;
+        }
+        worker_timer_place(worker, slot, worker->timers[child]);
+        slot = child;
+    }
+    worker_timer_place(worker, slot, index);
+}
+
+static void worker_timer_add(Worker *worker, Worker_Task *task, uint32_t index) {
+    assert(task->timer_slot == 0);
+    assert(worker->timer_count < worker->slot_count);
+
+    worker->timers[worker->timer_count] = index;
+    worker->timer_count += 1;
+    worker_timer_sift_up(worker, worker->timer_count - 1);
+    assert(task->timer_slot != 0);
+}
+
+static void worker_timer_remove(Worker *worker, Worker_Task *task) {
+    if(task->timer_slot == 0) {
+        return;
+    }
+
+    uint32_t slot = task->timer_slot - 1;
+    task->timer_slot = 0;
+    worker->timer_count -= 1;
+    if(slot == worker->timer_count) {
+        return;
+    }
+
+    worker_timer_place(worker, slot, worker->timers[worker->timer_count]);
+    if(slot > 0 && worker_timer_at(worker, slot) < worker_timer_at(worker, (slot - 1) / 2)) {
+        worker_timer_sift_up(worker, slot);
+    }
+    else {
+        worker_timer_sift_down(worker, slot);
+    }
+}
+
+// When the earliest timer goes off. 0 for none.
+static inline uint64_t worker_next_timer_ns(const Worker *worker) {
+    return worker->timer_count > 0 ? worker_timer_at(worker, 0) : 0;
+}
+
+static void worker_unregister_task_fd(Worker *worker, Worker_Task *task) {
+    if(!task->registered) {
+        return;
+    }
+
+    // NOTE: Fails with EBADF if the task already closed the fd, which also removed it from the epoll. That's fine.
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, task->registered_fd, NULL);
+    task->registered = false;
+    worker->registered_count -= 1;
+}
+
+// Makes the epoll registration match what the task just said it's waiting for. Registrations are level-triggered and
+// kept between ticks, so a task that keeps waiting on the same fd doesn't cost any epoll_ctl(..) calls.
+static void worker_update_task_fd(Worker *worker, Worker_Task *task, uint32_t index) {
+    bool wants_fd = !task->done && task->waiting && task->wait_events != Worker_Wait_Events_None;
+
+    if(task->registered) {
+        bool same = wants_fd && task->registered_fd == task->wait_fd && task->registered_events == task->wait_events;
+        if(same) {
+            return;
+        }
+        if(!wants_fd || task->registered_fd != task->wait_fd) {
+            worker_unregister_task_fd(worker, task);
+        }
+    }
+
+    if(!wants_fd) {
+        return;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    if(task->wait_events & Worker_Wait_Events_Readable) event.events |= EPOLLIN | EPOLLRDHUP;
+    if(task->wait_events & Worker_Wait_Events_Writable) event.events |= EPOLLOUT;
+    event.data.u64 = worker_task_event_data(task, index);
+
+    int op = task->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if(epoll_ctl(worker->epoll_fd, op, task->wait_fd, &event) == -1) {
+        // Can't wait on this fd (a regular file, or another task already has it). Just run the task next tick.
+        if(task->registered) {
+            task->registered = false;
+            worker->registered_count -= 1;
+        }
+        worker_queue_task(worker, task, index);
+        return;
+    }
+
+    if(!task->registered) {
+        worker->registered_count += 1;
+    }
+    task->registered = true;
+    task->registered_fd = task->wait_fd;
+    task->registered_events = task->wait_events;
+}
+
+static void worker_release_task(Worker *worker, uint32_t index) {
+    Worker_Task *task = worker_task_at(worker, index);
+    assert(task->in_use);
+
+    worker_unregister_task_fd(worker, task);
+    worker_timer_remove(worker, task);
+    worker->task_count -= 1; // If it's still on a run list, the new generation below makes that entry stale.
+
+    if(task->context != (Worker_Context *)&task->inline_context) {
+        free(task->context);
+    }
+
+    uint32_t generation = task->generation + 1;
+    memset(task, 0, sizeof(Worker_Task));
+    task->generation = generation;
+
+    task->next_free = worker->first_free;
+    worker->first_free = index + 1;
+}
+
+bool worker_add_task(Worker *worker, Worker_Context *context, uint32_t context_size, const Worker_Task_Callback callback, Worker_Task_Handle *out_handle) {
     assert(worker != NULL);
     assert(callback != NULL);
 
-    if(worker->task_count >= MAX_WORKER_TASKS) {
-        return false;
+    if(worker->first_free == 0) {
+        if(!worker_grow(worker)) {
+            return false;
+        }
     }
 
-    Worker_Task *task = &worker->tasks[worker->task_count];
-    worker->task_count += 1;
+    uint32_t index = worker->first_free - 1;
+    Worker_Task *task = worker_task_at(worker, index);
+    assert(!task->in_use);
+
+    if(context_size <= WORKER_TASK_INLINE_CONTEXT_SIZE) {
+        task->context = (Worker_Context *)&task->inline_context;
+    }
+    else {
+        task->context = malloc(context_size);
+        if(task->context == NULL) {
+            return false;
+        }
+    }
+    memcpy(task->context, context, context_size);
+
+    worker->first_free = task->next_free;
+    task->next_free = 0;
     
     task->uid = worker->next_uid;
     worker->next_uid += 1;
     task->callback = callback;
     task->lifetime = 0;
+    task->done = false;
+    task->in_use = true;
 
-    task->context = malloc(context_size);
-    memcpy(task->context, context, context_size);
+    worker->task_count += 1;
+    worker_queue_task(worker, task, index);
+
+    if(out_handle != NULL) {
+        out_handle->index = index;
+        out_handle->generation = task->generation;
+    }
+
+    return true;
+}
+
+static inline Worker_Task *worker_lookup(const Worker *worker, const Worker_Task_Handle handle) {
+    if(handle.index >= worker_page_start(worker->page_count)) {
+        return NULL;
+    }
+
+    Worker_Task *task = worker_task_at(worker, handle.index);
+    if(!task->in_use || task->generation != handle.generation || task->done) {
+        return NULL;
+    }
+
+    return task;
+}
+
+bool worker_event_loop_init(Worker *worker) {
+    assert(worker != NULL);
+
+    if(worker->has_event_loop) {
+        return true;
+    }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd == -1) {
+        LOG_ERROR("'%s': Failed to create epoll (errno %i).", worker->name, errno);
+        return false;
+    }
+
+    int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wake_fd == -1) {
+        LOG_ERROR("'%s': Failed to create eventfd (errno %i).", worker->name, errno);
+        close(epoll_fd);
+        return false;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = WORKER_WAKE_EVENT_DATA;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) == -1) {
+        close(wake_fd);
+        close(epoll_fd);
+        return false;
+    }
+
+    worker->epoll_fd = epoll_fd;
+    worker->wake_fd = wake_fd;
+    worker->has_event_loop = true;
+    return true;
+}
+
+static const uint32_t worker_priority_rank[Worker_Priority_Count] = {
+    [Worker_Priority_Interactive] = 0,
+    [Worker_Priority_Normal]      = 1,
+    [Worker_Priority_Background]  = 2,
+};
+
+static const Worker_Priority worker_priority_by_rank[Worker_Priority_Count] = {
+    Worker_Priority_Interactive,
+    Worker_Priority_Normal,
+    Worker_Priority_Background,
+};
+
+// Within a class: earliest deadline first, then least recently run.
+static inline bool worker_runs_before(const Worker *worker, const Worker_Task_Handle a, const Worker_Task_Handle b) {
+    const Worker_Task *task_a = worker_task_at(worker, a.index);
+    const Worker_Task *task_b = worker_task_at(worker, b.index);
+
+    uint64_t deadline_a = task_a->deadline_ns != 0 ? task_a->deadline_ns : UINT64_MAX;
+    uint64_t deadline_b = task_b->deadline_ns != 0 ? task_b->deadline_ns : UINT64_MAX;
+    if(deadline_a != deadline_b) {
+        return deadline_a < deadline_b;
+    }
+
+    if(task_a->last_tick != task_b->last_tick) {
+        return task_a->last_tick < task_b->last_tick;
+    }
+    return task_a->uid < task_b->uid;
+}
+
+// Splits this tick's run list by class, in the order the classes run. 'out_class_end[rank]' is where each one ends.
+static void worker_split_by_class(Worker *worker, uint32_t out_class_end[Worker_Priority_Count]) {
+    Worker_Task_Handle *running = worker->running;
+    uint32_t low = 0;
+    uint32_t middle = 0;
+    uint32_t high = worker->running_count;
+    while(middle < high) {
+        uint32_t rank = worker_priority_rank[worker_task_at(worker, running[middle].index)->priority];
+        Worker_Task_Handle entry = running[middle];
+        if(rank == 0) {
+            running[middle] = running[low];
+            running[low] = entry;
+            low += 1;
+            middle += 1;
+        }
+        else if(rank == 1) {
+            middle += 1;
+        }
+        else {
+            high -= 1;
+            running[middle] = running[high];
+            running[high] = entry;
+        }
+    }
+
+    out_class_end[0] = low;
+    out_class_end[1] = high;
+    out_class_end[2] = worker->running_count;
+}
+
+static void worker_class_heap_sift_down(const Worker *worker, Worker_Task_Handle *heap, uint32_t count, uint32_t slot) {
+    const Worker_Task_Handle entry = heap[slot];
+    while(true) {
+        uint32_t child = 2 * slot + 1;
+        if(child >= count) {
+            break;
+        }
+        if(child + 1 < count && worker_runs_before(worker, heap[child + 1], heap[child])) {
+            child += 1;
+        }
+        if(!worker_runs_before(worker, heap[child], entry)) {
+            break;
+        }
+        heap[slot] = heap[child];
+        slot = child;
+    }
+    heap[slot] = entry;
+}
+
+static void worker_class_heap_init(const Worker *worker, Worker_Task_Handle *heap, uint32_t count) {
+    for(uint32_t slot = count / 2; slot > 0; slot--) {
+        worker_class_heap_sift_down(worker, heap, count, slot - 1);
+    }
+}
+
+static Worker_Task_Handle worker_class_heap_pop(const Worker *worker, Worker_Task_Handle *heap, uint32_t *count) {
+    assert(*count > 0);
+
+    Worker_Task_Handle first = heap[0];
+    *count -= 1;
+    if(*count > 0) {
+        heap[0] = heap[*count];
+        worker_class_heap_sift_down(worker, heap, *count, 0);
+    }
+    return first;
+}
+
+static inline void worker_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Returns how many tasks became ready (or wake-ups were seen).
+static uint32_t worker_collect_events(Worker *worker, int timeout_ms) {
+    struct epoll_event events[WORKER_MAX_EVENTS_PER_WAIT];
+    uint32_t ready_count = 0;
+
+    while(true) {
+        TRACE_BEGIN(Trace_Category_Syscall, "epoll_wait", timeout_ms);
+        int event_count = epoll_wait(worker->epoll_fd, &events[0], WORKER_MAX_EVENTS_PER_WAIT, timeout_ms);
+        TRACE_END(Trace_Category_Syscall, "epoll_wait", event_count);
+        if(event_count == -1) {
+            if(errno != EINTR) {
+                LOG_ERROR("'%s': epoll_wait(..) failed (errno %i).", worker->name, errno);
+            }
+            return ready_count;
+        }
+
+        for(int i = 0; i < event_count; i++) {
+            uint64_t data = events[i].data.u64;
+            if(data == WORKER_WAKE_EVENT_DATA) {
+                uint64_t value;
+                while(read(worker->wake_fd, &value, sizeof(value)) > 0);
+                ready_count += 1;
+                continue;
+            }
+
+            Worker_Task_Handle handle;
+            handle.index = (uint32_t)(data & 0xFFFFFFFF);
+            handle.generation = (uint32_t)(data >> 32);
+
+            Worker_Task *task = worker_lookup(worker, handle);
+            if(task != NULL) {
+                worker_queue_task(worker, task, handle.index);
+                ready_count += 1;
+            }
+        }
+
+        if(event_count < WORKER_MAX_EVENTS_PER_WAIT) {
+            return ready_count;
+        }
+        timeout_ms = 0; // There might be more. Grab them without blocking.
+    }
+}
+
+bool worker_submit_queue_init(Worker *worker, const uint32_t capacity) {
+    assert(worker != NULL);
+    assert(worker->submissions == NULL);
+
+    if(!worker_event_loop_init(worker)) {
+        return false;
+    }
+
+    Worker_Queue *submissions = malloc(sizeof(Worker_Queue));
+    if(submissions == NULL) {
+        return false;
+    }
+    if(!worker_queue_init(submissions, capacity)) {
+        free(submissions);
+        return false;
+    }
+
+    worker->submissions = submissions;
+    return true;
+}
 
+bool worker_submit_task(Worker *worker, Worker_Context *context, uint32_t context_size, const Worker_Task_Callback callback) {
+    assert(worker != NULL);
+    assert(worker->submissions != NULL);
+    assert(callback != NULL);
+
+    Worker_Submission *submission = malloc(sizeof(Worker_Submission) + context_size);
+    if(submission == NULL) {
+        return false;
+    }
+    submission->callback = callback;
+    submission->context_size = context_size;
+    memcpy(submission->context, context, context_size);
+
+    if(!worker_queue_push(worker->submissions, submission)) {
+        free(submission);
+        return false;
+    }
+
+    worker_wake(worker);
+    return true;
+}
+
+// Turns up to WORKER_SUBMIT_BATCH_SIZE submissions into tasks.
+static void worker_take_submissions(Worker *worker) {
+    for(uint32_t i = 0; i < WORKER_SUBMIT_BATCH_SIZE; i++) {
+        Worker_Submission *submission = worker->pending_submission;
+        if(submission == NULL) {
+            submission = worker_queue_pop(worker->submissions);
+            if(submission == NULL) {
+                break;
+            }
+        }
+
+        if(!worker_add_task(worker, submission->context, submission->context_size, submission->callback, NULL)) {
+            worker->pending_submission = submission;
+            break;
+        }
+
+        worker->pending_submission = NULL;
+        free(submission);
+    }
+}
+
+static inline bool worker_has_submissions(const Worker *worker) {
+    return worker->submissions != NULL && (worker->pending_submission != NULL || !worker_queue_probably_empty(worker->submissions));
+}
+
+// Runs one entry of this tick's run list. Returns false if its task went away since it was queued.
+static bool worker_run_task(Worker *worker, const Worker_Task_Handle entry) {
+    const uint32_t index = entry.index;
+    Worker_Task *task = worker_run_list_task(worker, entry);
+    if(task == NULL) {
+        return false; // Cancelled (or done) since it was queued.
+    }
+    task->queued = false;
+
+    // Whatever it waited for is one-shot. It has to say so again if it still needs to wait.
+    worker_timer_remove(worker, task);
+    task->waiting = false;
+    task->wait_events = Worker_Wait_Events_None;
+    task->wait_until_ns = 0;
+
+    worker->current_task = task;
+    worker->current_task_index = index;
+    TRACE_BEGIN(Trace_Category_Task, "task", index);
+    const bool finished = task->callback(worker, task->context, task->lifetime);
+    TRACE_END(Trace_Category_Task, "task", finished || task->done);
+    worker->current_task = NULL;
+    task->lifetime += 1;
+    task->last_tick = worker->tick;
+
+    if(finished && !task->done) { // Otherwise it cancelled itself, which already put it on the finished list.
+        task->done = true;
+        worker->finished[worker->finished_count] = index;
+        worker->finished_count += 1;
+    }
+
+    worker_update_task_fd(worker, task, index);
+
+    if(task->done || task->queued) {
+        return true; // Woken (or couldn't wait on its fd) while it ran. It's on the next tick already.
+    }
+
+    if(!task->waiting) {
+        worker_queue_task(worker, task, index);
+    }
+    else if(task->wait_until_ns != 0) {
+        worker_timer_add(worker, task, index);
+    }
     return true;
 }
 
 uint32_t worker_work(Worker *worker) {
     assert(worker != NULL);
+    if(worker->submissions != NULL) {
+        worker_take_submissions(worker);
+    }
     if(worker->task_count == 0) {
         return 0;
     }
 
-    // printf("'%s' working ...\n", worker->name);
-    
+    // LOG_TRACE("'%s' working ...", worker->name);
+    TRACE_BEGIN(Trace_Category_Worker, "tick", worker->tick + 1);
+
+    if(worker->registered_count > 0 && worker->has_event_loop && !worker->events_collected) {
+        worker_collect_events(worker, 0);
+    }
+    worker->events_collected = false;
+
+    const uint64_t now_ns = clock_now_ns(); // Also when the tick started, for the tick duration metric.
+
+    // Timers that went off. Their tasks run this tick, with everything else that became runnable since the last one.
+    while(worker->timer_count > 0 && worker_timer_at(worker, 0) <= now_ns) {
+        uint32_t index = worker->timers[0];
+        Worker_Task *task = worker_task_at(worker, index);
+        worker_timer_remove(worker, task);
+        worker_queue_task(worker, task, index);
+    }
+
+    Worker_Task_Handle *running = worker->ready;
+    worker->ready = worker->running;
+    worker->running = running;
+    worker->running_count = worker->ready_count;
+    worker->ready_count = 0;
+
+    worker->tick += 1;
+    worker->working = true;
+
     // Do the work.
-    for(uint32_t i = 0; i < worker->task_count; i++) {
-        Worker_Task *task = &worker->tasks[i];
-        assert(task != NULL);
+    if(!worker->scheduling) {
+        for(uint32_t i = 0; i < worker->running_count; i++) {
+            worker_run_task(worker, worker->running[i]);
+        }
+    }
+    else {
+        // NOTE: Only what's about to run gets ordered, one heap per class. A class that runs out of budget hands the
+        // rest of its tasks to the next tick without them ever being put in order.
+        uint32_t class_end[Worker_Priority_Count];
+        worker_split_by_class(worker, class_end);
+
+        uint32_t class_start = 0;
+        for(uint32_t rank = 0; rank < Worker_Priority_Count; rank++) {
+            const uint32_t start = class_start;
+            uint32_t count = class_end[rank] - start;
+            class_start = class_end[rank];
+            if(count == 0) {
+                continue;
+            }
+
+            const uint32_t budget_us = worker->priority_budget_us[worker_priority_by_rank[rank]];
+            const uint64_t budget_ns = (uint64_t)budget_us * CLOCK_NS_PER_US;
+            const uint64_t class_started_ns = budget_us > 0 ? clock_now_ns() : 0;
+            bool ran = false;
+
+            // NOTE: The heap is looked up again every time. A task that adds tasks can make the run lists move.
+            worker_class_heap_init(worker, &worker->running[start], count);
+            while(count > 0) {
+                if(budget_us > 0 && ran && clock_now_ns() - class_started_ns >= budget_ns) {
+                    // The class has had its share of this tick. What's left of it goes first in its class next tick,
+                    // since it didn't get to run on this one.
+                    for(uint32_t i = start; i < start + count; i++) {
+                        Worker_Task *task = worker_run_list_task(worker, worker->running[i]);
+                        if(task != NULL) {
+                            task->queued = false;
+                            worker_queue_task(worker, task, worker->running[i].index);
+                            worker->budget_deferrals += 1;
+                        }
+                    }
+                    break;
+                }
 
-        task->done = task->callback(task->context, task->lifetime);
-        task->lifetime += 1;
+                ran |= worker_run_task(worker, worker_class_heap_pop(worker, &worker->running[start], &count));
+            }
+        }
     }
 
+    worker->working = false;
+    worker->running_count = 0;
+
     // Remove tasks that are done.
-    int32_t task_count = worker->task_count;
-    for(int32_t i = task_count - 1; i >= 0; i--) {
-        Worker_Task *task = &worker->tasks[i];
-        assert(task != NULL);
+    for(uint32_t i = 0; i < worker->finished_count; i++) {
+        worker_release_task(worker, worker->finished[i]);
+    }
+    worker->finished_count = 0;
+
+    metrics_count(Metric_Counter_Worker_Ticks, 1);
+    metrics_observe(Metric_Histogram_Worker_Tick_Duration, (clock_now_ns() - now_ns) / CLOCK_NS_PER_US);
+
+    TRACE_END(Trace_Category_Worker, "tick", worker->task_count);
+    // LOG_TRACE("'%s' done working.", worker->name);
+    
+    return worker->task_count;
+}
+
+void worker_wait(Worker *worker, int32_t timeout_ms) {
+    assert(worker != NULL);
+    assert(!worker->working);
+
+    if(worker->task_count > 0 && worker->ready_count > 0) {
+        return; // Someone has something to do already.
+    }
+    if(worker_has_submissions(worker)) {
+        return; // More than one batch came in, or they showed up after the last tick.
+    }
+
+    if(!worker_event_loop_init(worker)) {
+        return;
+    }
 
-        if(!task->done) {
-            continue;
+    const uint64_t next_timer_ns = worker_next_timer_ns(worker);
+    if(next_timer_ns != 0) {
+        uint64_t now_ns = clock_now_ns();
+        int32_t timer_ms = 0;
+        if(next_timer_ns > now_ns) {
+            timer_ms = (int32_t)((next_timer_ns - now_ns + CLOCK_NS_PER_MS - 1) / CLOCK_NS_PER_MS);
         }
+        if(timeout_ms < 0 || timer_ms < timeout_ms) {
+            timeout_ms = timer_ms;
+        }
+    }
 
-        free(task->context);
+    if(worker->spin_budget_ns > 0 && timeout_ms != 0) {
+        uint64_t start_ns = clock_now_ns();
+        uint64_t spin_until_ns = start_ns + worker->spin_budget_ns;
+        if(timeout_ms > 0 && start_ns + (uint64_t)timeout_ms * CLOCK_NS_PER_MS < spin_until_ns) {
+            spin_until_ns = start_ns + (uint64_t)timeout_ms * CLOCK_NS_PER_MS;
+        }
+
+        bool found_something = false;
+        uint64_t now_ns = start_ns;
+        while(true) {
+            if(worker_collect_events(worker, 0) > 0) {
+                found_something = true;
+                break;
+            }
+
+            now_ns = clock_now_ns();
+            if(next_timer_ns != 0 && now_ns >= next_timer_ns) {
+                found_something = true;
+                break;
+            }
+            if(now_ns >= spin_until_ns) {
+                break;
+            }
 
-        if(i == (int32_t)worker->task_count - 1) {
-            memset(task, 0, sizeof(Worker_Task));
+            worker_cpu_relax();
         }
-        else {
-            Worker_Task *last_task = &worker->tasks[worker->task_count - 1];
-            *task = *last_task;
-            memset(last_task, 0, sizeof(Worker_Task));
+
+        worker->idle_stats.spin_ns += now_ns - start_ns;
+        worker->idle_stats.spin_count += 1;
+        if(found_something) {
+            worker->idle_stats.spin_hits += 1;
+            worker->events_collected = true;
+            return;
+        }
+
+        // Park for whatever is left of the timeout.
+        if(timeout_ms > 0) {
+            int32_t spun_ms = (int32_t)((now_ns - start_ns) / CLOCK_NS_PER_MS);
+            timeout_ms = spun_ms < timeout_ms ? timeout_ms - spun_ms : 0;
         }
+    }
 
-        worker->task_count -= 1;
+    if(timeout_ms == 0) {
+        worker_collect_events(worker, 0);
+    }
+    else {
+        uint64_t park_start_ns = clock_now_ns();
+        worker_collect_events(worker, timeout_ms);
+        worker->idle_stats.parked_ns += clock_now_ns() - park_start_ns;
+        worker->idle_stats.park_count += 1;
     }
+    worker->events_collected = true;
+}
 
-    // printf("'%s' done working.\n", worker->name);
-    
-    return worker->task_count;
+void worker_task_set_priority(Worker *worker, const Worker_Priority priority, const uint64_t deadline_ns) {
+    assert(worker != NULL);
+    assert(worker->current_task != NULL); // Only from inside a task's callback.
+    assert(priority < Worker_Priority_Count);
+
+    worker->current_task->priority = (uint8_t)priority;
+    worker->current_task->deadline_ns = deadline_ns;
+    worker->scheduling = true;
+}
+
+bool worker_set_task_priority(Worker *worker, const Worker_Task_Handle handle, const Worker_Priority priority, const uint64_t deadline_ns) {
+    assert(worker != NULL);
+    assert(priority < Worker_Priority_Count);
+
+    Worker_Task *task = worker_lookup(worker, handle);
+    if(task == NULL) {
+        return false;
+    }
+
+    task->priority = (uint8_t)priority;
+    task->deadline_ns = deadline_ns;
+    worker->scheduling = true;
+    return true;
+}
+
+void worker_set_priority_budget(Worker *worker, const Worker_Priority priority, const uint32_t budget_us) {
+    assert(worker != NULL);
+    assert(priority < Worker_Priority_Count);
+
+    worker->priority_budget_us[priority] = budget_us;
+    if(budget_us > 0) {
+        worker->scheduling = true;
+    }
+}
+
+void worker_set_spin_budget(Worker *worker, const uint32_t spin_budget_us) {
+    assert(worker != NULL);
+    worker->spin_budget_ns = (uint64_t)spin_budget_us * CLOCK_NS_PER_US;
+}
+
+bool worker_pin_to_cpu(Worker *worker, const uint32_t cpu) {
+    assert(worker != NULL);
+
+    if(cpu >= CPU_SETSIZE) {
+        LOG_ERROR("'%s': Can't pin to cpu %u, it's out of range.", worker->name, cpu);
+        return false;
+    }
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    if(sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == -1) {
+        LOG_ERROR("'%s': Failed to pin to cpu %u (errno %i).", worker->name, cpu, errno);
+        return false;
+    }
+
+    worker->pinned = true;
+    worker->pinned_cpu = cpu;
+    return true;
+}
+
+void worker_print_idle_stats(const Worker *worker) {
+    assert(worker != NULL);
+
+    const Worker_Idle_Stats *stats = &worker->idle_stats;
+    LOG_INFO("'%s': Spun %llu times for %.3f ms (%llu found work), parked %llu times for %.3f ms.",
+        worker->name,
+        (unsigned long long)stats->spin_count,
+        (double)stats->spin_ns / (double)CLOCK_NS_PER_MS,
+        (unsigned long long)stats->spin_hits,
+        (unsigned long long)stats->park_count,
+        (double)stats->parked_ns / (double)CLOCK_NS_PER_MS
+    );
+}
+
+void worker_run(Worker *worker) {
+    assert(worker != NULL);
+
+    while(worker_work(worker) > 0) {
+        worker_wait(worker, -1);
+    }
+}
+
+void worker_wake(Worker *worker) {
+    assert(worker != NULL);
+
+    if(!worker->has_event_loop) {
+        return; // Nobody can be blocked on it.
+    }
+
+    uint64_t value = 1;
+    ssize_t written = write(worker->wake_fd, &value, sizeof(value));
+    (void)written; // EAGAIN means the counter is already non-zero, which is just as good.
+}
+
+void worker_task_wait_for_fd(Worker *worker, int fd, const Worker_Wait_Events events) {
+    assert(worker != NULL);
+    assert(worker->current_task != NULL); // Only from inside a task's callback.
+
+    if(!worker_event_loop_init(worker)) {
+        return; // No epoll. The task will just be polled every tick like before.
+    }
+
+    Worker_Task *task = worker->current_task;
+    task->waiting = true;
+    task->wait_fd = fd;
+    task->wait_events = events;
+}
+
+void worker_task_forget_fd(Worker *worker, int fd) {
+    assert(worker != NULL);
+    assert(worker->current_task != NULL); // Only from inside a task's callback.
+
+    Worker_Task *task = worker->current_task;
+    if(task->registered && task->registered_fd == fd) {
+        worker_unregister_task_fd(worker, task); // Still open, so this really takes it out of the epoll.
+    }
+}
+
+void worker_task_wait_until(Worker *worker, const uint64_t deadline_ns) {
+    assert(worker != NULL);
+    assert(worker->current_task != NULL); // Only from inside a task's callback.
+
+    Worker_Task *task = worker->current_task;
+    task->waiting = true;
+    task->wait_until_ns = deadline_ns;
+}
+
+void worker_task_wait_for_wake(Worker *worker) {
+    assert(worker != NULL);
+    assert(worker->current_task != NULL); // Only from inside a task's callback.
+
+    worker->current_task->waiting = true;
+}
+
+bool worker_wake_task(Worker *worker, const Worker_Task_Handle handle) {
+    assert(worker != NULL);
+
+    Worker_Task *task = worker_lookup(worker, handle);
+    if(task == NULL) {
+        return false;
+    }
+
+    worker_queue_task(worker, task, handle.index); // Which also keeps worker_wait(..) from blocking on its behalf.
+    return true;
+}
+
+Worker_Task_Handle worker_current_task_handle(const Worker *worker) {
+    assert(worker != NULL);
+    assert(worker->current_task != NULL); // Only from inside a task's callback.
+
+    Worker_Task_Handle handle;
+    handle.index = worker->current_task_index;
+    handle.generation = worker->current_task->generation;
+    return handle;
+}
+
+Worker_Context *worker_get_task_context(Worker *worker, const Worker_Task_Handle handle) {
+    assert(worker != NULL);
+
+    Worker_Task *task = worker_lookup(worker, handle);
+    if(task == NULL) {
+        return NULL;
+    }
+
+    return task->context;
+}
+
+bool worker_task_alive(const Worker *worker, const Worker_Task_Handle handle) {
+    assert(worker != NULL);
+    return worker_lookup(worker, handle) != NULL;
+}
+
+bool worker_cancel_task(Worker *worker, const Worker_Task_Handle handle) {
+    assert(worker != NULL);
+
+    Worker_Task *task = worker_lookup(worker, handle);
+    if(task == NULL) {
+        return false;
+    }
+
+    if(worker->working) {
+        // We're somewhere inside worker_work(..), maybe inside this very task. Let it remove the task once the tick is
+        // over, but take its fd out of the epoll now; whoever cancelled it may close the fd (and have the number reused)
+        // before then.
+        task->done = true;
+        worker_unregister_task_fd(worker, task);
+        worker->finished[worker->finished_count] = handle.index;
+        worker->finished_count += 1;
+        return true;
+    }
+
+    worker_release_task(worker, handle.index);
+    return true;
+}
+
+void worker_await_task(Worker *worker, const Worker_Task_Handle handle) {
+    assert(worker != NULL);
+    assert(!worker->working);
+
+    while(worker_task_alive(worker, handle)) {
+        worker_work(worker);
+        if(worker_task_alive(worker, handle)) {
+            worker_wait(worker, -1);
+        }
+    }
+}
+
+void worker_dispose(Worker *worker) {
+    assert(worker != NULL);
+    assert(!worker->working);
+
+    for(uint32_t index = 0; index < worker->slot_count && worker->task_count > 0; index++) {
+        if(worker_task_at(worker, index)->in_use) {
+            worker_release_task(worker, index);
+        }
+    }
+
+    for(uint32_t i = 0; i < worker->page_count; i++) {
+        free(worker->pages[i]);
+    }
+    free(worker->ready);
+    free(worker->running);
+    free(worker->timers);
+    free(worker->finished);
+
+    if(worker->submissions != NULL) {
+        free(worker->pending_submission);
+        Worker_Submission *submission;
+        while((submission = worker_queue_pop(worker->submissions)) != NULL) {
+            free(submission);
+        }
+        worker_queue_dispose(worker->submissions);
+        free(worker->submissions);
+    }
+
+    if(worker->has_event_loop) {
+        close(worker->wake_fd);
+        close(worker->epoll_fd);
+    }
+
+    const char *name = worker->name;
+    memset(worker, 0, sizeof(Worker));
+    worker->name = name;
 }
\ No newline at end of file
@@ -5,33 +5,256 @@
 #include <stdbool.h>
 #include <stdio.h>
 
-#ifndef MAX_WORKER_TASKS
-#define MAX_WORKER_TASKS 64
+#include "worker/queue/worker_queue.h"
+
+// Tasks live in a slab of pages. Page 0 holds WORKER_TASK_FIRST_PAGE_SIZE tasks and every page after that is as big as
+// all the pages before it combined, so a Worker that only ever runs a couple of tasks stays small. Pages never move,
+// which means a task's context (and anything pointing into it) stays put for as long as the task is alive.
+#ifndef WORKER_TASK_FIRST_PAGE_SIZE
+#define WORKER_TASK_FIRST_PAGE_SIZE 16 // Must be a power of two.
+#endif
+
+#ifndef WORKER_TASK_MAX_PAGES
+#define WORKER_TASK_MAX_PAGES 24 // 16 << 23 = ~134M tasks.
+#endif
+
+// Contexts up to this size are stored inside the task itself instead of being malloc'd.
+#ifndef WORKER_TASK_INLINE_CONTEXT_SIZE
+#define WORKER_TASK_INLINE_CONTEXT_SIZE 64
+#endif
+
+// How many tasks handed over by other threads (see worker_submit_task(..)) are picked up per tick, at most. Keeps a
+// flood of submissions from starving the tasks that are already running.
+#ifndef WORKER_SUBMIT_BATCH_SIZE
+#define WORKER_SUBMIT_BATCH_SIZE 256
 #endif
 
+typedef struct Worker Worker;
+typedef struct Worker_Submission Worker_Submission;
+
 typedef uint32_t Worker_UID;
 typedef void Worker_Context;
-typedef bool (*Worker_Task_Callback)(Worker_Context *context, const uint32_t lifetime);
+typedef bool (*Worker_Task_Callback)(Worker *worker, Worker_Context *context, const uint32_t lifetime);
+
+typedef enum {
+    Worker_Wait_Events_None     = 0,
+    Worker_Wait_Events_Readable = 1 << 0,
+    Worker_Wait_Events_Writable = 1 << 1,
+} Worker_Wait_Events;
+
+// Scheduling classes. Once a worker has tasks with a priority or deadline (or a class budget is set), every tick runs
+// the classes in the order Interactive, Normal, Background, and within a class the earliest deadline first. Tasks
+// without a deadline come after those with one, least recently run first. Only the tasks that are about to run get
+// ordered, so waiting tasks cost nothing here either.
+typedef enum {
+    Worker_Priority_Normal = 0, // What tasks get unless told otherwise.
+    Worker_Priority_Interactive,
+    Worker_Priority_Background,
+
+    Worker_Priority_Count
+} Worker_Priority;
+
+// Refers to a task for as long as it's alive. Once the task is done (or cancelled) its slot gets reused with a new
+// generation, so an old handle can never reach someone else's task.
+typedef struct {
+    uint32_t index;
+    uint32_t generation;
+} Worker_Task_Handle;
 
 typedef struct {
     Worker_UID uid;
+    uint32_t generation;
 
-    Worker_Context *context;
+    Worker_Context *context; // Points at 'inline_context' if the context fit, otherwise at a heap allocation.
     Worker_Task_Callback callback;
 
     uint32_t lifetime;
     bool done;
+    bool in_use;
+
+    uint8_t priority;     // Worker_Priority.
+    uint64_t deadline_ns; // Absolute, on clock_now_ns()'s clock. 0 for none.
+    uint64_t last_tick;   // The tick it last ran on.
+
+    // What the task said it's waiting for the last time it ran. A task that didn't say anything runs every tick.
+    int wait_fd;
+    uint32_t wait_events;   // Worker_Wait_Events.
+    uint64_t wait_until_ns; // 0 for no timer.
+    bool waiting;
+    bool queued;            // It's in Worker.ready (or in Worker.running, not having had its turn yet).
+    uint32_t timer_slot;    // Index + 1 of its entry in Worker.timers. 0 if it isn't waiting for a timer.
+
+    bool registered; // The task's fd is in the worker's epoll, with these events.
+    int registered_fd;
+    uint32_t registered_events;
+
+    uint32_t next_free; // Index + 1 of the next free slot. 0 ends the list. Only valid while free.
+
+    union {
+        uint8_t bytes[WORKER_TASK_INLINE_CONTEXT_SIZE];
+        uint64_t align_u64;
+        void *align_pointer;
+        double align_double;
+    } inline_context;
 } Worker_Task;
 
+// Where a worker's idle time went. Useful for tuning the spin budget: lots of parking with few spin hits means the
+// budget is too small to matter, lots of spin time with few hits means it's burning the core for nothing.
 typedef struct {
+    uint64_t spin_ns;    // Time spent spinning in worker_wait(..).
+    uint64_t parked_ns;  // Time spent blocked in epoll_wait(..).
+    uint64_t spin_count; // How many times worker_wait(..) spun.
+    uint64_t spin_hits;  // How many of those found something to do before the budget ran out.
+    uint64_t park_count; // How many times worker_wait(..) blocked.
+} Worker_Idle_Stats;
+
+// A zeroed Worker is ready to use.
+struct Worker {
     const char *name;
     Worker_UID next_uid;
 
-    Worker_Task tasks[MAX_WORKER_TASKS];
+    Worker_Task *pages[WORKER_TASK_MAX_PAGES];
+    uint32_t page_count;
+
+    uint32_t first_free; // Index + 1 of the first free slot. 0 means there's none and a new page is needed.
+    uint32_t slot_count; // Across all pages.
     uint32_t task_count;
-} Worker;
 
-bool worker_add_task(Worker *worker, Worker_Context *context, uint32_t context_size, const Worker_Task_Callback callback);
+    // The tasks that run on the next tick, in the order they became runnable. Tasks that wait for something aren't in
+    // here until it happens, so a tick only costs as much as there is to do. Entries of tasks that went away meanwhile
+    // are skipped (and dropped whenever the list fills up).
+    Worker_Task_Handle *ready;
+    uint32_t ready_count;
+    Worker_Task_Handle *running; // What the current tick runs. Swapped with 'ready' when a tick starts.
+    uint32_t running_count;
+    uint32_t run_list_capacity;  // Of both. Twice 'slot_count', so there's always room after dropping stale entries.
+
+    uint32_t *timers; // Indices of the tasks that wait with a timer, as a min-heap on their 'wait_until_ns'.
+    uint32_t timer_count;
+
+    uint32_t *finished; // Indices of the tasks that are done this tick. Released once it's over.
+    uint32_t finished_count;
+
+    bool working; // Inside worker_work(..).
+    Worker_Task *current_task; // The task whose callback is running right now.
+    uint32_t current_task_index;
+
+    // Created the first time a task waits for something, or on the first worker_wait(..)/worker_wake(..).
+    bool has_event_loop;
+    int epoll_fd;
+    int wake_fd; // eventfd. Lets other threads wake us up while we're blocked in worker_wait(..).
+
+    uint32_t registered_count; // Tasks with an fd in the epoll.
+    bool events_collected;     // worker_wait(..) already looked at epoll for the next tick.
+
+    // Busy-poll mode. With a spin budget, worker_wait(..) keeps checking for readiness without blocking for up to that
+    // long before parking in epoll_wait(..). Trades a core for latency. 0 parks right away.
+    uint64_t spin_budget_ns;
+    bool pinned;
+    uint32_t pinned_cpu;
+
+    Worker_Idle_Stats idle_stats;
+
+    // Scheduling. Until some task asks for a priority or deadline tasks simply run in the order they became runnable.
+    bool scheduling;
+    uint64_t tick;
+    uint32_t priority_budget_us[Worker_Priority_Count]; // How long each class may run per tick. 0 for no limit.
+    uint64_t budget_deferrals; // Tasks pushed to the next tick because their class was out of budget.
+
+    // Tasks other threads handed us with worker_submit_task(..). NULL until worker_submit_queue_init(..).
+    Worker_Queue *submissions;
+    Worker_Submission *pending_submission; // Taken off the queue but couldn't be added (out of memory). Retried first.
+};
+
+// 'out_handle' may be NULL. Only fails if we run out of memory.
+bool worker_add_task(Worker *worker, Worker_Context *context, uint32_t context_size, const Worker_Task_Callback callback, Worker_Task_Handle *out_handle);
+
+// Lets other threads add tasks with worker_submit_task(..), up to 'capacity' (rounded up to a power of two) that
+// haven't been picked up yet. Must be called on the worker's own thread before any other thread gets to see it.
+// Also sets up the event loop, so submitting can wake the worker.
+bool worker_submit_queue_init(Worker *worker, const uint32_t capacity);
+
+// Same as worker_add_task(..), but safe from any thread. The context is copied right away, and the task is added at
+// the start of the worker's next tick. Lock-free; the worker is woken if it's blocked in worker_wait(..). Returns false
+// if the queue is full (or we're out of memory), in which case nothing was submitted. There's no handle: the task
+// doesn't exist yet when this returns, and handles only mean something on the worker's own thread anyway.
+bool worker_submit_task(Worker *worker, Worker_Context *context, uint32_t context_size, const Worker_Task_Callback callback);
+
+// Runs one tick without blocking: every task that became runnable since the last one. Tasks that are waiting for
+// something that hasn't happened yet aren't even looked at.
+// Returns how many tasks are left.
 uint32_t worker_work(Worker *worker);
 
+// Blocks until a task has something to do: a socket it waits for is ready, a timer expires, or worker_wake(..) is
+// called. Returns right away if some task didn't declare what it's waiting for. 'timeout_ms' -1 waits forever.
+void worker_wait(Worker *worker, int32_t timeout_ms);
+
+// Works until there are no tasks left, sleeping whenever every task is waiting. A worker that's fed by other threads
+// should rather loop on worker_work(..) and worker_wait(..) itself, since it doesn't get to decide when it's done.
+void worker_run(Worker *worker);
+
+// Sets up the epoll and eventfd used for waiting. Done lazily on the worker's own thread otherwise, but has to be done
+// up front if other threads are going to call worker_wake(..).
+bool worker_event_loop_init(Worker *worker);
+
+// Spin for up to 'spin_budget_us' in worker_wait(..) before parking. 0 turns busy-polling off. Sockets the HTTP client
+// opens on a busy-polling worker get SO_BUSY_POLL with the same budget, unless their options say otherwise.
+void worker_set_spin_budget(Worker *worker, const uint32_t spin_budget_us);
+
+// Pins the calling thread, which should be the one running the worker, to 'cpu'. Mostly useful together with a spin
+// budget so the spinning doesn't bounce between cores.
+bool worker_pin_to_cpu(Worker *worker, const uint32_t cpu);
+
+void worker_print_idle_stats(const Worker *worker);
+
+// Sets the task's class and (optional, 0 for none) deadline. The first one is for the task that is running right now,
+// from inside its own callback, the second for any task by handle. The second returns false if the handle is stale.
+void worker_task_set_priority(Worker *worker, const Worker_Priority priority, const uint64_t deadline_ns);
+bool worker_set_task_priority(Worker *worker, const Worker_Task_Handle handle, const Worker_Priority priority, const uint64_t deadline_ns);
+
+// Limits how long tasks of one class may run per tick. A class that's out of budget has its remaining tasks pushed to
+// the next tick, which comes right away, after everyone else got their turn. Every class always gets to run at least
+// one task per tick. 0 removes the limit.
+void worker_set_priority_budget(Worker *worker, const Worker_Priority priority, const uint32_t budget_us);
+
+// Safe to call from any thread once the event loop is set up. Makes a blocked worker_wait(..) return.
+void worker_wake(Worker *worker);
+
+// Called from inside a task's callback. Declares what the task needs before it's worth running again. Only holds
+// until the task runs next, so a task that is still waiting says so again every time. Both can be combined, in which
+// case the task runs on whichever happens first.
+void worker_task_wait_for_fd(Worker *worker, int fd, const Worker_Wait_Events events);
+void worker_task_wait_until(Worker *worker, const uint64_t deadline_ns);
+
+// Called from inside a task's callback, before it closes an fd it has waited on. The registration is kept between
+// ticks and matched by fd number, so without this a new fd that gets the same number (like the next socket, right
+// after a failed connect) would be taken for the old one and never make it into the epoll.
+void worker_task_forget_fd(Worker *worker, int fd);
+
+// Same, but for nothing in particular: the task doesn't run again until some other task (or whoever runs the worker)
+// calls worker_wake_task(..) for it. Whatever it waits on has to make sure that happens.
+void worker_task_wait_for_wake(Worker *worker);
+
+// Makes a task that's waiting run on the next tick. Only on the worker's own thread. Returns false if the handle is
+// stale.
+bool worker_wake_task(Worker *worker, const Worker_Task_Handle handle);
+
+// The handle of the task whose callback is running right now. Only from inside that callback.
+Worker_Task_Handle worker_current_task_handle(const Worker *worker);
+
+// Returns NULL if the task is done or the handle is stale.
+Worker_Context *worker_get_task_context(Worker *worker, const Worker_Task_Handle handle);
+bool worker_task_alive(const Worker *worker, const Worker_Task_Handle handle);
+
+// Removes the task without calling its callback again. Safe to call from inside another task's callback.
+// Returns false if the handle is stale.
+bool worker_cancel_task(Worker *worker, const Worker_Task_Handle handle);
+
+// Works the worker until the task is done. Must not be called from one of this worker's own tasks.
+void worker_await_task(Worker *worker, const Worker_Task_Handle handle);
+
+// Frees every task (without calling them), including submitted ones that weren't picked up yet, and all memory held
+// by the worker. No other thread may be submitting at this point.
+void worker_dispose(Worker *worker);
+
 #endif
\ No newline at end of file
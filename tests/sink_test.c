@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "http/client/http_client_sink.h"
+
+// Tests for the chunked decoding in HTTP_Client_Sink. Built and run by 'make test'; exits with 0 if they all pass.
+
+static int failures = 0;
+
+#define EXPECT(condition) \
+    do { \
+        if(!(condition)) { \
+            fprintf(stderr, "%s:%d: Expected '%s'.\n", __FILE__, __LINE__, #condition); \
+            failures += 1; \
+        } \
+    } while(0)
+
+// An empty file that goes away once it's closed.
+static int open_temp_file(void) {
+    char path[] = "/tmp/sink_test_XXXXXX";
+    int fd = mkstemp(path);
+    if(fd >= 0) {
+        unlink(path);
+    }
+    return fd;
+}
+
+// Starts streaming a chunked body into 'fd'. A tiny staging buffer makes it write out (and so test) every few bytes.
+static HTTP_Client_Sink_Result begin_chunked(HTTP_Client_Sink *sink, int fd, uint64_t max_bytes) {
+    http_client_sink_init(sink, fd, 0);
+    sink->max_bytes = max_bytes;
+    sink->staging_bytes = 3;
+
+    HTTP_Headers headers;
+    memset(&headers, 0, sizeof(HTTP_Headers));
+    snprintf(headers.headers[0].key, sizeof(headers.headers[0].key), "Transfer-Encoding");
+    snprintf(headers.headers[0].value, sizeof(headers.headers[0].value), "chunked");
+    headers.header_count = 1;
+
+    return http_client_sink_begin(sink, &headers);
+}
+
+// Hands 'data' over 'step' bytes at a time, like reads that came off the socket. Stops at the first result that isn't
+// Needs_More_Data, and says how much was handed over by then.
+static HTTP_Client_Sink_Result take_in_steps(HTTP_Client_Sink *sink, const char *data, uint64_t length, uint64_t step, uint64_t *out_taken) {
+    HTTP_Client_Sink_Result result = HTTP_Client_Sink_Result_Needs_More_Data;
+    uint64_t taken = 0;
+    while(taken < length && result == HTTP_Client_Sink_Result_Needs_More_Data) {
+        uint64_t amount = length - taken < step ? length - taken : step;
+        result = http_client_sink_take(sink, &data[taken], amount);
+        taken += amount;
+    }
+    *out_taken = taken;
+    return result;
+}
+
+// Whether the file holds exactly 'expected'.
+static bool file_holds(int fd, const char *expected) {
+    char contents[256];
+    ssize_t length = pread(fd, contents, sizeof(contents), 0);
+    return length == (ssize_t)strlen(expected) && memcmp(contents, expected, (size_t)length) == 0;
+}
+
+// Runs 'body' through a sink split at every possible read size, and checks that it ends where the body does and
+// leaves 'expected' in the file.
+static void expect_decodes_to(const char *body, const char *after_body, const char *expected) {
+    char data[512];
+    snprintf(data, sizeof(data), "%s%s", body, after_body);
+    const uint64_t length = strlen(data);
+
+    for(uint64_t step = 1; step <= length; step++) {
+        int fd = open_temp_file();
+        EXPECT(fd >= 0);
+        if(fd < 0) {
+            return;
+        }
+
+        HTTP_Client_Sink sink;
+        EXPECT(begin_chunked(&sink, fd, 0) == HTTP_Client_Sink_Result_Needs_More_Data);
+
+        uint64_t taken = 0;
+        EXPECT(take_in_steps(&sink, data, length, step, &taken) == HTTP_Client_Sink_Result_Done);
+        EXPECT(taken >= strlen(body) && taken < strlen(body) + step); // Done with the read that has the body's end.
+        EXPECT(sink.bytes_written == strlen(expected));
+        EXPECT(file_holds(fd, expected));
+
+        http_client_sink_release(&sink);
+        close(fd);
+    }
+}
+
+static void test_split_across_reads(void) {
+    // Sizes with more than one digit, in either case, with and without extensions (quoted ones too).
+    expect_decodes_to(
+        "4\r\nWiki\r\n"
+        "5;name=value\r\npedia\r\n"
+        "0E ; a=\"1;2\" ; b\r\n in\r\n\r\nchunks.\r\n"
+        "10\r\n0123456789abcdef\r\n"
+        "0\r\n\r\n",
+        "",
+        "Wikipedia in\r\n\r\nchunks.0123456789abcdef");
+
+    // Nothing that comes after the body ends up in the file.
+    expect_decodes_to("3\r\nabc\r\n0\r\n\r\n", "HTTP/1.1 200 OK\r\n", "abc");
+    expect_decodes_to("0\r\n\r\n", "", "");
+}
+
+static void test_trailers(void) {
+    expect_decodes_to("3\r\nabc\r\n0\r\nExpires: never\r\n\r\n", "", "abc");
+    expect_decodes_to("3\r\nabc\r\n0\r\nX-Checksum: 1\r\nX-Empty:\r\n\r\n", "3\r\n", "abc");
+    expect_decodes_to("0;last\r\nServer-Timing: a;dur=1\r\n\r\n", "", "");
+}
+
+// Broken bodies, each handed over in one go and a byte at a time.
+static void expect_invalid(const char *body, uint64_t max_bytes) {
+    const uint64_t steps[2] = { strlen(body), 1 };
+    for(uint32_t i = 0; i < 2; i++) {
+        int fd = open_temp_file();
+        EXPECT(fd >= 0);
+        if(fd < 0) {
+            return;
+        }
+
+        HTTP_Client_Sink sink;
+        EXPECT(begin_chunked(&sink, fd, max_bytes) == HTTP_Client_Sink_Result_Needs_More_Data);
+
+        uint64_t taken = 0;
+        EXPECT(take_in_steps(&sink, body, strlen(body), steps[i], &taken) == HTTP_Client_Sink_Result_Invalid_Data);
+
+        http_client_sink_release(&sink);
+        close(fd);
+    }
+}
+
+static void test_max_bytes(void) {
+    // Right up to the limit is fine, one more isn't, whether it's in the first chunk or a later one.
+    int fd = open_temp_file();
+    EXPECT(fd >= 0);
+    if(fd >= 0) {
+        HTTP_Client_Sink sink;
+        EXPECT(begin_chunked(&sink, fd, 9) == HTTP_Client_Sink_Result_Needs_More_Data);
+        const char *body = "5\r\nhello\r\n4\r\nabcd\r\n0\r\n\r\n";
+        uint64_t taken = 0;
+        EXPECT(take_in_steps(&sink, body, strlen(body), 1, &taken) == HTTP_Client_Sink_Result_Done);
+        EXPECT(file_holds(fd, "helloabcd"));
+        http_client_sink_release(&sink);
+        close(fd);
+    }
+
+    expect_invalid("a\r\n0123456789\r\n0\r\n\r\n", 9);
+    expect_invalid("5\r\nhello\r\n5\r\nabcde\r\n0\r\n\r\n", 9);
+
+    // Caught at the size, before any of the chunk is staged.
+    fd = open_temp_file();
+    EXPECT(fd >= 0);
+    if(fd >= 0) {
+        HTTP_Client_Sink sink;
+        EXPECT(begin_chunked(&sink, fd, 4) == HTTP_Client_Sink_Result_Needs_More_Data);
+        EXPECT(http_client_sink_take(&sink, "3\r\nabc\r\n", 8) == HTTP_Client_Sink_Result_Needs_More_Data);
+        EXPECT(http_client_sink_take(&sink, "2\r\nde\r\n", 7) == HTTP_Client_Sink_Result_Invalid_Data);
+        EXPECT(sink.bytes_written + sink.staged == 3);
+        http_client_sink_release(&sink);
+        close(fd);
+    }
+}
+
+static void test_size_digits_cap(void) {
+    // 15 digits is as many as a size can have, leading zeros included.
+    int fd = open_temp_file();
+    EXPECT(fd >= 0);
+    if(fd >= 0) {
+        HTTP_Client_Sink sink;
+        EXPECT(begin_chunked(&sink, fd, 0) == HTTP_Client_Sink_Result_Needs_More_Data);
+        EXPECT(http_client_sink_take(&sink, "fffffffffffffff\r\nab", 19) == HTTP_Client_Sink_Result_Needs_More_Data);
+        EXPECT(sink.remaining == 0xfffffffffffffffull - 2);
+        http_client_sink_release(&sink);
+        close(fd);
+    }
+
+    expect_invalid("1000000000000000\r\n", 0);
+    expect_invalid("0000000000000003\r\nabc\r\n0\r\n\r\n", 0);
+}
+
+static void test_broken_framing(void) {
+    expect_invalid("\r\nabc\r\n0\r\n\r\n", 0);       // No size.
+    expect_invalid("3x\r\nabc\r\n0\r\n\r\n", 0);     // Not hex.
+    expect_invalid("3\rabc\r\n0\r\n\r\n", 0);        // CR without LF.
+    expect_invalid("3\r\nabcd\r\n0\r\n\r\n", 0);     // More data than the size said.
+    expect_invalid("3\r\nabc\r\n0\r\nA: b\rx\r\n", 0); // Broken trailer line.
+}
+
+int main(void) {
+    test_split_across_reads();
+    test_trailers();
+    test_max_bytes();
+    test_size_digits_cap();
+    test_broken_framing();
+
+    if(failures > 0) {
+        fprintf(stderr, "sink_test: %d failed.\n", failures);
+        return 1;
+    }
+    printf("sink_test: OK.\n");
+    return 0;
+}
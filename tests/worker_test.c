@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "clock/clock.h"
+#include "worker/worker.h"
+#include "worker/coroutine/worker_coroutine.h"
+
+// Tests for Worker. Built and run by 'make test'; exits with 0 if they all pass.
+
+static int failures = 0;
+
+#define EXPECT(condition) \
+    do { \
+        if(!(condition)) { \
+            fprintf(stderr, "%s:%d: Expected '%s'.\n", __FILE__, __LINE__, #condition); \
+            failures += 1; \
+        } \
+    } while(0)
+
+typedef struct {
+    Worker_Coroutine coroutine;
+    int first[2];
+    int second[2];
+    uint64_t give_up_ns;
+    bool *got_data;
+} Fd_Reuse_Context;
+
+// Waits on a socket that never becomes readable until a timer gives up on it (like a connect attempt that fails),
+// closes it, and then waits on a new socket that gets the same fd number and is readable right away.
+static bool fd_reuse_task(Worker *worker, Worker_Context *context, const uint32_t lifetime) {
+    (void)lifetime;
+    Fd_Reuse_Context *ctx = (Fd_Reuse_Context *)context;
+
+    WORKER_COROUTINE_BEGIN(&ctx->coroutine);
+
+    while(clock_now_ns() < ctx->give_up_ns) {
+        worker_task_wait_for_fd(worker, ctx->first[0], Worker_Wait_Events_Readable);
+        worker_task_wait_until(worker, ctx->give_up_ns);
+        WORKER_COROUTINE_YIELD(&ctx->coroutine);
+    }
+
+    worker_task_forget_fd(worker, ctx->first[0]);
+    close(ctx->first[0]);
+    close(ctx->first[1]);
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, ctx->second) != 0) {
+        WORKER_COROUTINE_EXIT(&ctx->coroutine);
+    }
+    EXPECT(ctx->second[0] == ctx->first[0]); // Otherwise this doesn't test anything.
+    EXPECT(write(ctx->second[1], "x", 1) == 1);
+
+    WORKER_AWAIT_READABLE(worker, &ctx->coroutine, ctx->second[0]);
+
+    char byte;
+    *ctx->got_data = read(ctx->second[0], &byte, 1) == 1;
+    close(ctx->second[0]);
+    close(ctx->second[1]);
+
+    WORKER_COROUTINE_END(&ctx->coroutine);
+}
+
+static void test_fd_reused_after_close(void) {
+    Worker worker;
+    memset(&worker, 0, sizeof(Worker));
+    worker.name = "Test";
+
+    bool got_data = false;
+    Fd_Reuse_Context ctx;
+    memset(&ctx, 0, sizeof(Fd_Reuse_Context));
+    EXPECT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, ctx.first) == 0);
+    ctx.give_up_ns = clock_now_ns() + 20 * CLOCK_NS_PER_MS;
+    ctx.got_data = &got_data;
+
+    Worker_Task_Handle handle;
+    EXPECT(worker_add_task(&worker, &ctx, sizeof(Fd_Reuse_Context), fd_reuse_task, &handle));
+
+    const uint64_t deadline_ns = clock_now_ns() + 2 * CLOCK_NS_PER_S;
+    while(worker_task_alive(&worker, handle) && clock_now_ns() < deadline_ns) {
+        worker_work(&worker);
+        worker_wait(&worker, 100);
+    }
+    EXPECT(!worker_task_alive(&worker, handle)); // Still waiting on an fd that never made it into the epoll.
+    EXPECT(got_data);
+
+    worker_dispose(&worker);
+}
+
+typedef struct {
+    uint32_t id;
+    uint64_t wait_until_ns; // 0 waits for a wake instead.
+    uint32_t *runs;
+    uint32_t *order;
+    uint32_t *order_count;
+} Sleeper_Context;
+
+// Runs once to say what it waits for, and once more when that happens.
+static bool sleeper_task(Worker *worker, Worker_Context *context, const uint32_t lifetime) {
+    Sleeper_Context *ctx = (Sleeper_Context *)context;
+    ctx->runs[ctx->id] += 1;
+
+    if(lifetime == 0) {
+        if(ctx->wait_until_ns != 0) {
+            worker_task_wait_until(worker, ctx->wait_until_ns);
+        }
+        else {
+            worker_task_wait_for_wake(worker);
+        }
+        return false;
+    }
+
+    ctx->order[*ctx->order_count] = ctx->id;
+    *ctx->order_count += 1;
+    return true;
+}
+
+#define SLEEPER_COUNT 1000
+#define SLEEPER_TIMER_COUNT 8
+
+static void test_only_ready_tasks_run(void) {
+    Worker worker;
+    memset(&worker, 0, sizeof(Worker));
+    worker.name = "Test";
+
+    static uint32_t runs[SLEEPER_COUNT];
+    static uint32_t order[SLEEPER_COUNT];
+    uint32_t order_count = 0;
+    memset(runs, 0, sizeof(runs));
+
+    // The first few go off in the reverse order they were added, the rest wait to be woken.
+    static Worker_Task_Handle handles[SLEEPER_COUNT];
+    const uint64_t start_ns = clock_now_ns();
+    for(uint32_t i = 0; i < SLEEPER_COUNT; i++) {
+        Sleeper_Context ctx;
+        ctx.id = i;
+        ctx.wait_until_ns = i < SLEEPER_TIMER_COUNT ? start_ns + (SLEEPER_TIMER_COUNT - i) * 2 * CLOCK_NS_PER_MS : 0;
+        ctx.runs = runs;
+        ctx.order = order;
+        ctx.order_count = &order_count;
+        EXPECT(worker_add_task(&worker, &ctx, sizeof(Sleeper_Context), sleeper_task, &handles[i]));
+    }
+
+    const uint64_t deadline_ns = start_ns + 2 * CLOCK_NS_PER_S;
+    while(worker_work(&worker) > SLEEPER_COUNT - SLEEPER_TIMER_COUNT && clock_now_ns() < deadline_ns) {
+        worker_wait(&worker, 100);
+    }
+    EXPECT(order_count == SLEEPER_TIMER_COUNT);
+    for(uint32_t i = 0; i < order_count; i++) {
+        EXPECT(order[i] == SLEEPER_TIMER_COUNT - 1 - i); // Earliest timer first.
+    }
+    for(uint32_t i = SLEEPER_TIMER_COUNT; i < SLEEPER_COUNT; i++) {
+        EXPECT(runs[i] == 1); // Never again while nothing woke them.
+    }
+
+    // Cancelled tasks leave their entries on the run list behind. The slots they free get reused right away.
+    for(uint32_t i = SLEEPER_TIMER_COUNT; i < SLEEPER_COUNT; i += 2) {
+        EXPECT(worker_wake_task(&worker, handles[i]));
+        EXPECT(worker_cancel_task(&worker, handles[i]));
+    }
+    EXPECT(worker_wake_task(&worker, handles[SLEEPER_TIMER_COUNT + 1]));
+    worker_work(&worker);
+    EXPECT(order_count == SLEEPER_TIMER_COUNT + 1);
+    EXPECT(order[SLEEPER_TIMER_COUNT] == SLEEPER_TIMER_COUNT + 1);
+
+    uint32_t runs_before = 0;
+    for(uint32_t i = 0; i < SLEEPER_COUNT; i++) {
+        runs_before += runs[i];
+    }
+    worker_work(&worker);
+    uint32_t runs_after = 0;
+    for(uint32_t i = 0; i < SLEEPER_COUNT; i++) {
+        runs_after += runs[i];
+    }
+    EXPECT(runs_after == runs_before); // Nothing is ready, so nothing runs.
+
+    // Enough of those to fill up the run list with entries of tasks that are gone.
+    for(uint32_t i = 0; i < 4 * worker.slot_count; i++) {
+        Worker_Task_Handle handle;
+        Sleeper_Context ctx;
+        memset(&ctx, 0, sizeof(Sleeper_Context));
+        EXPECT(worker_add_task(&worker, &ctx, sizeof(Sleeper_Context), sleeper_task, &handle));
+        EXPECT(worker_cancel_task(&worker, handle));
+    }
+    EXPECT(worker.ready_count <= worker.run_list_capacity);
+    worker_work(&worker);
+    runs_before = runs_after;
+    runs_after = 0;
+    for(uint32_t i = 0; i < SLEEPER_COUNT; i++) {
+        runs_after += runs[i];
+    }
+    EXPECT(runs_after == runs_before);
+
+    worker_dispose(&worker);
+}
+
+typedef struct {
+    uint32_t id;
+    uint32_t *order;
+    uint32_t *order_count;
+} Order_Context;
+
+static bool order_task(Worker *worker, Worker_Context *context, const uint32_t lifetime) {
+    (void)worker;
+    (void)lifetime;
+    Order_Context *ctx = (Order_Context *)context;
+    ctx->order[*ctx->order_count] = ctx->id;
+    *ctx->order_count += 1;
+    return true;
+}
+
+static void test_scheduling_order(void) {
+    Worker worker;
+    memset(&worker, 0, sizeof(Worker));
+    worker.name = "Test";
+
+    // Added in the wrong order on purpose. 'id' is where each one should end up.
+    static const struct {
+        uint32_t id;
+        Worker_Priority priority;
+        uint64_t deadline_ns;
+    } tasks[] = {
+        { 7, Worker_Priority_Background,  0 },
+        { 4, Worker_Priority_Normal,      0 },
+        { 2, Worker_Priority_Normal,      5 },
+        { 6, Worker_Priority_Background,  9 },
+        { 1, Worker_Priority_Interactive, 0 },
+        { 3, Worker_Priority_Normal,      8 },
+        { 0, Worker_Priority_Interactive, 3 },
+        { 5, Worker_Priority_Normal,      0 },
+    };
+    const uint32_t task_count = sizeof(tasks) / sizeof(tasks[0]);
+
+    uint32_t order[sizeof(tasks) / sizeof(tasks[0])];
+    uint32_t order_count = 0;
+    for(uint32_t i = 0; i < task_count; i++) {
+        Order_Context ctx;
+        ctx.id = tasks[i].id;
+        ctx.order = order;
+        ctx.order_count = &order_count;
+
+        Worker_Task_Handle handle;
+        EXPECT(worker_add_task(&worker, &ctx, sizeof(Order_Context), order_task, &handle));
+        EXPECT(worker_set_task_priority(&worker, handle, tasks[i].priority, tasks[i].deadline_ns));
+    }
+
+    EXPECT(worker_work(&worker) == 0);
+    EXPECT(order_count == task_count);
+    for(uint32_t i = 0; i < order_count; i++) {
+        EXPECT(order[i] == i);
+    }
+
+    worker_dispose(&worker);
+}
+
+int main(void) {
+    test_fd_reused_after_close();
+    test_only_ready_tasks_run();
+    test_scheduling_order();
+
+    if(failures > 0) {
+        fprintf(stderr, "worker_test: %d failed.\n", failures);
+        return 1;
+    }
+    printf("worker_test: OK.\n");
+    return 0;
+}